@@ -0,0 +1,719 @@
+/*
+ * This program measures the performance of the motion extraction,
+ * image pyramid, extrapolation, morphing and vector field I/O
+ * components on synthetic image pairs.
+ */
+
+#include "DenseImageMorpher.h"
+#include "DenseVectorFieldIO.h"
+#include "ImagePyramid.h"
+#include "InverseDenseImageExtrapolator.h"
+#include "MappedDenseVectorField.h"
+#include "PyramidalLucasKanade.h"
+#include "PyramidalProesmans.h"
+#include "version.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace cimg_library;
+using namespace std;
+
+// Parameters of a benchmark run, set from the command line.
+struct Options
+{
+  vector< string > sizeNames;
+  vector< int > widths, heights;
+  int numRuns;
+  int numWarmupRuns;
+  int numThreads;
+  int numLucasKanadeIterations;
+  int numProesmansIterations;
+  int numLevels;
+  bool singlePrecision;
+  bool multicolorSweep;
+  string filter;
+  string format;
+  string outFileName;
+  string tmpDir;
+};
+
+// The inputs shared by the benchmarks of one image size.
+struct Inputs
+{
+  CImg< unsigned char > I1, I2;
+  // the motion used for generating I2 from I1 and its inverse
+  CImg< double > VF, VB;
+  string vectorFieldFileName;
+  string compressedVectorFieldFileName;
+  string halfVectorFieldFileName;
+};
+
+// Timing and memory statistics of one benchmark.
+struct Result
+{
+  string name;
+  string sizeName;
+  int width, height;
+  vector< double > times;
+  long peakRSS;
+  bool peakRSSIsPerBenchmark;
+};
+
+static double getTime()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Returns the peak resident set size of the process in kilobytes.
+static long getPeakRSS()
+{
+  ifstream status("/proc/self/status");
+  string line;
+
+  while(getline(status, line))
+  {
+    if(line.compare(0, 6, "VmHWM:") == 0)
+      return atol(line.c_str() + 6);
+  }
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Resets the peak resident set size to the current one (Linux 4.0
+// or later). Returns false if this is not supported, in which case
+// the peak is that of the whole process.
+static bool resetPeakRSS()
+{
+  ofstream clearRefs("/proc/self/clear_refs");
+
+  if(!clearRefs)
+    return false;
+  clearRefs<<"5"<<flush;
+
+  return clearRefs.good();
+}
+
+// Returns the pth percentile (0-100) of sorted values with linear interpolation.
+static double getPercentile(const vector< double > &sortedValues, double p)
+{
+  const double pos = p / 100.0 * (sortedValues.size() - 1);
+  const int i = (int)floor(pos);
+
+  if(i + 1 >= (int)sortedValues.size())
+    return sortedValues.back();
+
+  return sortedValues[i] + (pos - i) * (sortedValues[i + 1] - sortedValues[i]);
+}
+
+// Parses an image size: 480p, 720p, 1080p, 4k or WxH.
+static bool parseSize(const string &str, int &width, int &height)
+{
+  if(str == "480p")
+  {
+    width = 640;
+    height = 480;
+  }
+  else if(str == "720p")
+  {
+    width = 1280;
+    height = 720;
+  }
+  else if(str == "1080p")
+  {
+    width = 1920;
+    height = 1080;
+  }
+  else if(str == "4k" || str == "4K")
+  {
+    width = 3840;
+    height = 2160;
+  }
+  else if(sscanf(str.c_str(), "%dx%d", &width, &height) != 2)
+    return false;
+
+  return width > 0 && height > 0;
+}
+
+// Splits a comma-separated list.
+static vector< string > parseList(const string &str)
+{
+  vector< string > values;
+  size_t begin = 0;
+  size_t end;
+
+  do
+  {
+    end = str.find(',', begin);
+    values.push_back(str.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  while(end != string::npos);
+
+  return values;
+}
+
+// Returns a uniformly distributed random number in [-0.5, 0.5). 
+// The inputs are generated with this instead of CImg::noise, which 
+// seeds the random number generator from the clock, so that they 
+// are the same in every run.
+static double getRandom(unsigned int &seed)
+{
+  seed = seed * 1103515245U + 12345U;
+  return ((seed >> 8) & 0xffffff) / 16777216.0 - 0.5;
+}
+
+// Generates a textured image pair, where the second image is the
+// first one warped with a smooth synthetic motion field. The texture
+// has the same scales (in pixels) at each resolution, so that the
+// number of pixels with enough structure for the motion estimation
+// is proportional to the image size. The motion is scaled with the
+// image width like the motion of the same scene would be.
+static void generateInputs(int width, int height, Inputs &inputs)
+{
+  const double scale = width / 640.0;
+  CImg< float > texture(width, height);
+  unsigned int seed = 1;
+
+  // band-limited noise at several scales plus a smooth gradient
+  texture.fill(0.0f);
+  for(int octave = 0; octave < 4; octave++)
+  {
+    const float sigma = (float)(1 << octave);
+    CImg< float > noise(width, height);
+
+    cimg_forXY(noise, x, y)
+      noise(x, y) = (float)getRandom(seed);
+    noise.blur(sigma);
+    texture += noise * (float)sqrt(sigma);
+  }
+  cimg_forXY(texture, x, y)
+    texture(x, y) += 40.0f * x / width + 20.0f * y / height;
+  texture.normalize(0.0f, 255.0f);
+
+  inputs.VF.assign(width, height, 1, 3);
+  inputs.VB.assign(width, height, 1, 3);
+  cimg_forXY(inputs.VF, x, y)
+  {
+    const double u = scale * (2.0 + 1.5 * sin(2.0 * cimg::valuePI * y / height));
+    const double v = scale * (1.0 - 1.0 * cos(2.0 * cimg::valuePI * x / width));
+
+    inputs.VF(x, y, 0) = u;
+    inputs.VF(x, y, 1) = v;
+    inputs.VF(x, y, 2) = 1.0;
+    inputs.VB(x, y, 0) = -u;
+    inputs.VB(x, y, 1) = -v;
+    inputs.VB(x, y, 2) = 1.0;
+  }
+
+  inputs.I1 = texture;
+  inputs.I2.assign(width, height);
+  cimg_forXY(inputs.I2, x, y)
+  {
+    inputs.I2(x, y) = (unsigned char)(texture.linear_at2(x + inputs.VB(x, y, 0),
+                                                         y + inputs.VB(x, y, 1)) + 0.5f);
+  }
+}
+
+// Calls run(i) for the warmup runs and the timed runs, and
+// stores the timings in the result.
+template < class Benchmark >
+static void measure(Benchmark &benchmark, const Options &options, Result &result)
+{
+  double t;
+  int i;
+
+  result.peakRSSIsPerBenchmark = resetPeakRSS();
+
+  for(i = 0; i < options.numWarmupRuns; i++)
+    benchmark.run();
+
+  for(i = 0; i < options.numRuns; i++)
+  {
+    t = getTime();
+    benchmark.run();
+    result.times.push_back(getTime() - t);
+  }
+
+  result.peakRSS = getPeakRSS();
+}
+
+template < class T > struct LucasKanadeBenchmark
+{
+  const Inputs &inputs;
+  PyramidalLucasKanade< T > extractor;
+  CImg< T > V;
+
+  LucasKanadeBenchmark(const Inputs &inputs_, const Options &options) :
+    inputs(inputs_),
+    extractor(16, options.numLucasKanadeIterations, 0.0025, 0.0, options.numLevels,
+              true, LucasKanade< T >::LOCAL_WARP, options.numThreads) { }
+
+  void run() { extractor.compute(inputs.I1, inputs.I2, V); }
+};
+
+template < class T > struct ProesmansBenchmark
+{
+  const Inputs &inputs;
+  PyramidalProesmans< T > extractor;
+  CImg< T > VF, VB;
+
+  ProesmansBenchmark(const Inputs &inputs_, const Options &options) :
+    inputs(inputs_),
+    extractor(options.numProesmansIterations, 100.0, options.numLevels,
+              Proesmans< T >::NEUMANN, options.numThreads,
+              options.multicolorSweep ? Proesmans< T >::MULTICOLOR_SWEEP : Proesmans< T >::RASTER_SWEEP) { }
+
+  void run() { extractor.compute(inputs.I1, inputs.I2, VF, VB); }
+};
+
+struct PyramidBenchmark
+{
+  const Inputs &inputs;
+  const int numLevels;
+  const ImagePyramid::Filter filter;
+  ImagePyramid pyramid;
+
+  PyramidBenchmark(const Inputs &inputs_, const Options &options, ImagePyramid::Filter filter_) :
+    inputs(inputs_), numLevels(options.numLevels), filter(filter_) { }
+
+  void run() { pyramid.build(inputs.I1, numLevels, 0.5, filter); }
+};
+
+struct ExtrapolationBenchmark
+{
+  const Inputs &inputs;
+  InverseDenseImageExtrapolator extrapolator;
+  CImg< unsigned char > Ie;
+
+  ExtrapolationBenchmark(const Inputs &inputs_) : inputs(inputs_) { }
+
+  void run() { extrapolator.extrapolate(inputs.I2, inputs.VB, 1.0, Ie); }
+};
+
+struct MorphingBenchmark
+{
+  const Inputs &inputs;
+  CImg< unsigned char > M;
+
+  MorphingBenchmark(const Inputs &inputs_) : inputs(inputs_) { }
+
+  void run() { DenseImageMorpher::morph(inputs.I1, inputs.I2, inputs.VF, inputs.VB, 0.5, M); }
+};
+
+struct VectorFieldWriteBenchmark
+{
+  const Inputs &inputs;
+
+  VectorFieldWriteBenchmark(const Inputs &inputs_) : inputs(inputs_) { }
+
+  void run() { DenseVectorFieldIO::writeVectorField(inputs.VF, inputs.vectorFieldFileName); }
+};
+
+struct VectorFieldReadBenchmark
+{
+  const Inputs &inputs;
+  CImg< double > V;
+
+  VectorFieldReadBenchmark(const Inputs &inputs_) : inputs(inputs_) { }
+
+  void run() { DenseVectorFieldIO::readVectorField(inputs.vectorFieldFileName, V); }
+};
+
+// Writes the motion vectors in half precision.
+struct HalfVectorFieldWriteBenchmark
+{
+  const Inputs &inputs;
+
+  HalfVectorFieldWriteBenchmark(const Inputs &inputs_) : inputs(inputs_) { }
+
+  void run()
+  {
+    DenseVectorFieldIO::writeVectorField(inputs.VF, inputs.halfVectorFieldFileName,
+                                         VectorFieldEncoding::FLOAT16,
+                                         VectorFieldEncoding::FLOAT32);
+  }
+};
+
+struct HalfVectorFieldReadBenchmark
+{
+  const Inputs &inputs;
+  CImg< double > V;
+
+  HalfVectorFieldReadBenchmark(const Inputs &inputs_) : inputs(inputs_) { }
+
+  void run() { DenseVectorFieldIO::readVectorField(inputs.halfVectorFieldFileName, V); }
+};
+
+struct CompressedVectorFieldWriteBenchmark
+{
+  const Inputs &inputs;
+  CompressedDenseVectorFieldIO::Options compressionOptions;
+
+  CompressedVectorFieldWriteBenchmark(const Inputs &inputs_, const Options &options) : inputs(inputs_)
+  {
+    compressionOptions.numThreads = options.numThreads;
+  }
+
+  void run()
+  {
+    DenseVectorFieldIO::writeVectorField(inputs.VF, inputs.compressedVectorFieldFileName,
+                                         compressionOptions);
+  }
+};
+
+struct CompressedVectorFieldReadBenchmark
+{
+  const Inputs &inputs;
+  const int numThreads;
+  CImg< double > V;
+
+  CompressedVectorFieldReadBenchmark(const Inputs &inputs_, const Options &options) :
+    inputs(inputs_), numThreads(options.numThreads) { }
+
+  void run() { DenseVectorFieldIO::readVectorField(inputs.compressedVectorFieldFileName, V, numThreads); }
+};
+
+// Maps the vector field file and accesses the vectors in place.
+struct VectorFieldMapBenchmark
+{
+  const Inputs &inputs;
+  volatile double sum; // keeps the compiler from removing the loop
+
+  VectorFieldMapBenchmark(const Inputs &inputs_) : inputs(inputs_), sum(0.0) { }
+
+  void run()
+  {
+    MappedDenseVectorField V(inputs.vectorFieldFileName);
+    const float *p = V.getData();
+    const float *end = p + (size_t)V.getWidth() * V.getHeight() * V.getNumChannels();
+    double s = 0.0;
+
+    for(; p != end; p++)
+      s += *p;
+    sum = s;
+  }
+};
+
+// Runs a benchmark if its name passes the filter.
+template < class Benchmark >
+static void runBenchmark(const string &name, Benchmark &benchmark,
+                         const Options &options, int sizeIndex,
+                         vector< Result > &results)
+{
+  Result result;
+
+  if(!options.filter.empty() && name.find(options.filter) == string::npos)
+    return;
+
+  cerr<<"Running "<<name<<" ("<<options.sizeNames[sizeIndex]<<")..."<<endl;
+
+  result.name = name;
+  result.sizeName = options.sizeNames[sizeIndex];
+  result.width = options.widths[sizeIndex];
+  result.height = options.heights[sizeIndex];
+  measure(benchmark, options, result);
+
+  results.push_back(result);
+}
+
+template < class T >
+static void runExtractorBenchmarks(const Inputs &inputs, const Options &options,
+                                   int sizeIndex, vector< Result > &results)
+{
+  const string suffix = (options.singlePrecision ? "_float" : "_double");
+
+  LucasKanadeBenchmark< T > lucasKanade(inputs, options);
+  runBenchmark("lucaskanade" + suffix, lucasKanade, options, sizeIndex, results);
+
+  ProesmansBenchmark< T > proesmans(inputs, options);
+  runBenchmark("proesmans" + suffix, proesmans, options, sizeIndex, results);
+}
+
+static void runBenchmarks(const Options &options, vector< Result > &results)
+{
+  for(unsigned int i = 0; i < options.sizeNames.size(); i++)
+  {
+    Inputs inputs;
+
+    generateInputs(options.widths[i], options.heights[i], inputs);
+    ostringstream fileName;
+    fileName<<options.tmpDir<<"/optflow-benchmark-"<<getpid()<<".pdvm";
+    inputs.vectorFieldFileName = fileName.str();
+    inputs.compressedVectorFieldFileName = fileName.str() + "2";
+    inputs.halfVectorFieldFileName = fileName.str() + "h";
+
+    if(options.singlePrecision)
+      runExtractorBenchmarks< float >(inputs, options, i, results);
+    else
+      runExtractorBenchmarks< double >(inputs, options, i, results);
+
+    PyramidBenchmark boxPyramid(inputs, options, ImagePyramid::BOX_FILTER);
+    runBenchmark("pyramid_box", boxPyramid, options, i, results);
+
+    PyramidBenchmark gaussianPyramid(inputs, options, ImagePyramid::GAUSSIAN_FILTER);
+    runBenchmark("pyramid_gaussian", gaussianPyramid, options, i, results);
+
+    ExtrapolationBenchmark extrapolation(inputs);
+    runBenchmark("extrapolate_inverse", extrapolation, options, i, results);
+
+    MorphingBenchmark morphing(inputs);
+    runBenchmark("morph", morphing, options, i, results);
+
+    // the read benchmarks read the file written by the write benchmark
+    VectorFieldWriteBenchmark vectorFieldWrite(inputs);
+    runBenchmark("pdv_write", vectorFieldWrite, options, i, results);
+    if(options.filter.empty() || string("pdv_read").find(options.filter) != string::npos || 
+       string("pdv_map").find(options.filter) != string::npos)
+      vectorFieldWrite.run();
+
+    VectorFieldReadBenchmark vectorFieldRead(inputs);
+    runBenchmark("pdv_read", vectorFieldRead, options, i, results);
+
+    VectorFieldMapBenchmark vectorFieldMap(inputs);
+    runBenchmark("pdv_map", vectorFieldMap, options, i, results);
+
+    HalfVectorFieldWriteBenchmark halfVectorFieldWrite(inputs);
+    runBenchmark("pdv_write_f16", halfVectorFieldWrite, options, i, results);
+    if(options.filter.empty() || string("pdv_read_f16").find(options.filter) != string::npos)
+      halfVectorFieldWrite.run();
+
+    HalfVectorFieldReadBenchmark halfVectorFieldRead(inputs);
+    runBenchmark("pdv_read_f16", halfVectorFieldRead, options, i, results);
+
+    CompressedVectorFieldWriteBenchmark compressedVectorFieldWrite(inputs, options);
+    runBenchmark("pdv2_write", compressedVectorFieldWrite, options, i, results);
+    if(options.filter.empty() || string("pdv2_read").find(options.filter) != string::npos)
+      compressedVectorFieldWrite.run();
+
+    CompressedVectorFieldReadBenchmark compressedVectorFieldRead(inputs, options);
+    runBenchmark("pdv2_read", compressedVectorFieldRead, options, i, results);
+
+    remove(inputs.vectorFieldFileName.c_str());
+    remove(inputs.compressedVectorFieldFileName.c_str());
+    remove(inputs.halfVectorFieldFileName.c_str());
+  }
+}
+
+static void writeCSV(const vector< Result > &results, ostream &out)
+{
+  out<<"name,size,width,height,runs,min_s,p10_s,median_s,p90_s,max_s,mpix_per_s,peak_rss_kb"<<endl;
+
+  for(unsigned int i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    vector< double > t = r.times;
+    sort(t.begin(), t.end());
+    const double median = getPercentile(t, 50.0);
+
+    out<<r.name<<","<<r.sizeName<<","<<r.width<<","<<r.height<<","<<t.size()<<","
+       <<t.front()<<","<<getPercentile(t, 10.0)<<","<<median<<","
+       <<getPercentile(t, 90.0)<<","<<t.back()<<","
+       <<r.width * r.height / 1e6 / median<<","<<r.peakRSS<<endl;
+  }
+}
+
+static void writeJSON(const vector< Result > &results, const Options &options, ostream &out)
+{
+  out<<"{"<<endl;
+  out<<"  \"version\": \""<<OPTFLOW_VERSION_INFO<<"\","<<endl;
+  out<<"  \"threads\": "<<options.numThreads<<","<<endl;
+  out<<"  \"precision\": \""<<(options.singlePrecision ? "single" : "double")<<"\","<<endl;
+  out<<"  \"pyramid_levels\": "<<options.numLevels<<","<<endl;
+  out<<"  \"lucaskanade_iterations\": "<<options.numLucasKanadeIterations<<","<<endl;
+  out<<"  \"proesmans_iterations\": "<<options.numProesmansIterations<<","<<endl;
+  out<<"  \"proesmans_sweep_order\": \""<<(options.multicolorSweep ? "multicolor" : "raster")<<"\","<<endl;
+  out<<"  \"results\": ["<<endl;
+
+  for(unsigned int i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    vector< double > t = r.times;
+    sort(t.begin(), t.end());
+    const double median = getPercentile(t, 50.0);
+
+    out<<"    {"<<endl;
+    out<<"      \"name\": \""<<r.name<<"\","<<endl;
+    out<<"      \"size\": \""<<r.sizeName<<"\","<<endl;
+    out<<"      \"width\": "<<r.width<<","<<endl;
+    out<<"      \"height\": "<<r.height<<","<<endl;
+    out<<"      \"runs\": "<<t.size()<<","<<endl;
+    out<<"      \"min_s\": "<<t.front()<<","<<endl;
+    out<<"      \"p10_s\": "<<getPercentile(t, 10.0)<<","<<endl;
+    out<<"      \"median_s\": "<<median<<","<<endl;
+    out<<"      \"p90_s\": "<<getPercentile(t, 90.0)<<","<<endl;
+    out<<"      \"max_s\": "<<t.back()<<","<<endl;
+    out<<"      \"mpix_per_s\": "<<r.width * r.height / 1e6 / median<<","<<endl;
+    out<<"      \"peak_rss_kb\": "<<r.peakRSS<<","<<endl;
+    out<<"      \"peak_rss_scope\": \""<<(r.peakRSSIsPerBenchmark ? "benchmark" : "process")<<"\""<<endl;
+    out<<"    }"<<(i + 1 < results.size() ? "," : "")<<endl;
+  }
+
+  out<<"  ]"<<endl;
+  out<<"}"<<endl;
+}
+
+static void printUsage()
+{
+  cout<<"Usage: benchmark [options]"<<endl<<endl;
+  cout<<"Options:"<<endl;
+  cout<<"  --help                  print usage"<<endl;
+  cout<<"  --sizes <list>          comma-separated image sizes (480p, 720p, 1080p, 4k or WxH) (default = 480p,1080p,4k)"<<endl;
+  cout<<"  --runs <n>              number of timed runs of each benchmark (default = 5)"<<endl;
+  cout<<"  --warmup <n>            number of untimed runs before the timed ones (default = 1)"<<endl;
+  cout<<"  --threads <n>           number of threads of the motion extractors and PDV2 I/O, 0 = all available processors (default = 1)"<<endl;
+  cout<<"  --precision <arg>       floating-point precision of the motion extractors (single, double) (default = double)"<<endl;
+  cout<<"  --numlevels <n>         number of pyramid levels (default = 4)"<<endl;
+  cout<<"  --lkiter <n>            number of Lucas-Kanade iterations (default = 5)"<<endl;
+  cout<<"  --proesmansiter <n>     number of Proesmans iterations (default = 20)"<<endl;
+  cout<<"  --sweeporder <arg>      pixel update order of the Proesmans iteration (raster, multicolor) (default = raster)"<<endl;
+  cout<<"  --filter <arg>          only run the benchmarks whose name contains <arg>"<<endl;
+  cout<<"  --format <arg>          output format (json, csv) (default = json)"<<endl;
+  cout<<"  --output <file>         output file (default = standard output)"<<endl;
+  cout<<"  --tmpdir <dir>          directory for the vector field I/O benchmarks (default = /tmp)"<<endl<<endl;
+  cout<<"Benchmarks: lucaskanade_<precision>, proesmans_<precision>, pyramid_box, "<<endl;
+  cout<<"pyramid_gaussian, extrapolate_inverse, morph, pdv_write, pdv_read, "<<endl;
+  cout<<"pdv_map, pdv_write_f16, pdv_read_f16, pdv2_write, pdv2_read"<<endl;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  string sizes = "480p,1080p,4k";
+  int i;
+
+  options.numRuns = 5;
+  options.numWarmupRuns = 1;
+  options.numThreads = 1;
+  options.numLucasKanadeIterations = 5;
+  options.numProesmansIterations = 20;
+  options.numLevels = 4;
+  options.singlePrecision = false;
+  options.multicolorSweep = false;
+  options.format = "json";
+  options.tmpDir = "/tmp";
+
+  for(i = 1; i < argc; i++)
+  {
+    const string arg = argv[i];
+
+    if(arg == "--help")
+      return false;
+    if(i + 1 >= argc)
+    {
+      cerr<<"Missing value for "<<arg<<"."<<endl;
+      return false;
+    }
+
+    const string value = argv[++i];
+
+    if(arg == "--sizes")
+      sizes = value;
+    else if(arg == "--runs")
+      options.numRuns = atoi(value.c_str());
+    else if(arg == "--warmup")
+      options.numWarmupRuns = atoi(value.c_str());
+    else if(arg == "--threads")
+      options.numThreads = atoi(value.c_str());
+    else if(arg == "--precision" && (value == "single" || value == "double"))
+      options.singlePrecision = (value == "single");
+    else if(arg == "--numlevels")
+      options.numLevels = atoi(value.c_str());
+    else if(arg == "--lkiter")
+      options.numLucasKanadeIterations = atoi(value.c_str());
+    else if(arg == "--proesmansiter")
+      options.numProesmansIterations = atoi(value.c_str());
+    else if(arg == "--sweeporder" && (value == "raster" || value == "multicolor"))
+      options.multicolorSweep = (value == "multicolor");
+    else if(arg == "--filter")
+      options.filter = value;
+    else if(arg == "--format" && (value == "json" || value == "csv"))
+      options.format = value;
+    else if(arg == "--output")
+      options.outFileName = value;
+    else if(arg == "--tmpdir")
+      options.tmpDir = value;
+    else
+    {
+      cerr<<"Invalid option: "<<arg<<" "<<value<<endl;
+      return false;
+    }
+  }
+
+  options.sizeNames = parseList(sizes);
+  for(i = 0; i < (int)options.sizeNames.size(); i++)
+  {
+    int width, height;
+
+    if(!parseSize(options.sizeNames[i], width, height))
+    {
+      cerr<<"Invalid image size: "<<options.sizeNames[i]<<endl;
+      return false;
+    }
+    options.widths.push_back(width);
+    options.heights.push_back(height);
+  }
+
+  if(options.numRuns < 1 || options.numWarmupRuns < 0 || options.numLevels < 1)
+  {
+    cerr<<"Invalid number of runs or pyramid levels."<<endl;
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  vector< Result > results;
+
+  if(!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  try {
+    runBenchmarks(options, results);
+  }
+  catch(std::exception &e) {
+    cerr<<"Benchmark failed: "<<e.what()<<endl;
+    return EXIT_FAILURE;
+  }
+
+  ofstream outFile;
+  if(!options.outFileName.empty())
+  {
+    outFile.open(options.outFileName.c_str());
+    if(!outFile)
+    {
+      cerr<<"Cannot open "<<options.outFileName<<endl;
+      return EXIT_FAILURE;
+    }
+  }
+  ostream &out = options.outFileName.empty() ? cout : outFile;
+
+  if(options.format == "csv")
+    writeCSV(results, out);
+  else
+    writeJSON(results, options, out);
+
+  return EXIT_SUCCESS;
+}
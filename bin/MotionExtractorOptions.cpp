@@ -0,0 +1,236 @@
+
+#include "MotionExtractorOptions.h"
+#include "PyramidalLucasKanade.h"
+#include "PyramidalProesmans.h"
+
+#include <cstdlib>
+
+// Parses a comma-separated list of integers.
+static vector< int > parseIntList_(const string &str)
+{
+  vector< int > values;
+  size_t begin = 0;
+  size_t end;
+  
+  do
+  {
+    end = str.find(',', begin);
+    values.push_back(atoi(str.substr(begin, end - begin).c_str()));
+    begin = end + 1;
+  }
+  while(end != string::npos);
+  
+  return values;
+}
+
+// Adds the options of src that are not yet in dst to dst.
+static void addNewOptions_(options_description &dst, const options_description &src)
+{
+  for(size_t i = 0; i < src.options().size(); i++)
+  {
+    if(dst.find_nothrow(src.options()[i]->long_name(), false) == NULL)
+      dst.add(src.options()[i]);
+  }
+}
+
+// Sets the scale factor and filter of the image pyramids.
+template < class T >
+static void setPyramidOptions_(PyramidalDenseMotionExtractor< T > &e,
+                               const variables_map &vm)
+{
+  e.setPyramidScaleFactor(vm.count("pyramidscale") > 0 ? vm["pyramidscale"].as< float >() : 0.5, 
+                          MotionExtractorOptions::getPyramidFilter(vm));
+}
+
+string MotionExtractorOptions::checkOptions(const variables_map &vm)
+{
+  if(vm.count("precision") > 0 && 
+     vm["precision"].as< string >() != "single" && 
+     vm["precision"].as< string >() != "double")
+    return "Invalid precision.";
+  
+  if(vm.count("tolnorm") > 0 && 
+     vm["tolnorm"].as< string >() != "rms" && 
+     vm["tolnorm"].as< string >() != "max")
+    return "Invalid convergence norm.";
+  
+  if(vm.count("warpmode") > 0 && 
+     vm["warpmode"].as< string >() != "local" && 
+     vm["warpmode"].as< string >() != "dense")
+    return "Invalid warp mode.";
+  
+  if(vm.count("sweeporder") > 0 && 
+     vm["sweeporder"].as< string >() != "raster" && 
+     vm["sweeporder"].as< string >() != "multicolor")
+    return "Invalid sweep order.";
+  
+  if(((vm.count("tilewidth") > 0 && vm["tilewidth"].as< int >() != 0) || 
+      (vm.count("tileheight") > 0 && vm["tileheight"].as< int >() != 0)) && 
+     (vm.count("sweeporder") == 0 || vm["sweeporder"].as< string >() != "multicolor"))
+    return "The tiled iteration requires --sweeporder multicolor.";
+  
+  if(vm.count("pyramidfilter") > 0 && 
+     vm["pyramidfilter"].as< string >() != "box" && 
+     vm["pyramidfilter"].as< string >() != "gaussian")
+    return "Invalid pyramid filter.";
+  
+  if(vm.count("pyramidscale") > 0 && 
+     !ImagePyramid::isValidScaleFactor(vm["pyramidscale"].as< float >(), getPyramidFilter(vm)))
+    return "Invalid pyramid scale factor.";
+  
+  return "";
+}
+
+template < class T >
+DenseMotionExtractor< T > *MotionExtractorOptions::createDenseMotionExtractor(const variables_map &vm)
+{
+  if(vm["algorithm"].as< string >() == "lucaskanade")
+  {
+    PyramidalLucasKanade< T > *e = new PyramidalLucasKanade< T >(
+      vm.count("windowradius") > 0 ? vm["windowradius"].as< int >() : 16,
+      vm.count("numiter") > 0      ? vm["numiter"].as< int >() : 5,
+      vm.count("tau") > 0          ? vm["tau"].as< float >() : 0.0025,
+      vm.count("sigmap") > 0       ? vm["sigmap"].as< float >() : 0.0,
+      vm.count("numlevels") > 0    ? vm["numlevels"].as< int >() : 4,
+      true,
+      vm.count("warpmode") > 0 && vm["warpmode"].as< string >() == "dense" ? 
+        LucasKanade< T >::DENSE_WARP : LucasKanade< T >::LOCAL_WARP,
+      vm.count("threads") > 0 ? vm["threads"].as< int >() : 1);
+    
+    setPyramidOptions_(*e, vm);
+    
+    return e;
+  }
+  else if(vm["algorithm"].as< string >() == "proesmans")
+  {
+    typename Proesmans< T >::BoundaryConditions boundCond;
+    
+    int bc = 1;
+    if(vm.count("boundcond") > 0)
+      bc = vm["boundcond"].as< int >();
+    if(bc == 0)
+      boundCond = Proesmans< T >::DIRICHLET;
+    else
+      boundCond = Proesmans< T >::NEUMANN;
+    
+    PyramidalProesmans< T > *e = new PyramidalProesmans< T >(
+      vm.count("numiter") > 0   ? vm["numiter"].as< int >() : 200,
+      vm.count("lambda") > 0    ? vm["lambda"].as< float >() : 100.0,
+      vm.count("numlevels") > 0 ? vm["numlevels"].as< int >() : 4,
+      boundCond,
+      vm.count("threads") > 0   ? vm["threads"].as< int >() : 1,
+      vm.count("sweeporder") > 0 && vm["sweeporder"].as< string >() == "multicolor" ? 
+        Proesmans< T >::MULTICOLOR_SWEEP : Proesmans< T >::RASTER_SWEEP);
+    
+    if(vm.count("tolerance") > 0)
+    {
+      typename Proesmans< T >::ConvergenceNorm norm = Proesmans< T >::RMS_NORM;
+      if(vm.count("tolnorm") > 0 && vm["tolnorm"].as< string >() == "max")
+        norm = Proesmans< T >::MAX_NORM;
+      
+      e->setConvergenceTolerance(vm["tolerance"].as< float >(), norm,
+                                 vm.count("checkinterval") > 0 ? vm["checkinterval"].as< int >() : 10);
+    }
+    if(vm.count("leveliter") > 0)
+      e->setLevelIterations(parseIntList_(vm["leveliter"].as< string >()));
+    if(vm.count("consistencyinterval") > 0 || vm.count("lagnormalization") > 0)
+      e->setConsistencyUpdate(vm.count("consistencyinterval") > 0 ? vm["consistencyinterval"].as< int >() : 1,
+                              vm.count("lagnormalization") > 0);
+    if(vm.count("tilewidth") > 0 || vm.count("tileheight") > 0)
+      e->setTiling(vm.count("tilewidth") > 0  ? vm["tilewidth"].as< int >() : 512,
+                   vm.count("tileheight") > 0 ? vm["tileheight"].as< int >() : 16);
+    setPyramidOptions_(*e, vm);
+    
+    return e;
+  }
+  else
+    return NULL;
+}
+
+options_description MotionExtractorOptions::getExtractorOptions()
+{
+  options_description args("Motion extractor options");
+  args.add_options()
+    ("algorithm", value< std::string >(), "motion detection algorithm (lucaskanade, opencv, proesmans)")
+    ("precision", value< std::string >(), "floating-point precision of the computations (single, double) (default = double)")
+    ("pyramidfilter", value< std::string >(), "filter used for computing the pyramid levels (box, gaussian) (default = box for scale factor 0.5, otherwise gaussian)")
+    ("pyramidscale", value< float >(), "ratio between the dimensions of consecutive pyramid levels, 0 < <arg> < 1, box filter only supports 0.5 (default = 0.5)")
+    ("threads", value< int >(), "number of threads, 0 = all available processors, does not change the result (default = 1)");
+  
+  return args;
+}
+
+options_description MotionExtractorOptions::getLucasKanadeOptions()
+{
+  options_description args("Options for the Lucas-Kanade algorithm");
+  args.add_options()
+    ("numlevels",    value< int >(),         "number of pyramid levels (default = 4)")
+    ("windowradius", value< int >(),         "feature matching window radius (default = 16)")
+    ("numiter",      value< int >(),         "number of iterations (default = 5)")
+    ("tau",          value< float >(),       "eigenvalue threshold for feature matching (default = 0.0025)")
+    ("sigmap",       value< float >(),       "regularization parameter (default = 0)")
+    ("warpmode",     value< std::string >(), "warping of the second image (local = per-pixel windows, dense = whole image per iteration) (default = local)");
+  
+  return args;
+}
+
+options_description MotionExtractorOptions::getOpenCVOptions()
+{
+  options_description args("Options for the Lucas-Kanade algorithm (OpenCV)");
+  args.add_options()
+    ("numlevels",    value< int >(),   "number of pyramid levels (default = 4)")
+    ("windowsize",   value< int >(),   "feature matching window size (default = 30)")
+    ("maxnumpoints", value< int >(),   "maximum number of feature points (default = 1000)")
+    ("minpointdist", value< float >(), "minimum distance between feature points (default = 5)")
+    ("qualitylevel", value< float >(), "feature point quality threshold (default = 0.001)")
+    ("maxnumiter",   value< int >(),   "maximum number of iterations (default = 10)")
+    ("epsilon",      value< float >(), "stopping criterion threshold (default = 0.001)");
+  
+  return args;
+}
+
+options_description MotionExtractorOptions::getParserOptions()
+{
+  options_description args("");
+  
+  addNewOptions_(args, getLucasKanadeOptions());
+  addNewOptions_(args, getProesmansOptions());
+  addNewOptions_(args, getOpenCVOptions());
+  
+  return args;
+}
+
+options_description MotionExtractorOptions::getProesmansOptions()
+{
+  options_description args("Options for the Proesmans algorithm");
+  args.add_options()
+    ("numlevels",           value< int >(),         "number of pyramid levels (default = 4)")
+    ("numiter",             value< int >(),         "number of iterations (default = 200)")
+    ("leveliter",           value< std::string >(), "comma-separated numbers of iterations for each level, starting from the base level (default = numiter for all levels)")
+    ("lambda",              value< float >(),       "smoothness parameter (default = 100)")
+    ("boundcond",           value< int >(),         "boundary conditions (0 = Dirichlet, 1 = Neumann)  (default = 1)")
+    ("sweeporder",          value< std::string >(), "pixel update order of the iteration (raster = sequential Gauss-Seidel sweep, multicolor = four sweeps over the pixel classes with vectorized row kernels, distributed over the threads) (default = raster)")
+    ("tolerance",           value< float >(),       "stop iterating when the update of the motion vectors (in pixels) is below this (default = 0, no convergence check)")
+    ("tolnorm",             value< std::string >(), "norm of the update in the convergence check (rms, max) (default = rms)")
+    ("checkinterval",       value< int >(),         "number of iterations between convergence checks (default = 10)")
+    ("consistencyinterval", value< int >(),         "number of iterations between updates of the consistency maps (default = 1)")
+    ("lagnormalization",    "normalize the consistency maps with the normalization constant of the previous update in a single pass")
+    ("tilewidth",           value< int >(),         "tile width of the cache-blocked multicolor iteration, 0 = no tiling (default = 512 if tileheight is given, otherwise 0)")
+    ("tileheight",          value< int >(),         "tile height of the cache-blocked multicolor iteration, 0 = no tiling (default = 16 if tilewidth is given, otherwise 0)");
+  
+  return args;
+}
+
+ImagePyramid::Filter MotionExtractorOptions::getPyramidFilter(const variables_map &vm)
+{
+  if(vm.count("pyramidfilter") > 0)
+    return vm["pyramidfilter"].as< string >() == "box" ? 
+      ImagePyramid::BOX_FILTER : ImagePyramid::GAUSSIAN_FILTER;
+  else if(vm.count("pyramidscale") > 0 && vm["pyramidscale"].as< float >() != 0.5)
+    return ImagePyramid::GAUSSIAN_FILTER;
+  else
+    return ImagePyramid::BOX_FILTER;
+}
+
+template DenseMotionExtractor< double > *MotionExtractorOptions::createDenseMotionExtractor< double >(const variables_map &);
+template DenseMotionExtractor< float > *MotionExtractorOptions::createDenseMotionExtractor< float >(const variables_map &);
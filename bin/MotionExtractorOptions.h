@@ -0,0 +1,61 @@
+
+#ifndef MOTIONEXTRACTOROPTIONS_H
+
+#include "DenseMotionExtractor.h"
+#include "ImagePyramid.h"
+
+#include <boost/program_options.hpp>
+#include <string>
+
+using namespace boost::program_options;
+using namespace std;
+
+/// Describes the command-line options of the motion extractors and creates them.
+/**
+ * The options are shared by the command-line programs that run 
+ * motion extractors (extractmotion and evalflow). The options of 
+ * the different algorithms are described separately for printing 
+ * the help, but parsed with getParserOptions, which contains each 
+ * option only once (e.g. numlevels and numiter are options of 
+ * several algorithms).
+ */
+class MotionExtractorOptions
+{
+public:
+  /// Returns a message describing the first invalid option value, or an empty string if the values are valid.
+  static string checkOptions(const variables_map &vm);
+  
+  /// Creates the dense motion extractor given by the "algorithm" option with the scalar type T.
+  /**
+   * Returns NULL if the algorithm is not dense. The caller owns 
+   * the returned motion extractor.
+   */
+  template < class T >
+  static DenseMotionExtractor< T > *createDenseMotionExtractor(const variables_map &vm);
+  
+  /// Returns the options that select the algorithm and its general parameters.
+  static options_description getExtractorOptions();
+  
+  /// Returns the options specific to the Lucas-Kanade algorithm.
+  static options_description getLucasKanadeOptions();
+  
+  /// Returns the options specific to the Lucas-Kanade algorithm (OpenCV).
+  static options_description getOpenCVOptions();
+  
+  /// Returns the options of all algorithms, each option only once.
+  static options_description getParserOptions();
+  
+  /// Returns the options specific to the Proesmans algorithm.
+  static options_description getProesmansOptions();
+  
+  /// Returns the pyramid filter given by the "pyramidfilter" and "pyramidscale" options.
+  /**
+   * The default is the box filter for the scale factor 0.5 and 
+   * the Gaussian filter for other scale factors.
+   */
+  static ImagePyramid::Filter getPyramidFilter(const variables_map &vm);
+};
+
+#define MOTIONEXTRACTOROPTIONS_H
+
+#endif
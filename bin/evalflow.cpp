@@ -0,0 +1,393 @@
+/*
+ * This program evaluates dense motion extraction
+ * algorithms against ground truth motion fields.
+ */
+
+#include "DenseMotionExtractor.h"
+#include "DenseVectorFieldIO.h"
+#include "FlowErrorStatistics.h"
+#include "MotionExtractorOptions.h"
+#include "PNGFileUtils.h"
+#include "Profiler.h"
+#include "version.h"
+
+#include <boost/program_options.hpp>
+#include "CImg_config.h"
+#include <CImg.h>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
+
+using namespace boost::program_options;
+using namespace cimg_library;
+using namespace std;
+
+// A pair of images and the ground truth motion between them.
+struct DatasetPair
+{
+  string image1;
+  string image2;
+  string groundTruth;
+};
+
+// The result of evaluating a motion extractor on a pair of images.
+struct PairResult
+{
+  FlowErrorStatistics statistics;
+  long numPixels;
+  double computeTime;
+  string error;
+
+  PairResult() : numPixels(0), computeTime(0.0) { }
+};
+
+// Reads the pairs of a data set from a file listing
+// "image1 image2 groundtruth" on each line. Empty lines and lines
+// starting with # are skipped. Relative paths are relative to
+// the directory of the list file.
+static vector< DatasetPair > readDataset(const string &fileName)
+{
+  vector< DatasetPair > pairs;
+  ifstream listFile(fileName.c_str());
+  string line;
+  int lineNumber = 0;
+
+  if(!listFile)
+    throw runtime_error("File not found.");
+
+  const size_t slash = fileName.find_last_of('/');
+  const string directory = slash != string::npos ? fileName.substr(0, slash + 1) : "";
+
+  while(getline(listFile, line))
+  {
+    istringstream lineStream(line);
+    DatasetPair pair;
+
+    lineNumber++;
+    if(!(lineStream>>pair.image1) || pair.image1[0] == '#')
+      continue;
+    if(!(lineStream>>pair.image2>>pair.groundTruth))
+    {
+      ostringstream message;
+      message<<fileName<<":"<<lineNumber<<": expected image1 image2 groundtruth";
+      throw runtime_error(message.str());
+    }
+
+    if(pair.image1[0] != '/')
+      pair.image1 = directory + pair.image1;
+    if(pair.image2[0] != '/')
+      pair.image2 = directory + pair.image2;
+    if(pair.groundTruth[0] != '/')
+      pair.groundTruth = directory + pair.groundTruth;
+    pairs.push_back(pair);
+  }
+
+  return pairs;
+}
+
+// Loads a source image and preprocesses it in the same way as
+// extractmotion. PNG files are read with libpng, other formats
+// with CImg.
+static void loadImage(const string &fileName, CImg< unsigned char > &I)
+{
+  if(PNGFileUtils::isPNGFile(fileName))
+    PNGFileUtils::readImage(fileName, I);
+  else
+    I.load(fileName.c_str());
+
+  I.channel(0);
+  I.blur(3.0, 3.0, 3.0);
+}
+
+// Computes the forward motion of a pair of images and its errors.
+template < class T >
+static void evaluatePair(DenseMotionExtractor< T > &e,
+                         const DatasetPair &pair,
+                         PairResult &result)
+{
+  try
+  {
+    CImg< unsigned char > I1, I2;
+    CImg< T > VF, VB, Vgt;
+
+    loadImage(pair.image1, I1);
+    loadImage(pair.image2, I2);
+    DenseVectorFieldIO::readVectorField(pair.groundTruth, Vgt);
+
+    const double startTime = Profiler::getCurrentTime();
+    if(e.isDual())
+      e.compute(I1, I2, VF, VB);
+    else
+      e.compute(I1, I2, VF);
+    result.computeTime = Profiler::getCurrentTime() - startTime;
+
+    result.statistics.add(VF, Vgt, DenseVectorFieldIO::hasValidityChannel(pair.groundTruth) ? 2 : -1);
+    result.numPixels = (long)I1.dimx() * I1.dimy();
+  }
+  catch(CImgException &e1)
+  {
+    result.error = e1.message;
+  }
+  catch(std::exception &e2)
+  {
+    result.error = e2.what();
+  }
+}
+
+// Evaluates a motion extractor on all pairs of a data set. The
+// pairs are processed by numJobs threads, each of them having its
+// own motion extractor.
+template < class T >
+static void evaluate(const variables_map &vm,
+                     const vector< DatasetPair > &pairs,
+                     int numJobs,
+                     vector< PairResult > &results)
+{
+  results.assign(pairs.size(), PairResult());
+
+#ifdef WITH_OPENMP
+  #pragma omp parallel num_threads(numJobs > 0 ? numJobs : omp_get_max_threads())
+#endif
+  {
+    DenseMotionExtractor< T > *e = MotionExtractorOptions::createDenseMotionExtractor< T >(vm);
+
+#ifdef WITH_OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for(int i = 0; i < (int)pairs.size(); i++)
+      evaluatePair(*e, pairs[i], results[i]);
+
+    delete e;
+  }
+}
+
+// Prints a row of the result table.
+static void printRow(const string &format,
+                     const string &config,
+                     const string &pair,
+                     const FlowErrorStatistics &statistics,
+                     long numPixels,
+                     double computeTime,
+                     double wallTime)
+{
+  const double mpixPerSecond = computeTime > 0.0 ? numPixels / computeTime * 1e-6 : 0.0;
+
+  if(format == "csv")
+  {
+    std::cout<<"\""<<config<<"\",\""<<pair<<"\","<<numPixels<<","
+             <<statistics.getAverageEndpointError()<<","
+             <<statistics.getAverageAngularError()<<","
+             <<statistics.getOutlierPercentage(FlowErrorStatistics::R1)<<","
+             <<statistics.getOutlierPercentage(FlowErrorStatistics::R3)<<","
+             <<statistics.getOutlierPercentage(FlowErrorStatistics::R5)<<","
+             <<statistics.getOutlierPercentage(FlowErrorStatistics::FL)<<","
+             <<computeTime<<","<<mpixPerSecond<<",";
+    if(wallTime >= 0.0)
+      std::cout<<wallTime;
+    std::cout<<std::endl;
+  }
+  else
+  {
+    const ios::fmtflags flags = std::cout.flags();
+    const streamsize precision = std::cout.precision();
+
+    std::cout<<"  "<<std::left<<std::setw(24)<<pair<<std::right<<std::fixed
+             <<std::setw(10)<<numPixels
+             <<std::setprecision(3)
+             <<std::setw(9)<<statistics.getAverageEndpointError()
+             <<std::setw(9)<<statistics.getAverageAngularError()
+             <<std::setprecision(2)
+             <<std::setw(8)<<statistics.getOutlierPercentage(FlowErrorStatistics::R1)
+             <<std::setw(8)<<statistics.getOutlierPercentage(FlowErrorStatistics::R3)
+             <<std::setw(8)<<statistics.getOutlierPercentage(FlowErrorStatistics::R5)
+             <<std::setw(8)<<statistics.getOutlierPercentage(FlowErrorStatistics::FL)
+             <<std::setprecision(3)
+             <<std::setw(10)<<computeTime
+             <<std::setw(9)<<mpixPerSecond<<std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+  }
+}
+
+// Prints the results of a configuration.
+static void printResults(const string &format,
+                         bool details,
+                         const string &config,
+                         const vector< DatasetPair > &pairs,
+                         const vector< PairResult > &results,
+                         int numJobs,
+                         double wallTime)
+{
+  FlowErrorStatistics total;
+  long numPixels = 0;
+  double computeTime = 0.0;
+  int numFailed = 0;
+
+  if(format == "text")
+  {
+    std::cout<<config<<std::endl;
+    std::cout<<"  "<<std::left<<std::setw(24)<<"pair"<<std::right
+             <<std::setw(10)<<"pixels"<<std::setw(9)<<"AEPE"<<std::setw(9)<<"AAE"
+             <<std::setw(8)<<"R1 %"<<std::setw(8)<<"R3 %"<<std::setw(8)<<"R5 %"
+             <<std::setw(8)<<"Fl %"<<std::setw(10)<<"time (s)"<<std::setw(9)<<"Mpix/s"<<std::endl;
+  }
+
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    if(!results[i].error.empty())
+    {
+      std::cerr<<pairs[i].image1<<" "<<pairs[i].image2<<": "<<results[i].error<<std::endl;
+      numFailed++;
+      continue;
+    }
+
+    total.add(results[i].statistics);
+    numPixels += results[i].numPixels;
+    computeTime += results[i].computeTime;
+
+    if(details)
+      printRow(format, config, pairs[i].image1, results[i].statistics,
+               results[i].numPixels, results[i].computeTime, -1.0);
+  }
+
+  ostringstream totalName;
+  totalName<<"all ("<<results.size() - numFailed<<" pairs)";
+  printRow(format, config, format == "csv" ? "all" : totalName.str(),
+           total, numPixels, computeTime, wallTime);
+
+  if(format == "text")
+  {
+    std::cout<<"  wall time "<<std::fixed<<std::setprecision(3)<<wallTime<<" s (jobs = "<<numJobs<<")";
+    std::cout.unsetf(std::ios::fixed);
+    if(numFailed > 0)
+      std::cout<<", "<<numFailed<<" pairs failed";
+    std::cout<<std::endl<<std::endl;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  options_description generalArgs("General options");
+  generalArgs.add_options()
+    ("details", "print the results of each pair in addition to the totals")
+    ("format", value< std::string >(), "output format (text, csv) (default = text)")
+    ("help", "print usage")
+    ("jobs", value< int >(), "number of pairs evaluated concurrently, each with its own motion extractor, 0 = all available processors (default = 1)")
+    ("version", "print version number");
+
+  options_description mandatoryArgs("Mandatory arguments");
+  mandatoryArgs.add_options()
+    ("dataset", value< std::string >(), "file listing the pairs to evaluate, \"image1 image2 groundtruth\" on each line")
+    ("config", value< vector< std::string > >()->composing(), "motion extractor options in the format of extractmotion, e.g. \"--algorithm proesmans --precision single\" (can be given several times)");
+
+  options_description allArgs("Usage: evalflow <required arguments>");
+  allArgs.add(generalArgs).add(mandatoryArgs);
+
+  options_description configArgs("");
+  configArgs.add(MotionExtractorOptions::getExtractorOptions()).add(MotionExtractorOptions::getParserOptions());
+
+  std::string notes =
+    "Notes:\n"
+    " -the ground truth can be a .flo (Middlebury), KITTI PNG, PDVM or PDV2 file.\n"
+    " -the pixels of unknown flow in .flo and KITTI files are ignored, PDVM and PDV2 ground truth covers all pixels.\n"
+    " -the forward motion from image1 to image2 is evaluated.\n"
+    " -Mpix/s is the number of pixels divided by the total computation time of the pairs.\n"
+    " -see extractmotion --help and --options for the motion extractor options.";
+
+  cimg::exception_mode() = 0;
+
+  try {
+    variables_map vm;
+    store(parse_command_line(argc, argv, allArgs), vm);
+    notify(vm);
+
+    if(vm.size() == 0 || vm.count("help"))
+    {
+      std::cout<<allArgs<<std::endl;
+      std::cout<<notes<<std::endl;
+      return EXIT_SUCCESS;
+    }
+    else if(vm.count("version"))
+    {
+      std::cout<<OPTFLOW_VERSION_INFO<<std::endl;
+      return EXIT_SUCCESS;
+    }
+    else if(!vm.count("dataset") || !vm.count("config"))
+    {
+      std::cout<<"One or more required arguments missing."<<std::endl;
+      std::cout<<mandatoryArgs<<std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    const std::string format = vm.count("format") > 0 ? vm["format"].as< string >() : "text";
+    if(format != "text" && format != "csv")
+    {
+      std::cout<<"Invalid output format."<<std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    int numJobs = vm.count("jobs") > 0 ? vm["jobs"].as< int >() : 1;
+#ifdef WITH_OPENMP
+    if(numJobs <= 0)
+      numJobs = omp_get_max_threads();
+#else
+    numJobs = 1;
+#endif
+
+    const vector< std::string > configs = vm["config"].as< vector< string > >();
+    const vector< DatasetPair > pairs = readDataset(vm["dataset"].as< string >());
+
+    // parse all configurations before running any of them
+    vector< variables_map > configVms(configs.size());
+    for(size_t i = 0; i < configs.size(); i++)
+    {
+      store(command_line_parser(split_unix(configs[i])).options(configArgs).run(), configVms[i]);
+      notify(configVms[i]);
+
+      std::string invalidOptionMessage = MotionExtractorOptions::checkOptions(configVms[i]);
+      if(invalidOptionMessage.empty() &&
+         (!configVms[i].count("algorithm") ||
+          (configVms[i]["algorithm"].as< string >() != "lucaskanade" &&
+           configVms[i]["algorithm"].as< string >() != "proesmans")))
+        invalidOptionMessage = "Invalid algorithm name, only dense algorithms can be evaluated.";
+      if(!invalidOptionMessage.empty())
+      {
+        std::cout<<configs[i]<<": "<<invalidOptionMessage<<std::endl;
+        return EXIT_SUCCESS;
+      }
+    }
+
+    if(format == "csv")
+      std::cout<<"config,pair,pixels,aepe,aae,r1,r3,r5,fl,computetime,mpixpersecond,walltime"<<std::endl;
+
+    for(size_t i = 0; i < configs.size(); i++)
+    {
+      vector< PairResult > results;
+
+      const double startTime = Profiler::getCurrentTime();
+      if(configVms[i].count("precision") > 0 && configVms[i]["precision"].as< string >() == "single")
+        evaluate< float >(configVms[i], pairs, numJobs, results);
+      else
+        evaluate< double >(configVms[i], pairs, numJobs, results);
+      const double wallTime = Profiler::getCurrentTime() - startTime;
+
+      printResults(format, vm.count("details") > 0, configs[i], pairs, results, numJobs, wallTime);
+    }
+  }
+  catch(std::exception &e) {
+    std::cout<<e.what()<<std::endl;
+    std::cout<<allArgs<<std::endl;
+    std::cout<<notes<<std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -8,7 +8,8 @@
 #include "LucasKanadeOpenCV.h"
 #endif
 #include "MotionExtractorDriver.h"
-#include "PyramidalLucasKanade.h"
+#include "MotionExtractorOptions.h"
+#include "Profiler.h"
 #include "PyramidalProesmans.h"
 #include "SparseImageExtrapolator.h"
 #include "version.h"
@@ -16,15 +17,110 @@
 #include <boost/program_options.hpp>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <glob.h>
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace boost::program_options;
 using namespace std;
 
+// Returns the frames of a sequence. If the argument contains 
+// wildcards, the frames are the files matching it in alphabetical 
+// order. Otherwise the argument is a file listing the frames, 
+// one per line.
+static vector< string > readFrameList(const string &arg)
+{
+  vector< string > frames;
+  
+  if(arg.find_first_of("*?[") != string::npos)
+  {
+    glob_t globResult;
+    
+    if(glob(arg.c_str(), 0, NULL, &globResult) == 0)
+    {
+      for(size_t i = 0; i < globResult.gl_pathc; i++)
+        frames.push_back(globResult.gl_pathv[i]);
+    }
+    globfree(&globResult);
+  }
+  else
+  {
+    ifstream listFile(arg.c_str());
+    string line;
+    
+    if(!listFile)
+      throw runtime_error("File not found.");
+    
+    while(getline(listFile, line))
+    {
+      if(!line.empty())
+        frames.push_back(line);
+    }
+  }
+  
+  return frames;
+}
+
+// Runs a dense motion extractor on a sequence of frames.
+template < class T >
+static void runSequence(DenseMotionExtractor< T > &e,
+                        const vector< string > &frames,
+                        const string &outFilePrefix,
+                        const variables_map &vm)
+{
+  PyramidalDenseMotionExtractor< T > &pe = dynamic_cast< PyramidalDenseMotionExtractor< T > & >(e);
+  
+  if(vm.count("warmstart") > 0)
+  {
+    if(vm["warmstart"].as< string >() == "none")
+      pe.setWarmStartMode(PyramidalDenseMotionExtractor< T >::NO_WARM_START);
+    else if(vm["warmstart"].as< string >() == "all")
+      pe.setWarmStartMode(PyramidalDenseMotionExtractor< T >::WARM_START_ALL_LEVELS);
+    else
+      pe.setWarmStartMode(PyramidalDenseMotionExtractor< T >::WARM_START_COARSEST_LEVEL);
+  }
+  
+  MotionExtractorDriver::runDenseMotionExtractorSequence(pe, frames, outFilePrefix, 
+                                                         vm.count("sequencefile") > 0);
+}
+
+// Prints the number of iterations carried out in each pyramid 
+// level if the motion extractor is a Proesmans extractor.
+template < class T >
+static void printLevelIterations(const DenseMotionExtractor< T > &e)
+{
+  const PyramidalProesmans< T > *pe = dynamic_cast< const PyramidalProesmans< T > * >(&e);
+  
+  if(pe != NULL)
+  {
+    for(int i = pe->getNumPerformedIterations().size() - 1; i >= 0; i--)
+      std::cout<<"Level "<<i<<": "<<pe->getNumPerformedIterations()[i]<<" iterations"<<std::endl;
+  }
+}
+
+// Prints the running times of the stages and the counters 
+// collected during the computation.
+static void printProfile(const Profiler &profiler)
+{
+  if(!Profiler::isEnabled())
+  {
+    std::cout<<"Profiling is not enabled, compile with -DWITH_PROFILING=ON."<<std::endl;
+    return;
+  }
+  
+  std::cout<<std::endl;
+  std::cout<<"Profile"<<std::endl;
+  std::cout<<"======="<<std::endl;
+  profiler.print(std::cout);
+}
+
 int main(int argc, char **argv)
 {
-  DenseMotionExtractor *denseMotionExtractor = NULL;
+  DenseMotionExtractor< double > *denseMotionExtractor = NULL;
+  DenseMotionExtractor< float > *denseMotionExtractorF = NULL;
+  Profiler profiler;
 #ifdef WITH_CGAL
   SparseMotionExtractor *sparseMotionExtractor = NULL;
 #endif
@@ -33,49 +129,35 @@ int main(int argc, char **argv)
   generalArgs.add_options()
     ("help", "print usage")
     ("options", value< std::string >(), "print options specific to the algorithm <arg>")
-    ("version", "print version number");
+    ("profile", "print the running times of the computation stages and counters (requires compiling with -DWITH_PROFILING=ON)")
+    ("sequence", value< std::string >(), "compute the motion between consecutive frames listed in the file <arg>, or matching the wildcard pattern <arg> (replaces image1 and image2)")
+    ("sequencefile", "in the sequence mode, write the motion fields into a single PDVS file ([prefix]-motion.pdvs, or [prefix]-motionF.pdvs and [prefix]-motionB.pdvs) instead of one file per frame pair")
+    ("version", "print version number")
+    ("warmstart", value< std::string >(), "initialization of the motion from the previous frame pair in the sequence mode (none, coarsest, all) (default = coarsest)");
   
   options_description mandatoryArgs("Mandatory arguments");
   mandatoryArgs.add_options()
     ("image1", value< std::string >(), "first image")
     ("image2", value< std::string >(), "second image")
-    ("algorithm", value< std::string >(), "motion detection algorithm (lucaskanade, opencv, proesmans)")
     ("outprefix", value< std::string >(), "output file prefix");
   
-  // options specific to the Lucas-Kanade algorithm
-  options_description lucasKanadeArgs("Options for the Lucas-Kanade algorithm");
-  lucasKanadeArgs.add_options()
-    ("numlevels",    value< int >(),   "number of pyramid levels (default = 4)")
-    ("windowradius", value< int >(),   "feature matching window radius (default = 16)")
-    ("numiter",      value< int >(),   "number of iterations (default = 5)")
-    ("tau",          value< float >(), "eigenvalue threshold for feature matching (default = 0.0025)")
-    ("sigmap",       value< float >(), "regularization parameter (default = 0)");
-  
-  // options specific to the Lucas-Kanade algorithm (OpenCV)
-  options_description opencvArgs("Options for the Lucas-Kanade algorithm (OpenCV)");
-  opencvArgs.add_options()
-    ("numlevels",    value< int >(),   "number of pyramid levels (default = 4)")
-    ("windowsize",   value< int >(),   "feature matching window size (default = 30)")
-    ("maxnumpoints", value< int >(),   "maximum number of feature points (default = 1000)")
-    ("minpointdist", value< float >(), "minimum distance between feature points (default = 5)")
-    ("qualitylevel", value< float >(), "feature point quality threshold (default = 0.001)")
-    ("maxnumiter",   value< int >(),   "maximum number of iterations (default = 10)")
-    ("epsilon",      value< float >(), "stopping criterion threshold (default = 0.001)");
-  
-  // options specific to the Proesmans algorithm
-  options_description proesmansArgs("Options for the Proesmans algorithm");
-  proesmansArgs.add_options()
-    ("numlevels", value< int >(),   "number of pyramid levels (default = 4)")
-    ("numiter",   value< int >(),   "number of iterations (default = 200)")
-    ("lambda",    value< float >(), "smoothness parameter (default = 100)")
-    ("boundcond", value< int >(),   "boundary conditions (0 = Dirichlet, 1 = Neumann)  (default = 1)");
-  
   std::string restrictions = "Restrictions:\n -the source images must be 8-bit grayscale images.";
+  std::string notes = "Notes:\n"
+    " -the Proesmans algorithm is fastest with --sweeporder multicolor, which updates\n"
+    "  the pixels with vectorized (SSE2/AVX2) row kernels, also with --threads 1, and\n"
+    "  distributes the sweeps over the threads. The default raster order is the\n"
+    "  original sequential algorithm. The two orders give slightly different results,\n"
+    "  the number of threads does not change them.";
   
+  options_description extractorArgs = MotionExtractorOptions::getExtractorOptions();
+  
+  // The algorithm-specific options are parsed with a description 
+  // containing each option only once, some of them are shared by 
+  // several algorithms.
   options_description allArgs("");
-  allArgs.add(generalArgs).add(mandatoryArgs).add(lucasKanadeArgs).add(proesmansArgs).add(opencvArgs);
+  allArgs.add(generalArgs).add(mandatoryArgs).add(extractorArgs).add(MotionExtractorOptions::getParserOptions());
   options_description allVisibleArgs("Usage: extractmotion <required arguments> [algorithm-specific options]");
-  allVisibleArgs.add(generalArgs).add(mandatoryArgs);
+  allVisibleArgs.add(generalArgs).add(mandatoryArgs).add(extractorArgs);
   
   try {
     variables_map vm;
@@ -86,23 +168,24 @@ int main(int argc, char **argv)
     {
       std::cout<<allVisibleArgs<<std::endl;
       std::cout<<restrictions<<std::endl;
+      std::cout<<notes<<std::endl;
       return EXIT_SUCCESS;
     }
     else if(vm.count("version"))
       std::cout<<OPTFLOW_VERSION_INFO<<std::endl;
     else if(vm.count("options") && vm["options"].as< string >() == "lucaskanade")
     {
-      std::cout<<lucasKanadeArgs<<std::endl;
+      std::cout<<MotionExtractorOptions::getLucasKanadeOptions()<<std::endl;
       return EXIT_SUCCESS;
     }
     else if(vm.count("options") && vm["options"].as< string >() == "opencv")
     {
-      std::cout<<opencvArgs<<std::endl;
+      std::cout<<MotionExtractorOptions::getOpenCVOptions()<<std::endl;
       return EXIT_SUCCESS;
     }
     else if(vm.count("options") && vm["options"].as< string >() == "proesmans")
     {
-      std::cout<<proesmansArgs<<std::endl;
+      std::cout<<MotionExtractorOptions::getProesmansOptions()<<std::endl;
       return EXIT_SUCCESS;
     }
     else if(vm.count("options"))
@@ -110,21 +193,49 @@ int main(int argc, char **argv)
       std::cout<<"Invalid algorithm name."<<std::endl;
       return EXIT_SUCCESS;
     }
-    else if(!vm.count("image1") || !vm.count("image2") || !vm.count("algorithm"))
+    else if((!vm.count("sequence") && (!vm.count("image1") || !vm.count("image2"))) || 
+            !vm.count("algorithm"))
     {
       std::cout<<"One or more required arguments missing."<<std::endl;
       std::cout<<mandatoryArgs<<std::endl;
+      std::cout<<extractorArgs<<std::endl;
+      return EXIT_SUCCESS;
     }
     
-    if(vm["algorithm"].as< string >() == "lucaskanade")
+    std::string invalidOptionMessage = MotionExtractorOptions::checkOptions(vm);
+    if(!invalidOptionMessage.empty())
     {
-      denseMotionExtractor = new PyramidalLucasKanade(
-        vm.count("windowradius") > 0 ? vm["windowradius"].as< int >() : 16,
-        vm.count("numiter") > 0      ? vm["numiter"].as< int >() : 5,
-        vm.count("tau") > 0          ? vm["tau"].as< float >() : 0.0025,
-        vm.count("sigmap") > 0       ? vm["sigmap"].as< float >() : 0.0,
-        vm.count("numlevels") > 0    ? vm["numlevels"].as< int >() : 4,
-        true);
+      std::cout<<invalidOptionMessage<<std::endl;
+      return EXIT_SUCCESS;
+    }
+    
+    if(vm.count("warmstart") > 0 && 
+       vm["warmstart"].as< string >() != "none" && 
+       vm["warmstart"].as< string >() != "coarsest" && 
+       vm["warmstart"].as< string >() != "all")
+    {
+      std::cout<<"Invalid warm start mode."<<std::endl;
+      return EXIT_SUCCESS;
+    }
+    
+    if(vm["algorithm"].as< string >() == "lucaskanade" || 
+       vm["algorithm"].as< string >() == "proesmans")
+    {
+      if(vm.count("precision") > 0 && vm["precision"].as< string >() == "single")
+        denseMotionExtractorF = MotionExtractorOptions::createDenseMotionExtractor< float >(vm);
+      else
+        denseMotionExtractor = MotionExtractorOptions::createDenseMotionExtractor< double >(vm);
+      
+      // The parameters are printed on each computation.
+      if(denseMotionExtractor != NULL)
+        denseMotionExtractor->setLogStream(&std::cout);
+      if(denseMotionExtractorF != NULL)
+        denseMotionExtractorF->setLogStream(&std::cout);
+      
+      if(vm.count("profile") > 0 && denseMotionExtractor != NULL)
+        denseMotionExtractor->setProfiler(&profiler);
+      if(vm.count("profile") > 0 && denseMotionExtractorF != NULL)
+        denseMotionExtractorF->setProfiler(&profiler);
     }
 #if defined (WITH_OPENCV) && defined(WITH_CGAL)
     else if(vm["algorithm"].as< string >() == "opencv")
@@ -139,30 +250,36 @@ int main(int argc, char **argv)
         vm.count("epsilon") > 0      ? vm["epsilon"].as< float >() : 0.001);
     }
 #endif
-    else if(vm["algorithm"].as< string >() == "proesmans")
-    {
-      Proesmans::BoundaryConditions boundCond;
-      
-      int bc = 1;
-      if(vm.count("boundcond") > 0)
-        bc = vm["boundcond"].as< int >();
-      if(bc == 0)
-        boundCond = Proesmans::DIRICHLET;
-      else
-        boundCond = Proesmans::NEUMANN;
-      
-      denseMotionExtractor = new PyramidalProesmans(
-        vm.count("numiter") > 0   ? vm["numiter"].as< int >() : 200,
-        vm.count("lamda") > 0     ? vm["lambda"].as< float >() : 100.0,
-        vm.count("numlevels") > 0 ? vm["numlevels"].as< int >() : 4,
-        boundCond);
-    }
     else
     {
       std::cout<<"Invalid algorithm name."<<std::endl;
       return EXIT_SUCCESS;
     }
   
+    if(vm.count("sequence") > 0)
+    {
+      std::string outFilePrefix = vm["outprefix"].as< string >();
+      vector< string > frames = readFrameList(vm["sequence"].as< string >());
+      
+      if(denseMotionExtractor != NULL)
+      {
+        runSequence(*denseMotionExtractor, frames, outFilePrefix, vm);
+        delete denseMotionExtractor;
+      }
+      else if(denseMotionExtractorF != NULL)
+      {
+        runSequence(*denseMotionExtractorF, frames, outFilePrefix, vm);
+        delete denseMotionExtractorF;
+      }
+      else
+        std::cout<<"The sequence mode is only supported for dense motion extractors."<<std::endl;
+      
+      if(vm.count("profile") > 0)
+        printProfile(profiler);
+      
+      return EXIT_SUCCESS;
+    }
+    
     std::string srcImgFileName1 = vm["image1"].as< string >();
     std::string srcImgFileName2 = vm["image2"].as< string >();
     std::string outFilePrefix   = vm["outprefix"].as< string >();
@@ -171,7 +288,19 @@ int main(int argc, char **argv)
     {
       MotionExtractorDriver::runDenseMotionExtractor(
         *denseMotionExtractor, srcImgFileName1, srcImgFileName2, outFilePrefix);
+      printLevelIterations(*denseMotionExtractor);
       delete denseMotionExtractor;
+      if(vm.count("profile") > 0)
+        printProfile(profiler);
+    }
+    else if(denseMotionExtractorF != NULL)
+    {
+      MotionExtractorDriver::runDenseMotionExtractor(
+        *denseMotionExtractorF, srcImgFileName1, srcImgFileName2, outFilePrefix);
+      printLevelIterations(*denseMotionExtractorF);
+      delete denseMotionExtractorF;
+      if(vm.count("profile") > 0)
+        printProfile(profiler);
     }
 #ifdef WITH_CGAL
     else if(sparseMotionExtractor != NULL)
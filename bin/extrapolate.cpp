@@ -5,6 +5,7 @@
  */
 
 #include "DenseVectorFieldIO.h"
+#include "DenseVectorFieldSequence.h"
 #include "ImageExtrapolatorDriver.h"
 #include "InverseDenseImageExtrapolator.h"
 #include "SparseImageExtrapolator.h"
@@ -32,6 +33,7 @@ int main(int argc, char **argv)
   
   options_description generalArgs("General options");
   generalArgs.add_options()
+    ("frame", value< int >(), "the motion field to use from a motion field sequence (.pdvs), starting from 0 (default = 0)")
     ("help", "print usage")
     ("version", "print version number");
   
@@ -45,7 +47,7 @@ int main(int argc, char **argv)
   options_description allArgs("Usage: extrapolate <required arguments>");
   allArgs.add(generalArgs).add(reqArgs);
   
-  std::string notes = "NOTE: If you use a dense motion field (.pdvm), it is assumed to be an inverse motion field (image2->image1).";
+  std::string notes = "NOTE: If you use a dense motion field (.pdvm or .pdvs), it is assumed to be an inverse motion field (image2->image1).";
   
   try {
     variables_map vm;
@@ -80,6 +82,13 @@ int main(int argc, char **argv)
       DenseVectorFieldIO::readVectorField(motionFieldFileName, *Vd);
       denseExtrapolator = new InverseDenseImageExtrapolator();
     }
+    else if(ext == "pdvs")
+    {
+      DenseVectorFieldSequence sequence(motionFieldFileName);
+      Vd = new CImg< double >();
+      sequence.readFrame(vm.count("frame") > 0 ? vm["frame"].as< int >() : 0, *Vd);
+      denseExtrapolator = new InverseDenseImageExtrapolator();
+    }
 #if defined (WITH_OPENCV) && defined(WITH_CGAL)
     else if(ext == "psvm")
     {
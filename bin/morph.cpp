@@ -132,7 +132,7 @@ int main(int argc, char **argv)
     {
       CImg< double > V1, V2;
       CImg< unsigned char > M;
-      PyramidalProesmans motionExtractor;
+      PyramidalProesmans< double > motionExtractor;
       ostringstream ostr;
     
       motionExtractor.compute(I1_smoothed, I2_smoothed, V1, V2);
@@ -0,0 +1,605 @@
+
+#include "CompressedDenseVectorFieldIO.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+static const int HEADER_SIZE = 40;
+static const int INDEX_ENTRY_SIZE = 16;
+static const uint32_t VERSION = 1;
+static const uint32_t COMPRESSION_NONE = 0;
+static const uint32_t COMPRESSION_ZLIB = 1;
+static const uint32_t FLAG_DELTA_CODING = 1;
+
+// the limits of the header values, which keep the sizes computed
+// from them within 64 bits and the tile indices within int (a tile
+// can still have more than 2^31 pixels, so its pixel indices are
+// size_t)
+static const int MAX_SIZE = 65536;
+static const int MAX_NUM_CHANNELS = 64;
+static const uint64_t MAX_NUM_TILES = 0x7fffffff / INDEX_ENTRY_SIZE;
+
+// the contents of a PDV2 header
+struct Header_
+{
+  int width, height;
+  int numChannels;
+  int tileWidth, tileHeight;
+  uint32_t compression;
+  uint32_t flags;
+  float quantizationStep;
+
+  int getNumTilesX() const { return (width + tileWidth - 1) / tileWidth; }
+  int getNumTilesY() const { return (height + tileHeight - 1) / tileHeight; }
+  uint64_t getNumTiles() const { return (uint64_t)getNumTilesX() * getNumTilesY(); }
+
+  // Returns the size of an uncompressed w x h tile in bytes.
+  size_t getRawTileSize(int w, int h) const { return (size_t)4 * numChannels * w * h; }
+};
+
+static void putUInt32_(unsigned char *p, uint32_t value)
+{
+  for(int i = 0; i < 4; i++)
+    p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void putUInt64_(unsigned char *p, uint64_t value)
+{
+  for(int i = 0; i < 8; i++)
+    p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t getUInt32_(const unsigned char *p)
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; i++)
+    value |= (uint32_t)p[i] << (8 * i);
+  return value;
+}
+
+static uint64_t getUInt64_(const unsigned char *p)
+{
+  uint64_t value = 0;
+  for(int i = 0; i < 8; i++)
+    value |= (uint64_t)p[i] << (8 * i);
+  return value;
+}
+
+static uint32_t floatToBits_(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(float));
+  return bits;
+}
+
+static float bitsToFloat_(uint32_t bits)
+{
+  float value;
+  memcpy(&value, &bits, sizeof(float));
+  return value;
+}
+
+static uint32_t quantize_(double value, double step)
+{
+  double q = floor(value / step + 0.5);
+
+  if(q > 2147483647.0)
+    q = 2147483647.0;
+  else if(q < -2147483648.0)
+    q = -2147483648.0;
+
+  return (uint32_t)(int32_t)q;
+}
+
+#ifdef WITH_OPENMP
+static int getNumWorkerThreads_(int numThreads)
+{
+  if(numThreads <= 0)
+    return omp_get_max_threads();
+  return numThreads;
+}
+#endif
+
+// Encodes the channels of a tile to byte planes (see the class
+// documentation). words is a work buffer.
+template < class T >
+static void encodeTile_(const CImg< T > &V, const Header_ &header,
+                        int x0, int y0, int w, int h,
+                        vector< uint32_t > &words,
+                        vector< unsigned char > &raw)
+{
+  const size_t n = (size_t)w * h;
+  const double step = header.quantizationStep;
+
+  words.resize(n);
+  raw.resize(header.getRawTileSize(w, h));
+
+  for(int c = 0; c < header.numChannels; c++)
+  {
+    const bool isMotion = c < 2;
+
+    for(int y = 0; y < h; y++)
+    {
+      const T *src = V.ptr(x0, y0 + y, 0, c);
+      uint32_t *dst = &words[(size_t)y * w];
+
+      if(isMotion && step > 0.0)
+        for(int x = 0; x < w; x++)
+          dst[x] = quantize_(src[x], step);
+      else
+        for(int x = 0; x < w; x++)
+          dst[x] = floatToBits_(src[x]);
+    }
+
+    // The values are replaced in reverse order, so that the
+    // predictions are computed from the original values.
+    if(isMotion && (header.flags & FLAG_DELTA_CODING))
+    {
+      for(int y = h - 1; y >= 0; y--)
+      {
+        uint32_t *row = &words[(size_t)y * w];
+        for(int x = w - 1; x > 0; x--)
+          row[x] -= row[x - 1];
+        if(y > 0)
+          row[0] -= row[-w];
+      }
+    }
+
+    unsigned char *planes = &raw[4 * c * n];
+    for(size_t i = 0; i < n; i++)
+    {
+      const uint32_t bits = words[i];
+      planes[i] = (unsigned char)bits;
+      planes[n + i] = (unsigned char)(bits >> 8);
+      planes[2 * n + i] = (unsigned char)(bits >> 16);
+      planes[3 * n + i] = (unsigned char)(bits >> 24);
+    }
+  }
+}
+
+// Decodes the channels of a tile at (x0, y0) and stores the part
+// of it inside the region of V whose upper-left corner is at
+// (rx0, ry0).
+template < class T >
+static void decodeTile_(const vector< unsigned char > &raw,
+                        const Header_ &header,
+                        int x0, int y0, int w, int h,
+                        int rx0, int ry0,
+                        vector< uint32_t > &words,
+                        CImg< T > &V)
+{
+  const size_t n = (size_t)w * h;
+  const double step = header.quantizationStep;
+  const int xMin = max(x0, rx0), xMax = min(x0 + w, rx0 + V.dimx());
+  const int yMin = max(y0, ry0), yMax = min(y0 + h, ry0 + V.dimy());
+
+  words.resize(n);
+
+  for(int c = 0; c < header.numChannels; c++)
+  {
+    const bool isMotion = c < 2;
+    const unsigned char *planes = &raw[4 * c * n];
+
+    for(size_t i = 0; i < n; i++)
+    {
+      words[i] = (uint32_t)planes[i] |
+                 (uint32_t)planes[n + i] << 8 |
+                 (uint32_t)planes[2 * n + i] << 16 |
+                 (uint32_t)planes[3 * n + i] << 24;
+    }
+
+    if(isMotion && (header.flags & FLAG_DELTA_CODING))
+    {
+      for(int y = 0; y < h; y++)
+      {
+        uint32_t *row = &words[(size_t)y * w];
+        if(y > 0)
+          row[0] += row[-w];
+        for(int x = 1; x < w; x++)
+          row[x] += row[x - 1];
+      }
+    }
+
+    for(int y = yMin; y < yMax; y++)
+    {
+      const uint32_t *src = &words[(size_t)(y - y0) * w + xMin - x0];
+      T *dst = V.ptr(xMin - rx0, y - ry0, 0, c);
+
+      if(isMotion && step > 0.0)
+        for(int x = 0; x < xMax - xMin; x++)
+          dst[x] = (int32_t)src[x] * step;
+      else
+        for(int x = 0; x < xMax - xMin; x++)
+          dst[x] = bitsToFloat_(src[x]);
+    }
+  }
+}
+
+// Returns false if the compression fails.
+static bool compressTile_(const vector< unsigned char > &raw,
+                          const Header_ &header,
+                          int level,
+                          vector< unsigned char > &compressed)
+{
+#ifdef WITH_ZLIB
+  if(header.compression == COMPRESSION_ZLIB)
+  {
+    uLongf size = compressBound(raw.size());
+    compressed.resize(size);
+    if(compress2(&compressed[0], &size, &raw[0], raw.size(), level) != Z_OK)
+      return false;
+    compressed.resize(size);
+    return true;
+  }
+#endif
+  compressed = raw;
+  return true;
+}
+
+// Returns false if the data is corrupted.
+static bool decompressTile_(const vector< unsigned char > &compressed,
+                            const Header_ &header,
+                            vector< unsigned char > &raw)
+{
+#ifdef WITH_ZLIB
+  if(header.compression == COMPRESSION_ZLIB)
+  {
+    uLongf size = raw.size();
+    return uncompress(&raw[0], &size, &compressed[0], compressed.size()) == Z_OK &&
+           size == raw.size();
+  }
+#endif
+  if(compressed.size() != raw.size())
+    return false;
+  raw = compressed;
+  return true;
+}
+
+// Returns false if a tile of compressedSize bytes cannot decompress
+// to rawSize bytes. This rejects corrupted index entries before the
+// decompression buffers are allocated.
+static bool isValidTileSize_(uint64_t compressedSize, uint64_t rawSize,
+                             const Header_ &header)
+{
+  // the maximum compression ratio of deflate
+  const uint64_t MAX_COMPRESSION_RATIO = 1032;
+
+  if(header.compression == COMPRESSION_ZLIB)
+    return compressedSize > 0 && rawSize <= compressedSize * MAX_COMPRESSION_RATIO;
+  return compressedSize == rawSize;
+}
+
+static void readHeader_(ifstream &inputStream, Header_ &header,
+                        vector< uint64_t > &tileOffsets,
+                        vector< uint64_t > &tileSizes)
+{
+  unsigned char buffer[HEADER_SIZE];
+
+  inputStream.read((char *)buffer, HEADER_SIZE);
+  if(!inputStream || memcmp(buffer, "PDV2", 4) != 0)
+    throw runtime_error("Invalid PDV2 file.");
+  if(getUInt32_(buffer + 4) != VERSION)
+    throw runtime_error("Unsupported PDV2 version.");
+
+  const uint32_t width = getUInt32_(buffer + 8);
+  const uint32_t height = getUInt32_(buffer + 12);
+  const uint32_t numChannels = getUInt32_(buffer + 16);
+  const uint32_t tileWidth = getUInt32_(buffer + 20);
+  const uint32_t tileHeight = getUInt32_(buffer + 24);
+
+  // The values are checked before they are converted to int.
+  if(width == 0 || width > (uint32_t)MAX_SIZE ||
+     height == 0 || height > (uint32_t)MAX_SIZE ||
+     numChannels < 2 || numChannels > (uint32_t)MAX_NUM_CHANNELS ||
+     tileWidth == 0 || tileWidth > (uint32_t)MAX_SIZE ||
+     tileHeight == 0 || tileHeight > (uint32_t)MAX_SIZE)
+    throw runtime_error("Invalid PDV2 header.");
+
+  header.width = width;
+  header.height = height;
+  header.numChannels = numChannels;
+  header.tileWidth = tileWidth;
+  header.tileHeight = tileHeight;
+  header.compression = getUInt32_(buffer + 28);
+  header.flags = getUInt32_(buffer + 32);
+  header.quantizationStep = bitsToFloat_(getUInt32_(buffer + 36));
+
+  if(header.compression > COMPRESSION_ZLIB || header.getNumTiles() > MAX_NUM_TILES)
+    throw runtime_error("Invalid PDV2 header.");
+#ifndef WITH_ZLIB
+  if(header.compression == COMPRESSION_ZLIB)
+    throw runtime_error("Reading compressed PDV2 files requires zlib.");
+#endif
+
+  const int numTiles = header.getNumTiles();
+  const size_t indexSize = (size_t)numTiles * INDEX_ENTRY_SIZE;
+
+  // The index is not allocated before it is known to fit in the file.
+  const streampos indexPos = inputStream.tellg();
+  inputStream.seekg(0, ios::end);
+  const uint64_t fileSize = inputStream.tellg();
+  inputStream.seekg(indexPos);
+  if(!inputStream || fileSize - HEADER_SIZE < indexSize)
+    throw runtime_error("Truncated PDV2 file.");
+
+  vector< unsigned char > index(indexSize);
+
+  inputStream.read((char *)&index[0], index.size());
+  if(!inputStream)
+    throw runtime_error("Truncated PDV2 file.");
+
+  tileOffsets.resize(numTiles);
+  tileSizes.resize(numTiles);
+  for(int i = 0; i < numTiles; i++)
+  {
+    tileOffsets[i] = getUInt64_(&index[(size_t)i * INDEX_ENTRY_SIZE]);
+    tileSizes[i] = getUInt64_(&index[(size_t)i * INDEX_ENTRY_SIZE + 8]);
+  }
+}
+
+template < class T >
+static void readVectorFieldRegion_(const string &inFileName,
+                                   int x0, int y0, int width, int height,
+                                   bool wholeField,
+                                   CImg< T > &V,
+                                   int numThreads)
+{
+  Header_ header;
+  vector< uint64_t > tileOffsets, tileSizes;
+
+  ifstream inputStream(inFileName.c_str(), ios::binary | ios::in);
+  if(!inputStream)
+    throw runtime_error("File not found.");
+
+  readHeader_(inputStream, header, tileOffsets, tileSizes);
+
+  if(wholeField)
+  {
+    x0 = y0 = 0;
+    width = header.width;
+    height = header.height;
+  }
+  else if(x0 < 0 || y0 < 0 || width <= 0 || height <= 0 ||
+          x0 >= header.width || y0 >= header.height ||
+          width > header.width - x0 || height > header.height - y0)
+    throw runtime_error("Invalid region.");
+
+  // CImg computes the size of an image in unsigned int.
+  if((uint64_t)width * height * header.numChannels > 0xffffffffu)
+    throw runtime_error("The PDV2 vector field is too large.");
+
+  const int tw = header.tileWidth;
+  const int th = header.tileHeight;
+  const int numTilesX = header.getNumTilesX();
+  vector< int > tiles;
+
+  for(int ty = y0 / th; ty <= (y0 + height - 1) / th; ty++)
+    for(int tx = x0 / tw; tx <= (x0 + width - 1) / tw; tx++)
+      tiles.push_back(ty * numTilesX + tx);
+
+  inputStream.seekg(0, ios::end);
+  const uint64_t fileSize = inputStream.tellg();
+
+  // The tiles are read sequentially and decompressed in parallel.
+  const int numReadTiles = tiles.size();
+  vector< vector< unsigned char > > compressed(numReadTiles);
+
+  for(int i = 0; i < numReadTiles; i++)
+  {
+    const int tx = tiles[i] % numTilesX * tw;
+    const int ty = tiles[i] / numTilesX * th;
+    const size_t rawSize = header.getRawTileSize(min(tw, header.width - tx),
+                                                 min(th, header.height - ty));
+
+    if(tileOffsets[tiles[i]] > fileSize || tileSizes[tiles[i]] > fileSize - tileOffsets[tiles[i]])
+      throw runtime_error("Truncated PDV2 file.");
+    if(!isValidTileSize_(tileSizes[tiles[i]], rawSize, header))
+      throw runtime_error("Corrupted PDV2 file.");
+    compressed[i].resize(tileSizes[tiles[i]]);
+    inputStream.seekg(tileOffsets[tiles[i]]);
+    if(!compressed[i].empty())
+      inputStream.read((char *)&compressed[i][0], compressed[i].size());
+    if(!inputStream)
+      throw runtime_error("Truncated PDV2 file.");
+  }
+
+  V.assign(width, height, 1, header.numChannels);
+
+  int numFailed = 0;
+#ifdef WITH_OPENMP
+  #pragma omp parallel num_threads(getNumWorkerThreads_(numThreads))
+#endif
+  {
+    vector< unsigned char > raw;
+    vector< uint32_t > words;
+
+#ifdef WITH_OPENMP
+    #pragma omp for schedule(dynamic) reduction(+:numFailed)
+#endif
+    for(int i = 0; i < numReadTiles; i++)
+    {
+      const int tx = tiles[i] % numTilesX * tw;
+      const int ty = tiles[i] / numTilesX * th;
+      const int w = min(tw, header.width - tx);
+      const int h = min(th, header.height - ty);
+
+      raw.resize(header.getRawTileSize(w, h));
+      if(compressed[i].empty() || !decompressTile_(compressed[i], header, raw))
+        numFailed++;
+      else
+        decodeTile_(raw, header, tx, ty, w, h, x0, y0, words, V);
+    }
+  }
+
+  if(numFailed > 0)
+    throw runtime_error("Corrupted PDV2 file.");
+}
+
+template < class T >
+static void writeVectorField_(const CImg< T > &V,
+                              const string &outFileName,
+                              const CompressedDenseVectorFieldIO::Options &options)
+{
+  Header_ header;
+
+  if(V.dimv() < 2 || V.dimv() > MAX_NUM_CHANNELS || V.dimx() == 0 || V.dimy() == 0 ||
+     V.dimx() > MAX_SIZE || V.dimy() > MAX_SIZE)
+    throw runtime_error("Invalid vector field.");
+  if(options.tileSize <= 0 || options.tileSize > MAX_SIZE || options.compressionLevel < 0 || options.compressionLevel > 9)
+    throw runtime_error("Invalid PDV2 options.");
+
+  header.width = V.dimx();
+  header.height = V.dimy();
+  header.numChannels = V.dimv();
+  header.tileWidth = options.tileSize;
+  header.tileHeight = options.tileSize;
+#ifdef WITH_ZLIB
+  header.compression = options.compressionLevel > 0 ? COMPRESSION_ZLIB : COMPRESSION_NONE;
+#else
+  header.compression = COMPRESSION_NONE;
+#endif
+  header.flags = options.deltaCoding ? FLAG_DELTA_CODING : 0;
+  header.quantizationStep = options.quantizationStep > 0.0 ? options.quantizationStep : 0.0;
+
+  const int tw = header.tileWidth;
+  const int th = header.tileHeight;
+  const int numTilesX = header.getNumTilesX();
+  if(header.getNumTiles() > MAX_NUM_TILES)
+    throw runtime_error("Invalid PDV2 options.");
+  const int numTiles = header.getNumTiles();
+  vector< vector< unsigned char > > tiles(numTiles);
+
+  int numFailed = 0;
+#ifdef WITH_OPENMP
+  #pragma omp parallel num_threads(getNumWorkerThreads_(options.numThreads))
+#endif
+  {
+    vector< unsigned char > raw;
+    vector< uint32_t > words;
+
+#ifdef WITH_OPENMP
+    #pragma omp for schedule(dynamic) reduction(+:numFailed)
+#endif
+    for(int i = 0; i < numTiles; i++)
+    {
+      const int tx = i % numTilesX * tw;
+      const int ty = i / numTilesX * th;
+
+      encodeTile_(V, header, tx, ty, min(tw, header.width - tx),
+                  min(th, header.height - ty), words, raw);
+      if(!compressTile_(raw, header, options.compressionLevel, tiles[i]))
+        numFailed++;
+    }
+  }
+
+  if(numFailed > 0)
+    throw runtime_error("Error compressing vector field.");
+
+  vector< unsigned char > buffer(HEADER_SIZE + (size_t)numTiles * INDEX_ENTRY_SIZE);
+  memcpy(&buffer[0], "PDV2", 4);
+  putUInt32_(&buffer[4], VERSION);
+  putUInt32_(&buffer[8], header.width);
+  putUInt32_(&buffer[12], header.height);
+  putUInt32_(&buffer[16], header.numChannels);
+  putUInt32_(&buffer[20], header.tileWidth);
+  putUInt32_(&buffer[24], header.tileHeight);
+  putUInt32_(&buffer[28], header.compression);
+  putUInt32_(&buffer[32], header.flags);
+  putUInt32_(&buffer[36], floatToBits_(header.quantizationStep));
+
+  uint64_t offset = buffer.size();
+  for(int i = 0; i < numTiles; i++)
+  {
+    putUInt64_(&buffer[HEADER_SIZE + (size_t)i * INDEX_ENTRY_SIZE], offset);
+    putUInt64_(&buffer[HEADER_SIZE + (size_t)i * INDEX_ENTRY_SIZE + 8], tiles[i].size());
+    offset += tiles[i].size();
+  }
+
+  ofstream outputStream(outFileName.c_str(), ios::binary | ios::out);
+  if(!outputStream)
+    throw runtime_error("Error creating file " + outFileName);
+
+  outputStream.write((const char *)&buffer[0], buffer.size());
+  for(int i = 0; i < numTiles; i++)
+    outputStream.write((const char *)&tiles[i][0], tiles[i].size());
+
+  outputStream.close();
+  if(!outputStream)
+    throw runtime_error("Error writing file " + outFileName);
+}
+
+CompressedDenseVectorFieldIO::Options::Options() :
+  tileSize(128),
+  quantizationStep(0.0),
+  deltaCoding(true),
+  compressionLevel(6),
+  numThreads(1) { }
+
+bool CompressedDenseVectorFieldIO::isCompressedVectorField(const string &fileName)
+{
+  char magic[4];
+
+  ifstream inputStream(fileName.c_str(), ios::binary | ios::in);
+  inputStream.read(magic, 4);
+
+  return inputStream && memcmp(magic, "PDV2", 4) == 0;
+}
+
+void CompressedDenseVectorFieldIO::readVectorField(const string &inFileName,
+                                                   CImg< double > &V,
+                                                   int numThreads)
+{
+  readVectorFieldRegion_(inFileName, 0, 0, 0, 0, true, V, numThreads);
+}
+
+void CompressedDenseVectorFieldIO::readVectorField(const string &inFileName,
+                                                   CImg< float > &V,
+                                                   int numThreads)
+{
+  readVectorFieldRegion_(inFileName, 0, 0, 0, 0, true, V, numThreads);
+}
+
+void CompressedDenseVectorFieldIO::readVectorFieldRegion(const string &inFileName,
+                                                         int x0, int y0, int width, int height,
+                                                         CImg< double > &V,
+                                                         int numThreads)
+{
+  readVectorFieldRegion_(inFileName, x0, y0, width, height, false, V, numThreads);
+}
+
+void CompressedDenseVectorFieldIO::readVectorFieldRegion(const string &inFileName,
+                                                         int x0, int y0, int width, int height,
+                                                         CImg< float > &V,
+                                                         int numThreads)
+{
+  readVectorFieldRegion_(inFileName, x0, y0, width, height, false, V, numThreads);
+}
+
+void CompressedDenseVectorFieldIO::writeVectorField(const CImg< double > &V,
+                                                    const string &outFileName,
+                                                    const Options &options)
+{
+  writeVectorField_(V, outFileName, options);
+}
+
+void CompressedDenseVectorFieldIO::writeVectorField(const CImg< float > &V,
+                                                    const string &outFileName,
+                                                    const Options &options)
+{
+  writeVectorField_(V, outFileName, options);
+}
@@ -0,0 +1,120 @@
+
+#ifndef COMPRESSEDDENSEVECTORFIELDIO_H
+
+#include <string>
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements methods for reading and writing dense vector fields in the compressed PDV2 format.
+/**
+ * The vector field is divided into fixed-size tiles, and each
+ * tile is compressed independently with zlib. A tile index in the
+ * header gives the location of each tile, so that a region can be
+ * decoded by reading only the tiles that intersect it. The tiles
+ * are compressed and decompressed in parallel when the library is
+ * compiled with OpenMP.
+ *
+ * Before compression, the components of a tile are encoded as
+ * follows:
+ *   - If a quantization step is given, u and v are rounded to
+ *     multiples of it and stored as 32-bit integers. Otherwise
+ *     they are stored as single-precision floats, i.e. with the
+ *     same precision as in the PDVM format.
+ *   - With delta coding, the difference of each u and v value
+ *     from its left neighbour (or from the value above it in the
+ *     first column) is stored instead of the value. The differences
+ *     are computed with wrap-around integer arithmetic on the bit
+ *     patterns, so floats are also coded without loss.
+ *   - The four bytes of the values of each channel are stored in
+ *     separate byte planes, which compress better than the
+ *     interleaved values.
+ * The quality channels are always stored without loss.
+ *
+ * A PDV2 file consists of a header, a tile index and the tiles.
+ * The integers and floats in the header and the index are stored
+ * in little-endian byte order:
+ *   "PDV2"                  magic number (4 bytes)
+ *   version                 uint32, currently 1
+ *   width, height           uint32
+ *   numchannels             uint32, 2+q
+ *   tilewidth, tileheight   uint32
+ *   compression             uint32, 0 = none, 1 = zlib
+ *   flags                   uint32, bit 0 = delta coding of u and v
+ *   quantizationstep        float32, 0 = no quantization
+ *   tile index              (offset, size) of each tile as uint64 pairs,
+ *                           the tiles are in raster order
+ *
+ * If the library is compiled without zlib (WITH_ZLIB), the tiles
+ * are stored uncompressed, and files with zlib-compressed tiles
+ * cannot be read.
+ */
+class CompressedDenseVectorFieldIO
+{
+public:
+  /// The options of writing a vector field.
+  struct Options
+  {
+    int tileSize;              ///< width and height of the tiles (default = 128)
+    double quantizationStep;   ///< if > 0, u and v are rounded to multiples of this (default = 0)
+    bool deltaCoding;          ///< store the differences of neighbouring u and v values (default = true)
+    int compressionLevel;      ///< zlib compression level 1...9, 0 = no compression (default = 6)
+    int numThreads;            ///< number of threads, 0 = all available processors (default = 1)
+
+    /// Constructs the default options.
+    Options();
+  };
+
+  /// Returns true if the given file is in PDV2 format.
+  static bool isCompressedVectorField(const string &fileName);
+
+  /// Reads a vector field from a file in PDV2 format.
+  /**
+   * Throws runtime_error if the file cannot be read.
+   * @param inFileName the file to read
+   * @param V the vector field
+   * @param numThreads number of threads used for decompression, 0 = all available processors
+   */
+  static void readVectorField(const string &inFileName,
+                              CImg< double > &V,
+                              int numThreads = 1);
+
+  /// Reads a single-precision vector field from a file in PDV2 format.
+  static void readVectorField(const string &inFileName,
+                              CImg< float > &V,
+                              int numThreads = 1);
+
+  /// Reads a region of a vector field from a file in PDV2 format.
+  /**
+   * Only the tiles intersecting the region are read and
+   * decompressed. V is resized to width x height x 1 x (2+q).
+   * Throws runtime_error if the region is not inside the vector
+   * field.
+   */
+  static void readVectorFieldRegion(const string &inFileName,
+                                    int x0, int y0, int width, int height,
+                                    CImg< double > &V,
+                                    int numThreads = 1);
+
+  /// Reads a region of a single-precision vector field from a file in PDV2 format.
+  static void readVectorFieldRegion(const string &inFileName,
+                                    int x0, int y0, int width, int height,
+                                    CImg< float > &V,
+                                    int numThreads = 1);
+
+  /// Writes a vector field to a file in PDV2 format.
+  static void writeVectorField(const CImg< double > &V,
+                               const string &outFileName,
+                               const Options &options = Options());
+
+  /// Writes a single-precision vector field to a file in PDV2 format.
+  static void writeVectorField(const CImg< float > &V,
+                               const string &outFileName,
+                               const Options &options = Options());
+};
+
+#define COMPRESSEDDENSEVECTORFIELDIO_H
+
+#endif
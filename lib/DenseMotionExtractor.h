@@ -1,9 +1,11 @@
 
 #ifndef DENSEMOTIONEXTRACTOR_H
 
+#include <ostream>
 #include <stdexcept>
 
 namespace cimg_library { template < class T > class CImg; }
+class Profiler;
 
 using namespace cimg_library;
 
@@ -12,8 +14,16 @@ using namespace cimg_library;
  * This class defines the interface for dense motion extractors. 
  * In this context dense vector field means a vector field that 
  * has a vector assigned at each integer coordinate. 
+ * 
+ * The template parameter T is the scalar type used in the 
+ * computations and in the resulting motion vector fields. The 
+ * motion extractors in this library are instantiated for float 
+ * and double. Single precision halves the memory traffic and 
+ * doubles the width of the vectorized loops. The resulting motion 
+ * fields differ slightly from those computed in double precision, 
+ * see the README for the measured differences.
  */
-class DenseMotionExtractor
+template < class T = double > class DenseMotionExtractor
 {
  public:
   virtual ~DenseMotionExtractor() { }
@@ -27,7 +37,7 @@ class DenseMotionExtractor
    */
   virtual void compute(const CImg< unsigned char > &I1,
                        const CImg< unsigned char > &I2,
-                       CImg< double > &V) = 0;
+                       CImg< T > &V) = 0;
   
   /// Extracts motion between two source images.
   /**
@@ -40,12 +50,15 @@ class DenseMotionExtractor
    */
   virtual void compute(const CImg< unsigned char > &I1,
                        const CImg< unsigned char > &I2,
-                       CImg< double > &VF,
-                       CImg< double > &VB)
+                       CImg< T > &VF,
+                       CImg< T > &VB)
   {
     throw std::runtime_error("Motion extractor does not support computing dual motion fields.");
   }
   
+  /// Returns the stream that diagnostic text is written to, or NULL if the output is disabled.
+  std::ostream *getLogStream() const { return logStream; }
+  
   /// Returns the number of channels in the resulting motion vector field.
   /**
    * The number of channels is 2+number of quality channels (x,y,q1,...).
@@ -55,11 +68,60 @@ class DenseMotionExtractor
   /// Returns the number of quality channels in the resulting motion vector field.
   virtual int getNumResultQualityChannels() const = 0;
   
+  /// Returns the profiler that this motion extractor reports to, or NULL if none has been set.
+  Profiler *getProfiler() const { return profiler; }
+  
   /// Returns true if this motion extractor is dual, i.e. it produces two-directional flows.
   virtual bool isDual() const = 0;
   
-  /// Prints information about the motion extractor and its parameters.
-  virtual void printInfoText() const = 0;
+  /// Writes information about the motion extractor and its parameters to a stream.
+  virtual void printInfoText(std::ostream &out) const = 0;
+  
+  /// Frees the buffers kept between calls to compute.
+  /**
+   * The default implementation does nothing.
+   */
+  virtual void releaseBuffers() { }
+  
+  /// Selects the set of buffers used by the following calls to compute.
+  /**
+   * The pyramidal motion extractors call compute with a different 
+   * image size for each pyramid level, and select the buffer set of 
+   * the level before each call, so that the buffers of one level are 
+   * not reallocated for the next. The default implementation does 
+   * nothing.
+   * @param index index of the buffer set, e.g. the pyramid level
+   */
+  virtual void selectBufferSet(int index) { }
+  
+  /// Sets the stream that diagnostic text is written to.
+  /**
+   * By default the motion extractors write nothing, so that they 
+   * can be used in applications that compute motion in several 
+   * threads without contending for the standard output. If a 
+   * stream is set, the pyramidal motion extractors write their 
+   * parameters (see printInfoText) to it on each call to compute. 
+   * The stream is not owned by this object. If stream is NULL, 
+   * the output is disabled.
+   */
+  void setLogStream(std::ostream *stream) { logStream = stream; }
+  
+  /// Sets the profiler that the running times and counters of compute are reported to.
+  /**
+   * The profiler is not owned by this object. If profiler is NULL, 
+   * nothing is reported. The library must be compiled with 
+   * WITH_PROFILING for the motion extractors to report anything, 
+   * see Profiler.
+   */
+  virtual void setProfiler(Profiler *profiler) { this->profiler = profiler; }
+ protected:
+  // the stream set with setLogStream, or NULL
+  std::ostream *logStream;
+  
+  // the profiler set with setProfiler, or NULL
+  Profiler *profiler;
+  
+  DenseMotionExtractor() : logStream(NULL), profiler(NULL) { }
 };
 
 #define DENSEMOTIONEXTRACTOR_H
@@ -1,100 +1,142 @@
 
 #include "DenseVectorFieldIO.h"
-#include "PXMFileUtils.h"
+#include "DenseVectorFieldWriter.h"
+#include "KITTIFlowIO.h"
+#include "MappedDenseVectorField.h"
+#include "MiddleburyFlowIO.h"
 
 #include "CImg_config.h"
 #include <CImg.h>
-#include <iostream>
 #include <stdexcept>
-#include <stdlib.h>
-#include <string.h>
 
-static const int TOKEN_SIZE = 100;
+template < class T >
+static void readVectorField_(const string &inFileName,
+                             CImg< T > &V,
+                             int numThreads)
+{
+  if(CompressedDenseVectorFieldIO::isCompressedVectorField(inFileName))
+    CompressedDenseVectorFieldIO::readVectorField(inFileName, V, numThreads);
+  else if(MiddleburyFlowIO::isMiddleburyFlow(inFileName))
+    MiddleburyFlowIO::readVectorField(inFileName, V);
+  else if(KITTIFlowIO::isKITTIFlow(inFileName))
+    KITTIFlowIO::readVectorField(inFileName, V);
+  else
+    MappedDenseVectorField(inFileName).getVectorField(V);
+}
 
-void DenseVectorFieldIO::readVectorField(const string &inFileName,
-                                         CImg< double > &V)
+template < class T >
+static void readVectorFieldRegion_(const string &inFileName,
+                                   int x0, int y0, int width, int height,
+                                   CImg< T > &V,
+                                   int numThreads)
 {
-  char token[TOKEN_SIZE];
-  int width, height;
-  float u, v;
-  int x, y;
-  float q;
-  int qc;
-  int numQualityChannels;
-  
-  ifstream inputStream(inFileName.c_str(), ios::binary | ios::in);
-  if(!inputStream)
-    throw runtime_error("File not found.");
-  
-  PNMFileUtils::checkMagicNumber(inputStream, "PDV");
-  
-  // get dimensions
-  PNMFileUtils::extractToken(inputStream, token, TOKEN_SIZE);
-  width = atoi(token);
-  PNMFileUtils::extractToken(inputStream, token, TOKEN_SIZE);
-  height = atoi(token);
-  
-  // read the number of quality channels
-  PNMFileUtils::extractToken(inputStream, token, TOKEN_SIZE);
-  numQualityChannels = atoi(token);
-  char ch;
-  inputStream.read((char *)&ch, sizeof(char));
-  
-  V = CImg< double >(width, height, 1, 2 + numQualityChannels);
-  
-  // read data
-  for(y = 0; y < height; y++)
+  if(CompressedDenseVectorFieldIO::isCompressedVectorField(inFileName))
+    CompressedDenseVectorFieldIO::readVectorFieldRegion(inFileName, x0, y0, width, height, 
+                                                        V, numThreads);
+  else if(MiddleburyFlowIO::isMiddleburyFlow(inFileName) || 
+          KITTIFlowIO::isKITTIFlow(inFileName))
   {
-    for(x = 0; x < width; x++)
-    {
-      inputStream.read((char *)&u, sizeof(float));
-      inputStream.read((char *)&v, sizeof(float));
-      V(x, y, 0) = u;
-      V(x, y, 1) = v;
-      
-      for(qc = 0; qc < numQualityChannels; qc++)
-      {
-        inputStream.read((char *)&q, sizeof(float));
-        V(x, y, 2 + qc) = q;
-      }
-    }
+    // these formats have no random access, so the whole field is read
+    readVectorField_(inFileName, V, numThreads);
+    if(width <= 0 || height <= 0 || x0 < 0 || y0 < 0 || 
+       x0 + width > V.dimx() || y0 + height > V.dimy())
+      throw runtime_error("Invalid region.");
+    V.crop(x0, y0, x0 + width - 1, y0 + height - 1);
   }
-  
-  inputStream.close();
+  else
+    MappedDenseVectorField(inFileName).getVectorField(x0, y0, width, height, V);
+}
+
+bool DenseVectorFieldIO::hasValidityChannel(const string &fileName)
+{
+  return !CompressedDenseVectorFieldIO::isCompressedVectorField(fileName) && 
+         (MiddleburyFlowIO::isMiddleburyFlow(fileName) || KITTIFlowIO::isKITTIFlow(fileName));
+}
+
+void DenseVectorFieldIO::readVectorField(const string &inFileName,
+                                         CImg< double > &V,
+                                         int numThreads)
+{
+  readVectorField_(inFileName, V, numThreads);
+}
+
+void DenseVectorFieldIO::readVectorField(const string &inFileName,
+                                         CImg< float > &V,
+                                         int numThreads)
+{
+  readVectorField_(inFileName, V, numThreads);
+}
+
+void DenseVectorFieldIO::readVectorFieldRegion(const string &inFileName,
+                                               int x0, int y0, int width, int height,
+                                               CImg< double > &V,
+                                               int numThreads)
+{
+  readVectorFieldRegion_(inFileName, x0, y0, width, height, V, numThreads);
+}
+
+void DenseVectorFieldIO::readVectorFieldRegion(const string &inFileName,
+                                               int x0, int y0, int width, int height,
+                                               CImg< float > &V,
+                                               int numThreads)
+{
+  readVectorFieldRegion_(inFileName, x0, y0, width, height, V, numThreads);
 }
 
 void DenseVectorFieldIO::writeVectorField(const CImg< double > &V,
                                           const string &outFileName)
 {
-  float u, v;
-  int x, y;
-  float q;
-  int qc;
-  
-  ofstream outputStream(outFileName.c_str(), ios::binary | ios::out);
-  if(!outputStream)
-    throw runtime_error("Error creating file");
-  
-  char header[100];
-  sprintf(header,"PDV\n%d %d\n%d\n", V.dimx(), V.dimy(), V.dimv() - 2);
-  outputStream.write(header, strlen(header));
-  
-  // write data
-  for(y = 0; y < V.dimy(); y++)
-  {
-    for(x = 0; x < V.dimx(); x++)
-    {
-      u = V(x, y, 0);
-      v = V(x, y, 1);
-      outputStream.write((const char *)&u, sizeof(float));
-      outputStream.write((const char *)&v, sizeof(float));
-      for(qc = 0; qc < V.dimv() - 2; qc++)
-      {
-        q = V(x, y, 2 + qc);
-        outputStream.write((const char *)&q, sizeof(float));
-      }
-    }
-  }
-  
-  outputStream.close();
+  DenseVectorFieldWriter().write(V, outFileName);
+}
+
+void DenseVectorFieldIO::writeVectorField(const CImg< float > &V,
+                                          const string &outFileName)
+{
+  DenseVectorFieldWriter().write(V, outFileName);
+}
+
+template < class T >
+static void writeVectorField_(const CImg< T > &V,
+                              const string &outFileName,
+                              VectorFieldEncoding::Encoding flowEncoding,
+                              VectorFieldEncoding::Encoding qualityEncoding,
+                              int flowScale)
+{
+  DenseVectorFieldWriter writer;
+
+  writer.setFlowEncoding(flowEncoding, flowScale);
+  writer.setQualityEncoding(qualityEncoding);
+  writer.write(V, outFileName);
+}
+
+void DenseVectorFieldIO::writeVectorField(const CImg< double > &V,
+                                          const string &outFileName,
+                                          VectorFieldEncoding::Encoding flowEncoding,
+                                          VectorFieldEncoding::Encoding qualityEncoding,
+                                          int flowScale)
+{
+  writeVectorField_(V, outFileName, flowEncoding, qualityEncoding, flowScale);
+}
+
+void DenseVectorFieldIO::writeVectorField(const CImg< float > &V,
+                                          const string &outFileName,
+                                          VectorFieldEncoding::Encoding flowEncoding,
+                                          VectorFieldEncoding::Encoding qualityEncoding,
+                                          int flowScale)
+{
+  writeVectorField_(V, outFileName, flowEncoding, qualityEncoding, flowScale);
+}
+
+void DenseVectorFieldIO::writeVectorField(const CImg< double > &V,
+                                          const string &outFileName,
+                                          const CompressedDenseVectorFieldIO::Options &options)
+{
+  CompressedDenseVectorFieldIO::writeVectorField(V, outFileName, options);
+}
+
+void DenseVectorFieldIO::writeVectorField(const CImg< float > &V,
+                                          const string &outFileName,
+                                          const CompressedDenseVectorFieldIO::Options &options)
+{
+  CompressedDenseVectorFieldIO::writeVectorField(V, outFileName, options);
 }
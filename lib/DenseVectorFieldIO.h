@@ -1,6 +1,9 @@
 
 #ifndef VECTORFIELDIO_H
 
+#include "CompressedDenseVectorFieldIO.h"
+#include "VectorFieldEncoding.h"
+
 #include <string>
 
 namespace cimg_library { template < class T > class CImg; }
@@ -20,18 +23,120 @@ using namespace std;
  *
  * The data consists of 2+q -dimensional sequentially 
  * ordered vectors originating from each pixel in the raster, 
- * q is the number of quality channels.
+ * q is the number of quality channels. The vectors are stored 
+ * as single-precision floats in the byte order of the machine.
+ *
+ * The files are read through a memory mapping, see 
+ * MappedDenseVectorField. It can also be used directly to access 
+ * the vectors without converting them. The files are written with 
+ * DenseVectorFieldWriter, which can also write them asynchronously 
+ * and store the components with a reduced precision.
+ *
+ * The vector fields can also be written in the compressed PDV2 
+ * format (see CompressedDenseVectorFieldIO) by giving compression 
+ * options. The reading methods detect the format from the magic 
+ * number. They also read the ground truth formats of the optical 
+ * flow benchmarks, Middlebury .flo files (see MiddleburyFlowIO) 
+ * and KITTI PNG files (see KITTIFlowIO).
  */
 class DenseVectorFieldIO
 {
 public:
-  /// Reads a vector field from a file in PDVM format.
+  /// Returns true if the vector fields read from the given file have a validity channel.
+  /**
+   * This is the case for the .flo and KITTI files, whose third 
+   * channel is 1 for the pixels with a known flow and 0 for the 
+   * others. In PDVM and PDV2 files, the third channel is a quality 
+   * channel.
+   */
+  static bool hasValidityChannel(const string &fileName);
+  
+  /// Reads a vector field from a file in PDVM, PDV2, Middlebury .flo or KITTI PNG format.
+  /**
+   * The format is detected from the contents of the file. The 
+   * .flo and KITTI files give a vector field with three channels, 
+   * the third one being 1 for the pixels with a known flow and 0 
+   * for the others (see MiddleburyFlowIO and KITTIFlowIO). Reading 
+   * KITTI files requires libpng. Throws runtime_error if the file 
+   * cannot be read.
+   * @param inFileName the file to read
+   * @param V the vector field
+   * @param numThreads number of threads used for decompressing 
+   *                   PDV2 files, 0 = all available processors
+   */
   static void readVectorField(const string &inFileName,
-                              CImg< double > &V);
+                              CImg< double > &V,
+                              int numThreads = 1);
+  
+  /// Reads a vector field from a file in any of the above formats into a single-precision image.
+  /**
+   * The .flo and PDVM files store single-precision values and the 
+   * KITTI files 1/64-pixel fixed-point values, so these are read 
+   * without loss.
+   */
+  static void readVectorField(const string &inFileName,
+                              CImg< float > &V,
+                              int numThreads = 1);
+  
+  /// Reads a region of a vector field from a file in PDVM, PDV2, Middlebury .flo or KITTI PNG format.
+  /**
+   * For PDVM and PDV2 files only the part of the file containing 
+   * the region is read. The .flo and KITTI formats have no random 
+   * access, so the whole field is read and then cropped to the 
+   * region. V is resized to width x height x 1 x (2+q). Throws 
+   * runtime_error if the region is not inside the vector field.
+   */
+  static void readVectorFieldRegion(const string &inFileName,
+                                    int x0, int y0, int width, int height,
+                                    CImg< double > &V,
+                                    int numThreads = 1);
+  
+  /// Reads a region of a vector field from a file in any of the above formats into a single-precision image.
+  static void readVectorFieldRegion(const string &inFileName,
+                                    int x0, int y0, int width, int height,
+                                    CImg< float > &V,
+                                    int numThreads = 1);
   
   /// Writes a vector field to a file in PDVM format.
   static void writeVectorField(const CImg< double > &V,
                                const string &outFileName);
+  
+  /// Writes a single-precision vector field to a file in PDVM format.
+  static void writeVectorField(const CImg< float > &V,
+                               const string &outFileName);
+  
+  /// Writes a vector field to a file in PDVM format with encoded components.
+  /**
+   * See DenseVectorFieldWriter::setFlowEncoding and 
+   * DenseVectorFieldWriter::setQualityEncoding.
+   * @param V the vector field
+   * @param outFileName the file to write
+   * @param flowEncoding the encoding of the motion vectors
+   * @param qualityEncoding the encoding of the quality channels
+   * @param flowScale the number of units per pixel of the FIXED16 encoding
+   */
+  static void writeVectorField(const CImg< double > &V,
+                               const string &outFileName,
+                               VectorFieldEncoding::Encoding flowEncoding,
+                               VectorFieldEncoding::Encoding qualityEncoding,
+                               int flowScale = 64);
+  
+  /// Writes a single-precision vector field to a file in PDVM format with encoded components.
+  static void writeVectorField(const CImg< float > &V,
+                               const string &outFileName,
+                               VectorFieldEncoding::Encoding flowEncoding,
+                               VectorFieldEncoding::Encoding qualityEncoding,
+                               int flowScale = 64);
+  
+  /// Writes a vector field to a file in PDV2 format.
+  static void writeVectorField(const CImg< double > &V,
+                               const string &outFileName,
+                               const CompressedDenseVectorFieldIO::Options &options);
+  
+  /// Writes a single-precision vector field to a file in PDV2 format.
+  static void writeVectorField(const CImg< float > &V,
+                               const string &outFileName,
+                               const CompressedDenseVectorFieldIO::Options &options);
 };
 
 #define VECTORFIELDIO_H
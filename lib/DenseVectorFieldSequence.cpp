@@ -0,0 +1,316 @@
+
+#include "DenseVectorFieldSequence.h"
+#include "MappedDenseVectorField.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the frames and the index blocks start at multiples of this
+static const uint64_t ALIGNMENT = 4096;
+static const int HEADER_SIZE = 4096;
+static const int INDEX_BLOCK_SIZE = 4096;
+static const int INDEX_BLOCK_HEADER_SIZE = 16;
+static const int INDEX_ENTRY_SIZE = 16;
+static const int NUM_INDEX_BLOCK_ENTRIES = (INDEX_BLOCK_SIZE - INDEX_BLOCK_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+static const uint32_t VERSION = 1;
+
+// the positions of the fields in the header
+static const int NUM_FRAMES_POS = 8;
+static const int FIRST_INDEX_BLOCK_POS = 16;
+
+static void putUInt32_(unsigned char *p, uint32_t value)
+{
+  for(int i = 0; i < 4; i++)
+    p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void putUInt64_(unsigned char *p, uint64_t value)
+{
+  for(int i = 0; i < 8; i++)
+    p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t getUInt32_(const unsigned char *p)
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; i++)
+    value |= (uint32_t)p[i] << (8 * i);
+  return value;
+}
+
+static uint64_t getUInt64_(const unsigned char *p)
+{
+  uint64_t value = 0;
+  for(int i = 0; i < 8; i++)
+    value |= (uint64_t)p[i] << (8 * i);
+  return value;
+}
+
+static uint64_t align_(uint64_t offset)
+{
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// Reads size bytes at the given position. Returns false if the
+// file is too short.
+static bool readAt_(int fd, unsigned char *data, uint64_t size, uint64_t offset)
+{
+  while(size > 0)
+  {
+    ssize_t n = pread(fd, data, size, offset);
+    if(n == -1 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return false;
+    data += n;
+    size -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+DenseVectorFieldSequence::DenseVectorFieldSequence() :
+  fd_(-1),
+  mode_(READ),
+  end_(0) { }
+
+DenseVectorFieldSequence::DenseVectorFieldSequence(const string &fileName, Mode mode) :
+  fd_(-1),
+  mode_(READ),
+  end_(0)
+{
+  open(fileName, mode);
+}
+
+DenseVectorFieldSequence::~DenseVectorFieldSequence()
+{
+  close();
+}
+
+void DenseVectorFieldSequence::appendFrame(const string &header,
+                                           const unsigned char *data,
+                                           uint64_t dataSize)
+{
+  unsigned char buffer[INDEX_ENTRY_SIZE];
+
+  if(fd_ == -1 || mode_ == READ)
+    throw runtime_error("The PDVS file is not opened for writing.");
+
+  const uint64_t k = frameOffsets_.size();
+
+  // Allocate a new index block when the previous one is full. It
+  // is not used by readers before the number of frames is updated.
+  if(k % NUM_INDEX_BLOCK_ENTRIES == 0)
+  {
+    const vector< unsigned char > indexBlock(INDEX_BLOCK_SIZE, 0);
+    const uint64_t indexBlockOffset = end_;
+
+    writeAt_(&indexBlock[0], INDEX_BLOCK_SIZE, indexBlockOffset);
+    putUInt64_(buffer, indexBlockOffset);
+    writeAt_(buffer, 8, k == 0 ? FIRST_INDEX_BLOCK_POS : indexBlockOffsets_.back());
+
+    indexBlockOffsets_.push_back(indexBlockOffset);
+    end_ += INDEX_BLOCK_SIZE;
+  }
+
+  const uint64_t offset = end_;
+  const uint64_t size = header.size() + dataSize;
+
+  writeAt_(header.c_str(), header.size(), offset);
+  writeAt_(data, dataSize, offset + header.size());
+
+  putUInt64_(buffer, offset);
+  putUInt64_(buffer + 8, size);
+  writeAt_(buffer, INDEX_ENTRY_SIZE, indexBlockOffsets_[k / NUM_INDEX_BLOCK_ENTRIES] +
+           INDEX_BLOCK_HEADER_SIZE + (k % NUM_INDEX_BLOCK_ENTRIES) * INDEX_ENTRY_SIZE);
+
+  // the frame becomes visible to readers
+  putUInt64_(buffer, k + 1);
+  writeAt_(buffer, 8, NUM_FRAMES_POS);
+
+  frameOffsets_.push_back(offset);
+  frameSizes_.push_back(size);
+  end_ = align_(offset + size);
+}
+
+void DenseVectorFieldSequence::close()
+{
+  if(fd_ != -1)
+    ::close(fd_);
+
+  fileName_.clear();
+  fd_ = -1;
+  mode_ = READ;
+  vector< uint64_t >().swap(frameOffsets_);
+  vector< uint64_t >().swap(frameSizes_);
+  vector< uint64_t >().swap(indexBlockOffsets_);
+  end_ = 0;
+}
+
+void DenseVectorFieldSequence::getFrame(int k, MappedDenseVectorField &V) const
+{
+  if(k < 0 || k >= getNumFrames())
+    throw runtime_error("Invalid frame index.");
+
+  V.open(fileName_, frameOffsets_[k], frameSizes_[k]);
+}
+
+bool DenseVectorFieldSequence::isVectorFieldSequence(const string &fileName)
+{
+  ifstream inputStream(fileName.c_str(), ios::binary | ios::in);
+  char magic[4];
+
+  inputStream.read(magic, 4);
+
+  return inputStream && memcmp(magic, "PDVS", 4) == 0;
+}
+
+void DenseVectorFieldSequence::open(const string &fileName, Mode mode)
+{
+  struct stat fileStat;
+
+  close();
+
+  if(mode == READ)
+    fd_ = ::open(fileName.c_str(), O_RDONLY);
+  else if(mode == WRITE)
+    fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  else
+    fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0666);
+
+  if(fd_ == -1)
+  {
+    if(mode == READ)
+      throw runtime_error("File not found.");
+    else
+      throw runtime_error("Error creating file " + fileName);
+  }
+
+  fileName_ = fileName;
+  mode_ = mode;
+
+  try
+  {
+    if(fstat(fd_, &fileStat) == -1)
+      throw runtime_error("Invalid PDVS file.");
+
+    if(mode != READ && fileStat.st_size == 0)
+    {
+      vector< unsigned char > header(HEADER_SIZE, 0);
+
+      memcpy(&header[0], "PDVS", 4);
+      putUInt32_(&header[4], VERSION);
+      writeAt_(&header[0], HEADER_SIZE, 0);
+      end_ = align_(HEADER_SIZE);
+    }
+    else
+      readIndex_();
+  }
+  catch(runtime_error &)
+  {
+    close();
+    throw;
+  }
+}
+
+void DenseVectorFieldSequence::readFrame(int k, CImg< double > &V) const
+{
+  MappedDenseVectorField F;
+
+  getFrame(k, F);
+  F.getVectorField(V);
+}
+
+void DenseVectorFieldSequence::readFrame(int k, CImg< float > &V) const
+{
+  MappedDenseVectorField F;
+
+  getFrame(k, F);
+  F.getVectorField(V);
+}
+
+void DenseVectorFieldSequence::refresh()
+{
+  if(fd_ != -1)
+    readIndex_();
+}
+
+void DenseVectorFieldSequence::readIndex_()
+{
+  unsigned char header[FIRST_INDEX_BLOCK_POS + 8];
+  vector< unsigned char > indexBlock(INDEX_BLOCK_SIZE);
+  struct stat fileStat;
+
+  if(fstat(fd_, &fileStat) == -1 || fileStat.st_size < HEADER_SIZE ||
+     !readAt_(fd_, header, sizeof(header), 0) || memcmp(header, "PDVS", 4) != 0)
+    throw runtime_error("Invalid PDVS file.");
+  if(getUInt32_(header + 4) != VERSION)
+    throw runtime_error("Unsupported PDVS version.");
+
+  const uint64_t fileSize = fileStat.st_size;
+  const uint64_t numFrames = getUInt64_(header + NUM_FRAMES_POS);
+  uint64_t indexBlockOffset = getUInt64_(header + FIRST_INDEX_BLOCK_POS);
+
+  // each frame starts at a different multiple of the alignment
+  if(numFrames > fileSize / ALIGNMENT)
+    throw runtime_error("Invalid PDVS header.");
+
+  frameOffsets_.clear();
+  frameSizes_.clear();
+  indexBlockOffsets_.clear();
+  end_ = align_(HEADER_SIZE);
+
+  for(uint64_t k = 0; k < numFrames; k += NUM_INDEX_BLOCK_ENTRIES)
+  {
+    if(indexBlockOffset < HEADER_SIZE || indexBlockOffset % ALIGNMENT != 0 ||
+       !readAt_(fd_, &indexBlock[0], INDEX_BLOCK_SIZE, indexBlockOffset))
+      throw runtime_error("Invalid PDVS index.");
+
+    indexBlockOffsets_.push_back(indexBlockOffset);
+    end_ = max(end_, indexBlockOffset + INDEX_BLOCK_SIZE);
+
+    const uint64_t n = min(numFrames - k, (uint64_t)NUM_INDEX_BLOCK_ENTRIES);
+    for(uint64_t i = 0; i < n; i++)
+    {
+      const unsigned char *entry = &indexBlock[INDEX_BLOCK_HEADER_SIZE + i * INDEX_ENTRY_SIZE];
+      const uint64_t offset = getUInt64_(entry);
+      const uint64_t size = getUInt64_(entry + 8);
+
+      if(offset < HEADER_SIZE || offset % ALIGNMENT != 0 || size == 0 ||
+         offset > fileSize || size > fileSize - offset)
+        throw runtime_error("Invalid PDVS index.");
+
+      frameOffsets_.push_back(offset);
+      frameSizes_.push_back(size);
+      end_ = max(end_, align_(offset + size));
+    }
+
+    indexBlockOffset = getUInt64_(&indexBlock[0]);
+  }
+}
+
+void DenseVectorFieldSequence::writeAt_(const void *data, uint64_t size, uint64_t offset)
+{
+  const unsigned char *p = (const unsigned char *)data;
+
+  while(size > 0)
+  {
+    ssize_t n = pwrite(fd_, p, size, offset);
+    if(n == -1 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      throw runtime_error("Error writing file " + fileName_);
+    p += n;
+    size -= n;
+    offset += n;
+  }
+}
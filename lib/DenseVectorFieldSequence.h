@@ -0,0 +1,157 @@
+
+#ifndef DENSEVECTORFIELDSEQUENCE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace cimg_library { template < class T > class CImg; }
+
+class MappedDenseVectorField;
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements a PDVS file holding a sequence of dense vector fields.
+/**
+ * A PDVS file stores the motion fields of a frame sequence in one
+ * file instead of one PDVM file per frame pair. Each frame is
+ * stored as a complete PDVM file (see DenseVectorFieldIO and
+ * DenseVectorFieldWriter, the encoded PDVE variant is also
+ * allowed) starting at a multiple of 4096 bytes, and an index
+ * gives the position of each frame. A frame can therefore be
+ * located without reading the preceding frames, and it can be
+ * memory-mapped directly (see getFrame).
+ *
+ * Frames are appended to the end of the file, and nothing that
+ * has been written before is overwritten, so a file is valid
+ * after each appended frame. A reader can call refresh to see
+ * the frames appended since the file was opened, e.g. while the
+ * motion of a video is being computed. If the writing process is
+ * interrupted, the file contains the frames appended before the
+ * interruption.
+ *
+ * The index is stored in blocks of 4096 bytes that are allocated
+ * among the frames as needed and linked to each other. The
+ * integers in the header and the index blocks are stored in
+ * little-endian byte order:
+ *   header (4096 bytes):
+ *     "PDVS"                   magic number (4 bytes)
+ *     version                  uint32, currently 1
+ *     numframes                uint64
+ *     firstindexblock          uint64, the position of the first index block
+ *   index block (4096 bytes):
+ *     nextindexblock           uint64, the position of the next index block
+ *     (reserved)               8 bytes
+ *     (offset, size) * 255     the position and size of each frame as uint64 pairs
+ *
+ * The number of frames in the header is updated only after the
+ * frame and its index entry have been written.
+ *
+ * Frames are usually appended with DenseVectorFieldWriter, which
+ * converts the vector fields and can write them in a background
+ * thread.
+ */
+class DenseVectorFieldSequence
+{
+public:
+  /// The modes of opening a file.
+  enum Mode
+  {
+    READ,     ///< read the frames of an existing file
+    WRITE,    ///< create a new file, or truncate an existing one, and append frames to it
+    APPEND    ///< append frames to an existing file, or create a new one
+  };
+
+  /// Constructs an object with no file opened.
+  DenseVectorFieldSequence();
+
+  /// Opens a PDVS file, see open.
+  explicit DenseVectorFieldSequence(const string &fileName, Mode mode = READ);
+
+  /// Closes the file.
+  ~DenseVectorFieldSequence();
+
+  /// Appends a frame given as the contents of a PDVM file.
+  /**
+   * The frame consists of the PDVM header followed by the data.
+   * This is used by DenseVectorFieldWriter. Throws runtime_error
+   * if the file is not opened for writing or if writing fails.
+   */
+  void appendFrame(const string &header, const unsigned char *data, uint64_t dataSize);
+
+  /// Closes the file, if one is opened.
+  void close();
+
+  /// Maps frame k into memory.
+  /**
+   * Throws runtime_error if k is not a valid frame index or if
+   * the frame is not a valid PDVM file.
+   */
+  void getFrame(int k, MappedDenseVectorField &V) const;
+
+  /// Returns the name of the opened file.
+  const string &getFileName() const { return fileName_; }
+
+  /// Returns the number of frames.
+  /**
+   * If frames are appended by DenseVectorFieldWriter in
+   * asynchronous mode, the writer must be flushed first.
+   */
+  int getNumFrames() const { return frameOffsets_.size(); }
+
+  /// Returns true if a file is opened.
+  bool isOpen() const { return fd_ != -1; }
+
+  /// Returns true if the given file is in PDVS format.
+  static bool isVectorFieldSequence(const string &fileName);
+
+  /// Opens a PDVS file.
+  /**
+   * A previously opened file is closed first. Throws
+   * runtime_error if the file cannot be opened or if it is not a
+   * valid PDVS file.
+   */
+  void open(const string &fileName, Mode mode = READ);
+
+  /// Reads frame k.
+  /**
+   * V is resized to width x height x 1 x (2+q). Throws
+   * runtime_error if k is not a valid frame index.
+   */
+  void readFrame(int k, CImg< double > &V) const;
+
+  /// Reads frame k into a single-precision image.
+  void readFrame(int k, CImg< float > &V) const;
+
+  /// Reads the index again to find the frames appended since the file was opened.
+  void refresh();
+private:
+  string fileName_;
+  int fd_;
+  Mode mode_;
+
+  // the positions and sizes of the frames
+  vector< uint64_t > frameOffsets_;
+  vector< uint64_t > frameSizes_;
+
+  // the positions of the index blocks
+  vector< uint64_t > indexBlockOffsets_;
+
+  // the end of the last frame or index block, rounded up to the alignment
+  uint64_t end_;
+
+  // copying is not supported
+  DenseVectorFieldSequence(const DenseVectorFieldSequence &);
+  DenseVectorFieldSequence &operator=(const DenseVectorFieldSequence &);
+
+  // reads the header and the index
+  void readIndex_();
+
+  // writes size bytes at the given position
+  void writeAt_(const void *data, uint64_t size, uint64_t offset);
+};
+
+#define DENSEVECTORFIELDSEQUENCE_H
+
+#endif
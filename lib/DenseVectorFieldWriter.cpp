@@ -0,0 +1,419 @@
+
+#include "DenseVectorFieldSequence.h"
+#include "DenseVectorFieldWriter.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <stdio.h>
+
+using namespace VectorFieldEncoding;
+
+// the number of values converted and written at a time by synchronous writes
+static const int BLOCK_SIZE = 256 * 1024;
+
+// the number of double-precision values converted to single precision at a time
+static const unsigned long CHUNK_SIZE = 1024;
+
+// Converts rows y0...y1-1 of V to interleaved single-precision vectors.
+template < class T >
+static void convertRows_(const CImg< T > &V, int y0, int y1, float *dst)
+{
+  const int C = V.dimv();
+  const unsigned long n = (unsigned long)(y1 - y0) * V.dimx();
+
+  if(C == 3)
+  {
+    const T *u = V.ptr(0, y0, 0, 0);
+    const T *v = V.ptr(0, y0, 0, 1);
+    const T *q = V.ptr(0, y0, 0, 2);
+    for(unsigned long i = 0; i < n; i++, dst += 3)
+    {
+      dst[0] = u[i];
+      dst[1] = v[i];
+      dst[2] = q[i];
+    }
+  }
+  else
+  {
+    vector< const T * > channels(C);
+    for(int c = 0; c < C; c++)
+      channels[c] = V.ptr(0, y0, 0, c);
+    for(unsigned long i = 0; i < n; i++)
+      for(int c = 0; c < C; c++)
+        *dst++ = channels[c][i];
+  }
+}
+
+// Encodes n values of a channel.
+static void encodeValues_(const float *src, unsigned char *dst, unsigned long n,
+                          Encoding encoding, int scale)
+{
+  encode(src, dst, n, encoding, scale);
+}
+
+// Encodes n values of a channel. The values are converted to
+// single precision in chunks first.
+static void encodeValues_(const double *src, unsigned char *dst, unsigned long n,
+                          Encoding encoding, int scale)
+{
+  float buffer[CHUNK_SIZE];
+  const int size = getEncodingSize(encoding);
+
+  for(unsigned long i = 0; i < n; i += CHUNK_SIZE)
+  {
+    const unsigned long m = min(n - i, CHUNK_SIZE);
+    for(unsigned long j = 0; j < m; j++)
+      buffer[j] = src[i + j];
+    encode(buffer, dst + i * size, m, encoding, scale);
+  }
+}
+
+DenseVectorFieldWriter::DenseVectorFieldWriter(bool async) :
+  async_(async),
+  flowEncoding_(FLOAT32),
+  qualityEncoding_(FLOAT32),
+  flowScale_(DEFAULT_FLOW_SCALE),
+  writing_(false),
+  stopping_(false)
+{
+  if(async_)
+  {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&jobAdded_, NULL);
+    pthread_cond_init(&jobDone_, NULL);
+    if(pthread_create(&thread_, NULL, run_, this) != 0)
+    {
+      pthread_cond_destroy(&jobDone_);
+      pthread_cond_destroy(&jobAdded_);
+      pthread_mutex_destroy(&mutex_);
+      throw runtime_error("Error creating the writer thread.");
+    }
+  }
+}
+
+DenseVectorFieldWriter::~DenseVectorFieldWriter()
+{
+  if(async_)
+  {
+    pthread_mutex_lock(&mutex_);
+    stopping_ = true;
+    pthread_cond_signal(&jobAdded_);
+    pthread_mutex_unlock(&mutex_);
+    pthread_join(thread_, NULL);
+
+    for(unsigned int i = 0; i < freeJobs_.size(); i++)
+      delete freeJobs_[i];
+
+    pthread_cond_destroy(&jobDone_);
+    pthread_cond_destroy(&jobAdded_);
+    pthread_mutex_destroy(&mutex_);
+  }
+}
+
+void DenseVectorFieldWriter::flush()
+{
+  if(!async_)
+    return;
+
+  pthread_mutex_lock(&mutex_);
+  while(!pendingJobs_.empty() || writing_)
+    pthread_cond_wait(&jobDone_, &mutex_);
+  pthread_mutex_unlock(&mutex_);
+
+  checkError_();
+}
+
+Encoding DenseVectorFieldWriter::getFlowEncoding() const
+{
+  return flowEncoding_;
+}
+
+int DenseVectorFieldWriter::getFlowScale() const
+{
+  return flowScale_;
+}
+
+Encoding DenseVectorFieldWriter::getQualityEncoding() const
+{
+  return qualityEncoding_;
+}
+
+bool DenseVectorFieldWriter::isAsync() const
+{
+  return async_;
+}
+
+void DenseVectorFieldWriter::setFlowEncoding(Encoding encoding, int scale)
+{
+  if(encoding != FLOAT32 && encoding != FLOAT16 && encoding != FIXED16)
+    throw invalid_argument("Unsupported motion vector encoding.");
+  if(scale <= 0)
+    throw invalid_argument("The scale must be positive.");
+
+  flowEncoding_ = encoding;
+  flowScale_ = scale;
+}
+
+void DenseVectorFieldWriter::setQualityEncoding(Encoding encoding)
+{
+  if(encoding == FIXED16)
+    throw invalid_argument("Unsupported quality channel encoding.");
+
+  qualityEncoding_ = encoding;
+}
+
+void DenseVectorFieldWriter::write(const CImg< double > &V,
+                                   const string &outFileName)
+{
+  write_(V, outFileName, NULL);
+}
+
+void DenseVectorFieldWriter::write(const CImg< float > &V,
+                                   const string &outFileName)
+{
+  write_(V, outFileName, NULL);
+}
+
+void DenseVectorFieldWriter::write(const CImg< double > &V,
+                                   DenseVectorFieldSequence &sequence)
+{
+  write_(V, sequence.getFileName(), &sequence);
+}
+
+void DenseVectorFieldWriter::write(const CImg< float > &V,
+                                   DenseVectorFieldSequence &sequence)
+{
+  write_(V, sequence.getFileName(), &sequence);
+}
+
+void DenseVectorFieldWriter::checkError_()
+{
+  pthread_mutex_lock(&mutex_);
+  string error = error_;
+  error_.clear();
+  pthread_mutex_unlock(&mutex_);
+
+  if(!error.empty())
+    throw runtime_error(error);
+}
+
+// The number of quality channels is preceded by spaces so that
+// the data is aligned to four bytes, and it can be used in place
+// by MappedDenseVectorField.
+string DenseVectorFieldWriter::getHeader_(int width, int height, int numChannels) const
+{
+  char header[200];
+  char encodings[100] = "";
+
+  if(isEncoded_())
+  {
+    sprintf(encodings, "%s %s %d\n", getEncodingName(flowEncoding_),
+            getEncodingName(qualityEncoding_), flowScale_);
+  }
+
+  const char *magic = isEncoded_() ? "PDVE" : "PDV";
+  int padding = (4 - sprintf(header, "%s\n%d %d\n%d\n%s", magic, width, height,
+                             numChannels - 2, encodings) % 4) % 4;
+  int headerSize = sprintf(header, "%s\n%d %d\n%*s%d\n%s", magic, width, height, 
+                           padding, "", numChannels - 2, encodings);
+
+  return string(header, headerSize);
+}
+
+bool DenseVectorFieldWriter::isEncoded_() const
+{
+  return flowEncoding_ != FLOAT32 || qualityEncoding_ != FLOAT32;
+}
+
+DenseVectorFieldWriter::Job_ *DenseVectorFieldWriter::getFreeJob_()
+{
+  Job_ *job;
+
+  pthread_mutex_lock(&mutex_);
+  while(pendingJobs_.size() + (writing_ ? 1 : 0) >= MAX_NUM_PENDING_JOBS_)
+    pthread_cond_wait(&jobDone_, &mutex_);
+
+  if(!freeJobs_.empty())
+  {
+    job = freeJobs_.back();
+    freeJobs_.pop_back();
+  }
+  else
+    job = new Job_();
+  pthread_mutex_unlock(&mutex_);
+
+  return job;
+}
+
+void *DenseVectorFieldWriter::run_(void *writer)
+{
+  DenseVectorFieldWriter &w = *(DenseVectorFieldWriter *)writer;
+  Job_ *job;
+
+  pthread_mutex_lock(&w.mutex_);
+  while(true)
+  {
+    while(w.pendingJobs_.empty() && !w.stopping_)
+      pthread_cond_wait(&w.jobAdded_, &w.mutex_);
+    if(w.pendingJobs_.empty())
+      break;
+
+    job = w.pendingJobs_.front();
+    w.pendingJobs_.pop_front();
+    w.writing_ = true;
+    pthread_mutex_unlock(&w.mutex_);
+
+    string error;
+    try
+    {
+      writeJob_(*job);
+    }
+    catch(exception &e)
+    {
+      error = e.what();
+    }
+
+    pthread_mutex_lock(&w.mutex_);
+    w.writing_ = false;
+    if(!error.empty() && w.error_.empty())
+      w.error_ = error;
+    w.freeJobs_.push_back(job);
+    pthread_cond_broadcast(&w.jobDone_);
+  }
+  pthread_mutex_unlock(&w.mutex_);
+
+  return NULL;
+}
+
+template < class T >
+void DenseVectorFieldWriter::convert_(const CImg< T > &V, Job_ &job) const
+{
+  const int H = V.dimy();
+  const int C = V.dimv();
+  const unsigned long numPixels = (unsigned long)V.dimx() * H;
+
+  job.header = getHeader_(V.dimx(), H, C);
+
+  if(!isEncoded_())
+  {
+    job.data.resize(numPixels * C * sizeof(float));
+    if(!job.data.empty())
+      convertRows_(V, 0, H, (float *)&job.data[0]);
+  }
+  else
+  {
+    const int flowSize = getEncodingSize(flowEncoding_);
+    const int qualitySize = getEncodingSize(qualityEncoding_);
+    job.data.resize(numPixels * (2 * flowSize + (C - 2) * qualitySize));
+
+    unsigned char *dst = job.data.empty() ? NULL : &job.data[0];
+    for(int c = 0; c < C; c++)
+    {
+      const Encoding encoding = c < 2 ? flowEncoding_ : qualityEncoding_;
+      encodeValues_(V.ptr(0, 0, 0, c), dst, numPixels, encoding, flowScale_);
+      dst += numPixels * getEncodingSize(encoding);
+    }
+  }
+}
+
+template < class T >
+void DenseVectorFieldWriter::write_(const CImg< T > &V,
+                                    const string &outFileName,
+                                    DenseVectorFieldSequence *sequence)
+{
+  const int W = V.dimx();
+  const int H = V.dimy();
+  const int C = V.dimv();
+  const bool isEncoded = isEncoded_();
+
+  if(async_)
+  {
+    checkError_();
+
+    Job_ *job = getFreeJob_();
+    job->fileName = outFileName;
+    job->sequence = sequence;
+    convert_(V, *job);
+
+    pthread_mutex_lock(&mutex_);
+    pendingJobs_.push_back(job);
+    pthread_cond_signal(&jobAdded_);
+    pthread_mutex_unlock(&mutex_);
+  }
+  else if(sequence != NULL)
+  {
+    // A frame is appended as a whole, so it is converted at once.
+    syncJob_.fileName = outFileName;
+    syncJob_.sequence = sequence;
+    convert_(V, syncJob_);
+    writeJob_(syncJob_);
+  }
+  else
+  {
+    ofstream outputStream(outFileName.c_str(), ios::binary | ios::out);
+    if(!outputStream)
+      throw runtime_error("Error creating file " + outFileName);
+
+    const string header = getHeader_(W, H, C);
+    outputStream.write(header.c_str(), header.size());
+
+    if(!isEncoded)
+    {
+      const int blockHeight = max(1, BLOCK_SIZE / max(1, W * C));
+      buffer_.resize((unsigned long)min(blockHeight, H) * W * C * sizeof(float));
+      for(int y = 0; y < H && !buffer_.empty(); y += blockHeight)
+      {
+        const int y1 = min(y + blockHeight, H);
+        convertRows_(V, y, y1, (float *)&buffer_[0]);
+        outputStream.write((const char *)&buffer_[0],
+                           (unsigned long)(y1 - y) * W * C * sizeof(float));
+      }
+    }
+    else
+    {
+      // the channels are stored in planes
+      const int blockHeight = max(1, BLOCK_SIZE / max(1, W));
+      buffer_.resize((unsigned long)min(blockHeight, H) * W * sizeof(float));
+      for(int c = 0; c < C; c++)
+      {
+        const Encoding encoding = c < 2 ? flowEncoding_ : qualityEncoding_;
+        for(int y = 0; y < H && !buffer_.empty(); y += blockHeight)
+        {
+          const int y1 = min(y + blockHeight, H);
+          const unsigned long n = (unsigned long)(y1 - y) * W;
+          encodeValues_(V.ptr(0, y, 0, c), &buffer_[0], n, encoding, flowScale_);
+          outputStream.write((const char *)&buffer_[0], n * getEncodingSize(encoding));
+        }
+      }
+    }
+
+    outputStream.close();
+    if(!outputStream)
+      throw runtime_error("Error writing file " + outFileName);
+  }
+}
+
+void DenseVectorFieldWriter::writeJob_(const Job_ &job)
+{
+  if(job.sequence != NULL)
+  {
+    job.sequence->appendFrame(job.header, job.data.empty() ? NULL : &job.data[0],
+                              job.data.size());
+    return;
+  }
+
+  ofstream outputStream(job.fileName.c_str(), ios::binary | ios::out);
+  if(!outputStream)
+    throw runtime_error("Error creating file " + job.fileName);
+
+  outputStream.write(job.header.c_str(), job.header.size());
+  if(!job.data.empty())
+    outputStream.write((const char *)&job.data[0], job.data.size());
+
+  outputStream.close();
+  if(!outputStream)
+    throw runtime_error("Error writing file " + job.fileName);
+}
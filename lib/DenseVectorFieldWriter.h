@@ -0,0 +1,184 @@
+
+#ifndef DENSEVECTORFIELDWRITER_H
+
+#include "VectorFieldEncoding.h"
+
+#include <deque>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace cimg_library { template < class T > class CImg; }
+
+class DenseVectorFieldSequence;
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements buffered and asynchronous writing of dense vector fields.
+/**
+ * The vector fields are written in PDVM format (see
+ * DenseVectorFieldIO). The vectors are converted to single
+ * precision and interleaved into a float buffer, which is written
+ * in large blocks. The buffers are reused between calls.
+ *
+ * The motion vectors and the quality channels can also be stored
+ * with a reduced precision, see setFlowEncoding and
+ * setQualityEncoding. The file is then written in the PDVE variant
+ * of the format, whose header declares the encodings:
+ * PDVE
+ * [width] [height]
+ * [numqualitychannels]
+ * [flowencoding] [qualityencoding] [flowscale]
+ *
+ * where the encodings are given by their names (see
+ * VectorFieldEncoding) and flowscale is the number of units per
+ * pixel of the FIXED16 encoding. In a PDVE file, the components
+ * are stored in planes (all u components in raster order, then
+ * all v components, then each quality channel) in the byte order
+ * of the machine.
+ *
+ * In asynchronous mode, write converts the vector field into a
+ * buffer and returns, and a background thread writes the buffer
+ * to the file. The caller can then modify the vector field, e.g.
+ * compute the motion of the next frame, while the file is being
+ * written. The files are written in the order of the write calls.
+ * At most a few fields are kept in memory: write waits for the
+ * background thread if more are pending.
+ *
+ * The vector fields can also be appended as frames to a PDVS file
+ * (see DenseVectorFieldSequence). The file must stay open until
+ * the pending writes have completed.
+ *
+ * Errors of asynchronous writes are reported by throwing
+ * runtime_error from the next call to write or flush. The
+ * destructor waits for the pending writes but does not report
+ * errors, so flush should be called before destroying the writer.
+ *
+ * A writer must only be used from one thread at a time.
+ */
+class DenseVectorFieldWriter
+{
+public:
+  /// Constructs a writer. If async is true, the files are written by a background thread.
+  DenseVectorFieldWriter(bool async = false);
+
+  /// Waits for the pending writes and stops the background thread.
+  ~DenseVectorFieldWriter();
+
+  /// Waits until all pending writes have completed.
+  /**
+   * Throws runtime_error if an asynchronous write has failed
+   * since the previous call to write or flush.
+   */
+  void flush();
+
+  /// Returns the encoding of the motion vectors.
+  VectorFieldEncoding::Encoding getFlowEncoding() const;
+
+  /// Returns the number of units per pixel of the FIXED16 encoding of the motion vectors.
+  int getFlowScale() const;
+
+  /// Returns the encoding of the quality channels.
+  VectorFieldEncoding::Encoding getQualityEncoding() const;
+
+  /// Returns true if the files are written by a background thread.
+  bool isAsync() const;
+
+  /// Sets the encoding of the motion vectors (FLOAT32, FLOAT16 or FIXED16).
+  /**
+   * The default is FLOAT32. Throws invalid_argument if the encoding
+   * is not supported for motion vectors or if scale is not positive.
+   * @param encoding the encoding
+   * @param scale the number of units per pixel of the FIXED16 encoding
+   */
+  void setFlowEncoding(VectorFieldEncoding::Encoding encoding, int scale = DEFAULT_FLOW_SCALE);
+
+  /// Sets the encoding of the quality channels (FLOAT32, FLOAT16, UNORM16 or UNORM8).
+  /**
+   * The default is FLOAT32. Throws invalid_argument if the encoding
+   * is not supported for quality channels.
+   */
+  void setQualityEncoding(VectorFieldEncoding::Encoding encoding);
+
+  /// Writes a vector field to a file in PDVM format.
+  void write(const CImg< double > &V, const string &outFileName);
+
+  /// Writes a single-precision vector field to a file in PDVM format.
+  void write(const CImg< float > &V, const string &outFileName);
+
+  /// Appends a vector field to a PDVS file opened for writing.
+  void write(const CImg< double > &V, DenseVectorFieldSequence &sequence);
+
+  /// Appends a single-precision vector field to a PDVS file opened for writing.
+  void write(const CImg< float > &V, DenseVectorFieldSequence &sequence);
+
+  /// The default number of units per pixel of the FIXED16 encoding (1/64 pixel precision).
+  static const int DEFAULT_FLOW_SCALE = 64;
+private:
+  // a vector field converted for writing
+  struct Job_
+  {
+    string fileName;
+    DenseVectorFieldSequence *sequence;   // NULL if the field is written to fileName
+    string header;
+    vector< unsigned char > data;
+  };
+
+  static const unsigned int MAX_NUM_PENDING_JOBS_ = 2;
+
+  bool async_;
+  VectorFieldEncoding::Encoding flowEncoding_;
+  VectorFieldEncoding::Encoding qualityEncoding_;
+  int flowScale_;
+
+  // the conversion buffer of synchronous writes
+  vector< unsigned char > buffer_;
+
+  // the converted field of synchronous writes to a PDVS file
+  Job_ syncJob_;
+
+  // the state shared with the background thread
+  pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t jobAdded_;
+  pthread_cond_t jobDone_;
+  deque< Job_ * > pendingJobs_;
+  vector< Job_ * > freeJobs_;
+  bool writing_;
+  bool stopping_;
+  string error_;
+
+  // copying is not supported
+  DenseVectorFieldWriter(const DenseVectorFieldWriter &);
+  DenseVectorFieldWriter &operator=(const DenseVectorFieldWriter &);
+
+  // throws the error of a failed asynchronous write, if any
+  void checkError_();
+
+  // takes a job from freeJobs_ or allocates a new one
+  Job_ *getFreeJob_();
+
+  // converts a vector field into job
+  template < class T >
+  void convert_(const CImg< T > &V, Job_ &job) const;
+
+  // returns the header of a file
+  string getHeader_(int width, int height, int numChannels) const;
+
+  // returns true if the file is written in the PDVE variant
+  bool isEncoded_() const;
+
+  // the main loop of the background thread
+  static void *run_(void *writer);
+
+  template < class T >
+  void write_(const CImg< T > &V, const string &outFileName,
+              DenseVectorFieldSequence *sequence);
+
+  static void writeJob_(const Job_ &job);
+};
+
+#define DENSEVECTORFIELDWRITER_H
+
+#endif
@@ -4,11 +4,15 @@
 #include "CImg_config.h"
 #include <CImg.h>
 
-void DualDenseMotionExtractor::compute(const CImg< unsigned char > &I1,
-                                       const CImg< unsigned char > &I2,
-                                       CImg< double > &V)
+template < class T >
+void DualDenseMotionExtractor< T >::compute(const CImg< unsigned char > &I1,
+                                            const CImg< unsigned char > &I2,
+                                            CImg< T > &V)
 {
-  CImg< double > VB;
+  CImg< T > VB;
   
   return compute(I1, I2, V, VB);
 }
+
+template class DualDenseMotionExtractor< float >;
+template class DualDenseMotionExtractor< double >;
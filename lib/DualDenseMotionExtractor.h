@@ -13,14 +13,14 @@ using namespace cimg_library;
  * A dual motion field consists of the forward motion field (I1->I2) and the 
  * backward motion field (I2->I1).
  */
-class DualDenseMotionExtractor : public DenseMotionExtractor
+template < class T = double > class DualDenseMotionExtractor : public DenseMotionExtractor< T >
 {
  public:
   virtual ~DualDenseMotionExtractor() { }
   
   void compute(const CImg< unsigned char > &I1,
                const CImg< unsigned char > &I2,
-               CImg< double > &V);
+               CImg< T > &V);
   
   /// Extracts the dual motion field between two source images.
   /**
@@ -32,8 +32,8 @@ class DualDenseMotionExtractor : public DenseMotionExtractor
    */
   virtual void compute(const CImg< unsigned char > &I1,
                        const CImg< unsigned char > &I2,
-                       CImg< double > &VF,
-                       CImg< double > &VB) = 0;
+                       CImg< T > &VF,
+                       CImg< T > &VB) = 0;
 };
 
 #define DUALDENSEMOTIONEXTRACTOR_H
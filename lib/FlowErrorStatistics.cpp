@@ -0,0 +1,108 @@
+
+#include "FlowErrorStatistics.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <math.h>
+#include <stdexcept>
+
+using namespace std;
+
+// the endpoint error thresholds of the R1, R3 and R5 measures
+static const double OUTLIER_THRESHOLDS[3] = { 1.0, 3.0, 5.0 };
+
+// the endpoint error threshold of the Fl measure, both absolute
+// and relative to the length of the ground truth vector
+static const double FL_THRESHOLD = 3.0;
+static const double FL_RELATIVE_THRESHOLD = 0.05;
+
+FlowErrorStatistics::FlowErrorStatistics()
+{
+  reset();
+}
+
+void FlowErrorStatistics::add(const CImg< double > &V, const CImg< double > &Vgt, int validChannel)
+{
+  add_(V, Vgt, validChannel);
+}
+
+void FlowErrorStatistics::add(const CImg< float > &V, const CImg< float > &Vgt, int validChannel)
+{
+  add_(V, Vgt, validChannel);
+}
+
+void FlowErrorStatistics::add(const FlowErrorStatistics &statistics)
+{
+  numPixels_ += statistics.numPixels_;
+  sumAngularError_ += statistics.sumAngularError_;
+  sumEndpointError_ += statistics.sumEndpointError_;
+  for(int i = 0; i < 4; i++)
+    numOutliers_[i] += statistics.numOutliers_[i];
+}
+
+double FlowErrorStatistics::getAverageAngularError() const
+{
+  return numPixels_ > 0 ? sumAngularError_ / numPixels_ : 0.0;
+}
+
+double FlowErrorStatistics::getAverageEndpointError() const
+{
+  return numPixels_ > 0 ? sumEndpointError_ / numPixels_ : 0.0;
+}
+
+long FlowErrorStatistics::getNumPixels() const
+{
+  return numPixels_;
+}
+
+double FlowErrorStatistics::getOutlierPercentage(OutlierMeasure measure) const
+{
+  return numPixels_ > 0 ? 100.0 * numOutliers_[measure] / numPixels_ : 0.0;
+}
+
+void FlowErrorStatistics::reset()
+{
+  numPixels_ = 0;
+  sumAngularError_ = 0.0;
+  sumEndpointError_ = 0.0;
+  for(int i = 0; i < 4; i++)
+    numOutliers_[i] = 0;
+}
+
+template < class T >
+void FlowErrorStatistics::add_(const CImg< T > &V, const CImg< T > &Vgt, int validChannel)
+{
+  if(V.dimx() != Vgt.dimx() || V.dimy() != Vgt.dimy() ||
+     V.dimv() < 2 || Vgt.dimv() < 2 || validChannel >= Vgt.dimv())
+    throw runtime_error("The dimensions of the motion field and the ground truth do not match.");
+
+  cimg_forXY(V, x, y)
+  {
+    if(validChannel >= 0 && Vgt(x, y, 0, validChannel) == 0)
+      continue;
+
+    const double u = V(x, y, 0, 0);
+    const double v = V(x, y, 0, 1);
+    const double ug = Vgt(x, y, 0, 0);
+    const double vg = Vgt(x, y, 0, 1);
+
+    const double du = u - ug;
+    const double dv = v - vg;
+    const double epe = sqrt(du*du + dv*dv);
+
+    double c = (u*ug + v*vg + 1.0) / sqrt((u*u + v*v + 1.0) * (ug*ug + vg*vg + 1.0));
+    c = c < -1.0 ? -1.0 : (c > 1.0 ? 1.0 : c);
+
+    numPixels_++;
+    sumEndpointError_ += epe;
+    sumAngularError_ += acos(c) * 180.0 / M_PI;
+
+    for(int i = 0; i < 3; i++)
+    {
+      if(epe > OUTLIER_THRESHOLDS[i])
+        numOutliers_[i]++;
+    }
+    if(epe > FL_THRESHOLD && epe > FL_RELATIVE_THRESHOLD * sqrt(ug*ug + vg*vg))
+      numOutliers_[FL]++;
+  }
+}
@@ -0,0 +1,78 @@
+
+#ifndef FLOWERRORSTATISTICS_H
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+
+/// Accumulates the errors of motion fields with respect to the ground truth.
+/**
+ * The errors of each pixel with a known ground truth vector are
+ * accumulated over calls of add, so the statistics can cover a
+ * single pair of images or a whole data set. The measures are
+ * those of the Middlebury and KITTI optical flow benchmarks:
+ *   - the average endpoint error (AEPE) |(u,v) - (ug,vg)|,
+ *   - the average angular error (AAE) between the space-time
+ *     vectors (u,v,1) and (ug,vg,1) (in degrees),
+ *   - the percentages of pixels with an endpoint error larger than
+ *     1, 3 and 5 pixels (R1, R3, R5),
+ *   - the KITTI Fl measure, i.e. the percentage of pixels with an
+ *     endpoint error larger than 3 pixels and 5% of the length of
+ *     the ground truth vector.
+ *
+ * If a validity channel of the ground truth is given, the pixels
+ * where it is zero are ignored. The .flo and KITTI ground truth
+ * has one in its third channel (see MiddleburyFlowIO, KITTIFlowIO
+ * and DenseVectorFieldIO::hasValidityChannel).
+ */
+class FlowErrorStatistics
+{
+public:
+  /// The outlier measures.
+  enum OutlierMeasure { R1, R3, R5, FL };
+
+  /// Constructs empty statistics.
+  FlowErrorStatistics();
+
+  /// Adds the errors of a motion field V with respect to the ground truth Vgt.
+  /**
+   * If validChannel is nonnegative, the pixels where this channel 
+   * of Vgt is zero are ignored. Otherwise all pixels have a known 
+   * ground truth vector. Throws runtime_error if the dimensions of 
+   * V and Vgt differ or Vgt has no channel validChannel.
+   */
+  void add(const CImg< double > &V, const CImg< double > &Vgt, int validChannel = -1);
+
+  /// Adds the errors of a single-precision motion field.
+  void add(const CImg< float > &V, const CImg< float > &Vgt, int validChannel = -1);
+
+  /// Adds the errors accumulated by other statistics.
+  void add(const FlowErrorStatistics &statistics);
+
+  /// Returns the average angular error (in degrees).
+  double getAverageAngularError() const;
+
+  /// Returns the average endpoint error (in pixels).
+  double getAverageEndpointError() const;
+
+  /// Returns the number of pixels with a known ground truth vector.
+  long getNumPixels() const;
+
+  /// Returns the percentage of outlier pixels with respect to the given measure.
+  double getOutlierPercentage(OutlierMeasure measure) const;
+
+  /// Removes all accumulated errors.
+  void reset();
+private:
+  long numPixels_;
+  double sumAngularError_;
+  double sumEndpointError_;
+  long numOutliers_[4];
+
+  template < class T >
+  void add_(const CImg< T > &V, const CImg< T > &Vgt, int validChannel);
+};
+
+#define FLOWERRORSTATISTICS_H
+
+#endif
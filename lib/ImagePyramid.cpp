@@ -3,57 +3,473 @@
 
 #include "CImg_config.h"
 #include <CImg.h>
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-ImagePyramid::ImagePyramid() { }
+ImagePyramid::ImagePyramid() : 
+  scaleFactor_(0.5), 
+  filter_(BOX_FILTER), 
+  gradientOperator_(NO_GRADIENT) { }
 
-ImagePyramid::ImagePyramid(const CImg< unsigned char > &I0, int n)
+ImagePyramid::ImagePyramid(const ImagePyramid &other) : 
+  scaleFactor_(0.5), 
+  filter_(BOX_FILTER), 
+  gradientOperator_(NO_GRADIENT)
 {
-  int w = I0.dimx();
-  int h = I0.dimy();
-  CImg< unsigned char > currentLevel;
-  CImg< unsigned char > nextLevel;
-  
-  levels_.push_back(I0);
-  currentLevel = I0;
+  *this = other;
+}
+
+ImagePyramid::ImagePyramid(const CImg< unsigned char > &I0, int n,
+                           double scaleFactor, Filter filter, 
+                           GradientOperator gradientOperator) : 
+  scaleFactor_(scaleFactor), 
+  filter_(filter), 
+  gradientOperator_(gradientOperator)
+{
+  build(I0, n, scaleFactor, filter, gradientOperator);
+}
+
+const int ImagePyramid::ALIGNMENT_;
+
+void ImagePyramid::build(const CImg< unsigned char > &I0, int n,
+                         double scaleFactor, Filter filter, 
+                         GradientOperator gradientOperator)
+{
+  if(!isValidScaleFactor(scaleFactor, filter))
+    throw invalid_argument("Invalid scale factor for the pyramid filter.");
+
+  scaleFactor_ = scaleFactor;
+  filter_ = filter;
+  gradientOperator_ = gradientOperator;
+  if(filter_ == GAUSSIAN_FILTER)
+    initGaussianKernel_();
+
+  levelWidths_.resize(n);
+  levelHeights_.resize(n);
+  if(n > 0)
+  {
+    levelWidths_[0] = I0.dimx();
+    levelHeights_[0] = I0.dimy();
+  }
   for(int l = 1; l < n; l++)
   {
-    nextLevel = CImg< unsigned char >(w / 2, h / 2);
-    computeNextLevel_(currentLevel, nextLevel);
-    currentLevel = nextLevel;
-  
-    levels_.push_back(currentLevel);
+    if(filter_ == BOX_FILTER)
+    {
+      levelWidths_[l] = levelWidths_[l - 1] / 2;
+      levelHeights_[l] = levelHeights_[l - 1] / 2;
+    }
+    else
+    {
+      levelWidths_[l] = max(1, (int)floor(levelWidths_[l - 1] * scaleFactor_));
+      levelHeights_[l] = max(1, (int)floor(levelHeights_[l - 1] * scaleFactor_));
+    }
+  }
+
+  layOutLevels_();
+
+  if(n > 0)
+    memcpy(levels_[0].ptr(), I0.ptr(), levels_[0].size());
+  for(int l = 1; l < n; l++)
+  {
+    if(filter_ == BOX_FILTER)
+      computeNextLevel_(levels_[l - 1], levels_[l]);
+    else
+      computeNextLevelGaussian_(l - 1, levels_[l - 1], levels_[l]);
+  }
   
-    w /= 2;
-    h /= 2;
+  for(int l = 0; l < (int)gradientLevels_.size(); l++)
+  {
+    if(gradientOperator_ == SOBEL_GRADIENT)
+      computeSobelGradients_(levels_[l], gradientLevels_[l]);
+    else
+      computeFivePointGradients_(levels_[l], gradientLevels_[l]);
   }
 }
 
+unsigned long ImagePyramid::alignSize_(unsigned long size)
+{
+  return (size + ALIGNMENT_ - 1) / ALIGNMENT_ * ALIGNMENT_;
+}
+
+ImagePyramid::Filter ImagePyramid::getFilter() const
+{
+  return filter_;
+}
+
+const CImg< short > &ImagePyramid::getGradientLevel(int i) const
+{
+  return gradientLevels_[i];
+}
+
+ImagePyramid::GradientOperator ImagePyramid::getGradientOperator() const
+{
+  return gradientOperator_;
+}
+
 const CImg< unsigned char > &ImagePyramid::getImageLevel(int i) const
 {
   return levels_[i];
 }
 
+unsigned long ImagePyramid::getNumBytes() const
+{
+  return buffer_.size();
+}
+
 int ImagePyramid::getNumLevels() const
 {
   return levels_.size();
 }
 
+double ImagePyramid::getScaleFactor() const
+{
+  return scaleFactor_;
+}
+
+bool ImagePyramid::isValidScaleFactor(double scaleFactor, Filter filter)
+{
+  if(filter == BOX_FILTER)
+    return scaleFactor == 0.5;
+  else
+    return scaleFactor > 0.0 && scaleFactor < 1.0;
+}
+
+ImagePyramid &ImagePyramid::operator=(const ImagePyramid &other)
+{
+  if(this != &other)
+  {
+    levelWidths_ = other.levelWidths_;
+    levelHeights_ = other.levelHeights_;
+    scaleFactor_ = other.scaleFactor_;
+    filter_ = other.filter_;
+    gradientOperator_ = other.gradientOperator_;
+    kernel_ = other.kernel_;
+    layOutLevels_();
+    for(unsigned int i = 0; i < levels_.size(); i++)
+      memcpy(levels_[i].ptr(), other.levels_[i].ptr(), levels_[i].size());
+    for(unsigned int i = 0; i < gradientLevels_.size(); i++)
+      memcpy(gradientLevels_[i].ptr(), other.gradientLevels_[i].ptr(), 
+             gradientLevels_[i].size() * sizeof(short));
+  }
+  
+  return *this;
+}
+
+// Exchanging the buffers does not move their contents, 
+// so the views remain valid.
+void ImagePyramid::swap(ImagePyramid &other)
+{
+  buffer_.swap(other.buffer_);
+  levels_.swap(other.levels_);
+  gradientLevels_.swap(other.gradientLevels_);
+  levelWidths_.swap(other.levelWidths_);
+  levelHeights_.swap(other.levelHeights_);
+  std::swap(scaleFactor_, other.scaleFactor_);
+  std::swap(filter_, other.filter_);
+  std::swap(gradientOperator_, other.gradientOperator_);
+}
+
+// Averages the 2x2 blocks of two source rows. The SSE2 path
+// processes 32 source pixels of both rows at a time: the 16-bit
+// lanes hold the even pixels in their low and the odd pixels in
+// their high bytes, so the horizontal pairs are summed by masking
+// and shifting. The result is the same as that of the scalar path.
+static void reduceRowBox_(const unsigned char *r0,
+                          const unsigned char *r1,
+                          unsigned char *d,
+                          int DW)
+{
+  int x = 0;
+
+#ifdef __SSE2__
+  const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+  __m128i a, b;
+  __m128i s[2];
+  int i;
+
+  for(; x + 16 <= DW; x += 16)
+  {
+    for(i = 0; i < 2; i++)
+    {
+      a = _mm_loadu_si128((const __m128i *)(r0 + 2*x + 16*i));
+      b = _mm_loadu_si128((const __m128i *)(r1 + 2*x + 16*i));
+
+      s[i] = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8)),
+                           _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8)));
+      s[i] = _mm_srli_epi16(s[i], 2);
+    }
+    _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(s[0], s[1]));
+  }
+#endif
+
+  for(; x < DW; x++)
+    d[x] = (r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1]) / 4;
+}
+
 void ImagePyramid::computeNextLevel_(const CImg< unsigned char > &src,
                                      CImg< unsigned char > &dest)
+{
+  const int DW = dest.dimx();
+  const int DH = dest.dimy();
+
+  for(int y = 0; y < DH; y++)
+    reduceRowBox_(src.ptr(0, 2*y), src.ptr(0, 2*y+1), dest.ptr(0, y), DW);
+}
+
+// The rows of the source image that are needed for the bilinear 
+// sampling are smoothed with the separable Gaussian kernel (with 
+// Neumann boundary conditions) into a floating-point image, which 
+// is then sampled. All passes except the last horizontal sampling 
+// run over contiguous rows and are vectorized by the compiler.
+void ImagePyramid::computeNextLevelGaussian_(int srcLevel,
+                                             const CImg< unsigned char > &src,
+                                             CImg< unsigned char > &dest)
 {
   const int SW = src.dimx();
+  const int SH = src.dimy();
   const int DW = dest.dimx();
   const int DH = dest.dimy();
+  const int R = (kernel_.size() - 1) / 2;
   
-  for(int y = 0; y < DH; y++)
+  CImg< float > &S = workspace_.getBuffer(srcLevel, SW, SH);
+  float *r;
+  double xc, yc;
+  float dy;
+  int x, y;
+  int y0, y1;
+  int lastSmoothedRow = -1;
+  
+  rowBuffer_.resize(SW + 2 * R);
+  r = &rowBuffer_[0];
+  
+  sampleX0_.resize(DW);
+  sampleDX_.resize(DW);
+  for(x = 0; x < DW; x++)
   {
-    for(int x = 0; x < DW; x++)
+    xc = min(x / scaleFactor_, SW - 1.0);
+    sampleX0_[x] = (int)xc;
+    sampleDX_[x] = xc - sampleX0_[x];
+  }
+  
+  for(y = 0; y < DH; y++)
+  {
+    yc = min(y / scaleFactor_, SH - 1.0);
+    y0 = (int)yc;
+    y1 = min(y0 + 1, SH - 1);
+    dy = yc - y0;
+    
+    // The sampled rows are increasing, so the rows 
+    // up to lastSmoothedRow are not needed again.
+    if(y0 > lastSmoothedRow)
+      smoothRow_(src, y0, S.ptr(0, y0));
+    if(y1 > y0 && y1 > lastSmoothedRow)
+      smoothRow_(src, y1, S.ptr(0, y1));
+    lastSmoothedRow = y1;
+    
+    const float *S0 = S.ptr(0, y0);
+    const float *S1 = S.ptr(0, y1);
+    unsigned char *d = dest.ptr(0, y);
+    
+    for(x = 0; x < SW; x++)
+      r[x] = S0[x] + dy * (S1[x] - S0[x]);
+    
+    for(x = 0; x < DW; x++)
     {
-      int v = (src(2*x + 2*y*SW) + 
-               src(2*x+1 + 2*y*SW) + 
-               src(2*x + (2*y+1)*SW) + 
-               src(2*x+1 + (2*y+1)*SW)) / 4;
-      dest(x + y * DW) = v;
+      const int x0 = sampleX0_[x];
+      const int x1 = min(x0 + 1, SW - 1);
+      const float v = r[x0] + sampleDX_[x] * (r[x1] - r[x0]);
+      
+      d[x] = (unsigned char)min(v + 0.5f, 255.0f);
     }
   }
 }
+
+// The Sobel gradients are computed row by row from the vertical sums 
+// (1, 2, 1) and differences (-1, 0, 1) of three source rows, which 
+// are stored in zero-padded 16-bit row buffers. The loops over the 
+// rows are vectorized by the compiler.
+void ImagePyramid::computeSobelGradients_(const CImg< unsigned char > &I,
+                                          CImg< short > &G)
+{
+  const int W = I.dimx();
+  const int H = I.dimy();
+  const unsigned char *a, *b, *c;
+  short *s, *d;
+  short *gx, *gy;
+  int x, y;
+  
+  if(W == 0 || H == 0)
+    return;
+  
+  gradientRowBuffers_[0].assign(W + 2, 0);
+  gradientRowBuffers_[1].assign(W + 2, 0);
+  zeroRow_.assign(W, 0);
+  s = &gradientRowBuffers_[0][0];
+  d = &gradientRowBuffers_[1][0];
+  
+  for(y = 0; y < H; y++)
+  {
+    a = (y > 0 ? I.ptr(0, y - 1) : &zeroRow_[0]);
+    b = I.ptr(0, y);
+    c = (y < H - 1 ? I.ptr(0, y + 1) : &zeroRow_[0]);
+    gx = G.ptr(0, y, 0, 0);
+    gy = G.ptr(0, y, 0, 1);
+    
+    for(x = 0; x < W; x++)
+    {
+      s[x + 1] = a[x] + 2 * b[x] + c[x];
+      d[x + 1] = c[x] - a[x];
+    }
+    for(x = 0; x < W; x++)
+    {
+      gx[x] = s[x + 2] - s[x];
+      gy[x] = d[x] + 2 * d[x + 1] + d[x + 2];
+    }
+  }
+}
+
+// The five-point differences (1, -8, 0, 8, -1) are computed with 
+// zero boundaries, horizontally from a zero-padded 16-bit copy of 
+// the row and vertically from five source rows.
+void ImagePyramid::computeFivePointGradients_(const CImg< unsigned char > &I,
+                                              CImg< short > &G)
+{
+  const int W = I.dimx();
+  const int H = I.dimy();
+  const unsigned char *r[5];
+  short *p;
+  short *gx, *gy;
+  int x, y;
+  int i;
+  
+  if(W == 0 || H == 0)
+    return;
+  
+  gradientRowBuffers_[0].assign(W + 4, 0);
+  zeroRow_.assign(W, 0);
+  p = &gradientRowBuffers_[0][0];
+  
+  for(y = 0; y < H; y++)
+  {
+    for(i = 0; i < 5; i++)
+      r[i] = (y + i - 2 >= 0 && y + i - 2 < H ? I.ptr(0, y + i - 2) : &zeroRow_[0]);
+    gx = G.ptr(0, y, 0, 0);
+    gy = G.ptr(0, y, 0, 1);
+    
+    const unsigned char *r0 = r[0], *r1 = r[1], *r3 = r[3], *r4 = r[4];
+    
+    for(x = 0; x < W; x++)
+      p[x + 2] = r[2][x];
+    for(x = 0; x < W; x++)
+      gx[x] = p[x] - 8 * p[x + 1] + 8 * p[x + 3] - p[x + 4];
+    for(x = 0; x < W; x++)
+      gy[x] = r0[x] - 8 * r1[x] + 8 * r3[x] - r4[x];
+  }
+}
+
+// The standard deviation 1/sqrt(2*scaleFactor) gives 1 for the
+// scale factor 0.5. The kernel is truncated at three standard
+// deviations.
+void ImagePyramid::initGaussianKernel_()
+{
+  const double sigma = 1.0 / sqrt(2.0 * scaleFactor_);
+  const int R = (int)ceil(3.0 * sigma);
+  double sum = 0.0;
+  int i;
+
+  kernel_.resize(2 * R + 1);
+  for(i = -R; i <= R; i++)
+  {
+    kernel_[i + R] = exp(-i * i / (2.0 * sigma * sigma));
+    sum += kernel_[i + R];
+  }
+  for(i = 0; i < 2 * R + 1; i++)
+    kernel_[i] /= sum;
+}
+
+void ImagePyramid::smoothRow_(const CImg< unsigned char > &src, 
+                              int y, 
+                              float *dest)
+{
+  const int SW = src.dimx();
+  const int SH = src.dimy();
+  const int R = (kernel_.size() - 1) / 2;
+  const float *K = &kernel_[0];
+  float *r = &rowBuffer_[0];
+  int x;
+  int i;
+  
+  // vertical pass into the padded row buffer
+  for(x = 0; x < SW; x++)
+    r[R + x] = 0.0f;
+  for(i = -R; i <= R; i++)
+  {
+    const unsigned char *si = src.ptr(0, min(max(y + i, 0), SH - 1));
+    const float k = K[i + R];
+    
+    for(x = 0; x < SW; x++)
+      r[R + x] += k * si[x];
+  }
+  for(x = 0; x < R; x++)
+  {
+    r[x] = r[R];
+    r[R + SW + x] = r[R + SW - 1];
+  }
+  
+  // horizontal pass
+  for(x = 0; x < SW; x++)
+    dest[x] = 0.0f;
+  for(i = 0; i <= 2 * R; i++)
+  {
+    const float k = K[i];
+    
+    for(x = 0; x < SW; x++)
+      dest[x] += k * r[x + i];
+  }
+}
+
+void ImagePyramid::layOutLevels_()
+{
+  const int n = levelWidths_.size();
+  unsigned long size = 0;
+  unsigned char *base;
+  int l;
+  
+  const int numGradientLevels = (gradientOperator_ != NO_GRADIENT ? n : 0);
+  
+  for(l = 0; l < n; l++)
+    size += alignSize_(levelWidths_[l] * levelHeights_[l]);
+  for(l = 0; l < numGradientLevels; l++)
+    size += alignSize_(2 * levelWidths_[l] * levelHeights_[l] * sizeof(short));
+  
+  // The extra space allows aligning the start of the first level.
+  if(buffer_.size() < size + ALIGNMENT_)
+  {
+    // Discard the old contents instead of copying them.
+    vector< unsigned char >().swap(buffer_);
+    buffer_.resize(size + ALIGNMENT_);
+  }
+  
+  base = &buffer_[0];
+  base += (ALIGNMENT_ - (unsigned long)base % ALIGNMENT_) % ALIGNMENT_;
+  
+  levels_.resize(n);
+  for(l = 0; l < n; l++)
+  {
+    levels_[l].assign(base, levelWidths_[l], levelHeights_[l], 1, 1, true);
+    base += alignSize_(levelWidths_[l] * levelHeights_[l]);
+  }
+  
+  // The gradient levels follow the image levels in the same buffer.
+  gradientLevels_.resize(numGradientLevels);
+  for(l = 0; l < numGradientLevels; l++)
+  {
+    gradientLevels_[l].assign((short *)base, levelWidths_[l], levelHeights_[l], 1, 2, true);
+    base += alignSize_(2 * levelWidths_[l] * levelHeights_[l] * sizeof(short));
+  }
+}
@@ -1,6 +1,8 @@
 
 #ifndef IMAGEPYRAMID_H
 
+#include "ImageWorkspace.h"
+
 #include <vector>
 
 namespace cimg_library { template < class T > class CImg; }
@@ -13,31 +15,169 @@ using namespace std;
  * This class contains the implementation of image pyramid. 
  * Image pyramid is an ordered set of scaled instances of 
  * a given source image.
+ *
+ * Each level is obtained from the previous one by scaling its
+ * dimensions with the scale factor of the pyramid and rounding
+ * them down. With the box filter (scale factor 0.5 only), each
+ * pixel is the average of the corresponding 2x2 block. With the
+ * Gaussian filter, the previous level is smoothed with a Gaussian
+ * kernel of standard deviation 1/sqrt(2*scaleFactor) and sampled
+ * bilinearly at (x/scaleFactor, y/scaleFactor), i.e. the same
+ * positions that the pyramidal motion extractors use for
+ * propagating the motion to the next level.
+ *
+ * Optionally, the pyramid also contains the gradients of each 
+ * level, computed once when the pyramid is built so that the 
+ * motion extractors do not need to compute them for each frame 
+ * pair. The gradients are stored as 16-bit integers without 
+ * normalization; see GradientOperator for the kernels.
+ *
+ * All levels are stored in one contiguous buffer, and the level 
+ * images are shared views into it. Each level starts at a 64-byte 
+ * boundary, and the levels are computed directly in place. 
+ * Rebuilding a pyramid reuses the buffer unless it needs to grow.
  */
 class ImagePyramid
 {
 public:
+  /// Defines the filter used for computing the pyramid levels.
+  enum Filter { BOX_FILTER, GAUSSIAN_FILTER };
+  
+  /// Defines the operator used for computing the gradients of the levels.
+  /**
+   * NO_GRADIENT: the gradients are not computed.
+   * 
+   * SOBEL_GRADIENT: 3x3 Sobel kernels, the result divided by 8 
+   * is the derivative (used by Proesmans).
+   * 
+   * FIVE_POINT_GRADIENT: five-point central differences, the result 
+   * divided by 12 is the derivative (used by Lucas-Kanade).
+   * 
+   * Both use zero boundary conditions.
+   */
+  enum GradientOperator { NO_GRADIENT, SOBEL_GRADIENT, FIVE_POINT_GRADIENT };
+  
   /// Constructs an empty image pyramid
   ImagePyramid();
   
+  /// Constructs a copy of another pyramid.
+  ImagePyramid(const ImagePyramid &other);
+  
   /// Constructs an n-level pyramid from a given source image.
   /**
    * This method constructs an n-level pyramid from a given source image.
    * @param I0 source image
    * @param n number of levels
+   * @param scaleFactor ratio between the dimensions of consecutive levels, 0 < scaleFactor < 1
+   * @param filter the filter used for computing the levels
+   * @param gradientOperator the operator used for computing the gradients of the levels
+   */
+  ImagePyramid(const CImg< unsigned char > &I0, int n,
+               double scaleFactor = 0.5, Filter filter = BOX_FILTER, 
+               GradientOperator gradientOperator = NO_GRADIENT);
+  
+  /// Rebuilds this pyramid from a given source image.
+  /**
+   * The memory of the existing levels is reused if their 
+   * dimensions do not change.
+   * @param I0 source image
+   * @param n number of levels
+   * @param scaleFactor ratio between the dimensions of consecutive levels, 0 < scaleFactor < 1
+   * @param filter the filter used for computing the levels
+   * @param gradientOperator the operator used for computing the gradients of the levels
+   */
+  void build(const CImg< unsigned char > &I0, int n,
+             double scaleFactor = 0.5, Filter filter = BOX_FILTER, 
+             GradientOperator gradientOperator = NO_GRADIENT);
+  
+  /// Returns the filter used for computing the levels.
+  Filter getFilter() const;
+  
+  /// Returns the gradients of the ith level (x and y derivatives in channels 0 and 1).
+  /**
+   * Only available if the pyramid was built with a gradient operator.
    */
-  ImagePyramid(const CImg< unsigned char > &I0, int n);
+  const CImg< short > &getGradientLevel(int i) const;
+  
+  /// Returns the operator used for computing the gradients of the levels.
+  GradientOperator getGradientOperator() const;
   
   /// Returns a reference to the ith level of this image pyramid.
   const CImg< unsigned char > &getImageLevel(int i) const;
   
+  /// Returns the size of the buffer containing the levels and their gradients (in bytes).
+  unsigned long getNumBytes() const;
+  
   /// Returns the number of levels in this image pyramid.
   int getNumLevels() const;
+  
+  /// Returns the ratio between the dimensions of consecutive levels.
+  double getScaleFactor() const;
+  
+  /// Returns true if the given scale factor can be used with the given filter.
+  /**
+   * The box filter only supports the scale factor 0.5.
+   * The Gaussian filter supports scale factors between 0 and 1.
+   */
+  static bool isValidScaleFactor(double scaleFactor, Filter filter);
+  
+  /// Copies another pyramid into this one.
+  ImagePyramid &operator=(const ImagePyramid &other);
+  
+  /// Exchanges the contents of this pyramid and another pyramid without copying the images.
+  void swap(ImagePyramid &other);
 private:
+  // alignment of the levels in bytes
+  static const int ALIGNMENT_ = 64;
+  
+  // storage of all levels, the first level starts at the first aligned address
+  vector< unsigned char > buffer_;
+  // shared views into buffer_
   vector< CImg< unsigned char > > levels_;
+  vector< CImg< short > > gradientLevels_;
+  vector< int > levelWidths_, levelHeights_;
+  double scaleFactor_;
+  Filter filter_;
+  GradientOperator gradientOperator_;
+  
+  // smoothed levels (Gaussian filter)
+  ImageWorkspace< float > workspace_;
+  // Gaussian kernel, row buffer and horizontal sampling positions
+  vector< float > kernel_;
+  vector< float > rowBuffer_;
+  vector< int > sampleX0_;
+  vector< float > sampleDX_;
+  // row buffers of the gradient computation
+  vector< short > gradientRowBuffers_[2];
+  vector< unsigned char > zeroRow_;
   
   void computeNextLevel_(const CImg< unsigned char > &src,
                          CImg< unsigned char > &dest);
+  
+  // srcLevel selects the workspace slot of the smoothed level
+  void computeNextLevelGaussian_(int srcLevel,
+                                 const CImg< unsigned char > &src,
+                                 CImg< unsigned char > &dest);
+  
+  void computeFivePointGradients_(const CImg< unsigned char > &I,
+                                  CImg< short > &G);
+  
+  void computeSobelGradients_(const CImg< unsigned char > &I,
+                              CImg< short > &G);
+  
+  void initGaussianKernel_();
+  
+  // rounds a level size up to a multiple of ALIGNMENT_
+  static unsigned long alignSize_(unsigned long size);
+  
+  // allocates the buffer if necessary and lays out the 
+  // levels with dimensions levelWidths_ x levelHeights_
+  void layOutLevels_();
+  
+  // smooths row y of src with the Gaussian kernel
+  void smoothRow_(const CImg< unsigned char > &src, 
+                  int y, 
+                  float *dest);
 };
 
 #define IMAGEPYRAMID_H
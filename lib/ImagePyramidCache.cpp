@@ -0,0 +1,180 @@
+
+#include "ImagePyramidCache.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <stdexcept>
+#include <string.h>
+
+const long ImagePyramidCache::NO_FRAME_ID;
+const unsigned int ImagePyramidCache::MIN_NUM_ENTRIES_;
+
+ImagePyramidCache::ImagePyramidCache(unsigned long maxNumBytes) :
+  maxNumBytes_(maxNumBytes),
+  numBytes_(0),
+  numHits_(0),
+  numMisses_(0) { }
+
+void ImagePyramidCache::clear()
+{
+  entries_.clear();
+  numBytes_ = 0;
+}
+
+unsigned long ImagePyramidCache::getMaxNumBytes() const
+{
+  return maxNumBytes_;
+}
+
+unsigned long ImagePyramidCache::getNumBytes() const
+{
+  return numBytes_;
+}
+
+int ImagePyramidCache::getNumEntries() const
+{
+  return entries_.size();
+}
+
+unsigned long ImagePyramidCache::getNumHits() const
+{
+  return numHits_;
+}
+
+unsigned long ImagePyramidCache::getNumMisses() const
+{
+  return numMisses_;
+}
+
+const ImagePyramid &ImagePyramidCache::getPyramid(const CImg< unsigned char > &I,
+                                                  int numLevels,
+                                                  double scaleFactor,
+                                                  ImagePyramid::Filter filter,
+                                                  ImagePyramid::GradientOperator gradientOperator,
+                                                  long frameId)
+{
+  const unsigned long hash = (frameId == NO_FRAME_ID ? computeHash_(I) : 0);
+  list< Entry >::iterator it;
+
+  if(!ImagePyramid::isValidScaleFactor(scaleFactor, filter))
+    throw invalid_argument("Invalid scale factor for the pyramid filter.");
+
+  for(it = entries_.begin(); it != entries_.end(); it++)
+  {
+    if(matches_(*it, I, numLevels, scaleFactor, filter, gradientOperator, frameId, hash))
+    {
+      entries_.splice(entries_.begin(), entries_, it);
+      numHits_++;
+
+      return entries_.front().pyramid;
+    }
+  }
+
+  numMisses_++;
+
+  // If the cache is full, the memory of the least recently
+  // used pyramid is reused for the new one.
+  if(entries_.size() > MIN_NUM_ENTRIES_ &&
+     numBytes_ + I.size() > maxNumBytes_)
+  {
+    numBytes_ -= entries_.back().numBytes;
+    entries_.splice(entries_.begin(), entries_, --entries_.end());
+  }
+  else
+    entries_.push_front(Entry());
+
+  Entry &entry = entries_.front();
+  entry.frameId = frameId;
+  entry.hash = hash;
+  entry.numLevels = numLevels;
+  entry.scaleFactor = scaleFactor;
+  entry.filter = filter;
+  entry.gradientOperator = gradientOperator;
+  entry.pyramid.build(I, numLevels, scaleFactor, filter, gradientOperator);
+  entry.numBytes = entry.pyramid.getNumBytes();
+  numBytes_ += entry.numBytes;
+
+  evict_();
+
+  return entry.pyramid;
+}
+
+void ImagePyramidCache::resetCounters()
+{
+  numHits_ = 0;
+  numMisses_ = 0;
+}
+
+void ImagePyramidCache::setMaxNumBytes(unsigned long maxNumBytes)
+{
+  maxNumBytes_ = maxNumBytes;
+  evict_();
+}
+
+// FNV-1a applied to the pixels in machine words instead of bytes. 
+// Four interleaved hashes hide the latency of the multiplications; 
+// they are combined at the end. Collisions only cost a comparison 
+// of the images in matches_.
+unsigned long ImagePyramidCache::computeHash_(const CImg< unsigned char > &I)
+{
+  const unsigned long PRIME = (sizeof(unsigned long) >= 8 ? 1099511628211UL : 16777619UL);
+  const unsigned char *p = I.ptr();
+  const unsigned int N = I.size();
+  const unsigned int WORD_SIZE = sizeof(unsigned long);
+  unsigned long hash[4];
+  unsigned long w[4];
+  unsigned int i, j;
+
+  for(j = 0; j < 4; j++)
+    hash[j] = 2166136261UL + j;
+
+  for(i = 0; i + 4 * WORD_SIZE <= N; i += 4 * WORD_SIZE)
+  {
+    memcpy(w, p + i, sizeof(w));
+    for(j = 0; j < 4; j++)
+      hash[j] = (hash[j] ^ w[j]) * PRIME;
+  }
+  for(; i < N; i++)
+    hash[0] = (hash[0] ^ p[i]) * PRIME;
+
+  hash[0] = (hash[0] ^ I.dimx()) * PRIME;
+  hash[0] = (hash[0] ^ I.dimy()) * PRIME;
+  hash[0] = (hash[0] ^ I.dimv()) * PRIME;
+  for(j = 1; j < 4; j++)
+    hash[0] = (hash[0] ^ hash[j]) * PRIME;
+
+  return hash[0];
+}
+
+void ImagePyramidCache::evict_()
+{
+  while(entries_.size() > MIN_NUM_ENTRIES_ && numBytes_ > maxNumBytes_)
+  {
+    numBytes_ -= entries_.back().numBytes;
+    entries_.pop_back();
+  }
+}
+
+bool ImagePyramidCache::matches_(const Entry &entry,
+                                 const CImg< unsigned char > &I,
+                                 int numLevels,
+                                 double scaleFactor,
+                                 ImagePyramid::Filter filter,
+                                 ImagePyramid::GradientOperator gradientOperator,
+                                 long frameId,
+                                 unsigned long hash)
+{
+  if(entry.frameId != frameId || entry.hash != hash ||
+     entry.numLevels != numLevels || entry.scaleFactor != scaleFactor ||
+     entry.filter != filter || entry.gradientOperator != gradientOperator)
+    return false;
+
+  if(frameId != NO_FRAME_ID)
+    return true;
+
+  const CImg< unsigned char > &I0 = entry.pyramid.getImageLevel(0);
+
+  // The pyramid only contains the first channel of the image.
+  return I0.dimx() == I.dimx() && I0.dimy() == I.dimy() &&
+         memcmp(I0.ptr(), I.ptr(), I0.size()) == 0;
+}
@@ -0,0 +1,136 @@
+
+#ifndef IMAGEPYRAMIDCACHE_H
+
+#include "ImagePyramid.h"
+
+#include <list>
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements a least recently used cache of image pyramids.
+/**
+ * When the same frame takes part in several motion computations
+ * (e.g. the neighbours t-1 and t+1 of a frame, or the forward and
+ * backward motion computed separately), its image pyramid can be
+ * taken from this cache instead of building it again.
+ *
+ * A pyramid is identified either by a frame ID supplied by the
+ * caller or, if no ID is given, by the contents of the source
+ * image. In the latter case the image is hashed, and on a hash
+ * match the image is compared with the base level of the cached
+ * pyramid, so different images never share a pyramid. The number
+ * of levels, the scale factor, the filter and the gradient operator
+ * are also part of the key.
+ *
+ * Hashing and comparing an image costs about as much as building
+ * a box-filtered pyramid, so looking up by contents mostly pays
+ * off with the Gaussian filter. Lookups by frame ID are cheap.
+ *
+ * The total size of the cached pyramids is limited by a memory
+ * cap. When the cap is exceeded, the least recently used pyramids
+ * are evicted, and their memory is reused for the new pyramids.
+ * The two most recently used pyramids are never evicted, so the
+ * references returned by getPyramid remain valid until two other
+ * pyramids have been requested. This allows a motion extractor to
+ * request the pyramids of both images before using them.
+ *
+ * This class is not thread-safe.
+ */
+class ImagePyramidCache
+{
+public:
+  /// Denotes that the pyramid is identified by the contents of the image.
+  static const long NO_FRAME_ID = -1;
+
+  /// Constructs an empty cache with a given memory cap (in bytes).
+  ImagePyramidCache(unsigned long maxNumBytes = 256 * 1024 * 1024);
+
+  /// Removes all pyramids from this cache.
+  void clear();
+
+  /// Returns the memory cap of this cache (in bytes).
+  unsigned long getMaxNumBytes() const;
+
+  /// Returns the total size of the cached pyramids (in bytes).
+  unsigned long getNumBytes() const;
+
+  /// Returns the number of cached pyramids.
+  int getNumEntries() const;
+
+  /// Returns the number of requests that were served from this cache.
+  unsigned long getNumHits() const;
+
+  /// Returns the number of requests for which a pyramid was built.
+  unsigned long getNumMisses() const;
+
+  /// Returns the pyramid of a given image, building it if it is not cached.
+  /**
+   * @param I source image
+   * @param numLevels number of levels
+   * @param scaleFactor ratio between the dimensions of consecutive levels
+   * @param filter the filter used for computing the levels
+   * @param gradientOperator the operator used for computing the gradients of the levels
+   * @param frameId non-negative ID that identifies the image, or
+   *        NO_FRAME_ID for identifying the image by its contents.
+   *        The caller must ensure that an ID always refers to
+   *        the same image.
+   */
+  const ImagePyramid &getPyramid(const CImg< unsigned char > &I,
+                                 int numLevels,
+                                 double scaleFactor = 0.5,
+                                 ImagePyramid::Filter filter = ImagePyramid::BOX_FILTER,
+                                 ImagePyramid::GradientOperator gradientOperator = ImagePyramid::NO_GRADIENT,
+                                 long frameId = NO_FRAME_ID);
+
+  /// Sets the hit and miss counters to zero.
+  void resetCounters();
+
+  /// Sets the memory cap of this cache (in bytes).
+  void setMaxNumBytes(unsigned long maxNumBytes);
+private:
+  struct Entry
+  {
+    long frameId;
+    unsigned long hash;
+    int numLevels;
+    double scaleFactor;
+    ImagePyramid::Filter filter;
+    ImagePyramid::GradientOperator gradientOperator;
+    unsigned long numBytes;
+    ImagePyramid pyramid;
+  };
+
+  // the number of most recently used pyramids that are never evicted
+  static const unsigned int MIN_NUM_ENTRIES_ = 2;
+
+  // the cached pyramids, the most recently used first
+  list< Entry > entries_;
+
+  unsigned long maxNumBytes_;
+  unsigned long numBytes_;
+  unsigned long numHits_;
+  unsigned long numMisses_;
+
+  // computes a hash of the dimensions and pixels of an image
+  static unsigned long computeHash_(const CImg< unsigned char > &I);
+
+  // removes the least recently used pyramids until the cap is met
+  void evict_();
+
+  // returns true if an entry contains the pyramid of an image
+  static bool matches_(const Entry &entry,
+                       const CImg< unsigned char > &I,
+                       int numLevels,
+                       double scaleFactor,
+                       ImagePyramid::Filter filter,
+                       ImagePyramid::GradientOperator gradientOperator,
+                       long frameId,
+                       unsigned long hash);
+};
+
+#define IMAGEPYRAMIDCACHE_H
+
+#endif
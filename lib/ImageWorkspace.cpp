@@ -0,0 +1,52 @@
+
+#include "ImageWorkspace.h"
+
+template < class T >
+ImageWorkspace< T >::ImageWorkspace() { }
+
+template < class T >
+void ImageWorkspace< T >::clear()
+{
+  buffers_.clear();
+}
+
+template < class T >
+CImg< T > &ImageWorkspace< T >::getBuffer(int slot, int width, int height, int numChannels)
+{
+  typename list< Buffer >::iterator it;
+
+  for(it = buffers_.begin(); it != buffers_.end(); it++)
+  {
+    if(it->slot == slot)
+    {
+      // CImg::assign only reallocates the image if its size has 
+      // changed, e.g. when the slot is requested with different 
+      // dimensions or the image has been swapped with one of a 
+      // different size.
+      it->image.assign(width, height, 1, numChannels);
+      return it->image;
+    }
+  }
+
+  Buffer buffer;
+  buffer.slot = slot;
+  buffers_.push_back(buffer);
+  buffers_.back().image.assign(width, height, 1, numChannels);
+
+  return buffers_.back().image;
+}
+
+template < class T >
+unsigned long ImageWorkspace< T >::getNumBytes() const
+{
+  typename list< Buffer >::const_iterator it;
+  unsigned long numBytes = 0;
+
+  for(it = buffers_.begin(); it != buffers_.end(); it++)
+    numBytes += it->image.size() * sizeof(T);
+
+  return numBytes;
+}
+
+template class ImageWorkspace< float >;
+template class ImageWorkspace< double >;
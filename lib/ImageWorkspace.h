@@ -0,0 +1,65 @@
+
+#ifndef IMAGEWORKSPACE_H
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <list>
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements a set of reusable image buffers.
+/**
+ * The motion extractors need temporary images whose sizes depend
+ * on the pyramid level being processed. Instead of allocating them
+ * on each call, they are requested from a workspace that keeps
+ * them allocated after their first use. A buffer is identified by
+ * a slot number. When a slot is requested with different dimensions
+ * than before, its buffer is reallocated, so the workspace holds one
+ * buffer per slot and does not grow with the number of distinct
+ * image sizes. The buffers of different pyramid levels are therefore
+ * kept in separate slots. After the first computation, repeated
+ * computations with images of the same size do not allocate memory.
+ *
+ * The returned references remain valid until clear is called or
+ * the same slot is requested with different dimensions.
+ * The contents of a buffer can be exchanged with another image
+ * by CImg::swap. If the image has different dimensions, the buffer
+ * is reallocated the next time it is requested.
+ */
+template < class T = double > class ImageWorkspace
+{
+public:
+  /// Constructs an empty workspace.
+  ImageWorkspace();
+
+  /// Frees all buffers.
+  void clear();
+
+  /// Returns the buffer for the given slot and dimensions.
+  /**
+   * The buffer is allocated if the slot has not been requested 
+   * before, and reallocated if it was requested with different 
+   * dimensions. Its contents are not initialized.
+   * @param slot user-defined identifier of the buffer
+   * @param width width of the image
+   * @param height height of the image
+   * @param numChannels number of channels of the image
+   */
+  CImg< T > &getBuffer(int slot, int width, int height, int numChannels = 1);
+
+  /// Returns the total size of the buffers (in bytes).
+  unsigned long getNumBytes() const;
+private:
+  struct Buffer
+  {
+    int slot;
+    CImg< T > image;
+  };
+
+  list< Buffer > buffers_;
+};
+
+#define IMAGEWORKSPACE_H
+
+#endif
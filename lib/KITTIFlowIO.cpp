@@ -0,0 +1,114 @@
+
+#include "KITTIFlowIO.h"
+#include "PNGFileUtils.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <fstream>
+#include <math.h>
+#include <stdexcept>
+
+// the scale factor and offset of the stored vector components
+static const double SCALE = 64.0;
+static const double OFFSET = 32768.0;
+
+// Converts a vector component to the stored value.
+static unsigned short encode_(double value)
+{
+  const double s = floor(value * SCALE + OFFSET + 0.5);
+  return (unsigned short)(s < 0.0 ? 0.0 : (s > 65535.0 ? 65535.0 : s));
+}
+
+template < class T >
+static void readVectorField_(const string &inFileName, CImg< T > &V)
+{
+  CImg< unsigned short > I;
+
+  PNGFileUtils::readImage16(inFileName, I);
+  if(I.dimv() != 3)
+    throw runtime_error("Invalid KITTI flow file.");
+
+  V.assign(I.dimx(), I.dimy(), 1, 3);
+  cimg_forXY(I, x, y)
+  {
+    if(I(x, y, 0, 2) > 0)
+    {
+      V(x, y, 0, 0) = (I(x, y, 0, 0) - OFFSET) / SCALE;
+      V(x, y, 0, 1) = (I(x, y, 0, 1) - OFFSET) / SCALE;
+      V(x, y, 0, 2) = 1;
+    }
+    else
+    {
+      V(x, y, 0, 0) = 0;
+      V(x, y, 0, 1) = 0;
+      V(x, y, 0, 2) = 0;
+    }
+  }
+}
+
+template < class T >
+static void writeVectorField_(const CImg< T > &V,
+                              const string &outFileName,
+                              int validChannel)
+{
+  if(V.dimv() < 2 || validChannel >= V.dimv())
+    throw runtime_error("Invalid vector field.");
+
+  CImg< unsigned short > I(V.dimx(), V.dimy(), 1, 3);
+  cimg_forXY(I, x, y)
+  {
+    if(validChannel < 0 || V(x, y, 0, validChannel) != 0)
+    {
+      I(x, y, 0, 0) = encode_(V(x, y, 0, 0));
+      I(x, y, 0, 1) = encode_(V(x, y, 0, 1));
+      I(x, y, 0, 2) = 1;
+    }
+    else
+    {
+      I(x, y, 0, 0) = 0;
+      I(x, y, 0, 1) = 0;
+      I(x, y, 0, 2) = 0;
+    }
+  }
+
+  PNGFileUtils::writeImage16(I, outFileName);
+}
+
+bool KITTIFlowIO::isKITTIFlow(const string &fileName)
+{
+  ifstream inputStream(fileName.c_str(), ios::binary | ios::in);
+  unsigned char header[26];
+
+  if(!PNGFileUtils::isPNGFile(fileName))
+    return false;
+
+  // the bit depth and the color type (2 = RGB) in the IHDR chunk
+  // following the signature
+  inputStream.read((char *)header, 26);
+
+  return inputStream && header[24] == 16 && header[25] == 2;
+}
+
+void KITTIFlowIO::readVectorField(const string &inFileName, CImg< double > &V)
+{
+  readVectorField_(inFileName, V);
+}
+
+void KITTIFlowIO::readVectorField(const string &inFileName, CImg< float > &V)
+{
+  readVectorField_(inFileName, V);
+}
+
+void KITTIFlowIO::writeVectorField(const CImg< double > &V,
+                                   const string &outFileName,
+                                   int validChannel)
+{
+  writeVectorField_(V, outFileName, validChannel);
+}
+
+void KITTIFlowIO::writeVectorField(const CImg< float > &V,
+                                   const string &outFileName,
+                                   int validChannel)
+{
+  writeVectorField_(V, outFileName, validChannel);
+}
@@ -0,0 +1,64 @@
+
+#ifndef KITTIFLOWIO_H
+
+#include <string>
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements methods for reading and writing motion fields in the KITTI PNG format.
+/**
+ * The KITTI optical flow benchmark stores a motion field in a 16-bit
+ * RGB PNG file. The red and green channels hold u and v as
+ * 64 * u + 2^15 and 64 * v + 2^15, i.e. with 1/64 pixel precision
+ * in the range [-512, 512), and the blue channel is 1 for the
+ * pixels with a known flow and 0 for the others.
+ *
+ * When a file is read, the vector field has a third channel that
+ * is 1 for the pixels with a known flow and 0 for the others, in
+ * the same way as in MiddleburyFlowIO. The unknown vectors are set
+ * to zero.
+ *
+ * Requires libpng (WITH_PNG), otherwise the methods for reading
+ * and writing throw runtime_error.
+ */
+class KITTIFlowIO
+{
+public:
+  /// Returns true if the given file is a 16-bit RGB PNG file.
+  static bool isKITTIFlow(const string &fileName);
+
+  /// Reads a motion field from a KITTI PNG file.
+  /**
+   * V is resized to width x height x 1 x 3. Throws runtime_error
+   * if the file cannot be read.
+   */
+  static void readVectorField(const string &inFileName, CImg< double > &V);
+
+  /// Reads a single-precision motion field from a KITTI PNG file.
+  static void readVectorField(const string &inFileName, CImg< float > &V);
+
+  /// Writes a motion field to a KITTI PNG file.
+  /**
+   * The vectors are rounded to 1/64 pixels and clamped to the
+   * representable range.
+   * @param V the motion field
+   * @param outFileName the file to write
+   * @param validChannel if >= 0, the vectors are marked unknown at
+   *        the pixels where this channel of V is zero
+   */
+  static void writeVectorField(const CImg< double > &V,
+                               const string &outFileName,
+                               int validChannel = -1);
+
+  /// Writes a single-precision motion field to a KITTI PNG file.
+  static void writeVectorField(const CImg< float > &V,
+                               const string &outFileName,
+                               int validChannel = -1);
+};
+
+#define KITTIFLOWIO_H
+
+#endif
@@ -1,63 +1,87 @@
 
 #include "LucasKanade.h"
-#include "ROI.h"
+#include "Profiler.h"
 
 #include <iostream>
 #include <math.h>
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
 
 #include "CImg_config.h"
 #include <CImg.h>
 
-LucasKanade::LucasKanade() : COMPUTE_RESIDUALS_(true),
+template < class T >
+LucasKanade< T >::LucasKanade() : COMPUTE_RESIDUALS_(true),
                              INTENSITY_SCALE_(1.0 / 255.0),
                              WINDOW_RADIUS_(16),
                              NUM_ITERATIONS_(5),
                              TAU_(0.0025),
                              SIGMAP_(0.0),
-                             WINDOW_SIZE_(2 * WINDOW_RADIUS_ + 1)
+                             WINDOW_SIZE_(2 * WINDOW_RADIUS_ + 1),
+                             WARP_MODE_(LOCAL_WARP),
+                             NUM_THREADS_(1),
+                             numRejected_(0),
+                             numIterations_(0),
+                             numTerminated_(0),
+                             inputGradients_(NULL),
+                             bufferSet_(0)
 {
-  W_ = new CImg< double >(WINDOW_SIZE_, WINDOW_SIZE_);
-  double c[1] = { 1.0 };
+  W_ = new CImg< T >(WINDOW_SIZE_, WINDOW_SIZE_);
+  T c[1] = { 1 };
   W_->draw_gaussian(WINDOW_SIZE_ / 2.0f, WINDOW_SIZE_ / 2.0f, WINDOW_RADIUS_ / 3.0f, &c[0]);
+  initWindowWeights_();
 }
 
-LucasKanade::LucasKanade(int windowRadius,
-                         int numIterations,
-                         float tau,
-                         float sigmap,
-                         bool useWeightingKernel) : 
+template < class T >
+LucasKanade< T >::LucasKanade(int windowRadius,
+                              int numIterations,
+                              float tau,
+                              float sigmap,
+                              bool useWeightingKernel,
+                              WarpMode warpMode,
+                              int numThreads) : 
   COMPUTE_RESIDUALS_(true),
   INTENSITY_SCALE_(1.0 / 255.0),
   WINDOW_RADIUS_(windowRadius),
   NUM_ITERATIONS_(numIterations),
   TAU_(tau),
   SIGMAP_(sigmap),
-  WINDOW_SIZE_(2 * WINDOW_RADIUS_ + 1)
+  WINDOW_SIZE_(2 * WINDOW_RADIUS_ + 1),
+  WARP_MODE_(warpMode),
+  NUM_THREADS_(numThreads),
+  numRejected_(0),
+  numIterations_(0),
+  numTerminated_(0),
+  inputGradients_(NULL),
+  bufferSet_(0)
 {
   if(useWeightingKernel)
   {
-    W_ = new CImg< double >(WINDOW_SIZE_, WINDOW_SIZE_);
-    double c[1] = { 1.0 };
+    W_ = new CImg< T >(WINDOW_SIZE_, WINDOW_SIZE_);
+    T c[1] = { 1 };
     W_->draw_gaussian(WINDOW_SIZE_ / 2.0f, WINDOW_SIZE_ / 2.0f, WINDOW_RADIUS_ / 3.0f, &c[0]);
   }
   else
     W_ = NULL;
+  initWindowWeights_();
 }
 
-LucasKanade::~LucasKanade()
+template < class T >
+LucasKanade< T >::~LucasKanade()
 {
   delete W_;
 }
 
-void LucasKanade::compute(const CImg< unsigned char > &I1,
-                          const CImg< unsigned char > &I2,
-                          CImg< double > &V)
+template < class T >
+void LucasKanade< T >::compute(const CImg< unsigned char > &I1,
+                               const CImg< unsigned char > &I2,
+                               CImg< T > &V)
 {
-  int baseIndex = 0, index;
-  int i;
-  int x, y;
-  LSQInput lsqInput;
-  LSQResults lsqResults;
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  int y;
   
   width_  = I1.dimx();
   height_ = I1.dimy();
@@ -65,162 +89,437 @@ void LucasKanade::compute(const CImg< unsigned char > &I1,
   I1_.assign(I1, true);
   I2_.assign(I2, true);
   
-  computeGradients_(I1_, G1_);
+  // The pyramidal extractor calls this with a different image size 
+  // for each level, so the buffers are kept in a separate buffer set 
+  // for each level (see selectBufferSet).
+  G1_.assign(workspace_.getBuffer(getBufferSlot_(GRADIENT_SLOT_), width_, height_, 2), true);
+  GWG_.assign(sumWorkspace_.getBuffer(getBufferSlot_(STRUCTURE_TENSOR_SLOT_), width_, height_, 3), true);
   
-  if(COMPUTE_RESIDUALS_ == true)
   {
-    residualSum_ = 0.0;
-    maxResidual_ = 0.0;
-    numResidualSumTerms_ = 0;
+    PROFILE_SCOPE(this->profiler, "gradients");
+    if(inputGradients_ != NULL)
+      convertGradients_(*inputGradients_, G1_);
+    else
+      computeGradients_(I1_, G1_);
   }
   
-  roi_ = LucasKanadeROI(-WINDOW_RADIUS_, -WINDOW_RADIUS_,
-                        WINDOW_SIZE_, WINDOW_SIZE_,
-                        I1_, G1_, W_);
-  roi_.initialize();
+  rowResidualStats_.resize(height_);
   
-  for(y = 0; y < height_; y++)
   {
-    index = baseIndex;
-
-    for(x = 0; x < width_; x++)
+    PROFILE_SCOPE(this->profiler, "structure tensor");
+    computeStructureTensor_();
+  }
+  
+  if(WARP_MODE_ == DENSE_WARP)
+  {
+    PROFILE_SCOPE(this->profiler, "dense least squares");
+    computeDenseLSQVelocities_(V);
+  }
+  else
+  {
+    PROFILE_SCOPE(this->profiler, "local least squares");
+    
+    // The pixels are independent of each other, so the rows are 
+    // divided into bands of consecutive rows, one for each thread.
+#ifdef WITH_OPENMP
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+    for(y = 0; y < height_; y++)
     {
-      lsqInput.x = x;
-      lsqInput.y = y;
-      lsqInput.ivx = V(x, y, 0, 0);
-      lsqInput.ivy = V(x, y, 0, 1);
-      
-      computeLSQVelocity_(lsqInput, lsqResults);
+      LSQInput lsqInput;
+      LSQResults lsqResults;
+      ResidualStats &stats = rowResidualStats_[y];
       
-      V(x, y, 0, 0) = lsqResults.vx;
-      V(x, y, 0, 1) = lsqResults.vy;
-      for(i = 0; i < getNumResultQualityChannels(); i++)
-	V(x, y, 0, 2 + i) = lsqResults.quality[i];
+      stats.sum = 0.0;
+      stats.max = 0.0;
+      stats.numTerms = 0;
+      stats.numRejected = 0;
+      stats.numIterations = 0;
+      stats.numTerminated = 0;
       
-      index++;
-      roi_.translate(1, 0);
+      for(int x = 0; x < width_; x++)
+      {
+        lsqInput.x = x;
+        lsqInput.y = y;
+        lsqInput.ivx = V(x, y, 0, 0);
+        lsqInput.ivy = V(x, y, 0, 1);
+        
+        computeLSQVelocity_(lsqInput, lsqResults, stats);
+        
+        V(x, y, 0, 0) = lsqResults.vx;
+        V(x, y, 0, 1) = lsqResults.vy;
+        for(int i = 0; i < getNumResultQualityChannels(); i++)
+          V(x, y, 0, 2 + i) = lsqResults.quality[i];
+      }
+    }
+    
+    numRejected_ = 0;
+    numIterations_ = 0;
+    numTerminated_ = 0;
+    for(y = 0; y < height_; y++)
+    {
+      numRejected_ += rowResidualStats_[y].numRejected;
+      numIterations_ += rowResidualStats_[y].numIterations;
+      numTerminated_ += rowResidualStats_[y].numTerminated;
     }
+  }
+  
+  PROFILE_COUNT(this->profiler, "pixels", width_ * height_);
+  PROFILE_COUNT(this->profiler, "pixels rejected by tau", numRejected_);
+  PROFILE_COUNT(this->profiler, "Gauss-Newton iterations", numIterations_);
+  PROFILE_COUNT(this->profiler, "terminated Gauss-Newton loops", numTerminated_);
+  
+  // The per-row statistics are combined in a fixed order so that 
+  // the result does not depend on the number of threads.
+  if(COMPUTE_RESIDUALS_ == true)
+  {
+    residualSum_ = 0.0;
+    maxResidual_ = 0.0;
+    numResidualSumTerms_ = 0;
     
-    baseIndex += width_;
-    roi_.translate(-width_, 1);
+    for(y = 0; y < height_; y++)
+    {
+      residualSum_ += rowResidualStats_[y].sum;
+      maxResidual_ = max(maxResidual_, rowResidualStats_[y].max);
+      numResidualSumTerms_ += rowResidualStats_[y].numTerms;
+    }
   }
 }
 
-string LucasKanade::getName() const
+template < class T >
+string LucasKanade< T >::getName() const
 {
   return "Lucas-Kanade";
 }
 
-int LucasKanade::getNumIterations() const
+template < class T >
+int LucasKanade< T >::getNumIterations() const
 {
   return NUM_ITERATIONS_;
 }
 
-int LucasKanade::getNumResultQualityChannels() const
+template < class T >
+int LucasKanade< T >::getNumResultQualityChannels() const
 {
   return 2;
 }
 
-double LucasKanade::getSigmap() const
+template < class T >
+int LucasKanade< T >::getNumThreads() const
+{
+  return NUM_THREADS_;
+}
+
+template < class T >
+double LucasKanade< T >::getSigmap() const
 {
   return SIGMAP_;
 }
 
-double LucasKanade::getTau() const
+template < class T >
+double LucasKanade< T >::getTau() const
 {
   return TAU_;
 }
 
-int LucasKanade::getWindowSize() const
+template < class T >
+typename LucasKanade< T >::WarpMode LucasKanade< T >::getWarpMode() const
+{
+  return WARP_MODE_;
+}
+
+template < class T >
+int LucasKanade< T >::getWindowSize() const
 {
   return WINDOW_SIZE_;
 }
 
-bool LucasKanade::isDual() const
+template < class T >
+bool LucasKanade< T >::isDual() const
 {
   return false;
 }
 
-void LucasKanade::printInfoText() const
+template < class T >
+void LucasKanade< T >::printInfoText(ostream &out) const
 {
-  cout<<"Lucas & Kanade optical flow algorithm"<<endl;
-  cout<<"====================================="<<endl;
+  out<<"Lucas & Kanade optical flow algorithm"<<endl;
+  out<<"====================================="<<endl;
   
-  cout<<"Input image width: "<<I1_.dimx()<<endl;
-  cout<<"Input image height: "<<I1_.dimy()<<endl;
+  out<<"Input image width: "<<I1_.dimx()<<endl;
+  out<<"Input image height: "<<I1_.dimy()<<endl;
   
-  cout<<"Window size: "<<WINDOW_SIZE_<<endl;
-  cout<<"Number of Gauss-Newton iterations: "<<NUM_ITERATIONS_<<endl;
-  cout<<"Tau (eigenvalue threshold): "<<TAU_<<endl;
-  cout<<"Sigmap (regularization parameter): "<<SIGMAP_<<endl;
+  out<<"Window size: "<<WINDOW_SIZE_<<endl;
+  out<<"Number of Gauss-Newton iterations: "<<NUM_ITERATIONS_<<endl;
+  out<<"Tau (eigenvalue threshold): "<<TAU_<<endl;
+  out<<"Sigmap (regularization parameter): "<<SIGMAP_<<endl;
+  out<<"Warp mode: "<<(WARP_MODE_ == LOCAL_WARP ? "local" : "dense")<<endl;
+  out<<"Number of threads: "<<NUM_THREADS_<<endl;
+}
+
+template < class T >
+void LucasKanade< T >::releaseBuffers()
+{
+  workspace_.clear();
+  sumWorkspace_.clear();
+}
+
+template < class T >
+void LucasKanade< T >::selectBufferSet(int index)
+{
+  bufferSet_ = index;
+}
+
+template < class T >
+void LucasKanade< T >::setInputGradients(const CImg< short > *G1)
+{
+  inputGradients_ = G1;
+}
+
+// Computes the Gauss-Newton iterations for all pixels at once 
+// (DENSE_WARP mode). The termination criterion and the quality 
+// measures are the same as in computeLSQVelocity_.
+template < class T >
+void LucasKanade< T >::computeDenseLSQVelocities_(CImg< T > &V)
+{
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  const int N = width_ * height_;
+  
+  CImg< double > &P = sumWorkspace_.getBuffer(getBufferSlot_(PRODUCT_SLOT_), width_, height_, 3);
+  CImg< double > &S = sumWorkspace_.getBuffer(getBufferSlot_(WINDOW_SUM_SLOT_), width_, height_, 3);
+  int numActive = 0;
+  int numIterations = 0;
+  int numTerminated = 0;
+  int i;
+  int y;
+  
+  // (the vectors keep their capacity when the size decreases)
+  smallerLambdas_.resize(N);
+  rSums_.assign(N, 0.0);
+  accepted_.resize(N);
+  active_.resize(N);
+  
+#ifdef WITH_OPENMP
+  #pragma omp parallel for num_threads(numThreads) schedule(static) reduction(+:numActive)
+#endif
+  for(y = 0; y < height_; y++)
+  {
+    double lambda1, lambda2;
+    int k = y * width_;
+    
+    for(int x = 0; x < width_; x++, k++)
+    {
+      computeEigenValues_(GWG_(x, y, 0, 0), GWG_(x, y, 0, 1), GWG_(x, y, 0, 2), 
+                          lambda1, lambda2);
+      smallerLambdas_[k] = min(lambda1, lambda2);
+      accepted_[k] = smallerLambdas_[k] > TAU_;
+      active_[k] = accepted_[k];
+      if(active_[k])
+        numActive++;
+    }
+  }
+  
+  numRejected_ = N - numActive;
+  
+  for(i = 0; i < NUM_ITERATIONS_ && numActive > 0; i++)
+  {
+    // warp the second image by the current motion field
+#ifdef WITH_OPENMP
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+    for(y = 0; y < height_; y++)
+    {
+      T IDiff;
+      T gxs, gys;
+      
+      for(int x = 0; x < width_; x++)
+      {
+        IDiff = (I2_.linear_at2(x + V(x, y, 0, 0), y + V(x, y, 0, 1)) - 
+                 I1_(x, y)) * INTENSITY_SCALE_;
+        gxs = G1_(x, y, 0, 0);
+        gys = G1_(x, y, 0, 1);
+        
+        P(x, y, 0, 0) = IDiff * gxs;
+        P(x, y, 0, 1) = IDiff * gys;
+        P(x, y, 0, 2) = IDiff * IDiff;
+      }
+    }
+    
+    computeWindowSums_(P, S);
+    
+#ifdef WITH_OPENMP
+    #pragma omp parallel for num_threads(numThreads) schedule(static) reduction(+:numActive,numIterations,numTerminated)
+#endif
+    for(y = 0; y < height_; y++)
+    {
+      double D;
+      double deltavx, deltavy;
+      double sumx2, sumxy, sumy2;
+      double sumdx, sumdy;
+      double rSum;
+      int k = y * width_;
+      
+      for(int x = 0; x < width_; x++, k++)
+      {
+        if(!active_[k])
+          continue;
+        
+        sumdx = S(x, y, 0, 0);
+        sumdy = S(x, y, 0, 1);
+        rSum  = S(x, y, 0, 2);
+        
+        // Terminate the iteration if it doesn't converge. 
+        if(rSum > rSums_[k] && i > 0)
+        {
+          active_[k] = false;
+          numActive--;
+          numTerminated++;
+          continue;
+        }
+        rSums_[k] = rSum;
+        
+        sumx2 = GWG_(x, y, 0, 0);
+        sumxy = GWG_(x, y, 0, 1);
+        sumy2 = GWG_(x, y, 0, 2);
+        D = sumx2 * sumy2 - sumxy * sumxy;
+        
+        deltavx = (sumy2*sumdx - sumxy*sumdy) / D;
+        deltavy = (-sumxy*sumdx + sumx2*sumdy) / D;
+        
+        V(x, y, 0, 0) -= deltavx;
+        V(x, y, 0, 1) -= deltavy;
+        numIterations++;
+      }
+    }
+  }
+  
+  numIterations_ = numIterations;
+  numTerminated_ = numTerminated;
+  
+#ifdef WITH_OPENMP
+  #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for(y = 0; y < height_; y++)
+  {
+    LSQResults results;
+    ResidualStats &stats = rowResidualStats_[y];
+    int k = y * width_;
+    
+    stats.sum = 0.0;
+    stats.max = 0.0;
+    stats.numTerms = 0;
+    
+    for(int x = 0; x < width_; x++, k++)
+    {
+      computeQuality_(smallerLambdas_[k], rSums_[k], accepted_[k], results, stats);
+      for(int j = 0; j < getNumResultQualityChannels(); j++)
+        V(x, y, 0, 2 + j) = results.quality[j];
+    }
+  }
 }
 
 // Computes eigenvalues of a 2x2 matrix
 // |a   b|
 // |b   c|.
-void LucasKanade::computeEigenValues_(double a, double b, double c,
-                                      double &lambda1, double &lambda2)
+template < class T >
+void LucasKanade< T >::computeEigenValues_(double a, double b, double c,
+                                           double &lambda1, double &lambda2)
 {
   lambda1 = 0.5 * (a + c + sqrt(4.0*b*b + (a - c)*(a - c)));
   lambda2 = 0.5 * (a + c - sqrt(4.0*b*b + (a - c)*(a - c)));
 }
 
-void LucasKanade::computeGradients_(const CImg< unsigned char > &I,
-                                    CImg< double > &G)
+template < class T >
+void LucasKanade< T >::computeGradients_(const CImg< unsigned char > &I,
+                                         CImg< T > &G)
 {
-  G = CImg< double >(width_, height_, 1, 2);
-  
-  CImg< double > Kx = CImg< double >(5, 1);
-  CImg< double > Ky = CImg< double >(1, 5);
+  // The five-point central difference kernel is applied as by 
+  // CImg::get_convolve (i.e. reversed) with zero boundary conditions, 
+  // but the result is written directly to G. The integer kernel 
+  // sums are exact, so the result equals that of convertGradients_ 
+  // for gradients computed by ImagePyramid.
+  const T k = 1.0 / 12.0 * INTENSITY_SCALE_;
+  const int K[5] = { 1, -8, 0, 8, -1 };
   
-  Kx(0, 0) = -1.0 / 12.0 * INTENSITY_SCALE_;
-  Kx(1, 0) = 8.0 / 12.0 * INTENSITY_SCALE_;
-  Kx(2, 0) = 0.0;
-  Kx(3, 0) = -8.0 / 12.0 * INTENSITY_SCALE_;
-  Kx(4, 0) = 1.0 / 12.0 * INTENSITY_SCALE_;
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  int y;
   
-  Ky(0, 0) = -1.0 / 12.0 * INTENSITY_SCALE_;
-  Ky(0, 1) = 8.0 / 12.0 * INTENSITY_SCALE_;
-  Ky(0, 2) = 0.0;
-  Ky(0, 3) = -8.0 / 12.0 * INTENSITY_SCALE_;
-  Ky(0, 4) = 1.0 / 12.0 * INTENSITY_SCALE_;
+#ifdef WITH_OPENMP
+  #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for(y = 0; y < height_; y++)
+  {
+    int gx, gy;
+    
+    for(int x = 0; x < width_; x++)
+    {
+      gx = 0;
+      gy = 0;
+      
+      for(int i = -2; i <= 2; i++)
+      {
+        if(x + i >= 0 && x + i < width_)
+          gx += I(x + i, y) * K[i + 2];
+        if(y + i >= 0 && y + i < height_)
+          gy += I(x, y + i) * K[i + 2];
+      }
+      
+      G(x, y, 0, 0) = T(gx) * k;
+      G(x, y, 0, 1) = T(gy) * k;
+    }
+  }
+}
+
+template < class T >
+void LucasKanade< T >::convertGradients_(const CImg< short > &Gi,
+                                         CImg< T > &G)
+{
+  const T k = 1.0 / 12.0 * INTENSITY_SCALE_;
+  const int N = Gi.size();
+  const short *gi = Gi.ptr();
+  T *g = G.ptr();
   
-  G.get_shared_channel(0) = I.get_convolve(Kx, 0);
-  G.get_shared_channel(1) = I.get_convolve(Ky, 0);
+  for(int i = 0; i < N; i++)
+    g[i] = T(gi[i]) * k;
 }
 
-void LucasKanade::computeLSQVelocity_(const LSQInput &input,
-                                      LSQResults &results)
+template < class T >
+void LucasKanade< T >::computeLSQVelocity_(const LSQInput &input,
+                                           LSQResults &results,
+                                           ResidualStats &stats)
 {
   bool accepted = false;
   double D;
   double deltavx, deltavy;
   int i;
-  double I1s, I2s;
-  double IDiff;
+  T I1s, I2s;
+  T IDiff;
   double lambda1 = 0.0, lambda2 = 0.0;
-  double gxs, gys;
-  double prevrSum = 0.0, rSum = 0.0;
-  double r = 0.0;
+  T gxs, gys;
+  T prevrSum = 0, rSum = 0;
   double smallerLambda;
-  double sumdx;
-  double sumdy;
+  T sumdx;
+  T sumdy;
   double sumx2 = 0.0;
   double sumy2 = 0.0;
   double sumxy = 0.0;
-  double xd, yd;
+  T xd, yd;
   int xw, yw;
-  double w;
+  T w;
   int x1Abs, y1Abs;
-  double x2Abs, y2Abs;
+  T x2Abs, y2Abs;
   
   results.vx = input.ivx;
   results.vy = input.ivy;
   
-  sumx2 = roi_.getGWGElement(0, 0);
-  sumxy = roi_.getGWGElement(0, 1);
-  sumy2 = roi_.getGWGElement(1, 1);
-  D = roi_.computeDeterminant();
+  sumx2 = GWG_(input.x, input.y, 0, 0);
+  sumxy = GWG_(input.x, input.y, 0, 1);
+  sumy2 = GWG_(input.x, input.y, 0, 2);
+  D = sumx2 * sumy2 - sumxy * sumxy;
   
   computeEigenValues_(sumx2, sumxy, sumy2, lambda1, lambda2);
   smallerLambda = min(lambda1, lambda2);
@@ -280,25 +579,197 @@ void LucasKanade::computeLSQVelocity_(const LSQInput &input,
       if(rSum > prevrSum && i > 0)
       {
         rSum = prevrSum;
+        stats.numTerminated++;
         break;
       }
       
       results.vx -= deltavx;
       results.vy -= deltavy;
+      stats.numIterations++;
     }
   }
+  else
+    stats.numRejected++;
+  
+  computeQuality_(smallerLambda, rSum, accepted, results, stats);
+}
+
+template < class T >
+void LucasKanade< T >::computeQuality_(double smallerLambda, 
+                                       double rSum, 
+                                       bool accepted, 
+                                       LSQResults &results,
+                                       ResidualStats &stats)
+{
+  double r = 0.0;
   
   if(COMPUTE_RESIDUALS_ == true && accepted == true)
   {
     r = rSum / (WINDOW_SIZE_ * WINDOW_SIZE_);
-    residualSum_ += r;
+    stats.sum += r;
     
-    if(r > maxResidual_)
-      maxResidual_ = r;
+    if(r > stats.max)
+      stats.max = r;
     
-    numResidualSumTerms_++;
+    stats.numTerms++;
   }
   
   results.quality[0] = max(0.0, min(1.0, smallerLambda));
   results.quality[1] = min(255.0, 255.0 / (1000.0*r + 1.0))  / 255.0;
 }
+
+// Computes the structure tensor of each pixel.
+template < class T >
+void LucasKanade< T >::computeStructureTensor_()
+{
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  CImg< double > &P = sumWorkspace_.getBuffer(getBufferSlot_(PRODUCT_SLOT_), width_, height_, 3);
+  int y;
+  
+#ifdef WITH_OPENMP
+  #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for(y = 0; y < height_; y++)
+  {
+    double gx, gy;
+    
+    for(int x = 0; x < width_; x++)
+    {
+      gx = G1_(x, y, 0, 0);
+      gy = G1_(x, y, 0, 1);
+      
+      P(x, y, 0, 0) = gx * gx;
+      P(x, y, 0, 1) = gx * gy;
+      P(x, y, 0, 2) = gy * gy;
+    }
+  }
+  
+  computeWindowSums_(P, GWG_);
+}
+
+// Computes the weighted sums of each channel of P over the window 
+// centered at each pixel. The weighting kernel is a product of 
+// one-dimensional factors, so the sums are computed with a horizontal 
+// and a vertical one-dimensional pass. The image is extended with 
+// Neumann boundary conditions as in the per-pixel window loop of 
+// computeLSQVelocity_.
+template < class T >
+void LucasKanade< T >::computeWindowSums_(const CImg< double > &P, 
+                                          CImg< double > &S)
+{
+  const int numThreads = getNumWorkerThreads_();
+  const int R = WINDOW_RADIUS_;
+  const int PW = width_ + 2 * R;
+  
+  CImg< double > &H = sumWorkspace_.getBuffer(getBufferSlot_(HORIZONTAL_SUM_SLOT_), width_, height_, P.dimv());
+  // the extended rows of each thread
+  CImg< double > &rows = sumWorkspace_.getBuffer(getBufferSlot_(ROW_SLOT_), PW, numThreads);
+  int y;
+  
+  S.assign(width_, height_, 1, P.dimv());
+  
+  // horizontal pass
+#ifdef WITH_OPENMP
+  #pragma omp parallel num_threads(numThreads)
+#endif
+  {
+#ifdef WITH_OPENMP
+    double *Pr = rows.ptr(0, omp_get_thread_num());
+#else
+    double *Pr = rows.ptr();
+#endif
+    
+#ifdef WITH_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for(y = 0; y < height_; y++)
+    {
+      for(int c = 0; c < P.dimv(); c++)
+      {
+        const double *Pc = P.ptr(0, y, 0, c);
+        double *Hc = H.ptr(0, y, 0, c);
+        int x, xr;
+        
+        for(x = 0; x < PW; x++)
+        {
+          xr = x - R;
+          xr = xr < 0 ? 0 : (xr >= width_ ? width_ - 1 : xr);
+          Pr[x] = Pc[xr];
+        }
+        
+        for(x = 0; x < width_; x++)
+          Hc[x] = 0.0;
+        
+        for(int i = 0; i < WINDOW_SIZE_; i++)
+        {
+          const double k = windowWeights_[i];
+          for(x = 0; x < width_; x++)
+            Hc[x] += k * Pr[x + i];
+        }
+      }
+    }
+  }
+  
+  // vertical pass
+#ifdef WITH_OPENMP
+  #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for(y = 0; y < height_; y++)
+  {
+    for(int c = 0; c < P.dimv(); c++)
+    {
+      double *Sc = S.ptr(0, y, 0, c);
+      int x, yr;
+      
+      for(x = 0; x < width_; x++)
+        Sc[x] = 0.0;
+      
+      for(int j = 0; j < WINDOW_SIZE_; j++)
+      {
+        yr = y - R + j;
+        yr = yr < 0 ? 0 : (yr >= height_ ? height_ - 1 : yr);
+        
+        const double k = windowWeights_[j];
+        const double *Hr = H.ptr(0, yr, 0, c);
+        for(x = 0; x < width_; x++)
+          Sc[x] += k * Hr[x];
+      }
+    }
+  }
+}
+
+template < class T >
+int LucasKanade< T >::getBufferSlot_(BufferSlot slot) const
+{
+  return NUM_BUFFER_SLOTS_ * bufferSet_ + slot;
+}
+
+template < class T >
+int LucasKanade< T >::getNumWorkerThreads_() const
+{
+#ifdef WITH_OPENMP
+  if(NUM_THREADS_ <= 0)
+    return omp_get_max_threads();
+#endif
+  return NUM_THREADS_ > 0 ? NUM_THREADS_ : 1;
+}
+
+// The Gaussian weighting kernel is isotropic, i.e. W(i,j) = f(i)*f(j), 
+// so its factors are the square roots of its diagonal elements.
+template < class T >
+void LucasKanade< T >::initWindowWeights_()
+{
+  windowWeights_.resize(WINDOW_SIZE_);
+  for(int i = 0; i < WINDOW_SIZE_; i++)
+  {
+    if(W_ != NULL)
+      windowWeights_[i] = sqrt((double)(*W_)(i, i));
+    else
+      windowWeights_[i] = 1.0;
+  }
+}
+
+template class LucasKanade< float >;
+template class LucasKanade< double >;
@@ -1,14 +1,16 @@
 
 #ifndef LUCASKANADE_H
 
-#include "LucasKanadeROI.h"
 #include "DenseMotionExtractor.h"
+#include "ImageWorkspace.h"
 
+#include "CImg_config.h"
+#include <CImg.h>
 #include <string>
-
-namespace cimg_library { template < class T > class CImg; }
+#include <vector>
 
 using namespace cimg_library;
+using namespace std;
 
 /// Implements single-resolution Lucas and Kanade motion extractor.
 /**
@@ -21,9 +23,24 @@ using namespace cimg_library;
  *
  * and the C-implementation found at ftp://ftp.csd.uwo.ca/pub/vision/LUCAS
  */
-class LucasKanade : public DenseMotionExtractor
+template < class T = double > class LucasKanade : public DenseMotionExtractor< T >
 {
  public:
+  /// Defines how the second image is warped during the Gauss-Newton iterations.
+  /**
+   * LOCAL_WARP: the window of each pixel is warped by the motion vector 
+   * of that pixel, and the window sums are computed separately for 
+   * each pixel. This is the original formulation of the algorithm.
+   * 
+   * DENSE_WARP: the second image is warped once per iteration by the 
+   * whole motion field, and the window sums are computed for all 
+   * pixels with separable filtering. Each tap of a window is thus 
+   * warped by its own motion vector. This is much faster for large 
+   * windows, and gives nearly the same results where the motion 
+   * field is smooth.
+   */
+  enum WarpMode { LOCAL_WARP, DENSE_WARP };
+  
   /// Default constructor. 
   /**
    * Constructs a Lucas and Kanade motion extractor with the default parameters.
@@ -31,21 +48,30 @@ class LucasKanade : public DenseMotionExtractor
    * - number of iterations = 5
    * - tau = 0.0025
    * - sigmap = 0
+   * - warp mode = LOCAL_WARP
+   * - number of threads = 1
    */
   LucasKanade();
   
   /// Parametrized constructor.
+  /**
+   * The pixels are divided over numThreads threads in bands of 
+   * consecutive rows. Zero means that all available processors 
+   * are used. The result does not depend on the number of threads.
+   */
   LucasKanade(int windowRadius,
               int numIterations,
               float tau,
               float sigmap,
-              bool useWeightingKernel);
+              bool useWeightingKernel,
+              WarpMode warpMode = LOCAL_WARP,
+              int numThreads = 1);
   
   ~LucasKanade();
   
   void compute(const CImg< unsigned char > &I1,
                const CImg< unsigned char > &I2,
-               CImg< double > &V);
+               CImg< T > &V);
   
   string getName() const;
   
@@ -53,28 +79,61 @@ class LucasKanade : public DenseMotionExtractor
   
   int getNumResultQualityChannels() const;
   
+  int getNumThreads() const;
+  
   double getSigmap() const;
   
   double getTau() const;
   
+  WarpMode getWarpMode() const;
+  
   int getWindowSize() const;
   
   bool isDual() const;
   
-  void printInfoText() const;
+  void printInfoText(ostream &out) const;
+  
+  void releaseBuffers();
+  
+  void selectBufferSet(int index);
+  
+  /// Sets precomputed gradients of the first input image.
+  /**
+   * The gradients are used by the following calls to compute 
+   * instead of computing them from the image. They must have 
+   * the dimensions of the image and must have been computed 
+   * with ImagePyramid::FIVE_POINT_GRADIENT. A NULL pointer 
+   * restores the default.
+   */
+  void setInputGradients(const CImg< short > *G1);
 private:
   struct LSQInput
   {
     int x, y;
-    double ivx, ivy;
+    T ivx, ivy;
   };
   
   struct LSQResults
   {
-    double vx, vy;
-    double quality[2];
+    T vx, vy;
+    T quality[2];
   };
   
+  struct ResidualStats
+  {
+    double sum;
+    double max;
+    int numTerms;
+    // counts of the pixels (or iterations) for the profiler
+    int numRejected;
+    int numIterations;
+    int numTerminated;
+  };
+  
+  // workspace slots of the buffers
+  enum BufferSlot { GRADIENT_SLOT_, STRUCTURE_TENSOR_SLOT_, PRODUCT_SLOT_, WINDOW_SUM_SLOT_, 
+                    HORIZONTAL_SUM_SLOT_, ROW_SLOT_, NUM_BUFFER_SLOTS_ };
+  
   const bool COMPUTE_RESIDUALS_;
   const double INTENSITY_SCALE_;
   
@@ -83,23 +142,73 @@ private:
   const double TAU_;
   const double SIGMAP_;
   const int WINDOW_SIZE_;
+  const WarpMode WARP_MODE_;
+  const int NUM_THREADS_;
   
   double residualSum_;
   double maxResidual_;
   int numResidualSumTerms_;
-  LucasKanadeROI roi_;
-  CImg< double > *W_;
+  // per-row residual statistics
+  vector< ResidualStats > rowResidualStats_;
+  // pixels rejected by TAU_, Gauss-Newton iterations and iteration 
+  // loops terminated because the residual increased in the last call
+  long numRejected_;
+  long numIterations_;
+  long numTerminated_;
+  CImg< T > *W_;
   int width_, height_;
   CImg< unsigned char > I1_, I2_;
-  CImg< double > G1_;
+  CImg< T > G1_;
+  // precomputed gradients of I1 (optional)
+  const CImg< short > *inputGradients_;
+  
+  // Structure tensor of each pixel, i.e. the weighted sums of 
+  // gx^2, gx*gy and gy^2 (channels 0-2) over the window centered 
+  // at the pixel. The sums are accumulated in double precision.
+  CImg< double > GWG_;
+  
+  // one-dimensional factors of the weighting kernel
+  vector< double > windowWeights_;
+  
+  // buffers for each buffer set
+  ImageWorkspace< T > workspace_;
+  ImageWorkspace< double > sumWorkspace_;
+  int bufferSet_;
+  
+  // per-pixel state of the DENSE_WARP iteration
+  vector< double > smallerLambdas_;
+  vector< double > rSums_;
+  // (vector< bool > is not safe to write from several threads)
+  vector< char > accepted_;
+  vector< char > active_;
   
   void computeEigenValues_(double a, double b, double c,
                            double &lambda1, double &lambda2);
   
   void computeGradients_(const CImg< unsigned char > &I,
-                         CImg< double > &G);
+                         CImg< T > &G);
+  
+  void convertGradients_(const CImg< short > &Gi,
+                         CImg< T > &G);
+  
+  void computeLSQVelocity_(const LSQInput &input, LSQResults &results, 
+                           ResidualStats &stats);
+  
+  void computeQuality_(double smallerLambda, double rSum, bool accepted, 
+                       LSQResults &results, ResidualStats &stats);
+  
+  void computeDenseLSQVelocities_(CImg< T > &V);
+  
+  void computeStructureTensor_();
+  
+  void computeWindowSums_(const CImg< double > &P, CImg< double > &S);
+  
+  // returns the workspace slot of a buffer in the current buffer set
+  int getBufferSlot_(BufferSlot slot) const;
+  
+  int getNumWorkerThreads_() const;
   
-  void computeLSQVelocity_(const LSQInput &input, LSQResults &results);
+  void initWindowWeights_();
 };
 
 #define LUCASKANADE_H
@@ -116,14 +116,14 @@ bool LucasKanadeOpenCV::isDual() const
   return false;
 }
 
-void LucasKanadeOpenCV::printInfoText() const
+void LucasKanadeOpenCV::printInfoText(ostream &out) const
 {
-  cout<<"Lucas-Kanade optical flow algorithm (OpenCV implementation)"<<endl;
-  cout<<"==========================================================="<<endl;
+  out<<"Lucas-Kanade optical flow algorithm (OpenCV implementation)"<<endl;
+  out<<"==========================================================="<<endl;
   
   // TODO
-  /*cout<<"Input image width: "<<baseWidth<<endl;
-  cout<<"Input image height: "<<baseHeight<<endl;*/
+  /*out<<"Input image width: "<<baseWidth<<endl;
+  out<<"Input image height: "<<baseHeight<<endl;*/
 }
 
 #endif
@@ -26,7 +26,7 @@ public:
   
   bool isDual() const;
   
-  void printInfoText() const;
+  void printInfoText(ostream &out) const;
 private:
   const double EPSILON_;
   const int MAX_NUM_FEATURE_POINTS_;
@@ -0,0 +1,336 @@
+
+#include "MappedDenseVectorField.h"
+#include "VectorFieldEncoding.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace VectorFieldEncoding;
+
+static const int TOKEN_SIZE = 100;
+
+// the largest number of channels (as in the PDV2 format)
+static const int MAX_NUM_CHANNELS = 64;
+
+// Extracts a token from the header in the same way as
+// PNMFileUtils::extractToken. p is advanced past the token.
+static void extractToken_(const char *&p, const char *end, char *token)
+{
+  int count = 0;
+
+  // skip whitespace and comments
+  while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '#'))
+  {
+    if(*p == '#')
+      while(p < end && *p != '\n')
+        p++;
+    else
+      p++;
+  }
+
+  // copy data into token
+  while(p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '.')
+  {
+    if(count >= TOKEN_SIZE - 1)
+      throw runtime_error("Token too large");
+    token[count++] = *p++;
+  }
+
+  if(p == end)
+    throw runtime_error("Invalid PDVM header.");
+  token[count] = '\0';
+}
+
+static void decodeValues_(const unsigned char *src, float *dst, int n,
+                          Encoding encoding, int scale, vector< float > &)
+{
+  decode(src, dst, n, encoding, scale);
+}
+
+static void decodeValues_(const unsigned char *src, double *dst, int n,
+                          Encoding encoding, int scale, vector< float > &buffer)
+{
+  buffer.resize(n);
+  decode(src, &buffer[0], n, encoding, scale);
+  for(int i = 0; i < n; i++)
+    dst[i] = buffer[i];
+}
+
+template < class T >
+static void getVectorField_(const MappedDenseVectorField &F,
+                            int x0, int y0, int width, int height,
+                            CImg< T > &V)
+{
+  const int C = F.getNumChannels();
+
+  if(x0 < 0 || y0 < 0 || width <= 0 || height <= 0 ||
+     x0 + width > F.getWidth() || y0 + height > F.getHeight())
+    throw runtime_error("Invalid region.");
+
+  V.assign(width, height, 1, C);
+
+  // The encoded components are stored in planes, so each row of 
+  // the region is decoded from a contiguous run of values.
+  if(F.isEncoded())
+  {
+    const size_t numPixels = (size_t)F.getWidth() * F.getHeight();
+    const unsigned char *plane = F.getEncodedData();
+    vector< float > buffer;
+
+    for(int c = 0; c < C; c++)
+    {
+      const Encoding encoding = c < 2 ? F.getFlowEncoding() : F.getQualityEncoding();
+      const int size = getEncodingSize(encoding);
+
+      for(int y = 0; y < height; y++)
+      {
+        decodeValues_(plane + ((size_t)(y0 + y) * F.getWidth() + x0) * size,
+                      V.ptr(0, y, 0, c), width, encoding, F.getFlowScale(), buffer);
+      }
+      plane += numPixels * size;
+    }
+
+    return;
+  }
+
+  vector< T * > channels(C);
+  for(int y = 0; y < height; y++)
+  {
+    const float *src = F.getRow(y0 + y) + x0 * C;
+
+    // The common case of motion vectors with one quality channel
+    // is unrolled.
+    if(C == 3)
+    {
+      T *u = V.ptr(0, y, 0, 0), *v = V.ptr(0, y, 0, 1), *q = V.ptr(0, y, 0, 2);
+      for(int x = 0; x < width; x++, src += 3)
+      {
+        u[x] = src[0];
+        v[x] = src[1];
+        q[x] = src[2];
+      }
+    }
+    else
+    {
+      for(int c = 0; c < C; c++)
+        channels[c] = V.ptr(0, y, 0, c);
+      for(int x = 0; x < width; x++)
+        for(int c = 0; c < C; c++)
+          channels[c][x] = *src++;
+    }
+  }
+}
+
+MappedDenseVectorField::MappedDenseVectorField() :
+  map_(NULL),
+  mapSize_(0),
+  data_(NULL),
+  encodedData_(NULL),
+  flowEncoding_(FLOAT32),
+  qualityEncoding_(FLOAT32),
+  flowScale_(1),
+  width_(0),
+  height_(0),
+  numChannels_(0) { }
+
+MappedDenseVectorField::MappedDenseVectorField(const string &fileName) :
+  map_(NULL),
+  mapSize_(0),
+  data_(NULL),
+  encodedData_(NULL),
+  flowEncoding_(FLOAT32),
+  qualityEncoding_(FLOAT32),
+  flowScale_(1),
+  width_(0),
+  height_(0),
+  numChannels_(0)
+{
+  open(fileName);
+}
+
+MappedDenseVectorField::~MappedDenseVectorField()
+{
+  close();
+}
+
+void MappedDenseVectorField::close()
+{
+  if(map_ != NULL)
+    munmap(map_, mapSize_);
+
+  map_ = NULL;
+  mapSize_ = 0;
+  data_ = NULL;
+  encodedData_ = NULL;
+  vector< float >().swap(alignedData_);
+  flowEncoding_ = FLOAT32;
+  qualityEncoding_ = FLOAT32;
+  flowScale_ = 1;
+  width_ = 0;
+  height_ = 0;
+  numChannels_ = 0;
+}
+
+void MappedDenseVectorField::getVectorField(CImg< double > &V) const
+{
+  getVectorField_(*this, 0, 0, width_, height_, V);
+}
+
+void MappedDenseVectorField::getVectorField(CImg< float > &V) const
+{
+  getVectorField_(*this, 0, 0, width_, height_, V);
+}
+
+void MappedDenseVectorField::getVectorField(int x0, int y0, int width, int height,
+                                            CImg< double > &V) const
+{
+  getVectorField_(*this, x0, y0, width, height, V);
+}
+
+void MappedDenseVectorField::getVectorField(int x0, int y0, int width, int height,
+                                            CImg< float > &V) const
+{
+  getVectorField_(*this, x0, y0, width, height, V);
+}
+
+void MappedDenseVectorField::open(const string &fileName)
+{
+  open_(fileName, 0, 0, true);
+}
+
+void MappedDenseVectorField::open(const string &fileName, uint64_t offset, uint64_t size)
+{
+  open_(fileName, offset, size, false);
+}
+
+void MappedDenseVectorField::open_(const string &fileName, uint64_t offset, uint64_t size,
+                                   bool wholeFile)
+{
+  char token[TOKEN_SIZE];
+  struct stat fileStat;
+
+  close();
+
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if(fd == -1)
+    throw runtime_error("File not found.");
+
+  if(fstat(fd, &fileStat) == -1)
+  {
+    ::close(fd);
+    throw runtime_error("Invalid PDVM file.");
+  }
+  if(wholeFile)
+    size = fileStat.st_size;
+  if(size == 0 || offset > (uint64_t)fileStat.st_size || size > fileStat.st_size - offset)
+  {
+    ::close(fd);
+    throw runtime_error("Invalid PDVM file.");
+  }
+
+  // The offset of a mapping must be a multiple of the page size.
+  const uint64_t pageOffset = offset % sysconf(_SC_PAGESIZE);
+  mapSize_ = size + pageOffset;
+  map_ = mmap(NULL, mapSize_, PROT_READ, MAP_PRIVATE, fd, offset - pageOffset);
+  ::close(fd);
+  if(map_ == MAP_FAILED)
+  {
+    map_ = NULL;
+    mapSize_ = 0;
+    throw runtime_error("Error mapping file " + fileName);
+  }
+
+  try
+  {
+    const char *begin = (const char *)map_ + pageOffset;
+    const char *end = begin + size;
+    const char *p = begin;
+
+    extractToken_(p, end, token);
+    const bool isEncoded = strcmp(token, "PDVE") == 0;
+    if(!isEncoded && strcmp(token, "PDV") != 0)
+      throw runtime_error("Bad magic number " + string(token) + " != PDV");
+
+    // get dimensions
+    extractToken_(p, end, token);
+    width_ = atoi(token);
+    extractToken_(p, end, token);
+    height_ = atoi(token);
+
+    // read the number of quality channels
+    extractToken_(p, end, token);
+    const int numQualityChannels = atoi(token);
+    if(numQualityChannels < 0 || numQualityChannels > MAX_NUM_CHANNELS - 2)
+      throw runtime_error("Invalid PDVM header.");
+    numChannels_ = 2 + numQualityChannels;
+
+    // read the encodings
+    if(isEncoded)
+    {
+      try
+      {
+        extractToken_(p, end, token);
+        flowEncoding_ = getEncoding(token);
+        extractToken_(p, end, token);
+        qualityEncoding_ = getEncoding(token);
+      }
+      catch(invalid_argument &e)
+      {
+        throw runtime_error(e.what());
+      }
+      extractToken_(p, end, token);
+      flowScale_ = atoi(token);
+    }
+
+    // skip the character terminating the header
+    p++;
+
+    if(width_ <= 0 || height_ <= 0 || numChannels_ < 2 || flowScale_ <= 0)
+      throw runtime_error("Invalid PDVM header.");
+
+    // The pixel count is compared before the data size is computed, 
+    // which could overflow otherwise.
+    const size_t numPixels = (size_t)width_ * height_;
+    const size_t pixelSize = 2 * (size_t)getEncodingSize(flowEncoding_) + 
+                             (size_t)(numChannels_ - 2) * getEncodingSize(qualityEncoding_);
+    if(p > end || numPixels > (size_t)(end - p) / pixelSize)
+      throw runtime_error("Truncated PDVM file.");
+    const size_t dataSize = numPixels * pixelSize;
+
+    // The mapping is page-aligned, so the data is aligned if
+    // its offset in the file is a multiple of the float size.
+    if((offset + (p - begin)) % sizeof(float) == 0)
+    {
+      if(isEncoded)
+        encodedData_ = (const unsigned char *)p;
+      else
+        data_ = (const float *)p;
+      madvise(map_, mapSize_, MADV_SEQUENTIAL);
+    }
+    else
+    {
+      alignedData_.resize((dataSize + sizeof(float) - 1) / sizeof(float));
+      memcpy(&alignedData_[0], p, dataSize);
+      if(isEncoded)
+        encodedData_ = (const unsigned char *)&alignedData_[0];
+      else
+        data_ = &alignedData_[0];
+
+      munmap(map_, mapSize_);
+      map_ = NULL;
+      mapSize_ = 0;
+    }
+  }
+  catch(runtime_error &)
+  {
+    close();
+    throw;
+  }
+}
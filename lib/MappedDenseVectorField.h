@@ -0,0 +1,182 @@
+
+#ifndef MAPPEDDENSEVECTORFIELD_H
+
+#include "VectorFieldEncoding.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements read-only access to a PDVM file through a memory mapping.
+/**
+ * The file is mapped into memory, and its header is parsed once.
+ * The vectors are then accessed directly in the mapped file
+ * without reading or copying them. This is useful e.g. when only
+ * a part of a vector field is needed, or when a large number of
+ * files are read. See DenseVectorFieldIO for the PDVM format.
+ *
+ * The vectors are stored interleaved: the 2+q single-precision
+ * components of each pixel are consecutive, and the pixels are in
+ * raster order. The components are in the byte order of the
+ * machine, as written by DenseVectorFieldIO.
+ *
+ * The vectors can only be accessed in place if they start at a
+ * multiple of four bytes from the beginning of the file, which
+ * depends on the length of the header. Otherwise they are copied
+ * to an aligned buffer when the file is opened (see isZeroCopy).
+ * The files written by DenseVectorFieldIO are padded so that the
+ * vectors are aligned.
+ *
+ * The CImg images used by this library store the channels in
+ * separate planes, so getVectorField converts the interleaved
+ * vectors in one pass.
+ *
+ * Files whose components are stored with a reduced precision (the
+ * PDVE variant, see DenseVectorFieldWriter) are also supported.
+ * Their components cannot be accessed as floats in place, so
+ * getData returns NULL for them, and they are decoded by
+ * getVectorField.
+ */
+class MappedDenseVectorField
+{
+public:
+  /// Constructs an object with no file opened.
+  MappedDenseVectorField();
+
+  /// Opens a PDVM file, see open.
+  explicit MappedDenseVectorField(const string &fileName);
+
+  /// Closes the file.
+  ~MappedDenseVectorField();
+
+  /// Unmaps the file, if one is opened.
+  void close();
+
+  /// Returns the vectors (2+q interleaved components per pixel in raster order).
+  /**
+   * Returns NULL if the file is not opened or if its components 
+   * are encoded (see isEncoded).
+   */
+  const float *getData() const { return data_; }
+
+  /// Returns the encoded components of a PDVE file, or NULL if the file is not encoded.
+  /**
+   * The components are stored in planes, see DenseVectorFieldWriter.
+   */
+  const unsigned char *getEncodedData() const { return encodedData_; }
+
+  /// Returns the encoding of the motion vectors.
+  VectorFieldEncoding::Encoding getFlowEncoding() const { return flowEncoding_; }
+
+  /// Returns the number of units per pixel of the FIXED16 encoding.
+  int getFlowScale() const { return flowScale_; }
+
+  /// Returns the height of the vector field.
+  int getHeight() const { return height_; }
+
+  /// Returns the number of components of each vector (2+number of quality channels).
+  int getNumChannels() const { return numChannels_; }
+
+  /// Returns the number of quality channels.
+  int getNumQualityChannels() const { return numChannels_ - 2; }
+
+  /// Returns the encoding of the quality channels.
+  VectorFieldEncoding::Encoding getQualityEncoding() const { return qualityEncoding_; }
+
+  /// Returns the first vector of a row. The file must not be encoded.
+  const float *getRow(int y) const { return data_ + (size_t)y * width_ * numChannels_; }
+
+  /// Converts the vector field to an image with one channel for each component.
+  /**
+   * V is resized to width x height x 1 x (2+q).
+   */
+  void getVectorField(CImg< double > &V) const;
+
+  /// Converts the vector field to a single-precision image with one channel for each component.
+  void getVectorField(CImg< float > &V) const;
+
+  /// Converts a region of the vector field to an image with one channel for each component.
+  /**
+   * Throws runtime_error if the region is not inside the vector
+   * field.
+   */
+  void getVectorField(int x0, int y0, int width, int height,
+                      CImg< double > &V) const;
+
+  /// Converts a region of the vector field to a single-precision image.
+  void getVectorField(int x0, int y0, int width, int height,
+                      CImg< float > &V) const;
+
+  /// Returns the width of the vector field.
+  int getWidth() const { return width_; }
+
+  /// Returns true if the components of the file are encoded with a reduced precision.
+  bool isEncoded() const { return encodedData_ != NULL; }
+
+  /// Returns true if a file is opened.
+  bool isOpen() const { return data_ != NULL || encodedData_ != NULL; }
+
+  /// Returns true if the data is accessed in the mapped file instead of a copy.
+  bool isZeroCopy() const { return isOpen() && alignedData_.empty(); }
+
+  /// Maps a PDVM file into memory and parses its header.
+  /**
+   * A previously opened file is closed first. Throws
+   * runtime_error if the file cannot be opened or if it is not
+   * a valid PDVM file.
+   */
+  void open(const string &fileName);
+
+  /// Maps a PDVM file stored in a part of a larger file, e.g. a frame of a PDVS file.
+  /**
+   * Only the given part of the file is mapped. See 
+   * DenseVectorFieldSequence.
+   * @param fileName the file containing the vector field
+   * @param offset the position of the PDVM header in the file
+   * @param size the size of the vector field including the header
+   */
+  void open(const string &fileName, uint64_t offset, uint64_t size);
+
+  /// Returns the cth component of the vector at (x, y). The file must not be encoded.
+  float operator()(int x, int y, int c) const
+  {
+    return data_[((size_t)y * width_ + x) * numChannels_ + c];
+  }
+private:
+  // the mapped file
+  void *map_;
+  size_t mapSize_;
+
+  // the vectors in the mapped file or in alignedData_
+  const float *data_;
+
+  // the encoded components in the mapped file or in alignedData_
+  const unsigned char *encodedData_;
+
+  // a copy of the data if it is not aligned in the file
+  vector< float > alignedData_;
+
+  VectorFieldEncoding::Encoding flowEncoding_;
+  VectorFieldEncoding::Encoding qualityEncoding_;
+  int flowScale_;
+
+  int width_, height_;
+  int numChannels_;
+
+  // copying is not supported
+  MappedDenseVectorField(const MappedDenseVectorField &);
+  MappedDenseVectorField &operator=(const MappedDenseVectorField &);
+
+  // maps size bytes from offset, or the rest of the file if wholeFile is true
+  void open_(const string &fileName, uint64_t offset, uint64_t size, bool wholeFile);
+};
+
+#define MAPPEDDENSEVECTORFIELD_H
+
+#endif
@@ -0,0 +1,173 @@
+
+#include "MiddleburyFlowIO.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <fstream>
+#include <math.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+static const int HEADER_SIZE = 12;
+static const float TAG = 202021.25f;
+
+// the threshold of unknown flow values and the value written for them
+static const float UNKNOWN_FLOW_THRESHOLD = 1e9f;
+static const float UNKNOWN_FLOW = 1e10f;
+
+static void putFloat_(unsigned char *p, float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(float));
+  for(int i = 0; i < 4; i++)
+    p[i] = (unsigned char)(bits >> (8 * i));
+}
+
+static uint32_t getUInt32_(const unsigned char *p)
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; i++)
+    value |= (uint32_t)p[i] << (8 * i);
+  return value;
+}
+
+static float getFloat_(const unsigned char *p)
+{
+  const uint32_t bits = getUInt32_(p);
+  float value;
+  memcpy(&value, &bits, sizeof(float));
+  return value;
+}
+
+template < class T >
+static void readVectorField_(const string &inFileName, CImg< T > &V)
+{
+  unsigned char header[HEADER_SIZE];
+  ifstream inputStream(inFileName.c_str(), ios::binary | ios::in);
+
+  if(!inputStream)
+    throw runtime_error("File not found.");
+
+  inputStream.read((char *)header, HEADER_SIZE);
+  if(!inputStream || getFloat_(header) != TAG)
+    throw runtime_error("Invalid .flo file.");
+
+  const int width = (int32_t)getUInt32_(header + 4);
+  const int height = (int32_t)getUInt32_(header + 8);
+  // CImg computes the size of an image in unsigned int.
+  if(width <= 0 || height <= 0 || (uint64_t)width * height * 3 > 0xffffffffu)
+    throw runtime_error("Invalid .flo header.");
+
+  // The field is not allocated before it is known to fit in the file.
+  inputStream.seekg(0, ios::end);
+  const uint64_t fileSize = inputStream.tellg();
+  inputStream.seekg(HEADER_SIZE);
+  if(!inputStream || (uint64_t)width * height * 8 > fileSize - HEADER_SIZE)
+    throw runtime_error("Truncated .flo file.");
+
+  // the rows are read one at a time
+  vector< unsigned char > row((size_t)width * 8);
+
+  V.assign(width, height, 1, 3);
+  for(int y = 0; y < height; y++)
+  {
+    inputStream.read((char *)&row[0], row.size());
+    if(!inputStream)
+      throw runtime_error("Truncated .flo file.");
+
+    for(int x = 0; x < width; x++)
+    {
+      const float u = getFloat_(&row[x * 8]);
+      const float v = getFloat_(&row[x * 8 + 4]);
+
+      if(fabs(u) <= UNKNOWN_FLOW_THRESHOLD && fabs(v) <= UNKNOWN_FLOW_THRESHOLD)
+      {
+        V(x, y, 0, 0) = u;
+        V(x, y, 0, 1) = v;
+        V(x, y, 0, 2) = 1;
+      }
+      else
+      {
+        V(x, y, 0, 0) = 0;
+        V(x, y, 0, 1) = 0;
+        V(x, y, 0, 2) = 0;
+      }
+    }
+  }
+}
+
+template < class T >
+static void writeVectorField_(const CImg< T > &V,
+                              const string &outFileName,
+                              int validChannel)
+{
+  unsigned char header[HEADER_SIZE];
+
+  if(V.dimv() < 2 || validChannel >= V.dimv())
+    throw runtime_error("Invalid vector field.");
+
+  ofstream outputStream(outFileName.c_str(), ios::binary | ios::out);
+  if(!outputStream)
+    throw runtime_error("Error creating file " + outFileName);
+
+  putFloat_(header, TAG);
+  for(int i = 0; i < 4; i++)
+  {
+    header[4 + i] = (unsigned char)(V.dimx() >> (8 * i));
+    header[8 + i] = (unsigned char)(V.dimy() >> (8 * i));
+  }
+  outputStream.write((const char *)header, HEADER_SIZE);
+
+  vector< unsigned char > row((size_t)V.dimx() * 8);
+  for(int y = 0; y < V.dimy(); y++)
+  {
+    for(int x = 0; x < V.dimx(); x++)
+    {
+      const bool isValid = validChannel < 0 || V(x, y, 0, validChannel) != 0;
+
+      putFloat_(&row[x * 8], isValid ? (float)V(x, y, 0, 0) : UNKNOWN_FLOW);
+      putFloat_(&row[x * 8 + 4], isValid ? (float)V(x, y, 0, 1) : UNKNOWN_FLOW);
+    }
+    outputStream.write((const char *)&row[0], row.size());
+  }
+
+  outputStream.close();
+  if(!outputStream)
+    throw runtime_error("Error writing file " + outFileName);
+}
+
+bool MiddleburyFlowIO::isMiddleburyFlow(const string &fileName)
+{
+  ifstream inputStream(fileName.c_str(), ios::binary | ios::in);
+  char tag[4];
+
+  inputStream.read(tag, 4);
+
+  return inputStream && memcmp(tag, "PIEH", 4) == 0;
+}
+
+void MiddleburyFlowIO::readVectorField(const string &inFileName, CImg< double > &V)
+{
+  readVectorField_(inFileName, V);
+}
+
+void MiddleburyFlowIO::readVectorField(const string &inFileName, CImg< float > &V)
+{
+  readVectorField_(inFileName, V);
+}
+
+void MiddleburyFlowIO::writeVectorField(const CImg< double > &V,
+                                        const string &outFileName,
+                                        int validChannel)
+{
+  writeVectorField_(V, outFileName, validChannel);
+}
+
+void MiddleburyFlowIO::writeVectorField(const CImg< float > &V,
+                                        const string &outFileName,
+                                        int validChannel)
+{
+  writeVectorField_(V, outFileName, validChannel);
+}
@@ -0,0 +1,60 @@
+
+#ifndef MIDDLEBURYFLOWIO_H
+
+#include <string>
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements methods for reading and writing motion fields in the Middlebury .flo format.
+/**
+ * The .flo format is used by the Middlebury and MPI Sintel optical
+ * flow benchmarks. The integers and floats are stored in
+ * little-endian byte order:
+ *   202021.25               float32, the tag "PIEH"
+ *   width, height           int32
+ *   u, v                    float32 pairs of each pixel in raster order
+ *
+ * Values larger than 1e9 in magnitude denote unknown flow. When a
+ * file is read, the vector field has a third channel that is 1 for
+ * the pixels with a known flow and 0 for the others, in the same
+ * way as in KITTIFlowIO. The unknown vectors are set to zero.
+ */
+class MiddleburyFlowIO
+{
+public:
+  /// Returns true if the given file is in .flo format.
+  static bool isMiddleburyFlow(const string &fileName);
+
+  /// Reads a motion field from a .flo file.
+  /**
+   * V is resized to width x height x 1 x 3. Throws runtime_error
+   * if the file cannot be read.
+   */
+  static void readVectorField(const string &inFileName, CImg< double > &V);
+
+  /// Reads a single-precision motion field from a .flo file.
+  static void readVectorField(const string &inFileName, CImg< float > &V);
+
+  /// Writes a motion field to a .flo file.
+  /**
+   * @param V the motion field
+   * @param outFileName the file to write
+   * @param validChannel if >= 0, the vectors are written as unknown
+   *        at the pixels where this channel of V is zero
+   */
+  static void writeVectorField(const CImg< double > &V,
+                               const string &outFileName,
+                               int validChannel = -1);
+
+  /// Writes a single-precision motion field to a .flo file.
+  static void writeVectorField(const CImg< float > &V,
+                               const string &outFileName,
+                               int validChannel = -1);
+};
+
+#define MIDDLEBURYFLOWIO_H
+
+#endif
@@ -1,13 +1,16 @@
 
 #include "CImg_config.h"
 #include <CImg.h>
+#include <iomanip>
 #include <sstream>
 #include <string>
 
-#include "DenseVectorFieldIO.h"
+#include "DenseVectorFieldSequence.h"
+#include "DenseVectorFieldWriter.h"
 #include "DualDenseMotionExtractor.h"
 #include "ImageExtrapolatorDriver.h"
 #include "MotionExtractorDriver.h"
+#include "Profiler.h"
 #include "SparseVectorFieldIO.h"
 #include "VectorFieldIllustrator.h"
 
@@ -73,16 +76,18 @@ namespace MotionExtractorDriver
     }
   }
   
-  static void saveResultMotionField_(const CImg< double > &VF,
+  template < class T >
+  static void saveResultMotionField_(DenseVectorFieldWriter &writer,
+                                     const CImg< T > &VF,
                                      const string &outFilePrefix,
-                                     const CImg< double > *VB = NULL)
+                                     const CImg< T > *VB = NULL)
   {
     if(VB == NULL)
-      DenseVectorFieldIO::writeVectorField(VF, outFilePrefix + "-motion.pdvm");
+      writer.write(VF, outFilePrefix + "-motion.pdvm");
     else
     {
-      DenseVectorFieldIO::writeVectorField(VF, outFilePrefix + "-motionF.pdvm");
-      DenseVectorFieldIO::writeVectorField(*VB, outFilePrefix + "-motionB.pdvm");
+      writer.write(VF, outFilePrefix + "-motionF.pdvm");
+      writer.write(*VB, outFilePrefix + "-motionB.pdvm");
     }
   }
   
@@ -94,36 +99,55 @@ namespace MotionExtractorDriver
   }
 #endif
   
-  void runDenseMotionExtractor(DenseMotionExtractor &e,
+  template < class T >
+  void runDenseMotionExtractor(DenseMotionExtractor< T > &e,
                                const string &src1,
                                const string &src2,
                                const string &outFilePrefix)
   {
-    CImg< unsigned char > I1(src1.c_str());
-    CImg< unsigned char > I2(src2.c_str());
+    CImg< unsigned char > I1, I2;
+    {
+      PROFILE_SCOPE(e.getProfiler(), "image input");
+      I1.load(src1.c_str());
+      I2.load(src2.c_str());
+    }
     const int W = I1.dimx();
     const int H = I1.dimy();
     CImg< unsigned char > I1_smoothed;
     CImg< unsigned char > I2_smoothed;
     CImg< unsigned char > motionImageF(W, H, 1, 3);
     CImg< unsigned char > motionImageB;
-    CImg< double > VF, VB;
+    CImg< T > VF, VB;
     
     if(!e.isDual())
     {
       preProcess_(I1, I2, I1_smoothed, I2_smoothed, motionImageF);
+      PROFILE_SCOPE(e.getProfiler(), "motion extraction");
       e.compute(I1_smoothed, I2_smoothed, VF);
     }
     else
     {
       motionImageB = CImg< unsigned char >(W, H, 1, 3);
       preProcess_(I1, I2, I1_smoothed, I2_smoothed, motionImageF, &motionImageB);
-      e.compute(I1_smoothed, I2_smoothed, VF, VB);
+      {
+        PROFILE_SCOPE(e.getProfiler(), "motion extraction");
+        e.compute(I1_smoothed, I2_smoothed, VF, VB);
+      }
       VectorFieldIllustrator::renderDenseVectorField(VF, motionImageF);
       VectorFieldIllustrator::renderDenseVectorField(VB, motionImageB);
     }
     VectorFieldIllustrator::renderDenseVectorField(VF, motionImageF);
     
+    PROFILE_SCOPE(e.getProfiler(), "output");
+    
+    // The motion fields are written by a background thread while 
+    // the images are saved.
+    DenseVectorFieldWriter writer(true);
+    if(!e.isDual())
+      saveResultMotionField_(writer, VF, outFilePrefix);
+    else
+      saveResultMotionField_(writer, VF, outFilePrefix, &VB);
+    
     for(int i = 0; i < e.getNumResultQualityChannels(); i++)
     {
       ostringstream ostr;
@@ -134,16 +158,101 @@ namespace MotionExtractorDriver
     }
     
     if(!e.isDual())
-    {
       saveResultImages_(src1, src2, outFilePrefix, I1_smoothed, I2_smoothed, motionImageF);
-      saveResultMotionField_(VF, outFilePrefix);
-    }
     else
-    {
       saveResultImages_(src1, src2, outFilePrefix, I1_smoothed, I2_smoothed, motionImageF, &motionImageB);
-      saveResultMotionField_(VF, outFilePrefix, &VB);
+    
+    writer.flush();
+  }
+
+  
+  template void runDenseMotionExtractor< float >(DenseMotionExtractor< float > &e,
+                                                 const string &src1,
+                                                 const string &src2,
+                                                 const string &outFilePrefix);
+  template void runDenseMotionExtractor< double >(DenseMotionExtractor< double > &e,
+                                                  const string &src1,
+                                                  const string &src2,
+                                                  const string &outFilePrefix);
+
+  template < class T >
+  void runDenseMotionExtractorSequence(PyramidalDenseMotionExtractor< T > &e,
+                                       const vector< string > &frames,
+                                       const string &outFilePrefix,
+                                       bool singleFile)
+  {
+    CImg< unsigned char > I;
+    CImg< T > VF, VB;
+    bool computed;
+    DenseVectorFieldSequence sequenceF, sequenceB;
+    
+    if(singleFile)
+    {
+      if(e.isDual())
+      {
+        sequenceF.open(outFilePrefix + "-motionF.pdvs", DenseVectorFieldSequence::WRITE);
+        sequenceB.open(outFilePrefix + "-motionB.pdvs", DenseVectorFieldSequence::WRITE);
+      }
+      else
+        sequenceF.open(outFilePrefix + "-motion.pdvs", DenseVectorFieldSequence::WRITE);
     }
+    
+    // The motion fields are written while the next frame is 
+    // processed. The writer is destroyed before the sequences.
+    DenseVectorFieldWriter writer(true);
+    
+    e.resetSequence();
+    
+    for(unsigned int i = 0; i < frames.size(); i++)
+    {
+      {
+        PROFILE_SCOPE(e.getProfiler(), "image input");
+        I.load(frames[i].c_str());
+      }
+      // the same smoothing as in preProcess_
+      I.channel(0);
+      I.blur(3.0, 3.0, 3.0);
+      
+      {
+        PROFILE_SCOPE(e.getProfiler(), "motion extraction");
+        if(e.isDual())
+          computed = e.pushFrame(I, VF, VB);
+        else
+          computed = e.pushFrame(I, VF);
+      }
+      
+      if(computed && singleFile)
+      {
+        PROFILE_SCOPE(e.getProfiler(), "output");
+        writer.write(VF, sequenceF);
+        if(e.isDual())
+          writer.write(VB, sequenceB);
+      }
+      else if(computed)
+      {
+        PROFILE_SCOPE(e.getProfiler(), "output");
+        ostringstream ostr;
+        ostr<<outFilePrefix<<"-"<<setw(5)<<setfill('0')<<(i-1);
+        
+        if(e.isDual())
+          saveResultMotionField_(writer, VF, ostr.str(), &VB);
+        else
+          saveResultMotionField_(writer, VF, ostr.str());
+      }
+    }
+    
+    PROFILE_SCOPE(e.getProfiler(), "output");
+    writer.flush();
   }
+  
+  template void runDenseMotionExtractorSequence< float >(PyramidalDenseMotionExtractor< float > &e,
+                                                         const vector< string > &frames,
+                                                         const string &outFilePrefix,
+                                                         bool singleFile);
+  template void runDenseMotionExtractorSequence< double >(PyramidalDenseMotionExtractor< double > &e,
+                                                          const vector< string > &frames,
+                                                          const string &outFilePrefix,
+                                                          bool singleFile);
 
 #ifdef WITH_CGAL
   void runSparseMotionExtractor(SparseMotionExtractor &e,
@@ -2,9 +2,11 @@
 #ifndef MOTIONEXTRACTORDRIVER_H
 
 #include "DenseMotionExtractor.h"
+#include "PyramidalDenseMotionExtractor.h"
 #include "SparseMotionExtractor.h"
 
 #include <string>
+#include <vector>
 
 class SparseVectorField;
 
@@ -34,16 +36,42 @@ namespace MotionExtractorDriver
 //public:
   /// Runs a dense motion extractor.
   /**
+   * This is implemented for single- and double-precision 
+   * motion extractors (T = float or double).
    * @param e motion extraction algorithm
    * @param srcFileName1 the file to read the first source image from
    * @param srcFileName2 the file to read the second source image from
    * @param outFileNamePrefix the prefix of the resulting images
    */
-  void runDenseMotionExtractor(DenseMotionExtractor &e,
+  template < class T >
+  void runDenseMotionExtractor(DenseMotionExtractor< T > &e,
                                const string &src1,
                                const string &src2,
                                const string &outFilePrefix);
   
+  /// Runs a pyramidal dense motion extractor on a sequence of frames.
+  /**
+   * The frames are given to the motion extractor one at a time 
+   * (see PyramidalDenseMotionExtractor::pushFrame). The motion 
+   * between frames k and k+1 is saved to 
+   * [prefix]-[k]-motion.pdvm (or [prefix]-[k]-motionF.pdvm and 
+   * [prefix]-[k]-motionB.pdvm for dual motion extractors), where 
+   * k is zero-padded to five digits. If singleFile is true, the 
+   * motion fields are instead appended as frames to 
+   * [prefix]-motion.pdvs (or [prefix]-motionF.pdvs and 
+   * [prefix]-motionB.pdvs), see DenseVectorFieldSequence.
+   * This is implemented for T = float or double.
+   * @param e motion extraction algorithm
+   * @param frames the files to read the frames from, in order
+   * @param outFilePrefix the prefix of the resulting motion fields
+   * @param singleFile write the motion fields into one PDVS file
+   */
+  template < class T >
+  void runDenseMotionExtractorSequence(PyramidalDenseMotionExtractor< T > &e,
+                                       const vector< string > &frames,
+                                       const string &outFilePrefix,
+                                       bool singleFile = false);
+  
 #ifdef WITH_CGAL
   /// Runs a sparse motion extractor.
   /**
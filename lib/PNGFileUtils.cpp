@@ -0,0 +1,209 @@
+
+#include "PNGFileUtils.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <fstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef WITH_PNG
+#include <png.h>
+#endif
+
+static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+#ifdef WITH_PNG
+// Reads the samples of a PNG file. The rows of interleaved samples
+// are stored in data, 16-bit samples in big-endian byte order. If
+// is16 is false, the samples are converted to 8 bits.
+static void readPNG_(const string &fileName, bool is16,
+                     int &width, int &height, int &numChannels,
+                     vector< unsigned char > &data)
+{
+  unsigned char signature[8];
+  vector< png_bytep > rows;
+
+  FILE *file = fopen(fileName.c_str(), "rb");
+  if(file == NULL)
+    throw runtime_error("File not found.");
+
+  if(fread(signature, 1, 8, file) != 8 || png_sig_cmp(signature, 0, 8) != 0)
+  {
+    fclose(file);
+    throw runtime_error("Invalid PNG file.");
+  }
+
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png == NULL ? NULL : png_create_info_struct(png);
+  if(info == NULL)
+  {
+    png_destroy_read_struct(&png, NULL, NULL);
+    fclose(file);
+    throw runtime_error("Error reading PNG file " + fileName);
+  }
+
+  // libpng returns here if an error occurs
+  if(setjmp(png_jmpbuf(png)))
+  {
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(file);
+    throw runtime_error("Error reading PNG file " + fileName);
+  }
+
+  png_init_io(png, file);
+  png_set_sig_bytes(png, 8);
+  png_read_info(png, info);
+
+  const int bitDepth = png_get_bit_depth(png, info);
+  const int colorType = png_get_color_type(png, info);
+
+  if(is16 && bitDepth != 16)
+  {
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(file);
+    throw runtime_error("Not a 16-bit PNG file.");
+  }
+
+  if(colorType == PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb(png);
+  if(colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
+    png_set_expand_gray_1_2_4_to_8(png);
+  if(!is16)
+  {
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+  }
+  png_read_update_info(png, info);
+
+  width = png_get_image_width(png, info);
+  height = png_get_image_height(png, info);
+  numChannels = png_get_channels(png, info);
+
+  const size_t rowSize = png_get_rowbytes(png, info);
+  data.resize(rowSize * height);
+  rows.resize(height);
+  for(int y = 0; y < height; y++)
+    rows[y] = &data[y * rowSize];
+
+  png_read_image(png, &rows[0]);
+  png_read_end(png, NULL);
+
+  png_destroy_read_struct(&png, &info, NULL);
+  fclose(file);
+}
+#endif
+
+bool PNGFileUtils::isPNGFile(const string &fileName)
+{
+  ifstream inputStream(fileName.c_str(), ios::binary | ios::in);
+  unsigned char signature[8];
+
+  inputStream.read((char *)signature, 8);
+
+  return inputStream && memcmp(signature, PNG_SIGNATURE, 8) == 0;
+}
+
+void PNGFileUtils::readImage(const string &fileName, CImg< unsigned char > &I)
+{
+#ifdef WITH_PNG
+  int width, height, numChannels;
+  vector< unsigned char > data;
+
+  readPNG_(fileName, false, width, height, numChannels, data);
+
+  I.assign(width, height, 1, numChannels);
+  const unsigned char *src = &data[0];
+  cimg_forXY(I, x, y)
+  {
+    for(int c = 0; c < numChannels; c++)
+      I(x, y, 0, c) = *src++;
+  }
+#else
+  throw runtime_error("Reading PNG files requires libpng.");
+#endif
+}
+
+void PNGFileUtils::readImage16(const string &fileName, CImg< unsigned short > &I)
+{
+#ifdef WITH_PNG
+  int width, height, numChannels;
+  vector< unsigned char > data;
+
+  readPNG_(fileName, true, width, height, numChannels, data);
+
+  I.assign(width, height, 1, numChannels);
+  const unsigned char *src = &data[0];
+  cimg_forXY(I, x, y)
+  {
+    for(int c = 0; c < numChannels; c++, src += 2)
+      I(x, y, 0, c) = (unsigned short)(src[0] << 8 | src[1]);
+  }
+#else
+  throw runtime_error("Reading PNG files requires libpng.");
+#endif
+}
+
+void PNGFileUtils::writeImage16(const CImg< unsigned short > &I, const string &fileName)
+{
+#ifdef WITH_PNG
+  static const int COLOR_TYPES[] = { PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA,
+                                     PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA };
+  const int numChannels = I.dimv();
+
+  if(I.is_empty() || numChannels > 4)
+    throw runtime_error("Invalid image.");
+
+  // the samples are stored in big-endian byte order
+  const size_t rowSize = (size_t)I.dimx() * numChannels * 2;
+  vector< unsigned char > data(rowSize * I.dimy());
+  vector< png_bytep > rows(I.dimy());
+  unsigned char *dst = &data[0];
+  cimg_forXY(I, x, y)
+  {
+    for(int c = 0; c < numChannels; c++, dst += 2)
+    {
+      dst[0] = (unsigned char)(I(x, y, 0, c) >> 8);
+      dst[1] = (unsigned char)I(x, y, 0, c);
+    }
+  }
+  for(int y = 0; y < I.dimy(); y++)
+    rows[y] = &data[y * rowSize];
+
+  FILE *file = fopen(fileName.c_str(), "wb");
+  if(file == NULL)
+    throw runtime_error("Error creating file " + fileName);
+
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png == NULL ? NULL : png_create_info_struct(png);
+  if(info == NULL)
+  {
+    png_destroy_write_struct(&png, NULL);
+    fclose(file);
+    throw runtime_error("Error writing file " + fileName);
+  }
+
+  // libpng returns here if an error occurs
+  if(setjmp(png_jmpbuf(png)))
+  {
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+    throw runtime_error("Error writing file " + fileName);
+  }
+
+  png_init_io(png, file);
+  png_set_IHDR(png, info, I.dimx(), I.dimy(), 16, COLOR_TYPES[numChannels - 1],
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+  png_write_image(png, &rows[0]);
+  png_write_end(png, NULL);
+
+  png_destroy_write_struct(&png, &info);
+  if(fclose(file) != 0)
+    throw runtime_error("Error writing file " + fileName);
+#else
+  throw runtime_error("Writing PNG files requires libpng.");
+#endif
+}
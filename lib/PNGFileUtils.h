@@ -0,0 +1,45 @@
+
+#ifndef PNGFILEUTILS_H
+
+#include <string>
+
+namespace cimg_library { template < class T > class CImg; }
+
+using namespace cimg_library;
+using namespace std;
+
+/// Implements utility methods for reading and writing PNG files with libpng.
+/**
+ * The images are stored in CImg images with one channel for each
+ * sample of a pixel (1 = gray, 2 = gray and alpha, 3 = RGB, 4 = RGBA).
+ * If the library is compiled without libpng (WITH_PNG), the
+ * methods for reading and writing throw runtime_error.
+ */
+class PNGFileUtils
+{
+public:
+  /// Returns true if the given file starts with the PNG signature.
+  static bool isPNGFile(const string &fileName);
+
+  /// Reads an 8-bit gray or RGB image from a PNG file.
+  /**
+   * Palette images are converted to RGB, 16-bit samples are
+   * reduced to 8 bits and alpha channels are removed. Throws
+   * runtime_error if the file cannot be read.
+   */
+  static void readImage(const string &fileName, CImg< unsigned char > &I);
+
+  /// Reads a 16-bit image from a PNG file without converting the samples.
+  /**
+   * Throws runtime_error if the file cannot be read or if its bit
+   * depth is not 16.
+   */
+  static void readImage16(const string &fileName, CImg< unsigned short > &I);
+
+  /// Writes a 16-bit image with 1-4 channels to a PNG file.
+  static void writeImage16(const CImg< unsigned short > &I, const string &fileName);
+};
+
+#define PNGFILEUTILS_H
+
+#endif
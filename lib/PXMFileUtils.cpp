@@ -1,7 +1,6 @@
 
 #include "PXMFileUtils.h"
 
-#include <iostream>
 #include <stdexcept>
 #include <string.h>
 
@@ -13,10 +12,7 @@ void PNMFileUtils::checkMagicNumber(ifstream &inputStream, const string &id)
   
   extractToken(inputStream, token, TOKEN_SIZE);
   if(strcmp(token, id.c_str()) != 0)
-  {
-    cerr<<"Magic number "<<token<<" != "<<id<<endl;
-    throw runtime_error("Bad magic number");
-  }
+    throw runtime_error("Bad magic number " + string(token) + " != " + id);
 }
 
 void PNMFileUtils::extractToken(ifstream &inputStream,
@@ -1,37 +1,88 @@
 
 #include "Proesmans.h"
+#include "Profiler.h"
 
+#include <algorithm>
 #include <iostream>
 #include <math.h>
+#include <stdexcept>
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
 
-Proesmans::Proesmans() : BOUNDARY_CONDITIONS_(NEUMANN),
+// forces the inlining of the per-pixel update into the raster sweep, 
+// whose speed is otherwise sensitive to the layout of the code
+#ifdef __GNUC__
+#define PROESMANS_FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define PROESMANS_FORCE_INLINE inline
+#endif
+
+// the parities (x mod 2, y mod 2) of the pixel classes in the order 
+// they are swept by the multicolour iteration (see sweepMulticolor_)
+static const int CLASS_PARITIES[4][2] = { { 0, 0 }, { 1, 1 }, { 1, 0 }, { 0, 1 } };
+
+template < class T >
+const int Proesmans< T >::TILE_ALIGNMENT_;
+
+template < class T >
+Proesmans< T >::Proesmans() : BOUNDARY_CONDITIONS_(NEUMANN),
                          COMPUTE_RESIDUALS_(false),
                          INTENSITY_SCALE_(1.0 / 255.0),
                          LAMBDA_(100.0),
-                         NUM_ITERATIONS_(200)
-{ }
+                         NUM_ITERATIONS_(200),
+                         NUM_THREADS_(1),
+                         SWEEP_ORDER_(RASTER_SWEEP),
+                         convergenceTolerance_(0.0),
+                         convergenceNorm_(RMS_NORM),
+                         convergenceCheckInterval_(10),
+                         iterationBudget_(0),
+                         numPerformedIterations_(0),
+                         tileWidth_(0),
+                         tileHeight_(0),
+                         consistencyUpdateInterval_(1),
+                         lagNormalization_(false),
+                         bufferSet_(0)
+{
+  inputGradients_[0] = NULL;
+  inputGradients_[1] = NULL;
+}
 
-Proesmans::Proesmans(int numIterations_,
-                     float lambda_,
-                     BoundaryConditions boundaryConditions_) : 
+template < class T >
+Proesmans< T >::Proesmans(int numIterations_,
+                          float lambda_,
+                          BoundaryConditions boundaryConditions_,
+                          int numThreads_,
+                          SweepOrder sweepOrder_) : 
   BOUNDARY_CONDITIONS_(boundaryConditions_),
   COMPUTE_RESIDUALS_(false),
   INTENSITY_SCALE_(1.0 / 255.0),
   LAMBDA_(lambda_),
-  NUM_ITERATIONS_(numIterations_)
-{ }
+  NUM_ITERATIONS_(numIterations_),
+  NUM_THREADS_(numThreads_),
+  SWEEP_ORDER_(sweepOrder_),
+  convergenceTolerance_(0.0),
+  convergenceNorm_(RMS_NORM),
+  convergenceCheckInterval_(10),
+  iterationBudget_(0),
+  numPerformedIterations_(0),
+  tileWidth_(0),
+  tileHeight_(0),
+  consistencyUpdateInterval_(1),
+  lagNormalization_(false),
+  bufferSet_(0)
+{
+  inputGradients_[0] = NULL;
+  inputGradients_[1] = NULL;
+}
 
-void Proesmans::compute(const CImg< unsigned char > &I1,
-                        const CImg< unsigned char > &I2,
-                        CImg< double > &VF,
-                        CImg< double > &VB)
+template < class T >
+void Proesmans< T >::compute(const CImg< unsigned char > &I1,
+                             const CImg< unsigned char > &I2,
+                             CImg< T > &VF,
+                             CImg< T > &VB)
 {
-  int i, j;
-  int x, y;
-  double vAvg[2];
-  double xd, yd;
-  double It;
-  double vNext[2];
+  int i;
 
   width_ = I1.dimx();
   height_ = I1.dimy();
@@ -42,216 +93,360 @@ void Proesmans::compute(const CImg< unsigned char > &I1,
   V_[0].assign(VF, true);
   V_[1].assign(VB, true);
 
-  computeGradients_(I_[0], G_[0]);
-  computeGradients_(I_[1], G_[1]);
-
-  gamma_[0] = CImg< double >(width_, height_);
-  gamma_[1] = CImg< double >(width_, height_);
+  // The pyramidal extractor calls this with a different image size 
+  // for each level, so the buffers are kept in a separate buffer set 
+  // for each level (see selectBufferSet).
+  for(i = 0; i < 2; i++)
+  {
+    G_[i].assign(workspace_.getBuffer(getBufferSlot_(GRADIENT_SLOT_) + i, width_, height_, 2), true);
+    gamma_[i].assign(workspace_.getBuffer(getBufferSlot_(GAMMA_SLOT_) + i, width_, height_), true);
+    
+    PROFILE_SCOPE(this->profiler, "gradients");
+    if(inputGradients_[i] != NULL)
+      convertGradients_(*inputGradients_[i], G_[i]);
+    else
+      computeGradients_(I_[i], G_[i]);
+  }
+  
+  rowCSums_.resize(height_);
+  rowCCounts_.resize(height_);
+  
+  if(SWEEP_ORDER_ == MULTICOLOR_SWEEP)
+  {
+    for(i = 0; i < 2; i++)
+    {
+      Is_[i].assign(workspace_.getBuffer(getBufferSlot_(SCALED_IMAGE_SLOT_) + i, width_, height_), true);
+      
+      const int N = width_ * height_;
+      for(int k = 0; k < N; k++)
+        Is_[i](k) = T(I_[i](k)) * T(INTENSITY_SCALE_);
+    }
+    rowKernel_ = ProesmansKernels::getRowKernel< T >();
+  }
+  
+  if(convergenceTolerance_ > 0.0)
+  {
+    for(i = 0; i < 2; i++)
+      Vprev_[i].assign(workspace_.getBuffer(getBufferSlot_(PREV_FLOW_SLOT_) + i, width_, height_, 2), true);
+  }
 
-  for(i = 0; i < NUM_ITERATIONS_; i++)
+  const int numIterations = getNumIterations();
+  bool checkConvergence;
+  
+  // K is not carried over from the previous call
+  prevK_[0] = 0.0;
+  prevK_[1] = 0.0;
+  
+  numPerformedIterations_ = 0;
+  for(i = 0; i < numIterations; i++)
   {
-    if(i < NUM_ITERATIONS_)
+    checkConvergence = convergenceTolerance_ > 0.0 && 
+                       (i + 1) % convergenceCheckInterval_ == 0;
+    if(checkConvergence)
+    {
+      // store the motion vectors (the first two channels are contiguous)
+      Vprev_[0].assign(V_[0].ptr(), width_, height_, 1, 2);
+      Vprev_[1].assign(V_[1].ptr(), width_, height_, 1, 2);
+    }
+    
+    if(i % consistencyUpdateInterval_ == 0)
+    {
+      PROFILE_SCOPE(this->profiler, "consistency maps");
       computeConsistencyMaps_();
+    }
     
-    for(y = 1; y < height_ - 1; y++)
     {
-      for(x = 1; x < width_ - 1; x++)
-      {
-        for(j = 0; j < 2 ; j++)
-        {
-          computeAvg_(x, y, gamma_[j], V_[j], &vAvg[0]);
-          
-          xd = x + vAvg[0];
-          yd = y + vAvg[1];
-          
-          //iteration step
-          if(xd >= 0 && xd <= width_ - 1 && yd >= 0 && yd <= height_ - 1)
-          {
-            It = (I_[1 - j].linear_at2(xd, yd) - I_[j].at2(x, y)) * INTENSITY_SCALE_;
-            IterationStep_(G_[j](x, y, 0), G_[j](x, y, 1), It, vAvg, &vNext[0]);
-          }
-          else
-          {
-            // use consistency-weighted average as the next value 
-            // if (xd,yd) is outside the image
-            vNext[0] = vAvg[0];
-            vNext[1] = vAvg[1];
-          }
-
-          if(i < NUM_ITERATIONS_)
-          {
-            V_[j](x, y, 0) = vNext[0];
-            V_[j](x, y, 1) = vNext[1];
-          }
-        }
-
-        // store quality information (gamma)
-        if(i < NUM_ITERATIONS_)
-        {
-          VF(x, y, 2) = gamma_[0](x, y);
-          VB(x, y, 2) = gamma_[1](x, y);
-        }
-      }
+      PROFILE_SCOPE(this->profiler, "sweeps");
+      if(SWEEP_ORDER_ == RASTER_SWEEP)
+        sweepRaster_();
+      else if(tileWidth_ > 0)
+        sweepTiled_();
+      else
+        sweepMulticolor_();
     }
     
-    if(i < NUM_ITERATIONS_ && BOUNDARY_CONDITIONS_ == NEUMANN)
+    if(BOUNDARY_CONDITIONS_ == NEUMANN)
     {
       repairEdges_(V_[0]);
       repairEdges_(V_[1]);
     }
+    
+    numPerformedIterations_++;
+    
+    if(checkConvergence && computeUpdateNorm_() < convergenceTolerance_)
+      break;
   }
+  
+  PROFILE_COUNT(this->profiler, "pixels", width_ * height_);
+  PROFILE_COUNT(this->profiler, "Proesmans iterations", numPerformedIterations_);
+  PROFILE_COUNT(this->profiler, "consistency map updates", 
+                (numPerformedIterations_ + consistencyUpdateInterval_ - 1) / consistencyUpdateInterval_);
 }
 
-Proesmans::BoundaryConditions Proesmans::getBoundaryConditions() const
+template < class T >
+typename Proesmans< T >::BoundaryConditions Proesmans< T >::getBoundaryConditions() const
 {
   return BOUNDARY_CONDITIONS_;
 }
 
-double Proesmans::getLambda() const
+template < class T >
+double Proesmans< T >::getLambda() const
 {
   return LAMBDA_;
 }
 
-string Proesmans::getName() const
+template < class T >
+string Proesmans< T >::getName() const
 {
   return "Proesmans";
 }
 
-int Proesmans::getNumIterations() const
+template < class T >
+int Proesmans< T >::getConsistencyUpdateInterval() const
+{
+  return consistencyUpdateInterval_;
+}
+
+template < class T >
+double Proesmans< T >::getConvergenceTolerance() const
+{
+  return convergenceTolerance_;
+}
+
+template < class T >
+int Proesmans< T >::getNumIterations() const
+{
+  if(iterationBudget_ > 0)
+    return iterationBudget_;
+  else
+    return NUM_ITERATIONS_;
+}
+
+template < class T >
+int Proesmans< T >::getNumPerformedIterations() const
 {
-  return NUM_ITERATIONS_;
+  return numPerformedIterations_;
 }
 
-int Proesmans::getNumResultQualityChannels() const
+template < class T >
+int Proesmans< T >::getNumResultQualityChannels() const
 {
   return 1;
 }
 
-bool Proesmans::isDual() const
+template < class T >
+int Proesmans< T >::getNumThreads() const
+{
+  return NUM_THREADS_;
+}
+
+template < class T >
+typename Proesmans< T >::SweepOrder Proesmans< T >::getSweepOrder() const
+{
+  return SWEEP_ORDER_;
+}
+
+template < class T >
+int Proesmans< T >::getTileHeight() const
+{
+  return tileHeight_;
+}
+
+template < class T >
+int Proesmans< T >::getTileWidth() const
+{
+  return tileWidth_;
+}
+
+template < class T >
+bool Proesmans< T >::isDual() const
 {
   return true;
 }
 
-inline void Proesmans::IterationStep_(double gx,
-                                      double gy,
-                                      double It,
-                                      double *avg,
-                                      double *result)
+template < class T >
+bool Proesmans< T >::isNormalizationLagged() const
+{
+  return lagNormalization_;
+}
+
+template < class T >
+inline void Proesmans< T >::IterationStep_(T gx,
+                                           T gy,
+                                           T It,
+                                           T *avg,
+                                           T *result)
 {
-  double m = LAMBDA_ * It / (1.0 + LAMBDA_ * (gx * gx + gy * gy));
+  T m = T(LAMBDA_) * It / (T(1) + T(LAMBDA_) * (gx * gx + gy * gy));
 
   result[0] = avg[0] - gx * m;
   result[1] = avg[1] - gy * m;
 }
 
-void Proesmans::printInfoText() const
+template < class T >
+void Proesmans< T >::printInfoText(ostream &out) const
 {
-  cout<<"Proesmans' optical flow algorithm"<<endl;
-  cout<<"================================="<<endl;
+  out<<"Proesmans' optical flow algorithm"<<endl;
+  out<<"================================="<<endl;
   
-  cout<<"Input image width: "<<I_[0].dimx()<<endl;
-  cout<<"Input image height: "<<I_[0].dimy()<<endl;
+  out<<"Input image width: "<<I_[0].dimx()<<endl;
+  out<<"Input image height: "<<I_[0].dimy()<<endl;
   
-  cout<<"Number of iterations: "<<NUM_ITERATIONS_<<endl;
-  cout<<"Lambda: "<<LAMBDA_<<endl;
-  cout<<"Boundary conditions: ";
+  out<<"Number of iterations: "<<getNumIterations()<<endl;
+  if(convergenceTolerance_ > 0.0)
+  {
+    out<<"Convergence tolerance: "<<convergenceTolerance_;
+    out<<(convergenceNorm_ == RMS_NORM ? " (RMS" : " (max");
+    out<<", checked every "<<convergenceCheckInterval_<<" iterations)"<<endl;
+  }
+  if(consistencyUpdateInterval_ > 1 || lagNormalization_)
+  {
+    out<<"Consistency update interval: "<<consistencyUpdateInterval_;
+    out<<(lagNormalization_ ? " (lagged normalization)" : "")<<endl;
+  }
+  out<<"Lambda: "<<LAMBDA_<<endl;
+  out<<"Number of threads: "<<NUM_THREADS_<<endl;
+  out<<"Sweep order: "<<(SWEEP_ORDER_ == RASTER_SWEEP ? "raster" : "multicolour")<<endl;
+  if(tileWidth_ > 0)
+    out<<"Tile size: "<<tileWidth_<<"x"<<tileHeight_<<endl;
+  out<<"Boundary conditions: ";
   if(BOUNDARY_CONDITIONS_ == NEUMANN)
-    cout<<"Neumann"<<endl;
+    out<<"Neumann"<<endl;
   else
-    cout<<"Dirichlet"<<endl;
+    out<<"Dirichlet"<<endl;
+}
+
+template < class T >
+void Proesmans< T >::releaseBuffers()
+{
+  workspace_.clear();
 }
 
-inline double Proesmans::computeAvg_(int x, int y,
-                                     const CImg< double > &gi,
-                                     const CImg< double > &Vi,
-                                     double *v)
+template < class T >
+void Proesmans< T >::selectBufferSet(int index)
 {
-  double sumWeights = (gi(x, y-1)   + gi(x-1, y) +
-                       gi(x+1, y)   + gi(x, y+1)) / 6.0 +
-                      (gi(x-1, y-1) + gi(x+1, y-1) +
-                       gi(x-1, y+1) + gi(x+1, y+1)) / 12.0;
+  bufferSet_ = index;
+}
+
+template < class T >
+void Proesmans< T >::setConsistencyUpdate(int interval, bool lagNormalization)
+{
+  if(interval < 1)
+    throw invalid_argument("The consistency update interval must be positive.");
   
-  for(int j = 0; j < 2; j++)
-  {
-    if(sumWeights > 1e-8)
-    {
-      v[j] = (gi(x, y-1)   * Vi(x, y-1, j)   + gi(x-1, y)   * Vi(x-1, y, j) + 
-              gi(x+1, y)   * Vi(x+1, y, j)   + gi(x, y+1)   * Vi(x, y+1, j))   / 6.0 + 
-             (gi(x-1, y-1) * Vi(x-1, y-1, j) + gi(x+1, y-1) * Vi(x+1, y-1, j) + 
-              gi(x-1, y+1) * Vi(x-1, y+1, j) + gi(x+1, y+1) * Vi(x+1, y+1, j)) / 12.0;
-      
-      v[j] /= sumWeights;
-    }
-    else
-      // use the old value if the weight sum is too small to give accurate results
-      v[j] = Vi(x, y, j);
-  }
+  consistencyUpdateInterval_ = interval;
+  lagNormalization_ = lagNormalization;
+}
+
+template < class T >
+void Proesmans< T >::setConvergenceTolerance(double tolerance, 
+                                             ConvergenceNorm norm, 
+                                             int checkInterval)
+{
+  if(checkInterval < 1)
+    throw invalid_argument("The convergence check interval must be positive.");
   
-  // Reject too small values for numerical stability.
-  if(sumWeights > 1e-8)
-    return sumWeights;
-  else
-    return 1.0;
+  convergenceTolerance_ = tolerance;
+  convergenceNorm_ = norm;
+  convergenceCheckInterval_ = checkInterval;
 }
 
-void Proesmans::computeConsistencyMaps_()
+template < class T >
+void Proesmans< T >::setIterationBudget(int numIterations)
 {
-  int x, y;
+  iterationBudget_ = numIterations;
+}
+
+template < class T >
+void Proesmans< T >::setInputGradients(const CImg< short > *G1, const CImg< short > *G2)
+{
+  inputGradients_[0] = G1;
+  inputGradients_[1] = G2;
+}
+
+template < class T >
+void Proesmans< T >::setTiling(int tileWidth, int tileHeight)
+{
+  if(tileWidth < 0 || tileHeight < 0 || (tileWidth == 0) != (tileHeight == 0))
+    throw invalid_argument("The tile dimensions must be both positive or both zero.");
+  if(tileWidth > 0 && SWEEP_ORDER_ == RASTER_SWEEP)
+    throw invalid_argument("The tiled iteration requires the multicolour sweep order.");
+  
+  // round the width up to a multiple of TILE_ALIGNMENT_
+  tileWidth_ = (tileWidth + TILE_ALIGNMENT_ - 1) / TILE_ALIGNMENT_ * TILE_ALIGNMENT_;
+  tileHeight_ = tileHeight;
+}
+
+template < class T >
+void Proesmans< T >::computeConsistencyMaps_()
+{
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  int y;
   int i;
-  int xd, yd;
-  double ub, vb;
-  double uDiff, vDiff;
-  double c;
   double CSum;
   int CCount;
-  double K;
-  double g;
+  T K;
   
   for(i = 0; i < 2; i++)
   {
     CSum = 0.0;
     CCount = 0;
     
-    for(y = 0; y < height_; y++)
+    // With the lagged normalization, the map is normalized with 
+    // the previous K while it is computed.
+    const T prevK = (lagNormalization_ ? prevK_[i] : T(0));
+    
+    // The consistency sums are accumulated in the same order for all 
+    // numbers of threads, so the result only depends on the sweep order.
+    if(SWEEP_ORDER_ == RASTER_SWEEP)
     {
-      for(x = 0; x < width_; x++)
+      for(y = 0; y < height_; y++)
+        computeConsistencyRow_(i, y, prevK, CSum, CCount);
+    }
+    else
+    {
+      // The sums are accumulated row by row and combined in a fixed 
+      // order so that K does not depend on the number of threads.
+#ifdef WITH_OPENMP
+      #pragma omp parallel for num_threads(numThreads) schedule(static) if(numThreads > 1)
+#endif
+      for(y = 0; y < height_; y++)
       {
-        xd = (int)(x + V_[i](x, y, 0));
-        yd = (int)(y + V_[i](x, y, 1));
-        
-        if(xd >= 0 && yd >= 0 && xd <= width_ - 1 && yd <= height_ - 1)
-        {
-          ub = V_[1 - i](xd, yd, 0, 0);
-          vb = V_[1 - i](xd, yd, 0, 1);
-          
-          uDiff = V_[i](x, y, 0) + ub;
-          vDiff = V_[i](x, y, 1) + vb;
-          
-          c = sqrt(uDiff * uDiff + vDiff * vDiff);
-          
-          gamma_[i](x, y) = c;
-          CSum += c;
-          CCount++;
-        }
-        else
-          gamma_[i](x, y) = -1.0;
+        rowCSums_[y] = 0.0;
+        rowCCounts_[y] = 0;
+        computeConsistencyRow_(i, y, prevK, rowCSums_[y], rowCCounts_[y]);
+      }
+      
+      for(y = 0; y < height_; y++)
+      {
+        CSum += rowCSums_[y];
+        CCount += rowCCounts_[y];
       }
     }
     
+    prevK_[i] = 0.0;
     if(CCount > 0)
     {
       K = 0.9 * CSum / CCount;
+      prevK_[i] = K;
       
-      if(K > 0.0)
+      if(K > 0.0 && prevK <= 0.0)
       {
+#ifdef WITH_OPENMP
+        #pragma omp parallel for num_threads(numThreads) schedule(static) if(numThreads > 1)
+#endif
         for(y = 0; y < height_; y++)
         {
-          for(x = 0; x < width_; x++)
+          T g;
+          
+          for(int x = 0; x < width_; x++)
           {
             if(gamma_[i](x, y) >= 0.0)
             {
               g = gamma_[i](x, y);
-              gamma_[i](x, y) = 1.0 / (1.0 + (g / K) * (g / K));
+              gamma_[i](x, y) = T(1) / (T(1) + (g / K) * (g / K));
             }
             else
               gamma_[i](x, y) = 0.0;
@@ -262,39 +457,190 @@ void Proesmans::computeConsistencyMaps_()
   }
 }
 
-void Proesmans::computeGradients_(const CImg< unsigned char > &I,
-                                  CImg< double > &G)
+template < class T >
+void Proesmans< T >::computeConsistencyRow_(int i, int y, T K, double &CSum, int &CCount)
+{
+  int x;
+  int xd, yd;
+  T ub, vb;
+  T uDiff, vDiff;
+  T c;
+  
+  for(x = 0; x < width_; x++)
+  {
+    xd = (int)(x + V_[i](x, y, 0));
+    yd = (int)(y + V_[i](x, y, 1));
+    
+    if(xd >= 0 && yd >= 0 && xd <= width_ - 1 && yd <= height_ - 1)
+    {
+      ub = V_[1 - i](xd, yd, 0, 0);
+      vb = V_[1 - i](xd, yd, 0, 1);
+      
+      uDiff = V_[i](x, y, 0) + ub;
+      vDiff = V_[i](x, y, 1) + vb;
+      
+      c = sqrt(uDiff * uDiff + vDiff * vDiff);
+      
+      CSum += c;
+      CCount++;
+      
+      if(K > 0.0)
+        gamma_[i](x, y) = T(1) / (T(1) + (c / K) * (c / K));
+      else
+        gamma_[i](x, y) = c;
+    }
+    else
+      gamma_[i](x, y) = (K > 0.0 ? 0.0 : -1.0);
+  }
+}
+
+template < class T >
+double Proesmans< T >::computeUpdateNorm_() const
+{
+  double du, dv;
+  double d2;
+  double sum = 0.0;
+  double maxD2 = 0.0;
+  int x, y;
+  int i;
+  
+  for(i = 0; i < 2; i++)
+  {
+    for(y = 0; y < height_; y++)
+    {
+      for(x = 0; x < width_; x++)
+      {
+        du = V_[i](x, y, 0) - Vprev_[i](x, y, 0);
+        dv = V_[i](x, y, 1) - Vprev_[i](x, y, 1);
+        d2 = du * du + dv * dv;
+        
+        sum += d2;
+        if(d2 > maxD2)
+          maxD2 = d2;
+      }
+    }
+  }
+  
+  if(convergenceNorm_ == RMS_NORM)
+    return sqrt(sum / (2.0 * width_ * height_));
+  else
+    return sqrt(maxD2);
+}
+
+template < class T >
+void Proesmans< T >::computeGradients_(const CImg< unsigned char > &I,
+                                       CImg< T > &G)
+{
+  // This uses 3x3 Sobel kernels for computing partial derivatives. 
+  // The kernels are applied as by CImg::get_convolve (i.e. rotated 
+  // by 180 degrees) with zero boundary conditions, but the result 
+  // is written directly to G. The integer kernel sums are exact, 
+  // so the result equals that of convertGradients_ for gradients 
+  // computed by ImagePyramid.
+  const T k = 1.0 / 8.0 * INTENSITY_SCALE_;
+  const int Kx[3][3] = { { -1, 0, 1 }, { -2, 0, 2 }, { -1, 0, 1 } };
+  const int Ky[3][3] = { { -1, -2, -1 }, { 0, 0, 0 }, { 1, 2, 1 } };
+  
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  int y;
+  
+#ifdef WITH_OPENMP
+  #pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for(y = 0; y < height_; y++)
+  {
+    int gx, gy;
+    int Ixy;
+    
+    for(int x = 0; x < width_; x++)
+    {
+      gx = 0;
+      gy = 0;
+      
+      for(int ym = -1; ym <= 1; ym++)
+      {
+        if(y + ym < 0 || y + ym >= height_)
+          continue;
+        
+        for(int xm = -1; xm <= 1; xm++)
+        {
+          if(x + xm < 0 || x + xm >= width_)
+            continue;
+          
+          Ixy = I(x + xm, y + ym);
+          gx += Ixy * Kx[ym + 1][xm + 1];
+          gy += Ixy * Ky[ym + 1][xm + 1];
+        }
+      }
+      
+      G(x, y, 0, 0) = T(gx) * k;
+      G(x, y, 0, 1) = T(gy) * k;
+    }
+  }
+}
+
+template < class T >
+void Proesmans< T >::convertGradients_(const CImg< short > &Gi, 
+                                       CImg< T > &G)
+{
+  const T k = 1.0 / 8.0 * INTENSITY_SCALE_;
+  const int N = Gi.size();
+  const short *gi = Gi.ptr();
+  T *g = G.ptr();
+  
+  for(int i = 0; i < N; i++)
+    g[i] = T(gi[i]) * k;
+}
+
+template < class T >
+void Proesmans< T >::fillRowArgs_(int j, int y, int x0, int x1, int parity, 
+                                  ProesmansKernels::RowArgs< T > &args)
 {
-  // This uses 3x3 Sobel kernels for computing partial derivatives.
-  G = CImg< double >(width_, height_, 1, 2);
-  CImg< double > Kx = CImg< double >(3, 3);
-  CImg< double > Ky = CImg< double >(3, 3);
+  args.u = V_[j].ptr(x0, y, 0, 0);
+  args.v = V_[j].ptr(x0, y, 0, 1);
+  args.q = V_[j].ptr(x0, y, 0, 2);
+  args.flowStride = width_;
+  
+  args.gamma = gamma_[j].ptr(x0, y);
+  args.gammaStride = width_;
   
-  Kx(0, 0) = 1.0 / 8.0 * INTENSITY_SCALE_;
-  Kx(1, 0) = 0.0;
-  Kx(2, 0) = -1.0 / 8.0 * INTENSITY_SCALE_;
-  Kx(0, 1) = 2.0 / 8.0 * INTENSITY_SCALE_;
-  Kx(1, 1) = 0.0;
-  Kx(2, 1) = -2.0 / 8.0 * INTENSITY_SCALE_;
-  Kx(0, 2) = 1.0 / 8.0 * INTENSITY_SCALE_;
-  Kx(1, 2) = 0.0;
-  Kx(2, 2) = -1.0 / 8.0 * INTENSITY_SCALE_;
+  args.gx = G_[j].ptr(x0, y, 0, 0);
+  args.gy = G_[j].ptr(x0, y, 0, 1);
   
-  Ky(0, 0) = 1.0 / 8.0 * INTENSITY_SCALE_;
-  Ky(1, 0) = 2.0 / 8.0 * INTENSITY_SCALE_;
-  Ky(2, 0) = 1.0 / 8.0 * INTENSITY_SCALE_;
-  Ky(0, 1) = 0.0;
-  Ky(1, 1) = 0.0;
-  Ky(2, 1) = 0.0;
-  Ky(0, 2) = -1.0 / 8.0 * INTENSITY_SCALE_;
-  Ky(1, 2) = -2.0 / 8.0 * INTENSITY_SCALE_;
-  Ky(2, 2) = -1.0 / 8.0 * INTENSITY_SCALE_;
+  args.I = Is_[j].ptr(x0, y);
+  args.Iother = Is_[1 - j].ptr();
   
-  G.get_shared_channel(0) = I.get_convolve(Kx, 0);
-  G.get_shared_channel(1) = I.get_convolve(Ky, 0);
+  args.width = width_;
+  args.height = height_;
+  
+  args.x0 = x0;
+  args.y = y;
+  args.n = x1 - x0;
+  args.parity = parity;
+  
+  args.lambda = LAMBDA_;
+}
+
+template < class T >
+int Proesmans< T >::getBufferSlot_(BufferSlot slot) const
+{
+  return NUM_BUFFER_SLOTS_ * bufferSet_ + slot;
+}
+
+template < class T >
+int Proesmans< T >::getNumWorkerThreads_() const
+{
+#ifdef WITH_OPENMP
+  if(NUM_THREADS_ <= 0)
+    return omp_get_max_threads();
+#endif
+  return NUM_THREADS_ > 0 ? NUM_THREADS_ : 1;
 }
 
-void Proesmans::repairEdges_(CImg< double > &V)
+template < class T >
+void Proesmans< T >::repairEdges_(CImg< T > &V)
 {
   int x, y;
   int i;
@@ -322,3 +668,191 @@ void Proesmans::repairEdges_(CImg< double > &V)
     V(width_ - 1, height_ - 1, i) = V(width_ - 2, height_ - 2);
   }
 }
+
+template < class T >
+void Proesmans< T >::sweepMulticolor_()
+{
+  // A plain red-black ordering is not sufficient here because the 
+  // averaging stencil also couples a pixel to its diagonal neighbours. 
+  // Instead, the pixels are partitioned into four classes by the 
+  // parities of their coordinates: the two "red" classes (0,0) and 
+  // (1,1) are swept first, followed by the "black" classes (1,0) and 
+  // (0,1). Pixels within a class do not depend on each other.
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  int c;
+  int y;
+  
+  for(c = 0; c < 4; c++)
+  {
+    const int y0 = CLASS_PARITIES[c][1] == 1 ? 1 : 2;
+    
+#ifdef WITH_OPENMP
+    #pragma omp parallel for num_threads(numThreads) schedule(static) if(numThreads > 1)
+#endif
+    for(y = y0; y < height_ - 1; y += 2)
+    {
+      ProesmansKernels::RowArgs< T > args;
+      
+      for(int j = 0; j < 2; j++)
+      {
+        fillRowArgs_(j, y, 1, width_ - 1, CLASS_PARITIES[c][0], args);
+        rowKernel_(args);
+      }
+    }
+  }
+}
+
+template < class T >
+void Proesmans< T >::sweepRaster_()
+{
+  // the data pointers are hoisted out of the loop
+  T *V[2] = { V_[0].ptr(), V_[1].ptr() };
+  const T *gamma[2] = { gamma_[0].ptr(), gamma_[1].ptr() };
+  const T *G[2] = { G_[0].ptr(), G_[1].ptr() };
+  int x, y;
+  
+  for(y = 1; y < height_ - 1; y++)
+  {
+    for(x = 1; x < width_ - 1; x++)
+    {
+      updatePixel_(x, y, 0, V[0], gamma[0], G[0]);
+      updatePixel_(x, y, 1, V[1], gamma[1], G[1]);
+    }
+  }
+}
+
+template < class T >
+void Proesmans< T >::sweepTile_(int tx, int ty)
+{
+  ProesmansKernels::RowArgs< T > args;
+  int c;
+  int x0, x1, y0, y1;
+  int y;
+  int j;
+  
+  // The sweep over class c covers the tile shifted up by 2c pixels 
+  // and left by (c+1)*TILE_ALIGNMENT_-1 pixels, clipped to the 
+  // interior of the image. The horizontal shifts keep the runs 
+  // congruent to 1 modulo TILE_ALIGNMENT_, so the row kernels split 
+  // them into vectors exactly as the whole rows in sweepMulticolor_.
+  for(c = 0; c < 4; c++)
+  {
+    x0 = max(tx * tileWidth_ - (c + 1) * TILE_ALIGNMENT_ + 1, 1);
+    y0 = max(ty * tileHeight_ - 2 * c, 1);
+    x1 = min((tx + 1) * tileWidth_ - (c + 1) * TILE_ALIGNMENT_ + 1, width_ - 1);
+    y1 = min((ty + 1) * tileHeight_ - 2 * c, height_ - 1);
+    if(x0 >= x1)
+      continue;
+    
+    // the first row of the class
+    if((y0 & 1) != CLASS_PARITIES[c][1])
+      y0++;
+    
+    for(y = y0; y < y1; y += 2)
+    {
+      for(j = 0; j < 2; j++)
+      {
+        fillRowArgs_(j, y, x0, x1, CLASS_PARITIES[c][0], args);
+        rowKernel_(args);
+      }
+    }
+  }
+}
+
+template < class T >
+void Proesmans< T >::sweepTiled_()
+{
+  // The tiles are processed in wavefront order, i.e. by the 
+  // anti-diagonals tx+ty = d. A pixel only depends on pixels in 
+  // the same tile and in the tiles above and to the left of it, 
+  // because the sweep over each class is shifted up and left by 
+  // at least two pixels from the sweep over the previous class. 
+  // Thus the tiles on a diagonal are independent, and the result 
+  // is the same as that of sweepMulticolor_.
+#ifdef WITH_OPENMP
+  const int numThreads = getNumWorkerThreads_();
+#endif
+  const int numTilesX = (width_ + 4 * TILE_ALIGNMENT_ - 3) / tileWidth_ + 1;
+  const int numTilesY = (height_ + 4) / tileHeight_ + 1;
+  int d;
+  int ty;
+  
+  for(d = 0; d < numTilesX + numTilesY - 1; d++)
+  {
+    const int tyBegin = max(0, d - numTilesX + 1);
+    const int tyEnd = min(d, numTilesY - 1);
+    
+#ifdef WITH_OPENMP
+    #pragma omp parallel for num_threads(numThreads) schedule(static) if(numThreads > 1)
+#endif
+    for(ty = tyBegin; ty <= tyEnd; ty++)
+      sweepTile_(d - ty, ty);
+  }
+}
+
+template < class T >
+PROESMANS_FORCE_INLINE void Proesmans< T >::updatePixel_(int x, int y, int j, 
+                                                         T *V, const T *gamma, const T *G)
+{
+  const int W = width_;
+  const int N = width_ * height_;
+  const int k = x + y * W;
+  const T *g = gamma + k;
+  T vAvg[2];
+  T xd, yd;
+  T It;
+  T vNext[2];
+  int c;
+  
+  // the consistency-weighted average of the neighbouring vectors
+  const T sumWeights = (g[-W]     + g[-1] +
+                        g[1]      + g[W]) / T(6) +
+                       (g[-W - 1] + g[-W + 1] +
+                        g[W - 1]  + g[W + 1]) / T(12);
+  
+  for(c = 0; c < 2; c++)
+  {
+    const T *v = V + c * N + k;
+    
+    if(sumWeights > T(1e-8))
+    {
+      vAvg[c] = (g[-W]     * v[-W]     + g[-1]     * v[-1] + 
+                 g[1]      * v[1]      + g[W]      * v[W])     / T(6) + 
+                (g[-W - 1] * v[-W - 1] + g[-W + 1] * v[-W + 1] + 
+                 g[W - 1]  * v[W - 1]  + g[W + 1]  * v[W + 1]) / T(12);
+      
+      vAvg[c] /= sumWeights;
+    }
+    else
+      // use the old value if the weight sum is too small to give accurate results
+      vAvg[c] = v[0];
+  }
+  
+  xd = x + vAvg[0];
+  yd = y + vAvg[1];
+  
+  //iteration step
+  if(xd >= 0 && xd <= width_ - 1 && yd >= 0 && yd <= height_ - 1)
+  {
+    It = (I_[1 - j].linear_at2(xd, yd) - I_[j](x, y)) * INTENSITY_SCALE_;
+    IterationStep_(G[k], G[N + k], It, vAvg, &vNext[0]);
+  }
+  else
+  {
+    // use consistency-weighted average as the next value 
+    // if (xd,yd) is outside the image
+    vNext[0] = vAvg[0];
+    vNext[1] = vAvg[1];
+  }
+  
+  V[k] = vNext[0];
+  V[N + k] = vNext[1];
+  
+  // store quality information (gamma)
+  V[2 * N + k] = g[0];
+}
+
+template class Proesmans< float >;
+template class Proesmans< double >;
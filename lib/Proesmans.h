@@ -2,10 +2,13 @@
 #ifndef PROESMANS_H
 
 #include "DualDenseMotionExtractor.h"
+#include "ImageWorkspace.h"
+#include "ProesmansKernels.h"
 
 #include "CImg_config.h"
 #include <CImg.h>
 #include <string>
+#include <vector>
 
 using namespace cimg_library;
 using namespace std;
@@ -21,10 +24,26 @@ using namespace std;
  *
  * and the C-implementation found at http://of-eval.sourceforge.net
  */
-class Proesmans : public DualDenseMotionExtractor
+template < class T = double > class Proesmans : public DualDenseMotionExtractor< T >
 {
 public:
   enum BoundaryConditions { DIRICHLET, NEUMANN };
+  enum ConvergenceNorm { RMS_NORM, MAX_NORM };
+  
+  /// Defines the order in which the pixels are updated in each iteration.
+  /**
+   * RASTER_SWEEP: a single Gauss-Seidel sweep in raster order, as in 
+   * the original algorithm. The sweep is sequential, so the number of 
+   * threads has no effect.
+   * 
+   * MULTICOLOR_SWEEP: four sweeps over the pixel classes (x mod 2, 
+   * y mod 2). No two pixels of the same class are neighbours, so each 
+   * sweep is distributed over the threads, and the pixels of a row are 
+   * updated with vectorized row kernels (see ProesmansKernels), also 
+   * with one thread. The result differs from that of the raster sweep 
+   * because of the different update order.
+   */
+  enum SweepOrder { RASTER_SWEEP, MULTICOLOR_SWEEP };
   
   /// Default constructor.
   /**
@@ -32,18 +51,29 @@ public:
    * - number of iterations = 200
    * - lambda = 100
    * - boundary conditions = Neumann
+   * - number of threads = 1
+   * - sweep order = RASTER_SWEEP
+   * - no convergence check
    */
   Proesmans();
   
   /// Parametrized constructor.
+  /**
+   * The sweep order selects the algorithm (see SweepOrder), and 
+   * numThreads_ only affects the speed: the result does not depend 
+   * on the number of threads. Zero means that all available 
+   * processors are used.
+   */
   Proesmans(int numIterations_,
             float lambda_,
-            BoundaryConditions boundaryConditions_);
+            BoundaryConditions boundaryConditions_,
+            int numThreads_ = 1,
+            SweepOrder sweepOrder_ = RASTER_SWEEP);
   
   void compute(const CImg< unsigned char > &I1,
                const CImg< unsigned char > &I2,
-               CImg< double > &VF,
-               CImg< double > &VB);
+               CImg< T > &VF,
+               CImg< T > &VB);
   
   BoundaryConditions getBoundaryConditions() const;
   
@@ -51,45 +81,214 @@ public:
   
   string getName() const;
   
+  /// Returns the maximum number of iterations.
+  /**
+   * This is the iteration budget if one has been set, 
+   * otherwise the number of iterations given to the constructor.
+   */
   int getNumIterations() const;
   
+  /// Returns the number of iterations carried out by the last call to compute.
+  int getNumPerformedIterations() const;
+  
   int getNumResultQualityChannels() const;
   
+  int getNumThreads() const;
+  
+  SweepOrder getSweepOrder() const;
+  
+  /// Returns the number of iterations between updates of the consistency maps.
+  int getConsistencyUpdateInterval() const;
+  
+  double getConvergenceTolerance() const;
+  
+  /// Returns the tile height of the tiled iteration (zero if disabled).
+  int getTileHeight() const;
+  
+  /// Returns the tile width of the tiled iteration (zero if disabled).
+  int getTileWidth() const;
+  
   bool isDual() const;
   
-  void printInfoText() const;
+  /// Returns true if the consistency maps are normalized with the previous K.
+  bool isNormalizationLagged() const;
+  
+  void printInfoText(ostream &out) const;
+  
+  void releaseBuffers();
+  
+  void selectBufferSet(int index);
+  
+  /// Sets how often and how the consistency maps are updated.
+  /**
+   * By default, the consistency maps are computed at the beginning 
+   * of each iteration in two passes over the motion fields: the 
+   * first one computes the consistency values and their mean, and 
+   * the second one normalizes them with K = 0.9 * mean.
+   * 
+   * If interval is greater than one, the maps are only updated every 
+   * interval iterations and reused in between. If lagNormalization 
+   * is true, the maps are normalized in the same pass with the K of 
+   * the previous update (the first update of each call to compute 
+   * uses two passes). Both options give an approximation of the 
+   * original algorithm that saves memory traffic; the differences 
+   * are small once the motion fields change slowly.
+   * @param interval number of iterations between updates, the default is 1
+   * @param lagNormalization normalize with the K of the previous update
+   */
+  void setConsistencyUpdate(int interval, bool lagNormalization = false);
+  
+  /// Enables convergence-based termination of the iteration.
+  /**
+   * Every checkInterval iterations, the update of the motion 
+   * fields during the last iteration is measured. The update 
+   * of a pixel is the length of the change of its motion vector 
+   * (in pixels). If the RMS (RMS_NORM) or the maximum (MAX_NORM) 
+   * of the updates over both motion fields is below the tolerance, 
+   * the iteration is stopped. A zero tolerance disables the check, 
+   * which is the default.
+   */
+  void setConvergenceTolerance(double tolerance, 
+                               ConvergenceNorm norm = RMS_NORM, 
+                               int checkInterval = 10);
+  
+  /// Sets the maximum number of iterations.
+  /**
+   * This overrides the number of iterations given to the 
+   * constructor. Zero restores the original value.
+   */
+  void setIterationBudget(int numIterations);
+  
+  /// Sets precomputed gradients of the input images.
+  /**
+   * The gradients are used by the following calls to compute 
+   * instead of computing them from the images. They must have 
+   * the dimensions of the images and must have been computed 
+   * with ImagePyramid::SOBEL_GRADIENT. NULL pointers restore 
+   * the default.
+   * @param G1 gradients of the first image
+   * @param G2 gradients of the second image
+   */
+  void setInputGradients(const CImg< short > *G1, const CImg< short > *G2);
+  
+  /// Enables the tiled iteration.
+  /**
+   * The tiled iteration is a variant of the multicolour sweep order, 
+   * so it cannot be enabled with RASTER_SWEEP (invalid_argument is 
+   * thrown). In the multicolour iteration, the four sweeps over the pixel 
+   * classes are separate passes over the whole image, so the motion 
+   * fields, the consistency maps and the gradients are streamed from 
+   * memory four times per iteration. In the tiled mode, the four 
+   * sweeps are carried out tile by tile while the tile is in the 
+   * cache. The tiles are processed in wavefront order, and the tiles 
+   * of a wavefront are distributed over the threads. The result is 
+   * identical to that of the multicolour iteration, also with one 
+   * thread.
+   * 
+   * Consecutive iterations are not fused, because the consistency 
+   * maps of an iteration depend on the motion fields of the whole 
+   * image after the previous one. The tile width is rounded up to 
+   * a multiple of 16 pixels. Zero dimensions disable the tiled mode, 
+   * which is the default.
+   * @param tileWidth tile width in pixels
+   * @param tileHeight tile height in pixels
+   */
+  void setTiling(int tileWidth, int tileHeight);
 private:
+  // workspace slots of the buffers (two of each)
+  enum BufferSlot { GRADIENT_SLOT_ = 0, GAMMA_SLOT_ = 2, SCALED_IMAGE_SLOT_ = 4, 
+                    PREV_FLOW_SLOT_ = 6, NUM_BUFFER_SLOTS_ = 8 };
+  
+  // the largest number of pixels spanned by one vector of the row 
+  // kernels (eight floats of every other pixel with AVX2)
+  static const int TILE_ALIGNMENT_ = 16;
+  
   const BoundaryConditions BOUNDARY_CONDITIONS_;
   const bool COMPUTE_RESIDUALS_;
   const double INTENSITY_SCALE_;
   const double LAMBDA_;
   const int NUM_ITERATIONS_;
+  const int NUM_THREADS_;
+  const SweepOrder SWEEP_ORDER_;
+  
+  double convergenceTolerance_;
+  ConvergenceNorm convergenceNorm_;
+  int convergenceCheckInterval_;
+  int iterationBudget_;
+  int numPerformedIterations_;
+  int tileWidth_, tileHeight_;
+  int consistencyUpdateInterval_;
+  bool lagNormalization_;
+  
+  // precomputed gradients of the input images (optional)
+  const CImg< short > *inputGradients_[2];
+  
+  // buffers of gamma_, G_, Vprev_ and Is_ for each buffer set
+  ImageWorkspace< T > workspace_;
+  int bufferSet_;
   
   CImg< unsigned char > I_[2];
-  CImg< double > gamma_[2];
-  CImg< double > G_[2];
-  CImg< double > V_[2];
+  CImg< T > gamma_[2];
+  CImg< T > G_[2];
+  CImg< T > V_[2];
+  
+  // motion fields before the last iteration (used for the convergence check)
+  CImg< T > Vprev_[2];
+  
+  // scaled intensities of the input images (used by the row kernels)
+  CImg< T > Is_[2];
+  typename ProesmansKernels::RowKernel< T >::Type rowKernel_;
   
   int width_, height_;
   
-  double computeAvg_(int x,
-                     int y,
-                     const CImg< double > &gi,
-                     const CImg< double > &Vi,
-                     double *v);
+  // per-row partial sums of the consistency maps
+  vector< double > rowCSums_;
+  vector< int > rowCCounts_;
+  
+  // the normalization constants of the last update of the consistency maps
+  T prevK_[2];
+  
+  double computeUpdateNorm_() const;
+  
+  // returns the workspace slot of a buffer in the current buffer set
+  int getBufferSlot_(BufferSlot slot) const;
   
   void computeGradients_(const CImg< unsigned char > &I, 
-                         CImg< double > &G);
+                         CImg< T > &G);
+  
+  void convertGradients_(const CImg< short > &Gi, 
+                         CImg< T > &G);
   
   void computeConsistencyMaps_();
   
-  void IterationStep_(double gx,
-                      double gy,
-                      double It,
-                      double *avg,
-                      double *result);
+  // computes row y of the consistency map i, normalized with K if it is positive
+  void computeConsistencyRow_(int i, int y, T K, double &CSum, int &CCount);
+  
+  // fills the arguments of a row kernel for the pixels x0,...,x1-1 of row y
+  void fillRowArgs_(int j, int y, int x0, int x1, int parity, 
+                    ProesmansKernels::RowArgs< T > &args);
+  
+  int getNumWorkerThreads_() const;
+  
+  void IterationStep_(T gx,
+                      T gy,
+                      T It,
+                      T *avg,
+                      T *result);
+  
+  void repairEdges_(CImg< T > &V);
+  
+  void sweepMulticolor_();
+  
+  void sweepRaster_();
+  
+  void sweepTile_(int tx, int ty);
+  
+  void sweepTiled_();
   
-  void repairEdges_(CImg< double > &V);
+  // updates the pixel (x,y) of the motion field j, given the data 
+  // of V_[j], gamma_[j] and G_[j]
+  void updatePixel_(int x, int y, int j, T *V, const T *gamma, const T *G);
 };
 
 #define PROESMANS_H
@@ -0,0 +1,138 @@
+
+#include "ProesmansKernels.h"
+
+namespace ProesmansKernels
+{
+  static const double SUMWEIGHTS_EPS = 1e-8;
+
+  template < class T >
+  static inline void updatePixel_(const RowArgs< T > &a, int i)
+  {
+    const T *gm = a.gamma + i - a.gammaStride;
+    const T *g0 = a.gamma + i;
+    const T *gp = a.gamma + i + a.gammaStride;
+    T *um = a.u + i - a.flowStride;
+    T *u0 = a.u + i;
+    T *up = a.u + i + a.flowStride;
+    T *vm = a.v + i - a.flowStride;
+    T *v0 = a.v + i;
+    T *vp = a.v + i + a.flowStride;
+    T uAvg, vAvg;
+    T xd, yd;
+
+    T sumWeights = (gm[0]  + g0[-1] + g0[1]  + gp[0]) * T(1.0 / 6.0) +
+                   (gm[-1] + gm[1]  + gp[-1] + gp[1]) * T(1.0 / 12.0);
+
+    if(sumWeights > T(SUMWEIGHTS_EPS))
+    {
+      uAvg = ((gm[0]  * um[0]  + g0[-1] * u0[-1] + g0[1]  * u0[1]  + gp[0]  * up[0])  * T(1.0 / 6.0) +
+              (gm[-1] * um[-1] + gm[1]  * um[1]  + gp[-1] * up[-1] + gp[1]  * up[1])  * T(1.0 / 12.0)) / sumWeights;
+      vAvg = ((gm[0]  * vm[0]  + g0[-1] * v0[-1] + g0[1]  * v0[1]  + gp[0]  * vp[0])  * T(1.0 / 6.0) +
+              (gm[-1] * vm[-1] + gm[1]  * vm[1]  + gp[-1] * vp[-1] + gp[1]  * vp[1])  * T(1.0 / 12.0)) / sumWeights;
+    }
+    else
+    {
+      // use the old value if the weight sum is too small to give accurate results
+      uAvg = u0[0];
+      vAvg = v0[0];
+    }
+
+    xd = a.x0 + i + uAvg;
+    yd = a.y + vAvg;
+
+    if(xd >= 0 && xd <= a.width - 1 && yd >= 0 && yd <= a.height - 1)
+    {
+      const int xi = (int)xd;
+      const int yi = (int)yd;
+      const T dx = xd - xi;
+      const T dy = yd - yi;
+      const int nx = xi < a.width - 1 ? xi + 1 : xi;
+      const int ny = yi < a.height - 1 ? yi + 1 : yi;
+      const T Icc = a.Iother[xi + yi * a.width];
+      const T Inc = a.Iother[nx + yi * a.width];
+      const T Icn = a.Iother[xi + ny * a.width];
+      const T Inn = a.Iother[nx + ny * a.width];
+
+      const T It = Icc + dx * (Inc - Icc + dy * (Icc + Inn - Icn - Inc)) + dy * (Icn - Icc) - a.I[i];
+      const T gx = a.gx[i];
+      const T gy = a.gy[i];
+      const T m = a.lambda * It / (T(1) + a.lambda * (gx * gx + gy * gy));
+
+      u0[0] = uAvg - gx * m;
+      v0[0] = vAvg - gy * m;
+    }
+    else
+    {
+      // use consistency-weighted average as the next value
+      // if (xd,yd) is outside the image
+      u0[0] = uAvg;
+      v0[0] = vAvg;
+    }
+
+    a.q[i] = g0[0];
+  }
+
+  template < class T >
+  void updateRowScalar(const RowArgs< T > &a)
+  {
+    updateRowScalar(a, 0);
+  }
+
+  template < class T >
+  void updateRowScalar(const RowArgs< T > &a, int begin)
+  {
+    for(int i = (((a.x0 + begin) & 1) == a.parity) ? begin : begin + 1; i < a.n; i += 2)
+      updatePixel_(a, i);
+  }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  static bool hasAVX2_()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+
+  static bool hasSSE2_()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+  }
+#else
+  static bool hasAVX2_() { return false; }
+
+  static bool hasSSE2_() { return false; }
+#endif
+
+  template < class T >
+  typename RowKernel< T >::Type getRowKernel()
+  {
+    typename RowKernel< T >::Type kernel;
+
+    if(hasAVX2_())
+      kernel = &updateRowAVX2;
+    else if(hasSSE2_())
+      kernel = &updateRowSSE2;
+    else
+      kernel = &updateRowScalar< T >;
+
+    return kernel;
+  }
+
+  const char *getRowKernelName()
+  {
+    if(hasAVX2_())
+      return "AVX2";
+    else if(hasSSE2_())
+      return "SSE2";
+    else
+      return "scalar";
+  }
+
+  template void updateRowScalar< float >(const RowArgs< float > &);
+  template void updateRowScalar< double >(const RowArgs< double > &);
+  template void updateRowScalar< float >(const RowArgs< float > &, int);
+  template void updateRowScalar< double >(const RowArgs< double > &, int);
+
+  template RowKernel< float >::Type getRowKernel< float >();
+  template RowKernel< double >::Type getRowKernel< double >();
+}
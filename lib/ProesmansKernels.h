@@ -0,0 +1,94 @@
+
+#ifndef PROESMANSKERNELS_H
+
+#include <cstddef>
+
+/// Implements row kernels for the multicolour iteration of the Proesmans algorithm.
+/**
+ * A row kernel carries out one Proesmans iteration step for a
+ * horizontal run of pixels that belong to the same parity class
+ * (see Proesmans). The flow, consistency and gradient data is
+ * accessed through plain row pointers into contiguous planes,
+ * so that the kernel can process several pixels at a time in
+ * vector registers.
+ *
+ * The kernels are provided for single and double precision.
+ * Vectorized kernels are provided for SSE2 and AVX2. The fastest
+ * kernel supported by the processor is selected at runtime, and
+ * the scalar kernel is used as a fallback on other platforms.
+ */
+namespace ProesmansKernels
+{
+  /// Arguments of a row kernel.
+  /**
+   * All row pointers point to the first pixel (x0,y) of the run.
+   */
+  template < class T > struct RowArgs
+  {
+    /// flow components to update (rows y-1 and y+1 are at -/+ flowStride)
+    T *u, *v;
+    /// quality channel, receives the consistency value of each updated pixel
+    T *q;
+    /// distance between two consecutive rows of u and v
+    ptrdiff_t flowStride;
+
+    /// consistency map (rows y-1 and y+1 are at -/+ gammaStride)
+    const T *gamma;
+    /// distance between two consecutive rows of gamma
+    ptrdiff_t gammaStride;
+
+    /// partial derivatives of the current image
+    const T *gx, *gy;
+
+    /// scaled intensities of the current image
+    const T *I;
+    /// scaled intensities of the other image (the whole image, not the row)
+    const T *Iother;
+
+    /// dimensions of the images
+    int width, height;
+
+    /// the first pixel of the run and the number of pixels in it
+    int x0, y, n;
+
+    /// only pixels with x mod 2 == parity are updated
+    int parity;
+
+    /// the smoothness parameter
+    T lambda;
+  };
+
+  /// Defines the type of a row kernel for the scalar type T.
+  template < class T > struct RowKernel
+  {
+    typedef void (*Type)(const RowArgs< T > &args);
+  };
+
+  /// Returns the fastest row kernel supported by the processor.
+  template < class T > typename RowKernel< T >::Type getRowKernel();
+
+  /// Returns the name of the instruction set used by getRowKernel.
+  const char *getRowKernelName();
+
+  /// Scalar row kernel.
+  template < class T > void updateRowScalar(const RowArgs< T > &args);
+
+  /// Updates the pixels begin,...,n-1 of the run with the scalar kernel.
+  /**
+   * The vectorized kernels use this for the remaining pixels of the
+   * run that do not fill a whole vector.
+   */
+  template < class T > void updateRowScalar(const RowArgs< T > &args, int begin);
+
+  /// Row kernels using SSE2 instructions (two doubles or four floats at a time).
+  void updateRowSSE2(const RowArgs< float > &args);
+  void updateRowSSE2(const RowArgs< double > &args);
+
+  /// Row kernels using AVX2 instructions (four doubles or eight floats at a time).
+  void updateRowAVX2(const RowArgs< float > &args);
+  void updateRowAVX2(const RowArgs< double > &args);
+}
+
+#define PROESMANSKERNELS_H
+
+#endif
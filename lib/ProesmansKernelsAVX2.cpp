@@ -0,0 +1,202 @@
+
+// This file is compiled with AVX2 code generation enabled. Its functions
+// must only be called after checking that the processor supports AVX2
+// (see ProesmansKernels::getRowKernel).
+
+#include "ProesmansKernels.h"
+
+#ifdef __AVX2__
+#include "ProesmansKernelsVector.h"
+
+#include <immintrin.h>
+
+namespace
+{
+  // vector operations for four doubles
+  struct AVX2Double
+  {
+    typedef double Scalar;
+    typedef __m256d Vec;
+    enum { LANES = 4 };
+
+    static inline Vec set1(double s) { return _mm256_set1_pd(s); }
+    static inline Vec ramp() { return _mm256_set_pd(6.0, 4.0, 2.0, 0.0); }
+
+    static inline Vec add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+    static inline Vec sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+    static inline Vec mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+    static inline Vec div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+    static inline Vec min(Vec a, Vec b) { return _mm256_min_pd(a, b); }
+    static inline Vec max(Vec a, Vec b) { return _mm256_max_pd(a, b); }
+
+    static inline Vec cmpgt(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static inline Vec cmpge(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static inline Vec cmple(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static inline Vec and_(Vec a, Vec b) { return _mm256_and_pd(a, b); }
+    static inline Vec blend(Vec a, Vec b, Vec mask) { return _mm256_blendv_pd(a, b, mask); }
+
+    static inline Vec loadCenter(const double *p)
+    {
+      return _mm256_permute4x64_pd(_mm256_unpacklo_pd(_mm256_loadu_pd(p), _mm256_loadu_pd(p + 4)),
+                                   _MM_SHUFFLE(3, 1, 2, 0));
+    }
+
+    static inline void loadStrided(const double *p, Vec &w, Vec &c, Vec &e)
+    {
+      const __m256d a = _mm256_loadu_pd(p);
+      const __m256d b = _mm256_loadu_pd(p + 4);
+
+      c = _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+      e = _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+      w = _mm256_blend_pd(_mm256_permute4x64_pd(e, _MM_SHUFFLE(2, 1, 0, 0)),
+                          _mm256_broadcast_sd(p - 1), 0x1);
+    }
+
+    static inline void storeStrided(double *p, Vec v)
+    {
+      _mm256_storeu_pd(p, _mm256_blend_pd(_mm256_loadu_pd(p),
+                                          _mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 1, 0, 0)), 0x5));
+      _mm256_storeu_pd(p + 4, _mm256_blend_pd(_mm256_loadu_pd(p + 4),
+                                              _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 2, 2)), 0x5));
+    }
+
+    // The masked gather is used because the plain one triggers a 
+    // spurious uninitialized variable warning with some compilers.
+    static inline Vec gather_(const double *I, __m128i index)
+    {
+      return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), I, index,
+                                      _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+    }
+
+    static inline Vec interpolate(const double *I, int width, int height, Vec x, Vec y)
+    {
+      const __m128i one = _mm_set1_epi32(1);
+      const __m128i xi = _mm256_cvttpd_epi32(x);
+      const __m128i yi = _mm256_cvttpd_epi32(y);
+      const __m256d dx = _mm256_sub_pd(x, _mm256_cvtepi32_pd(xi));
+      const __m256d dy = _mm256_sub_pd(y, _mm256_cvtepi32_pd(yi));
+      const __m128i nx = _mm_min_epi32(_mm_add_epi32(xi, one), _mm_set1_epi32(width - 1));
+      const __m128i ny = _mm_min_epi32(_mm_add_epi32(yi, one), _mm_set1_epi32(height - 1));
+      const __m128i row0 = _mm_mullo_epi32(yi, _mm_set1_epi32(width));
+      const __m128i row1 = _mm_mullo_epi32(ny, _mm_set1_epi32(width));
+
+      const __m256d Icc = gather_(I, _mm_add_epi32(row0, xi));
+      const __m256d Inc = gather_(I, _mm_add_epi32(row0, nx));
+      const __m256d Icn = gather_(I, _mm_add_epi32(row1, xi));
+      const __m256d Inn = gather_(I, _mm_add_epi32(row1, nx));
+
+      const __m256d cross = _mm256_sub_pd(_mm256_add_pd(Icc, Inn), _mm256_add_pd(Icn, Inc));
+      return _mm256_add_pd(_mm256_add_pd(Icc, _mm256_mul_pd(dx, _mm256_add_pd(_mm256_sub_pd(Inc, Icc),
+                                                                              _mm256_mul_pd(dy, cross)))),
+                           _mm256_mul_pd(dy, _mm256_sub_pd(Icn, Icc)));
+    }
+  };
+
+  // vector operations for eight floats
+  struct AVX2Float
+  {
+    typedef float Scalar;
+    typedef __m256 Vec;
+    enum { LANES = 8 };
+
+    static inline Vec set1(float s) { return _mm256_set1_ps(s); }
+    static inline Vec ramp() { return _mm256_setr_ps(0.0f, 2.0f, 4.0f, 6.0f, 8.0f, 10.0f, 12.0f, 14.0f); }
+
+    static inline Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    static inline Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+    static inline Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    static inline Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+    static inline Vec min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+    static inline Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+
+    static inline Vec cmpgt(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline Vec cmpge(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static inline Vec cmple(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static inline Vec and_(Vec a, Vec b) { return _mm256_and_ps(a, b); }
+    static inline Vec blend(Vec a, Vec b, Vec mask) { return _mm256_blendv_ps(a, b, mask); }
+
+    // Selects the even (imm = 2,0,2,0) or odd (imm = 3,1,3,1) elements
+    // of the sixteen floats in a and b.
+    template < int IMM >
+    static inline Vec deinterleave_(Vec a, Vec b)
+    {
+      return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, IMM)),
+                                                    _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    static inline Vec loadCenter(const float *p)
+    {
+      return deinterleave_< _MM_SHUFFLE(2, 0, 2, 0) >(_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8));
+    }
+
+    static inline void loadStrided(const float *p, Vec &w, Vec &c, Vec &e)
+    {
+      const __m256 a = _mm256_loadu_ps(p);
+      const __m256 b = _mm256_loadu_ps(p + 8);
+
+      c = deinterleave_< _MM_SHUFFLE(2, 0, 2, 0) >(a, b);
+      e = deinterleave_< _MM_SHUFFLE(3, 1, 3, 1) >(a, b);
+      w = _mm256_blend_ps(_mm256_permutevar8x32_ps(e, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)),
+                          _mm256_broadcast_ss(p - 1), 0x1);
+    }
+
+    static inline void storeStrided(float *p, Vec v)
+    {
+      _mm256_storeu_ps(p, _mm256_blend_ps(_mm256_loadu_ps(p),
+                                          _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3)),
+                                          0x55));
+      _mm256_storeu_ps(p + 8, _mm256_blend_ps(_mm256_loadu_ps(p + 8),
+                                              _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7)),
+                                              0x55));
+    }
+
+    static inline Vec interpolate(const float *I, int width, int height, Vec x, Vec y)
+    {
+      const __m256i one = _mm256_set1_epi32(1);
+      const __m256i xi = _mm256_cvttps_epi32(x);
+      const __m256i yi = _mm256_cvttps_epi32(y);
+      const __m256 dx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(xi));
+      const __m256 dy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(yi));
+      const __m256i nx = _mm256_min_epi32(_mm256_add_epi32(xi, one), _mm256_set1_epi32(width - 1));
+      const __m256i ny = _mm256_min_epi32(_mm256_add_epi32(yi, one), _mm256_set1_epi32(height - 1));
+      const __m256i row0 = _mm256_mullo_epi32(yi, _mm256_set1_epi32(width));
+      const __m256i row1 = _mm256_mullo_epi32(ny, _mm256_set1_epi32(width));
+
+      const __m256 Icc = _mm256_i32gather_ps(I, _mm256_add_epi32(row0, xi), 4);
+      const __m256 Inc = _mm256_i32gather_ps(I, _mm256_add_epi32(row0, nx), 4);
+      const __m256 Icn = _mm256_i32gather_ps(I, _mm256_add_epi32(row1, xi), 4);
+      const __m256 Inn = _mm256_i32gather_ps(I, _mm256_add_epi32(row1, nx), 4);
+
+      const __m256 cross = _mm256_sub_ps(_mm256_add_ps(Icc, Inn), _mm256_add_ps(Icn, Inc));
+      return _mm256_add_ps(_mm256_add_ps(Icc, _mm256_mul_ps(dx, _mm256_add_ps(_mm256_sub_ps(Inc, Icc),
+                                                                              _mm256_mul_ps(dy, cross)))),
+                           _mm256_mul_ps(dy, _mm256_sub_ps(Icn, Icc)));
+    }
+  };
+}
+#endif
+
+namespace ProesmansKernels
+{
+#ifdef __AVX2__
+  void updateRowAVX2(const RowArgs< float > &a)
+  {
+    updateRowVector_< AVX2Float >(a);
+  }
+
+  void updateRowAVX2(const RowArgs< double > &a)
+  {
+    updateRowVector_< AVX2Double >(a);
+  }
+#else
+  void updateRowAVX2(const RowArgs< float > &a)
+  {
+    updateRowScalar(a);
+  }
+
+  void updateRowAVX2(const RowArgs< double > &a)
+  {
+    updateRowScalar(a);
+  }
+#endif
+}
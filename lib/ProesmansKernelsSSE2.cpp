@@ -0,0 +1,206 @@
+
+// This file is compiled with SSE2 code generation enabled. Its functions
+// must only be called after checking that the processor supports SSE2
+// (see ProesmansKernels::getRowKernel).
+
+#include "ProesmansKernels.h"
+
+#ifdef __SSE2__
+#include "ProesmansKernelsVector.h"
+
+#include <emmintrin.h>
+
+namespace
+{
+  // vector operations for two doubles
+  struct SSE2Double
+  {
+    typedef double Scalar;
+    typedef __m128d Vec;
+    enum { LANES = 2 };
+
+    static inline Vec set1(double s) { return _mm_set1_pd(s); }
+    static inline Vec ramp() { return _mm_set_pd(2.0, 0.0); }
+
+    static inline Vec add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+    static inline Vec sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+    static inline Vec mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+    static inline Vec div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+    static inline Vec min(Vec a, Vec b) { return _mm_min_pd(a, b); }
+    static inline Vec max(Vec a, Vec b) { return _mm_max_pd(a, b); }
+
+    static inline Vec cmpgt(Vec a, Vec b) { return _mm_cmpgt_pd(a, b); }
+    static inline Vec cmpge(Vec a, Vec b) { return _mm_cmpge_pd(a, b); }
+    static inline Vec cmple(Vec a, Vec b) { return _mm_cmple_pd(a, b); }
+    static inline Vec and_(Vec a, Vec b) { return _mm_and_pd(a, b); }
+    static inline Vec blend(Vec a, Vec b, Vec mask)
+    {
+      return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+    }
+
+    static inline Vec loadCenter(const double *p)
+    {
+      return _mm_unpacklo_pd(_mm_loadu_pd(p), _mm_loadu_pd(p + 2));
+    }
+
+    static inline void loadStrided(const double *p, Vec &w, Vec &c, Vec &e)
+    {
+      const __m128d a = _mm_loadu_pd(p);
+      const __m128d b = _mm_loadu_pd(p + 2);
+
+      c = _mm_unpacklo_pd(a, b);
+      e = _mm_unpackhi_pd(a, b);
+      w = _mm_unpacklo_pd(_mm_load_sd(p - 1), e);
+    }
+
+    static inline void storeStrided(double *p, Vec v)
+    {
+      _mm_storeu_pd(p, _mm_move_sd(_mm_loadu_pd(p), v));
+      _mm_storeu_pd(p + 2, _mm_move_sd(_mm_loadu_pd(p + 2), _mm_unpackhi_pd(v, v)));
+    }
+
+    static inline Vec interpolate(const double *I, int width, int height, Vec x, Vec y)
+    {
+      const __m128i xii = _mm_cvttpd_epi32(x);
+      const __m128i yii = _mm_cvttpd_epi32(y);
+      const __m128d dx = _mm_sub_pd(x, _mm_cvtepi32_pd(xii));
+      const __m128d dy = _mm_sub_pd(y, _mm_cvtepi32_pd(yii));
+      int xi[4], yi[4];
+      double Icc[2], Inc[2], Icn[2], Inn[2];
+
+      // SSE2 has no gather instructions
+      _mm_storeu_si128((__m128i *)xi, xii);
+      _mm_storeu_si128((__m128i *)yi, yii);
+      for(int k = 0; k < 2; k++)
+      {
+        const int nx = xi[k] < width - 1 ? xi[k] + 1 : xi[k];
+        const int ny = yi[k] < height - 1 ? yi[k] + 1 : yi[k];
+
+        Icc[k] = I[xi[k] + yi[k] * width];
+        Inc[k] = I[nx + yi[k] * width];
+        Icn[k] = I[xi[k] + ny * width];
+        Inn[k] = I[nx + ny * width];
+      }
+
+      const __m128d Iccv = _mm_loadu_pd(Icc);
+      const __m128d Incv = _mm_loadu_pd(Inc);
+      const __m128d Icnv = _mm_loadu_pd(Icn);
+      const __m128d Innv = _mm_loadu_pd(Inn);
+
+      const __m128d cross = _mm_sub_pd(_mm_add_pd(Iccv, Innv), _mm_add_pd(Icnv, Incv));
+      return _mm_add_pd(_mm_add_pd(Iccv, _mm_mul_pd(dx, _mm_add_pd(_mm_sub_pd(Incv, Iccv),
+                                                                   _mm_mul_pd(dy, cross)))),
+                        _mm_mul_pd(dy, _mm_sub_pd(Icnv, Iccv)));
+    }
+  };
+
+  // vector operations for four floats
+  struct SSE2Float
+  {
+    typedef float Scalar;
+    typedef __m128 Vec;
+    enum { LANES = 4 };
+
+    static inline Vec set1(float s) { return _mm_set1_ps(s); }
+    static inline Vec ramp() { return _mm_setr_ps(0.0f, 2.0f, 4.0f, 6.0f); }
+
+    static inline Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+    static inline Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+    static inline Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+    static inline Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+    static inline Vec min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+    static inline Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+
+    static inline Vec cmpgt(Vec a, Vec b) { return _mm_cmpgt_ps(a, b); }
+    static inline Vec cmpge(Vec a, Vec b) { return _mm_cmpge_ps(a, b); }
+    static inline Vec cmple(Vec a, Vec b) { return _mm_cmple_ps(a, b); }
+    static inline Vec and_(Vec a, Vec b) { return _mm_and_ps(a, b); }
+    static inline Vec blend(Vec a, Vec b, Vec mask)
+    {
+      return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+    }
+
+    static inline Vec loadCenter(const float *p)
+    {
+      return _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    static inline void loadStrided(const float *p, Vec &w, Vec &c, Vec &e)
+    {
+      const __m128 a = _mm_loadu_ps(p);
+      const __m128 b = _mm_loadu_ps(p + 4);
+
+      c = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      e = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      w = _mm_move_ss(_mm_shuffle_ps(e, e, _MM_SHUFFLE(2, 1, 0, 0)), _mm_load_ss(p - 1));
+    }
+
+    static inline void storeStrided(float *p, Vec v)
+    {
+      const __m128 even = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0));
+
+      _mm_storeu_ps(p, blend(_mm_loadu_ps(p), _mm_unpacklo_ps(v, v), even));
+      _mm_storeu_ps(p + 4, blend(_mm_loadu_ps(p + 4), _mm_unpackhi_ps(v, v), even));
+    }
+
+    static inline Vec interpolate(const float *I, int width, int height, Vec x, Vec y)
+    {
+      const __m128i xii = _mm_cvttps_epi32(x);
+      const __m128i yii = _mm_cvttps_epi32(y);
+      const __m128 dx = _mm_sub_ps(x, _mm_cvtepi32_ps(xii));
+      const __m128 dy = _mm_sub_ps(y, _mm_cvtepi32_ps(yii));
+      int xi[4], yi[4];
+      float Icc[4], Inc[4], Icn[4], Inn[4];
+
+      // SSE2 has no gather instructions
+      _mm_storeu_si128((__m128i *)xi, xii);
+      _mm_storeu_si128((__m128i *)yi, yii);
+      for(int k = 0; k < 4; k++)
+      {
+        const int nx = xi[k] < width - 1 ? xi[k] + 1 : xi[k];
+        const int ny = yi[k] < height - 1 ? yi[k] + 1 : yi[k];
+
+        Icc[k] = I[xi[k] + yi[k] * width];
+        Inc[k] = I[nx + yi[k] * width];
+        Icn[k] = I[xi[k] + ny * width];
+        Inn[k] = I[nx + ny * width];
+      }
+
+      const __m128 Iccv = _mm_loadu_ps(Icc);
+      const __m128 Incv = _mm_loadu_ps(Inc);
+      const __m128 Icnv = _mm_loadu_ps(Icn);
+      const __m128 Innv = _mm_loadu_ps(Inn);
+
+      const __m128 cross = _mm_sub_ps(_mm_add_ps(Iccv, Innv), _mm_add_ps(Icnv, Incv));
+      return _mm_add_ps(_mm_add_ps(Iccv, _mm_mul_ps(dx, _mm_add_ps(_mm_sub_ps(Incv, Iccv),
+                                                                   _mm_mul_ps(dy, cross)))),
+                        _mm_mul_ps(dy, _mm_sub_ps(Icnv, Iccv)));
+    }
+  };
+}
+#endif
+
+namespace ProesmansKernels
+{
+#ifdef __SSE2__
+  void updateRowSSE2(const RowArgs< float > &a)
+  {
+    updateRowVector_< SSE2Float >(a);
+  }
+
+  void updateRowSSE2(const RowArgs< double > &a)
+  {
+    updateRowVector_< SSE2Double >(a);
+  }
+#else
+  void updateRowSSE2(const RowArgs< float > &a)
+  {
+    updateRowScalar(a);
+  }
+
+  void updateRowSSE2(const RowArgs< double > &a)
+  {
+    updateRowScalar(a);
+  }
+#endif
+}
@@ -0,0 +1,128 @@
+
+#ifndef PROESMANSKERNELSVECTOR_H
+
+#include "ProesmansKernels.h"
+
+// This header is only included by the instruction set specific kernel
+// files. It implements the row kernel on top of a set of vector
+// operations V that is defined separately for each instruction set
+// and scalar type. V must define the following:
+//
+//   Scalar                 the scalar type
+//   Vec                    the vector type
+//   LANES                  the number of scalars in a vector
+//   set1(s)                a vector with all lanes set to s
+//   ramp()                 the vector (0,2,4,...)
+//   add, sub, mul, div,
+//   min, max               lane-wise arithmetic
+//   cmpgt, cmpge, cmple,
+//   and_                   lane-wise comparisons and masking
+//   blend(a, b, mask)      selects b where mask is set, otherwise a
+//   loadCenter(p)          loads p[0],p[2],...
+//   loadStrided(p, w,c,e)  loads p[0],p[2],... and their left and right neighbours
+//   storeStrided(p, v)     stores v to p[0],p[2],... leaving the other values intact
+//   interpolate(I, width, height, x, y)
+//                          bilinear interpolation of the image I at (x,y),
+//                          the coordinates are inside the image
+
+namespace ProesmansKernels
+{
+  // Computes the consistency-weighted sum of the eight neighbours of
+  // the flow component r.
+  template < class V >
+  inline typename V::Vec weightedSum_(const typename V::Vec *g,
+                                      const typename V::Scalar *r,
+                                      ptrdiff_t stride)
+  {
+    typedef typename V::Scalar T;
+    typedef typename V::Vec Vec;
+    Vec rm[3], r0[3], rp[3];
+
+    V::loadStrided(r - stride, rm[0], rm[1], rm[2]);
+    V::loadStrided(r,          r0[0], r0[1], r0[2]);
+    V::loadStrided(r + stride, rp[0], rp[1], rp[2]);
+
+    const Vec a = V::add(V::add(V::mul(g[1], rm[1]), V::mul(g[3], r0[0])),
+                         V::add(V::mul(g[5], r0[2]), V::mul(g[7], rp[1])));
+    const Vec b = V::add(V::add(V::mul(g[0], rm[0]), V::mul(g[2], rm[2])),
+                         V::add(V::mul(g[6], rp[0]), V::mul(g[8], rp[2])));
+
+    return V::add(V::mul(a, V::set1(T(1.0 / 6.0))),
+                  V::mul(b, V::set1(T(1.0 / 12.0))));
+  }
+
+  template < class V >
+  void updateRowVector_(const RowArgs< typename V::Scalar > &a)
+  {
+    typedef typename V::Scalar T;
+    typedef typename V::Vec Vec;
+
+    const Vec zero = V::set1(T(0));
+    const Vec one = V::set1(T(1));
+    const Vec eps = V::set1(T(1e-8));
+    const Vec lambda = V::set1(a.lambda);
+    const Vec xMax = V::set1(T(a.width - 1));
+    const Vec yMax = V::set1(T(a.height - 1));
+    const Vec yd = V::set1(T(a.y));
+    int i;
+
+    // Each vector holds pixels of the same parity, i.e. every other
+    // pixel of the run. The loop stops early enough that the right
+    // neighbour of the last pixel is still inside the run.
+    for(i = ((a.x0 & 1) == a.parity) ? 0 : 1; i + 2 * V::LANES - 1 <= a.n; i += 2 * V::LANES)
+    {
+      Vec g[9];
+
+      // neighbourhood of the consistency map in row-major order
+      V::loadStrided(a.gamma + i - a.gammaStride, g[0], g[1], g[2]);
+      V::loadStrided(a.gamma + i,                 g[3], g[4], g[5]);
+      V::loadStrided(a.gamma + i + a.gammaStride, g[6], g[7], g[8]);
+
+      const Vec sumWeights =
+        V::add(V::mul(V::add(V::add(g[1], g[3]), V::add(g[5], g[7])), V::set1(T(1.0 / 6.0))),
+               V::mul(V::add(V::add(g[0], g[2]), V::add(g[6], g[8])), V::set1(T(1.0 / 12.0))));
+      const Vec validWeights = V::cmpgt(sumWeights, eps);
+      const Vec safeWeights = V::blend(one, sumWeights, validWeights);
+
+      T *u0 = a.u + i;
+      T *v0 = a.v + i;
+
+      // use the old value if the weight sum is too small to give accurate results
+      const Vec uAvg = V::blend(V::loadCenter(u0),
+                                V::div(weightedSum_< V >(g, u0, a.flowStride), safeWeights),
+                                validWeights);
+      const Vec vAvg = V::blend(V::loadCenter(v0),
+                                V::div(weightedSum_< V >(g, v0, a.flowStride), safeWeights),
+                                validWeights);
+
+      // warp the other image to (xd,yd) with bilinear interpolation
+      const Vec xd = V::add(V::add(V::set1(T(a.x0 + i)), V::ramp()), uAvg);
+      const Vec yw = V::add(yd, vAvg);
+      const Vec inside = V::and_(V::and_(V::cmpge(xd, zero), V::cmple(xd, xMax)),
+                                 V::and_(V::cmpge(yw, zero), V::cmple(yw, yMax)));
+      // clamp the coordinates so that the reads stay inside the image
+      const Vec Iw = V::interpolate(a.Iother, a.width, a.height,
+                                    V::min(V::max(xd, zero), xMax),
+                                    V::min(V::max(yw, zero), yMax));
+      const Vec It = V::sub(Iw, V::loadCenter(a.I + i));
+
+      // iteration step
+      const Vec gx = V::loadCenter(a.gx + i);
+      const Vec gy = V::loadCenter(a.gy + i);
+      const Vec gNorm2 = V::add(V::mul(gx, gx), V::mul(gy, gy));
+      const Vec m = V::div(V::mul(lambda, It), V::add(one, V::mul(lambda, gNorm2)));
+
+      // use consistency-weighted average as the next value
+      // if (xd,yd) is outside the image
+      V::storeStrided(u0, V::blend(uAvg, V::sub(uAvg, V::mul(gx, m)), inside));
+      V::storeStrided(v0, V::blend(vAvg, V::sub(vAvg, V::mul(gy, m)), inside));
+      V::storeStrided(a.q + i, g[4]);
+    }
+
+    updateRowScalar(a, i);
+  }
+}
+
+#define PROESMANSKERNELSVECTOR_H
+
+#endif
@@ -0,0 +1,157 @@
+
+#include "Profiler.h"
+
+#include <iomanip>
+#include <time.h>
+
+// The stage is added when the timer starts, so that an enclosing 
+// stage is listed before the stages nested in it.
+Profiler::ScopedTimer::ScopedTimer(Profiler *profiler, const char *stage) :
+  profiler_(profiler),
+  stageIndex_(0),
+  startTime_(0.0)
+{
+  if(profiler_ != NULL)
+  {
+    stageIndex_ = profiler_->getStageIndex_(stage);
+    startTime_ = getCurrentTime();
+  }
+}
+
+Profiler::ScopedTimer::~ScopedTimer()
+{
+  if(profiler_ != NULL)
+  {
+    Stage &s = profiler_->stages_[stageIndex_];
+    s.time += getCurrentTime() - startTime_;
+    s.numCalls++;
+  }
+}
+
+Profiler::Profiler() { }
+
+void Profiler::addCount(const char *counter, long n)
+{
+  vector< Counter >::iterator it;
+
+  for(it = counters_.begin(); it != counters_.end(); it++)
+  {
+    if(it->name == counter)
+    {
+      it->value += n;
+      return;
+    }
+  }
+
+  Counter c;
+  c.name = counter;
+  c.value = n;
+  counters_.push_back(c);
+}
+
+void Profiler::addTime(const char *stage, double seconds)
+{
+  Stage &s = stages_[getStageIndex_(stage)];
+
+  s.time += seconds;
+  s.numCalls++;
+}
+
+long Profiler::getCount(const string &counter) const
+{
+  vector< Counter >::const_iterator it;
+
+  for(it = counters_.begin(); it != counters_.end(); it++)
+  {
+    if(it->name == counter)
+      return it->value;
+  }
+
+  return 0;
+}
+
+const vector< Profiler::Counter > &Profiler::getCounters() const
+{
+  return counters_;
+}
+
+double Profiler::getCurrentTime()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+const vector< Profiler::Stage > &Profiler::getStages() const
+{
+  return stages_;
+}
+
+double Profiler::getTime(const string &stage) const
+{
+  vector< Stage >::const_iterator it;
+
+  for(it = stages_.begin(); it != stages_.end(); it++)
+  {
+    if(it->name == stage)
+      return it->time;
+  }
+
+  return 0.0;
+}
+
+bool Profiler::isEnabled()
+{
+#ifdef WITH_PROFILING
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Profiler::print(ostream &out) const
+{
+  vector< Stage >::const_iterator si;
+  vector< Counter >::const_iterator ci;
+
+  out<<left<<setw(36)<<"Stage"<<right<<setw(12)<<"Time (ms)"<<setw(10)<<"Calls"<<endl;
+  for(si = stages_.begin(); si != stages_.end(); si++)
+  {
+    out<<left<<setw(36)<<si->name<<right<<setw(12)<<fixed<<setprecision(3)
+       <<si->time * 1000.0<<setw(10)<<si->numCalls<<endl;
+  }
+
+  if(!counters_.empty())
+  {
+    out<<endl<<left<<setw(36)<<"Counter"<<right<<setw(22)<<"Value"<<endl;
+    for(ci = counters_.begin(); ci != counters_.end(); ci++)
+      out<<left<<setw(36)<<ci->name<<right<<setw(22)<<ci->value<<endl;
+  }
+
+  out.unsetf(ios::floatfield | ios::adjustfield);
+  out<<setprecision(6);
+}
+
+void Profiler::reset()
+{
+  stages_.clear();
+  counters_.clear();
+}
+
+int Profiler::getStageIndex_(const char *stage)
+{
+  for(unsigned int i = 0; i < stages_.size(); i++)
+  {
+    if(stages_[i].name == stage)
+      return i;
+  }
+
+  Stage s;
+  s.name = stage;
+  s.time = 0.0;
+  s.numCalls = 0;
+  stages_.push_back(s);
+
+  return stages_.size() - 1;
+}
@@ -0,0 +1,132 @@
+
+#ifndef PROFILER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/// Collects the running times of computation stages and event counts.
+/**
+ * A profiler can be given to a dense motion extractor with
+ * DenseMotionExtractor::setProfiler. The motion extractor then
+ * reports the time spent in its stages (e.g. building the image
+ * pyramids, computing each pyramid level, upsampling the motion
+ * fields) and counts of events (e.g. iterations carried out,
+ * rejected pixels) to it. The host application can read the
+ * collected values after compute. The values accumulate over
+ * calls until reset is called.
+ *
+ * The instrumentation is only compiled into the library if it
+ * is built with WITH_PROFILING (see isEnabled). Otherwise the
+ * PROFILE_SCOPE and PROFILE_COUNT macros expand to nothing, and
+ * the profiler stays empty. The stage and counter names are
+ * C strings, so the compiled-in instrumentation allocates no
+ * memory while no profiler is set.
+ *
+ * Stages can be nested, e.g. the time of a pyramid level includes
+ * the time of its gradient computation. The stages are listed in
+ * the order in which they were first started, so nested stages
+ * follow the enclosing stage. The counters are listed in the order
+ * in which they were first reported.
+ *
+ * This class is not thread-safe. The motion extractors only
+ * report to it outside their parallel regions.
+ */
+class Profiler
+{
+public:
+  /// The accumulated running time of a stage.
+  struct Stage
+  {
+    string name;
+    double time;       ///< total time (in seconds)
+    long numCalls;     ///< number of times the stage was run
+  };
+
+  /// The accumulated value of a counter.
+  struct Counter
+  {
+    string name;
+    long value;
+  };
+
+  /// Measures the time from its construction to its destruction.
+  class ScopedTimer
+  {
+  public:
+    /// Starts measuring a stage. If profiler is NULL, nothing is measured or allocated.
+    ScopedTimer(Profiler *profiler, const char *stage);
+
+    /// Adds the elapsed time to the stage.
+    ~ScopedTimer();
+  private:
+    Profiler *profiler_;
+    int stageIndex_;
+    double startTime_;
+  };
+
+  /// Constructs an empty profiler.
+  Profiler();
+
+  /// Adds n to a counter.
+  void addCount(const char *counter, long n = 1);
+
+  /// Adds a running time (in seconds) to a stage.
+  void addTime(const char *stage, double seconds);
+
+  /// Returns the value of a counter, or zero if it has not been reported.
+  long getCount(const string &counter) const;
+
+  /// Returns the counters in the order in which they were first reported.
+  const vector< Counter > &getCounters() const;
+
+  /// Returns the time of a monotonic clock (in seconds).
+  static double getCurrentTime();
+
+  /// Returns the stages in the order in which they were first started.
+  const vector< Stage > &getStages() const;
+
+  /// Returns the total time of a stage (in seconds), or zero if it has not been reported.
+  double getTime(const string &stage) const;
+
+  /// Returns true if the library was compiled with the profiling instrumentation.
+  static bool isEnabled();
+
+  /// Prints the stages and counters as a table.
+  void print(ostream &out) const;
+
+  /// Removes all stages and counters.
+  void reset();
+private:
+  vector< Stage > stages_;
+  vector< Counter > counters_;
+
+  // returns the index of a stage, adding the stage if it does not exist
+  int getStageIndex_(const char *stage);
+};
+
+#ifdef WITH_PROFILING
+
+#define PROFILE_CONCAT2_(a, b) a##b
+#define PROFILE_CONCAT_(a, b) PROFILE_CONCAT2_(a, b)
+
+/// Measures the time from this line to the end of the enclosing scope.
+#define PROFILE_SCOPE(profiler, stage) \
+  Profiler::ScopedTimer PROFILE_CONCAT_(profileScope_, __LINE__)((profiler), (stage))
+
+/// Adds n to a counter if profiler is not NULL.
+#define PROFILE_COUNT(profiler, counter, n) \
+  do { if((profiler) != NULL) (profiler)->addCount((counter), (n)); } while(0)
+
+#else
+
+#define PROFILE_SCOPE(profiler, stage)
+#define PROFILE_COUNT(profiler, counter, n)
+
+#endif
+
+#define PROFILER_H
+
+#endif
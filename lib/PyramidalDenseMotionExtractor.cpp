@@ -1,158 +1,492 @@
 
 #include "DualDenseMotionExtractor.h"
+#include "Profiler.h"
 #include "PyramidalDenseMotionExtractor.h"
 
+#include <sstream>
 #include <stdexcept>
 
-PyramidalDenseMotionExtractor::~PyramidalDenseMotionExtractor() { }
+#ifdef WITH_PROFILING
+// returns the name of the profiler stage of a pyramid level
+static string getLevelStageName_(int level)
+{
+  ostringstream name;
+  name<<"level "<<level;
+  
+  return name.str();
+}
+#endif
 
-void PyramidalDenseMotionExtractor::compute(const CImg< unsigned char > &I1,
-                                            const CImg< unsigned char > &I2,
-                                            CImg< double > &V)
+template < class T >
+PyramidalDenseMotionExtractor< T >::~PyramidalDenseMotionExtractor() { }
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::compute(const CImg< unsigned char > &I1,
+                                                 const CImg< unsigned char > &I2,
+                                                 CImg< T > &V)
 {
-  CImg< double > VB; // not used
+  CImg< T > VB; // not used
   compute(I1, I2, V, VB);
 }
 
-void PyramidalDenseMotionExtractor::compute(const CImg< unsigned char > &I1,
-                                            const CImg< unsigned char > &I2,
-                                            CImg< double > &VF,
-                                            CImg< double > &VB)
+template < class T >
+void PyramidalDenseMotionExtractor< T >::compute(const CImg< unsigned char > &I1,
+                                                 const CImg< unsigned char > &I2,
+                                                 CImg< T > &VF,
+                                                 CImg< T > &VB)
+{
+  compute(I1, I2, VF, VB, ImagePyramidCache::NO_FRAME_ID, ImagePyramidCache::NO_FRAME_ID);
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::compute(const CImg< unsigned char > &I1,
+                                                 const CImg< unsigned char > &I2,
+                                                 CImg< T > &VF,
+                                                 CImg< T > &VB,
+                                                 long frameId1,
+                                                 long frameId2)
 {
-  const int W = I1.dimx();
-  const int H = I1.dimy();
-  
-  CImg< double > nextLevelVF;
-  CImg< double > nextLevelVB;
-  
   // Check that the input images have the same dimensions;
   if(I1.dimx() != I2.dimx() || 
      I1.dimy() != I2.dimy())
     throw invalid_argument("The dimensions of the input images must match.");
   
-  imagePyramids[0] = ImagePyramid(I1, NUMLEVELS);
-  imagePyramids[1] = ImagePyramid(I2, NUMLEVELS);
+  // (the block limits the profiled stage)
+  {
+    PROFILE_SCOPE(this->profiler, "pyramids");
+    
+    if(pyramidCache_ != NULL)
+    {
+      pyramids_[0] = &pyramidCache_->getPyramid(I1, NUMLEVELS, pyramidScaleFactor_, 
+                                                pyramidFilter_, gradientOperator_, frameId1);
+      pyramids_[1] = &pyramidCache_->getPyramid(I2, NUMLEVELS, pyramidScaleFactor_, 
+                                                pyramidFilter_, gradientOperator_, frameId2);
+    }
+    else
+    {
+      // The pyramids of the streaming mode are overwritten, so the 
+      // previous frame of the sequence is lost.
+      resetSequence();
+      imagePyramids[0].build(I1, NUMLEVELS, pyramidScaleFactor_, pyramidFilter_, 
+                             gradientOperator_);
+      imagePyramids[1].build(I2, NUMLEVELS, pyramidScaleFactor_, pyramidFilter_, 
+                             gradientOperator_);
+      pyramids_[0] = &imagePyramids[0];
+      pyramids_[1] = &imagePyramids[1];
+    }
+  }
   
-  if(VF.dimx() != W || VF.dimy() != H || 
-     VF.dimz() != getNumResultChannels())
-    VF = CImg< double >(W, H, 1, 2 + getNumResultQualityChannels());
-  if(isDual())
+  computePyramidal_(VF, VB, false);
+}
+
+template < class T >
+ImagePyramidCache *PyramidalDenseMotionExtractor< T >::getPyramidCache() const
+{
+  return pyramidCache_;
+}
+
+template < class T >
+ImagePyramid::Filter PyramidalDenseMotionExtractor< T >::getPyramidFilter() const
+{
+  return pyramidFilter_;
+}
+
+template < class T >
+double PyramidalDenseMotionExtractor< T >::getPyramidScaleFactor() const
+{
+  return pyramidScaleFactor_;
+}
+
+template < class T >
+typename PyramidalDenseMotionExtractor< T >::WarmStartMode 
+PyramidalDenseMotionExtractor< T >::getWarmStartMode() const
+{
+  return warmStartMode_;
+}
+
+template < class T >
+bool PyramidalDenseMotionExtractor< T >::isDual() const
+{
+  return motionExtractor->isDual();
+}
+
+template < class T >
+bool PyramidalDenseMotionExtractor< T >::pushFrame(const CImg< unsigned char > &I,
+                                                   CImg< T > &V)
+{
+  CImg< T > VB; // not used
+  return pushFrame(I, V, VB);
+}
+
+template < class T >
+bool PyramidalDenseMotionExtractor< T >::pushFrame(const CImg< unsigned char > &I,
+                                                   CImg< T > &VF,
+                                                   CImg< T > &VB)
+{
+  if(numFrames_ > 0 && 
+     (I.dimx() != imagePyramids[1].getImageLevel(0).dimx() || 
+      I.dimy() != imagePyramids[1].getImageLevel(0).dimy()))
+    throw invalid_argument("The dimensions of the frames must match.");
+  
+  // The pyramid of the previous frame becomes the first pyramid, 
+  // and the levels of the older frame are reused for the new one.
+  imagePyramids[0].swap(imagePyramids[1]);
   {
-    if(VB.dimx() != W || VB.dimy() != H || VB.dimz() != getNumResultChannels())
-      VB = CImg< double >(W, H, 1, 2 + getNumResultQualityChannels());
+    PROFILE_SCOPE(this->profiler, "pyramids");
+    imagePyramids[1].build(I, NUMLEVELS, pyramidScaleFactor_, pyramidFilter_, 
+                           gradientOperator_);
   }
+  pyramids_[0] = &imagePyramids[0];
+  pyramids_[1] = &imagePyramids[1];
+  numFrames_++;
   
-  baseWidth = W;
-  baseHeight = H;
+  if(numFrames_ == 1)
+    return false;
+  
+  computePyramidal_(VF, VB, true);
+  
+  return true;
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::releaseBuffers()
+{
+  workspace_.clear();
+  motionExtractor->releaseBuffers();
+  havePrevLevelFlows_ = false;
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::resetSequence()
+{
+  numFrames_ = 0;
+  havePrevLevelFlows_ = false;
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::setPyramidCache(ImagePyramidCache *cache)
+{
+  pyramidCache_ = cache;
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::setProfiler(Profiler *profiler)
+{
+  this->profiler = profiler;
+  motionExtractor->setProfiler(profiler);
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::setPyramidScaleFactor(double scaleFactor, 
+                                                               ImagePyramid::Filter filter)
+{
+  if(!ImagePyramid::isValidScaleFactor(scaleFactor, filter))
+    throw invalid_argument("Invalid scale factor for the pyramid filter.");
   
-  printInfoText();
+  // The levels of the previous frame would have different dimensions.
+  if(scaleFactor != pyramidScaleFactor_ || filter != pyramidFilter_)
+    resetSequence();
   
-  curLevelW = imagePyramids[0].getImageLevel(NUMLEVELS - 1).dimx();
-  curLevelH = imagePyramids[0].getImageLevel(NUMLEVELS - 1).dimy();
+  pyramidScaleFactor_ = scaleFactor;
+  pyramidFilter_ = filter;
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::setWarmStartMode(WarmStartMode mode)
+{
+  warmStartMode_ = mode;
+}
+
+template < class T >
+PyramidalDenseMotionExtractor< T >::PyramidalDenseMotionExtractor(int numLevels, 
+                                                                  ImagePyramid::GradientOperator gradientOperator) : 
+  NUMLEVELS(numLevels),
+  pyramidScaleFactor_(0.5),
+  pyramidFilter_(ImagePyramid::BOX_FILTER),
+  gradientOperator_(gradientOperator),
+  pyramidCache_(NULL),
+  warmStartMode_(WARM_START_COARSEST_LEVEL),
+  numFrames_(0),
+  havePrevLevelFlows_(false)
+{
+  pyramids_[0] = &imagePyramids[0];
+  pyramids_[1] = &imagePyramids[1];
   
-  curLevelVF = CImg< double >(curLevelW, curLevelH, 1, getNumResultChannels());
-  curLevelVF.fill(0);
-  if(isDual())
+#ifdef WITH_PROFILING
+  for(int i = 0; i < NUMLEVELS; i++)
+    levelStageNames_.push_back(getLevelStageName_(i));
+#endif
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::beginLevel(int level) { }
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::endLevel(int level) { }
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::computePyramidal_(CImg< T > &VF,
+                                                           CImg< T > &VB,
+                                                           bool streaming)
+{
+  // The previous flows are only available after the first frame pair.
+  const bool warmStart = streaming && warmStartMode_ != NO_WARM_START && 
+                         havePrevLevelFlows_;
+  CImg< T > noFlow; // the backward flow if it is not used
+  int i;
+  
+  baseWidth = pyramids_[0]->getImageLevel(0).dimx();
+  baseHeight = pyramids_[0]->getImageLevel(0).dimy();
+  
+  if(this->logStream != NULL)
+    this->printInfoText(*this->logStream);
+  
+  // Start the coarsest level from the flow of the previous frame 
+  // pair in the streaming mode, otherwise from zero flow.
+  CImg< T > &coarsestVF = getLevelFlow_(NUMLEVELS - 1, FORWARD_FLOW_);
+  CImg< T > &coarsestVB = isDual() ? getLevelFlow_(NUMLEVELS - 1, BACKWARD_FLOW_) : noFlow;
+  if(warmStart)
   {
-    curLevelVB = CImg< double >(curLevelW, curLevelH, 1, getNumResultChannels());
-    curLevelVB.fill(0);
+    coarsestVF.assign(getLevelFlow_(NUMLEVELS - 1, PREV_FORWARD_FLOW_));
+    if(isDual())
+      coarsestVB.assign(getLevelFlow_(NUMLEVELS - 1, PREV_BACKWARD_FLOW_));
+  }
+  else
+  {
+    coarsestVF.fill(0);
+    if(isDual())
+      coarsestVB.fill(0);
   }
   
-  for(int i = NUMLEVELS - 1; i >= 0; i--)
+  for(i = NUMLEVELS - 1; i >= 0; i--)
   {
-    computeLevel_(i, curLevelVF, curLevelVB);
+    curLevelW = pyramids_[0]->getImageLevel(i).dimx();
+    curLevelH = pyramids_[0]->getImageLevel(i).dimy();
+    
+    CImg< T > &levelVF = getLevelFlow_(i, FORWARD_FLOW_);
+    CImg< T > &levelVB = isDual() ? getLevelFlow_(i, BACKWARD_FLOW_) : noFlow;
+    
+    computeLevel_(i, levelVF, levelVB);
     
     if(i > 0)
     {
-      curLevelW = imagePyramids[0].getImageLevel(i-1).dimx();
-      curLevelH = imagePyramids[0].getImageLevel(i-1).dimy();
+      PROFILE_SCOPE(this->profiler, "upsampling");
+      CImg< T > &nextLevelVF = getLevelFlow_(i-1, FORWARD_FLOW_);
+      CImg< T > &nextLevelVB = isDual() ? getLevelFlow_(i-1, BACKWARD_FLOW_) : noFlow;
       
-      nextLevelVF = CImg< double >(curLevelW, curLevelH, 1, getNumResultChannels());
-      if(isDual())
-        nextLevelVB = CImg< double >(curLevelW, curLevelH, 1, getNumResultChannels());
-      
-      initializeNextLevel_(nextLevelVF, nextLevelVB);
-      
-      curLevelVF = nextLevelVF;
+      // In the all-levels mode the next level starts from its flow 
+      // for the previous frame pair corrected by the change of the 
+      // flow in this level. The upsampling is linear, so only the 
+      // change needs to be upsampled. The previous flow of this 
+      // level is not needed after this, so the change is stored 
+      // in its place.
+      if(warmStart && warmStartMode_ == WARM_START_ALL_LEVELS)
+      {
+        CImg< T > &prevLevelVF = getLevelFlow_(i, PREV_FORWARD_FLOW_);
+        CImg< T > &prevLevelVB = isDual() ? getLevelFlow_(i, PREV_BACKWARD_FLOW_) : noFlow;
+        
+        subtractFromFlow_(levelVF, prevLevelVF);
+        if(isDual())
+          subtractFromFlow_(levelVB, prevLevelVB);
+        
+        initializeNextLevel_(prevLevelVF, prevLevelVB, nextLevelVF, nextLevelVB, 
+                             1.0 / pyramidScaleFactor_);
+        
+        nextLevelVF.get_shared_channels(0, 1) += 
+          getLevelFlow_(i-1, PREV_FORWARD_FLOW_).get_shared_channels(0, 1);
+        if(isDual())
+          nextLevelVB.get_shared_channels(0, 1) += 
+            getLevelFlow_(i-1, PREV_BACKWARD_FLOW_).get_shared_channels(0, 1);
+      }
+      else
+        initializeNextLevel_(levelVF, levelVB, nextLevelVF, nextLevelVB, 
+                             1.0 / pyramidScaleFactor_);
+    }
+  }
+  
+  // In the streaming mode, the flows of all levels are kept for 
+  // the next frame pair, and the result needs to be copied. 
+  // Otherwise the result is handed over by exchanging the buffers.
+  if(streaming)
+  {
+    for(i = 0; i < NUMLEVELS; i++)
+    {
+      getLevelFlow_(i, PREV_FORWARD_FLOW_).swap(getLevelFlow_(i, FORWARD_FLOW_));
       if(isDual())
-        curLevelVB = nextLevelVB;
+        getLevelFlow_(i, PREV_BACKWARD_FLOW_).swap(getLevelFlow_(i, BACKWARD_FLOW_));
     }
+    havePrevLevelFlows_ = true;
+    
+    VF.assign(getLevelFlow_(0, PREV_FORWARD_FLOW_));
+    if(isDual())
+      VB.assign(getLevelFlow_(0, PREV_BACKWARD_FLOW_));
+  }
+  else
+  {
+    handOverFlow_(getLevelFlow_(0, FORWARD_FLOW_), VF);
+    if(isDual())
+      handOverFlow_(getLevelFlow_(0, BACKWARD_FLOW_), VB);
+  }
+}
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::computeLevel_(int level,
+                                                       CImg< T > &VF,
+                                                       CImg< T > &VB)
+{
+  curLevelI[0].assign(pyramids_[0]->getImageLevel(level), true);
+  curLevelI[1].assign(pyramids_[1]->getImageLevel(level), true);
+  if(gradientOperator_ != ImagePyramid::NO_GRADIENT)
+  {
+    curLevelG[0].assign(pyramids_[0]->getGradientLevel(level), true);
+    curLevelG[1].assign(pyramids_[1]->getGradientLevel(level), true);
   }
   
-  VF = curLevelVF;
+  PROFILE_SCOPE(this->profiler, levelStageNames_[level].c_str());
+  
+  beginLevel(level);
+  motionExtractor->selectBufferSet(level);
+	
   if(isDual())
-    VB = curLevelVB;
+    dynamic_cast< DualDenseMotionExtractor< T > * >(motionExtractor)->
+      compute(curLevelI[0], curLevelI[1], VF, VB);
+  else
+    motionExtractor->compute(curLevelI[0], curLevelI[1], VF);
+  
+  endLevel(level);
 }
 
-bool PyramidalDenseMotionExtractor::isDual() const
+template < class T >
+CImg< T > &PyramidalDenseMotionExtractor< T >::getLevelFlow_(int level, FlowSlot slot)
 {
-  return motionExtractor->isDual();
+  const CImg< unsigned char > &I = pyramids_[0]->getImageLevel(level);
+  
+  return workspace_.getBuffer(NUM_FLOW_SLOTS_ * level + slot, I.dimx(), I.dimy(), 
+                              this->getNumResultChannels());
 }
 
-PyramidalDenseMotionExtractor::PyramidalDenseMotionExtractor(int numLevels) : 
-  NUMLEVELS(numLevels)
-{ }
-
-void PyramidalDenseMotionExtractor::computeLevel_(int level,
-                                                  CImg< double > &VF,
-                                                  CImg< double > &VB)
+template < class T >
+void PyramidalDenseMotionExtractor< T >::handOverFlow_(CImg< T > &buffer, 
+                                                       CImg< T > &V)
 {
-  curLevelI[0].assign(imagePyramids[0].getImageLevel(level), true);
-  curLevelI[1].assign(imagePyramids[1].getImageLevel(level), true);
-	
-  if(isDual())
-    dynamic_cast< DualDenseMotionExtractor * >(motionExtractor)->
-      compute(curLevelI[0], curLevelI[1], VF, VB);
+  // A shared image refers to memory owned by the caller, 
+  // so it cannot be exchanged with the buffer.
+  if(V.is_shared)
+    V = buffer;
   else
-    motionExtractor->compute(curLevelI[0], curLevelI[1], VF);
+    V.swap(buffer);
 }
 
-void PyramidalDenseMotionExtractor::initializeNextLevel_(CImg< double > &nextLevelVF,
-                                                         CImg< double > &nextLevelVB)
+// The motion vectors are interpolated bilinearly at (xn/scale, yn/scale) 
+// with the coordinates clamped to the current level (as by 
+// CImg::linear_at4). Each row is computed with two passes over 
+// contiguous memory: the two source rows are first interpolated 
+// vertically and scaled into a row buffer, which is then interpolated 
+// horizontally into the destination row. For the usual scale factor 2 
+// the horizontal pass does not need the position tables. Both motion 
+// fields are processed in the same pass over the rows.
+template < class T >
+void PyramidalDenseMotionExtractor< T >::initializeNextLevel_(const CImg< T > &curLevelVF,
+                                                              const CImg< T > &curLevelVB,
+                                                              CImg< T > &nextLevelVF,
+                                                              CImg< T > &nextLevelVB,
+                                                              double scale)
 {
+  const int W = curLevelVF.dimx();
+  const int H = curLevelVF.dimy();
   const int W_NEW = nextLevelVF.dimx();
   const int H_NEW = nextLevelVF.dimy();
+  const int numFlows = isDual() ? 2 : 1;
+  const bool halfStep = (scale == 2.0);
   
-  double vxf, vyf;
-  double vxb, vyb;
-	
+  const CImg< T > *src[2] = { &curLevelVF, &curLevelVB };
+  CImg< T > *dest[2] = { &nextLevelVF, &nextLevelVB };
+  
+  const T s = T(scale);
   double xc, yc;
+  T dy;
   int xn, yn;
+  int x0, y0, y1;
+  int f, c;
   
-  for(yn = 0; yn < H_NEW; yn++)
+  upsampleRow_.resize(W);
+  T *r = &upsampleRow_[0];
+  
+  if(!halfStep)
   {
-    yc = yn / 2.0;
+    upsampleX0_.resize(W_NEW);
+    upsampleDX_.resize(W_NEW);
     for(xn = 0; xn < W_NEW; xn++)
     {
-      xc = xn / 2.0;
-      if(xn % 2 != 0 || yn % 2 != 0)
+      xc = min(xn / scale, W - 1.0);
+      x0 = (int)xc;
+      upsampleX0_[xn] = x0;
+      upsampleDX_[xn] = T(xc - x0);
+    }
+  }
+  
+  for(yn = 0; yn < H_NEW; yn++)
+  {
+    yc = min(yn / scale, H - 1.0);
+    y0 = (int)yc;
+    dy = T(yc - y0);
+    y1 = dy > 0 ? y0 + 1 : y0;
+    
+    for(f = 0; f < numFlows; f++)
+    {
+      for(c = 0; c < 2; c++)
       {
-        vxf = curLevelVF.linear_at4(xc, yc, 0, 0);
-        vyf = curLevelVF.linear_at4(xc, yc, 0, 1);
-        if(isDual())
+        const T *r0 = src[f]->ptr(0, y0, 0, c);
+        const T *r1 = src[f]->ptr(0, y1, 0, c);
+        T *d = dest[f]->ptr(0, yn, 0, c);
+        int x;
+        
+        // vertical pass
+        for(x = 0; x < W; x++)
+          r[x] = s * (r0[x] + dy * (r1[x] - r0[x]));
+        
+        // horizontal pass
+        if(halfStep)
         {
-          vxb = curLevelVB.linear_at4(xc, yc, 0, 0);
-          vyb = curLevelVB.linear_at4(xc, yc, 0, 1);
+          const int K = min(W_NEW / 2, W - 1);
+          int k;
+          
+          for(k = 0; k < K; k++)
+          {
+            d[2*k] = r[k];
+            d[2*k + 1] = T(0.5) * (r[k] + r[k + 1]);
+          }
+          for(xn = 2 * K; xn < W_NEW; xn++)
+            d[xn] = r[min(xn / 2, W - 1)];
         }
-      }
-      else
-      {
-        vxf = curLevelVF(xc, yc, 0, 0);
-        vyf = curLevelVF(xc, yc, 0, 1);
-        if(isDual())
+        else
         {
-          vxb = curLevelVB(xc, yc, 0, 0);
-          vyb = curLevelVB(xc, yc, 0, 1);
+          const int *X0 = &upsampleX0_[0];
+          const T *DX = &upsampleDX_[0];
+          
+          for(xn = 0; xn < W_NEW; xn++)
+          {
+            x0 = X0[xn];
+            d[xn] = DX[xn] > 0 ? r[x0] + DX[xn] * (r[x0 + 1] - r[x0]) : r[x0];
+          }
         }
       }
-      
-      nextLevelVF(xn, yn, 0, 0) = 2.0 * vxf;
-      nextLevelVF(xn, yn, 0, 1) = 2.0 * vyf;
-      if(isDual())
-      {
-        nextLevelVB(xn, yn, 0, 0) = 2.0 * vxb;
-        nextLevelVB(xn, yn, 0, 1) = 2.0 * vyb;
-      }
     }
   }
 }
+
+template < class T >
+void PyramidalDenseMotionExtractor< T >::subtractFromFlow_(const CImg< T > &V, 
+                                                           CImg< T > &Vprev)
+{
+  // The motion vector channels are contiguous.
+  const int N = 2 * V.dimx() * V.dimy();
+  const T *v = V.ptr();
+  T *vPrev = Vprev.ptr();
+  
+  for(int k = 0; k < N; k++)
+    vPrev[k] = v[k] - vPrev[k];
+}
+
+template class PyramidalDenseMotionExtractor< float >;
+template class PyramidalDenseMotionExtractor< double >;
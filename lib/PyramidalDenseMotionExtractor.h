@@ -2,11 +2,15 @@
 #ifndef PYRAMIDALMOTIONEXTRACTOR_H
 
 #include "ImagePyramid.h"
+#include "ImagePyramidCache.h"
+#include "ImageWorkspace.h"
 #include "DenseMotionExtractor.h"
 
 #include <exception>
 #include "CImg_config.h"
 #include <CImg.h>
+#include <string>
+#include <vector>
 
 using namespace cimg_library;
 using namespace std;
@@ -30,10 +34,40 @@ using namespace std;
  * report, OpenCV documents, Intel Corporation, Microprocessor 
  * Research Labs, 2000
  *
+ * For video sequences, the frames can be given one at a time 
+ * with pushFrame. The pyramid of each frame is then built only 
+ * once, and the motion of each frame pair is initialized from 
+ * the motion of the previous pair (see WarmStartMode). Without 
+ * a pyramid cache, compute builds its pyramids in the buffers 
+ * of the streaming mode and therefore starts a new sequence, 
+ * i.e. the next pushFrame only stores its frame. With a cache, 
+ * calls to compute do not affect the sequence.
+ *
+ * The motion fields of the pyramid levels are stored in buffers 
+ * that are kept between calls. The computed motion field is 
+ * exchanged with the output argument instead of copying it, so 
+ * when the same output images are passed to repeated calls with 
+ * same-sized images, no memory is allocated after the first few 
+ * calls.
  */
-class PyramidalDenseMotionExtractor : public DenseMotionExtractor
+template < class T = double > 
+class PyramidalDenseMotionExtractor : public DenseMotionExtractor< T >
 {
 public:
+  /// Defines how the motion of a frame pair is initialized in the streaming mode.
+  /**
+   * NO_WARM_START: all frame pairs start from zero motion.
+   * 
+   * WARM_START_COARSEST_LEVEL: the coarsest pyramid level starts from 
+   * the motion computed for that level in the previous frame pair.
+   * 
+   * WARM_START_ALL_LEVELS: in addition, each finer level starts from 
+   * its motion in the previous frame pair plus the upsampled change 
+   * of the motion in the coarser level. If the motion does not 
+   * change, each level starts from its converged motion.
+   */
+  enum WarmStartMode { NO_WARM_START, WARM_START_COARSEST_LEVEL, WARM_START_ALL_LEVELS };
+  
   virtual ~PyramidalDenseMotionExtractor();
   
   /// Computes the motion field from image 1 to image 2.
@@ -44,7 +78,7 @@ public:
    */
   void compute(const CImg< unsigned char > &I1,
                const CImg< unsigned char > &I2,
-               CImg< double > &V);
+               CImg< T > &V);
   
   /// Computes both forward and backward motion fields.
   /**
@@ -55,11 +89,115 @@ public:
    */
   void compute(const CImg< unsigned char > &I1,
                const CImg< unsigned char > &I2,
-               CImg< double > &VF,
-               CImg< double > &VB);
+               CImg< T > &VF,
+               CImg< T > &VB);
+  
+  /// Computes the motion fields between two frames identified by frame IDs.
+  /**
+   * If a pyramid cache has been set, the pyramids of the images 
+   * are looked up by the given IDs, otherwise the IDs are ignored 
+   * and a new sequence is started for pushFrame (see resetSequence). 
+   * @param[in] I1 the first source image
+   * @param[in] I2 the second source image
+   * @param[out] VF the computed forward motion field (I1->I2)
+   * @param[out] VB the computed backward motion field (I2->I1), 
+   *             not used if the motion extractor is not dual
+   * @param[in] frameId1 ID of the first image, see ImagePyramidCache::getPyramid
+   * @param[in] frameId2 ID of the second image
+   */
+  void compute(const CImg< unsigned char > &I1,
+               const CImg< unsigned char > &I2,
+               CImg< T > &VF,
+               CImg< T > &VB,
+               long frameId1,
+               long frameId2);
+  
+  /// Returns the pyramid cache, or NULL if no cache has been set.
+  ImagePyramidCache *getPyramidCache() const;
+  
+  /// Returns the filter used for computing the image pyramids.
+  ImagePyramid::Filter getPyramidFilter() const;
+  
+  /// Returns the ratio between the dimensions of consecutive pyramid levels.
+  double getPyramidScaleFactor() const;
+  
+  WarmStartMode getWarmStartMode() const;
   
   /// Returns true if the single-resolution motion extractor uses two-directional flows.
   bool isDual() const;
+  
+  /// Adds the next frame of a sequence and computes the motion from the previous frame to it.
+  /**
+   * The frames must have the same dimensions. A call to compute 
+   * without a pyramid cache between two calls to pushFrame starts 
+   * a new sequence, so the frame after it is treated as the first. 
+   * @param[in] I the next frame
+   * @param[out] V the computed motion field (previous frame->I)
+   * @return false for the first frame of the sequence, for which 
+   *         no motion is computed, otherwise true
+   */
+  bool pushFrame(const CImg< unsigned char > &I,
+                 CImg< T > &V);
+  
+  /// Adds the next frame of a sequence and computes both motion fields.
+  /**
+   * @param[in] I the next frame
+   * @param[out] VF the computed forward motion field (previous frame->I)
+   * @param[out] VB the computed backward motion field (I->previous frame)
+   * @return false for the first frame of the sequence, otherwise true
+   */
+  bool pushFrame(const CImg< unsigned char > &I,
+                 CImg< T > &VF,
+                 CImg< T > &VB);
+  
+  /// Frees the buffers kept between calls.
+  /**
+   * This frees the motion fields of the levels and the buffers of 
+   * the single-resolution motion extractor, and discards the motion 
+   * of the previous frame pair in the streaming mode.
+   */
+  void releaseBuffers();
+  
+  /// Starts a new sequence, i.e. discards the previous frame and motion.
+  void resetSequence();
+  
+  /// Sets the cache from which compute takes the image pyramids.
+  /**
+   * The cache is not owned by this object, and it can be shared 
+   * by several motion extractors (in the same thread). If cache 
+   * is NULL, the pyramids are built on each call to compute. The 
+   * streaming mode (pushFrame) does not use the cache, since it 
+   * builds the pyramid of each frame only once anyway.
+   */
+  void setPyramidCache(ImagePyramidCache *cache);
+  
+  /// Sets the profiler of this and the single-resolution motion extractor.
+  /**
+   * The pyramid construction, each pyramid level (numbered from 
+   * the base level) and the upsampling of the motion fields are 
+   * reported as separate stages.
+   */
+  void setProfiler(Profiler *profiler);
+  
+  /// Sets the scale factor and filter of the image pyramids.
+  /**
+   * The default is the scale factor 0.5 with the box filter. 
+   * Larger scale factors give more levels for the same range 
+   * of motion, which can improve the accuracy at the cost of 
+   * computation time. Changing the pyramid starts a new sequence 
+   * in the streaming mode.
+   * @param scaleFactor ratio between the dimensions of consecutive levels
+   * @param filter the filter used for computing the levels, 
+   *        the box filter only supports the scale factor 0.5
+   */
+  void setPyramidScaleFactor(double scaleFactor, 
+                             ImagePyramid::Filter filter = ImagePyramid::GAUSSIAN_FILTER);
+  
+  /// Sets the initialization of the motion in the streaming mode.
+  /**
+   * The default is WARM_START_COARSEST_LEVEL.
+   */
+  void setWarmStartMode(WarmStartMode mode);
 protected:
   const int NUMLEVELS;
   
@@ -69,35 +207,94 @@ protected:
   // width and height of the current level
   int curLevelH, curLevelW;
   
-  // pyramids for the first and second input image
+  // pyramids for the first and second input image (unless taken from the cache)
   ImagePyramid imagePyramids[2];
   
-  // gradients of the current level
-  CImg< double > curLevelG[2];
+  // gradients of the current level for both input images 
+  // (empty if the gradient operator is NO_GRADIENT)
+  CImg< short > curLevelG[2];
   
   // input images in the current pyramid level
   CImg< unsigned char > curLevelI[2];
   
-  // current forward flow (and backward flow if used)
-  CImg< double > curLevelVF;
-  CImg< double > curLevelVB;
-  
   // the single-resolution motion extractor that is used in each pyramid level
-  DenseMotionExtractor *motionExtractor;
+  DenseMotionExtractor< T > *motionExtractor;
+  
+  // Constructs a pyramidal motion extractor with a given number of levels. 
+  // If a gradient operator is given, the gradients of each level are 
+  // computed with the image pyramids and stored in curLevelG for the 
+  // single-resolution motion extractor.
+  PyramidalDenseMotionExtractor(int numLevels, 
+                                ImagePyramid::GradientOperator gradientOperator = ImagePyramid::NO_GRADIENT);
   
-  // Constructs a pyramidal motion extractor with a given number of levels.
-  PyramidalDenseMotionExtractor(int numLevels);
+  // Called before and after the motion of each level is computed 
+  // (level 0 is the base level). Derived classes can override these 
+  // for adjusting the single-resolution motion extractor for each 
+  // level. The default implementations do nothing.
+  virtual void beginLevel(int level);
+  virtual void endLevel(int level);
 private:
+  // workspace slots of the motion fields of each level
+  enum FlowSlot { FORWARD_FLOW_, BACKWARD_FLOW_, PREV_FORWARD_FLOW_, PREV_BACKWARD_FLOW_, 
+                  NUM_FLOW_SLOTS_ };
+  
+  double pyramidScaleFactor_;
+  ImagePyramid::Filter pyramidFilter_;
+  const ImagePyramid::GradientOperator gradientOperator_;
+  
+  // the optional pyramid cache
+  ImagePyramidCache *pyramidCache_;
+  
+  // the pyramids of the current frame pair (imagePyramids or cached pyramids)
+  const ImagePyramid *pyramids_[2];
+  
+  WarmStartMode warmStartMode_;
+  
+  // number of frames given to pushFrame since the last reset
+  int numFrames_;
+  
+  // true if the workspace contains the motion of each level 
+  // for the previous frame pair (streaming mode)
+  bool havePrevLevelFlows_;
+  
+  // the motion fields of the levels
+  ImageWorkspace< T > workspace_;
+  
+  // the profiler stage names of the levels (only built with WITH_PROFILING)
+  vector< string > levelStageNames_;
+  
+  // row buffer and horizontal interpolation positions of initializeNextLevel_
+  vector< T > upsampleRow_;
+  vector< int > upsampleX0_;
+  vector< T > upsampleDX_;
+  
+  // computes the motion from the current image pyramids
+  void computePyramidal_(CImg< T > &VF,
+                         CImg< T > &VB,
+                         bool streaming);
+  
+  // returns the workspace buffer for the given motion field of a level
+  CImg< T > &getLevelFlow_(int level, FlowSlot slot);
+  
   // computes motion vectors for the current level
   void computeLevel_(int level,
-                     CImg< double > &VF,
-                     CImg< double > &VB);
+                     CImg< T > &VF,
+                     CImg< T > &VB);
+  
+  // moves the contents of a buffer to an output image
+  void handOverFlow_(CImg< T > &buffer, CImg< T > &V);
   
   // initializes the next motion vector level, i.e. copies the current vectors 
-  // to the next level with each vector multiplied by 2 and interpolated 
-  // if necessary
-  void initializeNextLevel_(CImg< double > &nextLevelVF,
-                            CImg< double > &nextLevelVB);
+  // to the next level with each vector multiplied by the scale factor between 
+  // the levels and interpolated if necessary
+  void initializeNextLevel_(const CImg< T > &curLevelVF,
+                            const CImg< T > &curLevelVB,
+                            CImg< T > &nextLevelVF,
+                            CImg< T > &nextLevelVB,
+                            double scale);
+  
+  // replaces the motion vectors of Vprev with V - Vprev
+  void subtractFromFlow_(const CImg< T > &V, CImg< T > &Vprev);
 };
 
 #define PYRAMIDALMOTIONEXTRACTOR_H
@@ -4,40 +4,70 @@
 #include "LucasKanade.h"
 #include "PyramidalLucasKanade.h"
 
-PyramidalLucasKanade::PyramidalLucasKanade():PyramidalDenseMotionExtractor(4)
+template < class T >
+PyramidalLucasKanade< T >::PyramidalLucasKanade():
+  PyramidalDenseMotionExtractor< T >(4, ImagePyramid::FIVE_POINT_GRADIENT)
 {
-  motionExtractor = new LucasKanade();
+  this->motionExtractor = new LucasKanade< T >();
 }
 
-PyramidalLucasKanade::PyramidalLucasKanade(int windowRadius,
-                                           int numIter,
-                                           float tau,
-                                           float sigmap,
-                                           int numLevels,
-                                           bool useWeightingKernel) : 
-  PyramidalDenseMotionExtractor(numLevels)
+template < class T >
+PyramidalLucasKanade< T >::PyramidalLucasKanade(int windowRadius,
+                                                int numIter,
+                                                float tau,
+                                                float sigmap,
+                                                int numLevels,
+                                                bool useWeightingKernel,
+                                                typename LucasKanade< T >::WarpMode warpMode,
+                                                int numThreads) : 
+  PyramidalDenseMotionExtractor< T >(numLevels, ImagePyramid::FIVE_POINT_GRADIENT)
 {
-  motionExtractor = new LucasKanade(windowRadius, numIter, tau, sigmap, useWeightingKernel);
+  this->motionExtractor = new LucasKanade< T >(windowRadius, numIter, tau, sigmap, 
+                                                useWeightingKernel, warpMode, numThreads);
 }
 
-PyramidalLucasKanade::~PyramidalLucasKanade()
+template < class T >
+PyramidalLucasKanade< T >::~PyramidalLucasKanade()
 {
-  delete motionExtractor;
+  delete this->motionExtractor;
 }
 
-void PyramidalLucasKanade::printInfoText() const
+// The gradients of the first image were computed with the image pyramids.
+template < class T >
+void PyramidalLucasKanade< T >::beginLevel(int level)
 {
-  LucasKanade *me = dynamic_cast< LucasKanade * >(motionExtractor);
+  dynamic_cast< LucasKanade< T > * >(this->motionExtractor)->
+    setInputGradients(&this->curLevelG[0]);
+}
+
+template < class T >
+void PyramidalLucasKanade< T >::endLevel(int level)
+{
+  dynamic_cast< LucasKanade< T > * >(this->motionExtractor)->
+    setInputGradients(NULL);
+}
+
+template < class T >
+void PyramidalLucasKanade< T >::printInfoText(ostream &out) const
+{
+  LucasKanade< T > *me = dynamic_cast< LucasKanade< T > * >(this->motionExtractor);
 	
-  cout<<"Pyramidal Lucas & Kanade optical flow algorithm"<<endl;
-  cout<<"==============================================="<<endl;
+  out<<"Pyramidal Lucas & Kanade optical flow algorithm"<<endl;
+  out<<"==============================================="<<endl;
 		
-  cout<<"Input image width: "<<baseWidth<<endl;
-  cout<<"Input image height: "<<baseHeight<<endl;
+  out<<"Input image width: "<<this->baseWidth<<endl;
+  out<<"Input image height: "<<this->baseHeight<<endl;
 	
-  cout<<"Window size: "<<me->getWindowSize()<<endl;
-  cout<<"Number of Gauss-Newton iterations: "<<me->getNumIterations()<<endl;
-  cout<<"Tau (eigenvalue threshold): "<<me->getTau()<<endl;
-  cout<<"Sigmap (regularization parameter): "<<me->getSigmap()<<endl;
-  cout<<"Number of pyramid levels: "<<NUMLEVELS<<endl;
+  out<<"Window size: "<<me->getWindowSize()<<endl;
+  out<<"Number of Gauss-Newton iterations: "<<me->getNumIterations()<<endl;
+  out<<"Tau (eigenvalue threshold): "<<me->getTau()<<endl;
+  out<<"Sigmap (regularization parameter): "<<me->getSigmap()<<endl;
+  out<<"Warp mode: "<<(me->getWarpMode() == LucasKanade< T >::LOCAL_WARP ? "local" : "dense")<<endl;
+  out<<"Number of pyramid levels: "<<this->NUMLEVELS<<endl;
+  out<<"Pyramid scale factor: "<<this->getPyramidScaleFactor()
+      <<(this->getPyramidFilter() == ImagePyramid::BOX_FILTER ? " (box filter)" : " (Gaussian filter)")<<endl;
+  out<<"Number of threads: "<<me->getNumThreads()<<endl;
 }
+
+template class PyramidalLucasKanade< float >;
+template class PyramidalLucasKanade< double >;
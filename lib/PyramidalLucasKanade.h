@@ -1,6 +1,7 @@
 
 #ifndef PYRAMIDALLUCASKANADE_H
 
+#include "LucasKanade.h"
 #include "PyramidalDenseMotionExtractor.h"
 
 #include <list>
@@ -14,7 +15,8 @@ using namespace std;
  * In addition, this implementation uses image 
  * pyramids and an arbitrary number of Gauss-Newton iterations. 
  */
-class PyramidalLucasKanade : public PyramidalDenseMotionExtractor
+template < class T = double > 
+class PyramidalLucasKanade : public PyramidalDenseMotionExtractor< T >
 {
 public:
   PyramidalLucasKanade();
@@ -26,13 +28,18 @@ public:
    * @param tau_ Eigenvalue threshold parameter.
    * @param sigmap_ Regularization parameter.
    * @param numLevels_ Number of pyramid levels.
+   * @param useWeightingKernel_ Use a Gaussian weighting kernel for the window.
+   * @param warpMode_ How the second image is warped (see LucasKanade::WarpMode).
+   * @param numThreads_ Number of threads, zero = all available processors.
    */
   PyramidalLucasKanade(int windowRadius,
                        int numIter,
                        float tau,
                        float sigmap,
                        int numLevels,
-                       bool useWeightingKernel);
+                       bool useWeightingKernel,
+                       typename LucasKanade< T >::WarpMode warpMode = LucasKanade< T >::LOCAL_WARP,
+                       int numThreads = 1);
   
   ~PyramidalLucasKanade();
   
@@ -40,7 +47,10 @@ public:
   
   int getNumResultQualityChannels() const { return 2; }
   
-  void printInfoText() const;
+  void printInfoText(ostream &out) const;
+protected:
+  void beginLevel(int level);
+  void endLevel(int level);
 };
 
 #define PYRAMIDALLUCASKANADE_H
@@ -3,41 +3,138 @@
 
 #include "PyramidalProesmans.h"
 
-PyramidalProesmans::PyramidalProesmans() : PyramidalDenseMotionExtractor(4)
+template < class T >
+PyramidalProesmans< T >::PyramidalProesmans() : 
+  PyramidalDenseMotionExtractor< T >(4, ImagePyramid::SOBEL_GRADIENT)
 {
-  motionExtractor = new Proesmans();
+  this->motionExtractor = new Proesmans< T >();
 }
 
-PyramidalProesmans::PyramidalProesmans(int numIterations,
-                                       float lambda,
-                                       int numLevels,
-                                       Proesmans::BoundaryConditions boundaryConditions) : 
-  PyramidalDenseMotionExtractor(numLevels)
+template < class T >
+PyramidalProesmans< T >::PyramidalProesmans(int numIterations,
+                                            float lambda,
+                                            int numLevels,
+                                            typename Proesmans< T >::BoundaryConditions boundaryConditions,
+                                            int numThreads,
+                                            typename Proesmans< T >::SweepOrder sweepOrder) : 
+  PyramidalDenseMotionExtractor< T >(numLevels, ImagePyramid::SOBEL_GRADIENT)
 {
-  motionExtractor = new Proesmans(numIterations, lambda, boundaryConditions);
+  this->motionExtractor = new Proesmans< T >(numIterations, lambda, boundaryConditions, numThreads, 
+                                             sweepOrder);
 }
 
-PyramidalProesmans::~PyramidalProesmans()
+template < class T >
+PyramidalProesmans< T >::~PyramidalProesmans()
 {
-  delete motionExtractor;
+  delete this->motionExtractor;
 }
 
-void PyramidalProesmans::printInfoText() const
+template < class T >
+const vector< int > &PyramidalProesmans< T >::getNumPerformedIterations() const
 {
-  Proesmans *me = dynamic_cast< Proesmans * >(motionExtractor);
+  return numPerformedIterations_;
+}
+
+template < class T >
+void PyramidalProesmans< T >::printInfoText(ostream &out) const
+{
+  Proesmans< T > *me = dynamic_cast< Proesmans< T > * >(this->motionExtractor);
 	
-  cout<<"Pyramidal Proesmans optical flow algorithm"<<endl;
-  cout<<"=========================================="<<endl;
+  out<<"Pyramidal Proesmans optical flow algorithm"<<endl;
+  out<<"=========================================="<<endl;
   
-  cout<<"Input image width: "<<baseWidth<<endl;
-  cout<<"Input image height: "<<baseHeight<<endl;
+  out<<"Input image width: "<<this->baseWidth<<endl;
+  out<<"Input image height: "<<this->baseHeight<<endl;
 	
-  cout<<"Number of iteration steps: "<<me->getNumIterations()<<endl;
-  cout<<"Lambda: "<<me->getLambda()<<endl;
-  cout<<"Number of pyramid levels: "<<NUMLEVELS<<endl;
-  cout<<"Boundary conditions: ";
-  if(me->getBoundaryConditions() == Proesmans::NEUMANN)
-    cout<<"Neumann"<<endl;
+  out<<"Number of iteration steps: "<<me->getNumIterations()<<endl;
+  if(!levelIterations_.empty())
+  {
+    out<<"Number of iteration steps per level:";
+    for(int i = 0; i < this->NUMLEVELS; i++)
+      out<<" "<<getLevelIterations_(i);
+    out<<endl;
+  }
+  if(me->getConvergenceTolerance() > 0.0)
+    out<<"Convergence tolerance: "<<me->getConvergenceTolerance()<<endl;
+  if(me->getConsistencyUpdateInterval() > 1 || me->isNormalizationLagged())
+  {
+    out<<"Consistency update interval: "<<me->getConsistencyUpdateInterval();
+    out<<(me->isNormalizationLagged() ? " (lagged normalization)" : "")<<endl;
+  }
+  out<<"Lambda: "<<me->getLambda()<<endl;
+  out<<"Number of pyramid levels: "<<this->NUMLEVELS<<endl;
+  out<<"Pyramid scale factor: "<<this->getPyramidScaleFactor()
+      <<(this->getPyramidFilter() == ImagePyramid::BOX_FILTER ? " (box filter)" : " (Gaussian filter)")<<endl;
+  out<<"Number of threads: "<<me->getNumThreads()<<endl;
+  out<<"Sweep order: "<<(me->getSweepOrder() == Proesmans< T >::RASTER_SWEEP ? "raster" : "multicolour")<<endl;
+  if(me->getTileWidth() > 0)
+    out<<"Tile size: "<<me->getTileWidth()<<"x"<<me->getTileHeight()<<endl;
+  out<<"Boundary conditions: ";
+  if(me->getBoundaryConditions() == Proesmans< T >::NEUMANN)
+    out<<"Neumann"<<endl;
   else
-    cout<<"Dirichlet"<<endl;
+    out<<"Dirichlet"<<endl;
+}
+
+template < class T >
+void PyramidalProesmans< T >::setConsistencyUpdate(int interval, bool lagNormalization)
+{
+  dynamic_cast< Proesmans< T > * >(this->motionExtractor)->
+    setConsistencyUpdate(interval, lagNormalization);
+}
+
+template < class T >
+void PyramidalProesmans< T >::setConvergenceTolerance(double tolerance, 
+                                                      typename Proesmans< T >::ConvergenceNorm norm, 
+                                                      int checkInterval)
+{
+  dynamic_cast< Proesmans< T > * >(this->motionExtractor)->
+    setConvergenceTolerance(tolerance, norm, checkInterval);
+}
+
+template < class T >
+void PyramidalProesmans< T >::setLevelIterations(const vector< int > &numIterations)
+{
+  levelIterations_ = numIterations;
+}
+
+template < class T >
+void PyramidalProesmans< T >::setTiling(int tileWidth, int tileHeight)
+{
+  dynamic_cast< Proesmans< T > * >(this->motionExtractor)->setTiling(tileWidth, tileHeight);
 }
+
+template < class T >
+void PyramidalProesmans< T >::beginLevel(int level)
+{
+  if(level == this->NUMLEVELS - 1)
+    numPerformedIterations_.assign(this->NUMLEVELS, 0);
+  
+  Proesmans< T > *me = dynamic_cast< Proesmans< T > * >(this->motionExtractor);
+  
+  me->setIterationBudget(getLevelIterations_(level));
+  // the gradients were computed with the image pyramids
+  me->setInputGradients(&this->curLevelG[0], &this->curLevelG[1]);
+}
+
+template < class T >
+void PyramidalProesmans< T >::endLevel(int level)
+{
+  Proesmans< T > *me = dynamic_cast< Proesmans< T > * >(this->motionExtractor);
+  
+  numPerformedIterations_[level] = me->getNumPerformedIterations();
+  me->setIterationBudget(0);
+  me->setInputGradients(NULL, NULL);
+}
+
+template < class T >
+int PyramidalProesmans< T >::getLevelIterations_(int level) const
+{
+  if(level < (int)levelIterations_.size() && levelIterations_[level] > 0)
+    return levelIterations_[level];
+  else
+    return dynamic_cast< Proesmans< T > * >(this->motionExtractor)->getNumIterations();
+}
+
+template class PyramidalProesmans< float >;
+template class PyramidalProesmans< double >;
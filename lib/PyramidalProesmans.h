@@ -4,24 +4,79 @@
 #include "Proesmans.h"
 #include "PyramidalDenseMotionExtractor.h"
 
+#include <vector>
+
 /// Implements pyramidal Proesmans motion extractor.
-class PyramidalProesmans : public PyramidalDenseMotionExtractor
+template < class T = double > 
+class PyramidalProesmans : public PyramidalDenseMotionExtractor< T >
 {
 public:
   PyramidalProesmans();
   
+  /// Parametrized constructor.
+  /**
+   * See Proesmans::Proesmans for the number of threads and the 
+   * sweep order.
+   */
   PyramidalProesmans(int numIterations_,
                       float lambda_,
                       int numLevels,
-                      Proesmans::BoundaryConditions boundaryConditions_);
+                      typename Proesmans< T >::BoundaryConditions boundaryConditions_,
+                      int numThreads_ = 1,
+                      typename Proesmans< T >::SweepOrder sweepOrder_ = Proesmans< T >::RASTER_SWEEP);
   
   ~PyramidalProesmans();
   
   string getName() const { return "Pyramidal Proesmans"; }
   
+  /// Returns the number of iterations carried out in each level by the last call to compute.
+  /**
+   * The vector is indexed by the pyramid level (0 is the base level).
+   */
+  const vector< int > &getNumPerformedIterations() const;
+  
   int getNumResultQualityChannels() const { return 1; }
   
-  void printInfoText() const;
+  void printInfoText(ostream &out) const;
+  
+  /// Sets how often and how the consistency maps are updated in each level.
+  /**
+   * See Proesmans::setConsistencyUpdate.
+   */
+  void setConsistencyUpdate(int interval, bool lagNormalization = false);
+  
+  /// Enables convergence-based termination of the iteration in each level.
+  /**
+   * See Proesmans::setConvergenceTolerance. The update norm 
+   * is measured in the pixels of each level.
+   */
+  void setConvergenceTolerance(double tolerance, 
+                               typename Proesmans< T >::ConvergenceNorm norm = Proesmans< T >::RMS_NORM, 
+                               int checkInterval = 10);
+  
+  /// Sets the maximum number of iterations separately for each pyramid level.
+  /**
+   * The vector is indexed by the pyramid level (0 is the base level). 
+   * Levels that are not covered by the vector or that have a 
+   * non-positive value use the number of iterations given to 
+   * the constructor.
+   */
+  void setLevelIterations(const vector< int > &numIterations);
+  
+  /// Enables the tiled iteration in each level.
+  /**
+   * See Proesmans::setTiling.
+   */
+  void setTiling(int tileWidth, int tileHeight);
+protected:
+  void beginLevel(int level);
+  void endLevel(int level);
+private:
+  vector< int > levelIterations_;
+  vector< int > numPerformedIterations_;
+  
+  // returns the maximum number of iterations for the given level
+  int getLevelIterations_(int level) const;
 };
 
 #define PYRAMIDALPROESMANS_H
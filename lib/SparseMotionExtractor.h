@@ -5,6 +5,7 @@
 #include "SparseVectorField.h"
 
 #include <list>
+#include <ostream>
 #include <vector>
 
 namespace cimg_library { template < class T > class CImg; }
@@ -36,8 +37,8 @@ public:
                        const CImg< unsigned char > &I2,
                        SparseVectorField &V) = 0;
   
-  /// Prints information about the motion extractor and its parameters.
-  virtual void printInfoText() const = 0;
+  /// Writes information about the motion extractor and its parameters to a stream.
+  virtual void printInfoText(ostream &out) const = 0;
 };
 
 #define SPARSEMOTIONEXTRACTOR_H
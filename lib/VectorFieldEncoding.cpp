@@ -0,0 +1,233 @@
+
+#include "VectorFieldEncoding.h"
+
+#include <stdexcept>
+#include <string.h>
+
+namespace VectorFieldEncoding
+{
+  static const char *ENCODING_NAMES_[] = { "float32", "float16", "fixed16", "unorm16", "unorm8" };
+  static const int ENCODING_SIZES_[] = { 4, 2, 2, 2, 1 };
+
+  static inline uint32_t floatToBits_(float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    return bits;
+  }
+
+  static inline float bitsToFloat_(uint32_t bits)
+  {
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+  }
+
+  // Rounds to the nearest half-precision value (ties to even),
+  // in the same way as the F16C instructions.
+  static inline uint16_t floatToHalf_(float value)
+  {
+    const uint32_t x = floatToBits_(value);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t absx = x & 0x7fffffff;
+    uint32_t h, rem, halfway;
+
+    if(absx >= 0x7f800000)
+    {
+      // infinity, or NaN with the quiet bit set
+      if(absx > 0x7f800000)
+        return sign | 0x7e00 | ((absx >> 13) & 0x3ff);
+      return sign | 0x7c00;
+    }
+
+    // values from 65520 upwards round to infinity
+    if(absx >= 0x477ff000)
+      return sign | 0x7c00;
+
+    if(absx < 0x38800000)
+    {
+      // subnormal half-precision values, 2^-25 rounds to zero
+      if(absx <= 0x33000000)
+        return sign;
+
+      const int shift = 126 - (int)(absx >> 23);
+      const uint32_t m = (absx & 0x7fffff) | 0x800000;
+      h = m >> shift;
+      rem = m & ((1u << shift) - 1);
+      halfway = 1u << (shift - 1);
+    }
+    else
+    {
+      // rebias the exponent from 127 to 15
+      h = (absx - 0x38000000) >> 13;
+      rem = absx & 0x1fff;
+      halfway = 0x1000;
+    }
+
+    if(rem > halfway || (rem == halfway && (h & 1)))
+      h++;
+
+    return sign | h;
+  }
+
+  static inline float halfToFloat_(uint16_t h)
+  {
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    int e = (h >> 10) & 0x1f;
+    uint32_t m = h & 0x3ff;
+
+    if(e == 0x1f)
+    {
+      // infinity, or NaN with the quiet bit set
+      return bitsToFloat_(sign | 0x7f800000 | (m != 0 ? 0x400000 : 0) | (m << 13));
+    }
+    if(e == 0)
+    {
+      if(m == 0)
+        return bitsToFloat_(sign);
+
+      // normalize a subnormal value
+      e = 1;
+      while(!(m & 0x400))
+      {
+        m <<= 1;
+        e--;
+      }
+      m &= 0x3ff;
+    }
+
+    return bitsToFloat_(sign | (uint32_t)(e + 112) << 23 | m << 13);
+  }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  // The F16C conversions are compiled with AVX, which also requires 
+  // the operating system to save the YMM registers.
+  static bool hasF16C_()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  }
+#else
+  static bool hasF16C_() { return false; }
+#endif
+
+  // The rounding is written with a comparison instead of a call to
+  // lrint so that the loops can be vectorized.
+  static void encodeFixed16_(const float *src, int16_t *dst, size_t n, float scale)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      float r = src[i] * scale;
+      r = r < -32767.0f ? -32767.0f : (r > 32767.0f ? 32767.0f : r);
+      dst[i] = (int16_t)(int)(r + (r >= 0.0f ? 0.5f : -0.5f));
+    }
+  }
+
+  template < class I >
+  static void encodeUNorm_(const float *src, I *dst, size_t n, float maxValue)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      float r = src[i];
+      r = r < 0.0f ? 0.0f : (r > 1.0f ? 1.0f : r);
+      dst[i] = (I)(int)(r * maxValue + 0.5f);
+    }
+  }
+
+  template < class I >
+  static void decodeInteger_(const I *src, float *dst, size_t n, float step)
+  {
+    for(size_t i = 0; i < n; i++)
+      dst[i] = src[i] * step;
+  }
+
+  void decode(const unsigned char *src, float *dst, size_t n,
+              Encoding encoding, int scale)
+  {
+    switch(encoding)
+    {
+      case FLOAT32:
+        memcpy(dst, src, n * sizeof(float));
+        break;
+      case FLOAT16:
+        if(hasF16C_())
+          halfToFloatF16C((const uint16_t *)src, dst, n);
+        else
+          halfToFloatScalar((const uint16_t *)src, dst, n);
+        break;
+      case FIXED16:
+        decodeInteger_((const int16_t *)src, dst, n, 1.0f / scale);
+        break;
+      case UNORM16:
+        decodeInteger_((const uint16_t *)src, dst, n, 1.0f / 65535.0f);
+        break;
+      case UNORM8:
+        decodeInteger_(src, dst, n, 1.0f / 255.0f);
+        break;
+    }
+  }
+
+  void encode(const float *src, unsigned char *dst, size_t n,
+              Encoding encoding, int scale)
+  {
+    switch(encoding)
+    {
+      case FLOAT32:
+        memcpy(dst, src, n * sizeof(float));
+        break;
+      case FLOAT16:
+        if(hasF16C_())
+          floatToHalfF16C(src, (uint16_t *)dst, n);
+        else
+          floatToHalfScalar(src, (uint16_t *)dst, n);
+        break;
+      case FIXED16:
+        encodeFixed16_(src, (int16_t *)dst, n, scale);
+        break;
+      case UNORM16:
+        encodeUNorm_(src, (uint16_t *)dst, n, 65535.0f);
+        break;
+      case UNORM8:
+        encodeUNorm_(src, dst, n, 255.0f);
+        break;
+    }
+  }
+
+  Encoding getEncoding(const string &name)
+  {
+    for(int i = FLOAT32; i <= UNORM8; i++)
+    {
+      if(name == ENCODING_NAMES_[i])
+        return (Encoding)i;
+    }
+
+    throw invalid_argument("Unknown encoding " + name);
+  }
+
+  const char *getEncodingName(Encoding encoding)
+  {
+    return ENCODING_NAMES_[encoding];
+  }
+
+  int getEncodingSize(Encoding encoding)
+  {
+    return ENCODING_SIZES_[encoding];
+  }
+
+  const char *getHalfKernelName()
+  {
+    return hasF16C_() ? "F16C" : "scalar";
+  }
+
+  void halfToFloatScalar(const uint16_t *src, float *dst, size_t n)
+  {
+    for(size_t i = 0; i < n; i++)
+      dst[i] = halfToFloat_(src[i]);
+  }
+
+  void floatToHalfScalar(const float *src, uint16_t *dst, size_t n)
+  {
+    for(size_t i = 0; i < n; i++)
+      dst[i] = floatToHalf_(src[i]);
+  }
+}
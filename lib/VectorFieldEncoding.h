@@ -0,0 +1,86 @@
+
+#ifndef VECTORFIELDENCODING_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+/// Implements the encodings of the components of stored vector fields.
+/**
+ * The motion vectors and quality channels of a dense vector field
+ * can be stored with a reduced precision (see
+ * DenseVectorFieldWriter::setFlowEncoding and
+ * DenseVectorFieldWriter::setQualityEncoding):
+ *   - FLOAT32: single-precision floats (4 bytes)
+ *   - FLOAT16: IEEE 754 half-precision floats (2 bytes),
+ *     rounded to the nearest representable value. Half-precision
+ *     floats have an 11-bit significand, so e.g. motion vectors
+ *     shorter than 32 pixels are stored with 1/64 pixel precision.
+ *   - FIXED16: signed 16-bit fixed-point numbers with a given
+ *     number of units per pixel (e.g. 64 for 1/64 pixel precision),
+ *     values outside the representable range are clamped
+ *   - UNORM16: unsigned 16-bit normalized integers, for values
+ *     in [0,1] (2 bytes), values outside [0,1] are clamped
+ *   - UNORM8: unsigned 8-bit normalized integers, for values in
+ *     [0,1] (1 byte), values outside [0,1] are clamped
+ *
+ * The conversions between single and half precision use the F16C
+ * instructions if the processor supports them. Otherwise a scalar
+ * implementation giving the same results is used. The other
+ * conversions are written so that the compiler can vectorize them.
+ */
+namespace VectorFieldEncoding
+{
+  /// The encoding of a vector field component.
+  enum Encoding { FLOAT32, FLOAT16, FIXED16, UNORM16, UNORM8 };
+
+  /// Decodes n values to single precision.
+  /**
+   * @param src the encoded values, aligned to getEncodingSize(encoding) bytes
+   * @param dst the decoded values
+   * @param n the number of values
+   * @param encoding the encoding of the values
+   * @param scale the number of units per pixel (FIXED16 only)
+   */
+  void decode(const unsigned char *src, float *dst, size_t n,
+              Encoding encoding, int scale);
+
+  /// Encodes n single-precision values.
+  /**
+   * @param src the values to encode
+   * @param dst the encoded values, aligned to getEncodingSize(encoding) bytes
+   * @param n the number of values
+   * @param encoding the encoding of the values
+   * @param scale the number of units per pixel (FIXED16 only)
+   */
+  void encode(const float *src, unsigned char *dst, size_t n,
+              Encoding encoding, int scale);
+
+  /// Returns the encoding with the given name, or throws invalid_argument.
+  Encoding getEncoding(const string &name);
+
+  /// Returns the name of an encoding (float32, float16, fixed16, unorm16 or unorm8).
+  const char *getEncodingName(Encoding encoding);
+
+  /// Returns the size of an encoded value in bytes.
+  int getEncodingSize(Encoding encoding);
+
+  /// Returns the name of the instruction set used for the half-precision conversions.
+  const char *getHalfKernelName();
+
+  /// Converts n half-precision values to single precision with scalar code.
+  void halfToFloatScalar(const uint16_t *src, float *dst, size_t n);
+
+  /// Converts n single-precision values to half precision with scalar code.
+  void floatToHalfScalar(const float *src, uint16_t *dst, size_t n);
+
+  /// Half-precision conversions using the F16C instructions (eight values at a time).
+  void halfToFloatF16C(const uint16_t *src, float *dst, size_t n);
+  void floatToHalfF16C(const float *src, uint16_t *dst, size_t n);
+}
+
+#define VECTORFIELDENCODING_H
+
+#endif
@@ -0,0 +1,44 @@
+
+// This file is compiled with F16C code generation enabled. Its functions
+// must only be called after checking that the processor supports F16C
+// (see VectorFieldEncoding::decode and VectorFieldEncoding::encode).
+
+#include "VectorFieldEncoding.h"
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace VectorFieldEncoding
+{
+#ifdef __F16C__
+  void halfToFloatF16C(const uint16_t *src, float *dst, size_t n)
+  {
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+    halfToFloatScalar(src + i, dst + i, n - i);
+  }
+
+  void floatToHalfF16C(const float *src, uint16_t *dst, size_t n)
+  {
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8)
+      _mm_storeu_si128((__m128i *)(dst + i),
+                       _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    floatToHalfScalar(src + i, dst + i, n - i);
+  }
+#else
+  void halfToFloatF16C(const uint16_t *src, float *dst, size_t n)
+  {
+    halfToFloatScalar(src, dst, n);
+  }
+
+  void floatToHalfF16C(const float *src, uint16_t *dst, size_t n)
+  {
+    floatToHalfScalar(src, dst, n);
+  }
+#endif
+}
@@ -12,9 +12,10 @@ double complement(double v)
   return 255.0 - v;
 }
 
-void VectorFieldIllustrator::renderDenseVectorField(const CImg< double > &V,
-                                                    CImg< unsigned char > &I,
-                                                    int spacing)
+template < class T >
+static void renderDenseVectorField_(const CImg< T > &V,
+                                    CImg< unsigned char > &I,
+                                    int spacing)
 {
   const int W = V.dimx();
   const int H = V.dimy();
@@ -30,6 +31,20 @@ void VectorFieldIllustrator::renderDenseVectorField(const CImg< double > &V,
   I.draw_quiver(V.get_shared_channels(0, 1), colorMap, spacing, 1.0f);
 }
 
+void VectorFieldIllustrator::renderDenseVectorField(const CImg< double > &V,
+                                                    CImg< unsigned char > &I,
+                                                    int spacing)
+{
+  renderDenseVectorField_(V, I, spacing);
+}
+
+void VectorFieldIllustrator::renderDenseVectorField(const CImg< float > &V,
+                                                    CImg< unsigned char > &I,
+                                                    int spacing)
+{
+  renderDenseVectorField_(V, I, spacing);
+}
+
 #ifdef WITH_CGAL
 void VectorFieldIllustrator::renderSparseVectorField(const SparseVectorField &V,
                                                      CImg< unsigned char > &I)
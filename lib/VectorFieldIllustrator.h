@@ -31,6 +31,11 @@ public:
                                      CImg< unsigned char > &I,
                                      int spacing = 15);
   
+  /// Renders an arrow image from a single-precision dense vector field.
+  static void renderDenseVectorField(const CImg< float > &V,
+                                     CImg< unsigned char > &I,
+                                     int spacing = 15);
+  
 #ifdef WITH_CGAL
   /// Renders an arrow image from a sparse vector field.
   /**
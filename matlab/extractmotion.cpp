@@ -103,12 +103,12 @@ void mexFunction(
     CImg< double > V;
     if(algoName == "Proesmans")
     {
-      PyramidalProesmans me;
+      PyramidalProesmans< double > me;
       me.compute(I1, I2, V);
     }
     else if(algoName == "LucasKanade")
     {
-      PyramidalLucasKanade me;
+      PyramidalLucasKanade< double > me;
       me.compute(I1, I2, V);
     }
     
@@ -0,0 +1,198 @@
+/*
+ * This program checks that the pyramidal dense motion extractors 
+ * do not allocate memory once their buffers have been set up, 
+ * i.e. on repeated calls with same-sized images (see 
+ * ImageWorkspace and PyramidalDenseMotionExtractor). With the 
+ * argument --profiler, the extractors report to a profiler (see 
+ * Profiler), otherwise the compiled-in profiling instrumentation 
+ * of a WITH_PROFILING build is checked to be idle.
+ */
+
+#include "PyramidalLucasKanade.h"
+#include "PyramidalProesmans.h"
+#include "Profiler.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string.h>
+
+using namespace cimg_library;
+using namespace std;
+
+// the number of calls checked after the buffers have been set up 
+// by the first calls
+static const int NUM_WARMUP_CALLS = 2;
+static const int NUM_CHECKED_CALLS = 2;
+
+// the number of allocations while counting is enabled
+static volatile long numAllocations = 0;
+static volatile int countAllocations = 0;
+
+// the profiler that the extractors report to, or NULL
+static Profiler *profiler = NULL;
+
+static void *allocate(size_t size)
+{
+  if(countAllocations)
+    __sync_fetch_and_add(&numAllocations, 1);
+  
+  void *p = malloc(size > 0 ? size : 1);
+  if(p == NULL)
+    throw bad_alloc();
+  
+  return p;
+}
+
+void *operator new(size_t size)
+{
+  return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void *p) throw()
+{
+  free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+  free(p);
+}
+
+// Returns a frame of a synthetic sequence moving by (t, t/2).
+static CImg< unsigned char > createFrame(int t)
+{
+  CImg< unsigned char > I(96, 80);
+  
+  cimg_forXY(I, x, y)
+    I(x, y) = (unsigned char)(128 + 60 * sin((x - t) * 0.3) * cos((y - 0.5 * t) * 0.25) + 
+                              40 * sin((x + 2 * y - 1.5 * t) * 0.11));
+  
+  return I;
+}
+
+// Calls compute and pushFrame repeatedly with same-sized images and 
+// returns false if a call after the warm-up calls allocates memory.
+template < class T >
+static bool checkExtractor(const string &name,
+                           PyramidalDenseMotionExtractor< T > &e)
+{
+  const int numCalls = NUM_WARMUP_CALLS + NUM_CHECKED_CALLS;
+  CImg< T > VF, VB;
+  bool passed = true;
+  int i;
+  
+  e.setProfiler(profiler);
+  
+  const CImg< unsigned char > frames[2] = { createFrame(0), createFrame(2) };
+  for(i = 0; i < numCalls; i++)
+  {
+    numAllocations = 0;
+    countAllocations = i >= NUM_WARMUP_CALLS;
+    e.compute(frames[0], frames[1], VF, VB);
+    countAllocations = 0;
+    
+    if(numAllocations > 0)
+    {
+      std::cout<<"FAILED: "<<name<<": compute call "<<i + 1<<" made "
+               <<numAllocations<<" allocations"<<std::endl;
+      passed = false;
+    }
+  }
+  
+  // The first frame does not compute any motion, so it is not 
+  // counted as a warm-up call.
+  CImg< unsigned char > sequence[numCalls + 1];
+  for(i = 0; i <= numCalls; i++)
+    sequence[i] = createFrame(i);
+  
+  e.resetSequence();
+  e.pushFrame(sequence[0], VF, VB);
+  for(i = 0; i < numCalls; i++)
+  {
+    numAllocations = 0;
+    countAllocations = i >= NUM_WARMUP_CALLS;
+    e.pushFrame(sequence[i + 1], VF, VB);
+    countAllocations = 0;
+    
+    if(numAllocations > 0)
+    {
+      std::cout<<"FAILED: "<<name<<": pushFrame call "<<i + 1<<" made "
+               <<numAllocations<<" allocations"<<std::endl;
+      passed = false;
+    }
+  }
+  
+  if(passed)
+    std::cout<<"passed: "<<name<<std::endl;
+  
+  return passed;
+}
+
+template < class T >
+static bool checkProesmans(const string &typeName)
+{
+  const int numThreads[] = { 1, 2, 0 };
+  bool passed = true;
+  
+  for(int i = 0; i < 3; i++)
+  {
+    PyramidalProesmans< T > raster(20, 100.0, 3, Proesmans< T >::NEUMANN, numThreads[i], 
+                                   Proesmans< T >::RASTER_SWEEP);
+    PyramidalProesmans< T > multicolor(20, 100.0, 3, Proesmans< T >::NEUMANN, numThreads[i], 
+                                       Proesmans< T >::MULTICOLOR_SWEEP);
+    ostringstream rasterName, multicolorName;
+    
+    rasterName<<"PyramidalProesmans<"<<typeName<<">, raster, "<<numThreads[i]<<" threads";
+    passed = checkExtractor(rasterName.str(), raster) && passed;
+    multicolorName<<"PyramidalProesmans<"<<typeName<<">, multicolor, "<<numThreads[i]<<" threads";
+    passed = checkExtractor(multicolorName.str(), multicolor) && passed;
+  }
+  
+  PyramidalProesmans< T > tiled(20, 100.0, 3, Proesmans< T >::NEUMANN, 2, 
+                                Proesmans< T >::MULTICOLOR_SWEEP);
+  tiled.setTiling(32, 8);
+  passed = checkExtractor("PyramidalProesmans<" + typeName + ">, tiled, 2 threads", tiled) && passed;
+  
+  return passed;
+}
+
+template < class T >
+static bool checkLucasKanade(const string &typeName)
+{
+  bool passed = true;
+  
+  PyramidalLucasKanade< T > localWarp(4, 3, 0.0025, 0.0, 3, true, LucasKanade< T >::LOCAL_WARP);
+  passed = checkExtractor("PyramidalLucasKanade<" + typeName + ">, local warp", localWarp) && passed;
+  
+  PyramidalLucasKanade< T > denseWarp(4, 3, 0.0025, 0.0, 3, true, LucasKanade< T >::DENSE_WARP);
+  passed = checkExtractor("PyramidalLucasKanade<" + typeName + ">, dense warp", denseWarp) && passed;
+  
+  return passed;
+}
+
+int main(int argc, char **argv)
+{
+  Profiler p;
+  bool passed = true;
+  
+  if(argc > 1 && strcmp(argv[1], "--profiler") == 0)
+    profiler = &p;
+  
+  passed = checkProesmans< float >("float") && passed;
+  passed = checkProesmans< double >("double") && passed;
+  passed = checkLucasKanade< float >("float") && passed;
+  passed = checkLucasKanade< double >("double") && passed;
+  
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
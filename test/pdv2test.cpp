@@ -0,0 +1,187 @@
+/*
+ * This program checks that vector fields written in the PDV2 format
+ * are read back correctly, both whole and by region, with the
+ * different encoding options, and that files with a corrupted
+ * header are rejected (see CompressedDenseVectorFieldIO).
+ */
+
+#include "CompressedDenseVectorFieldIO.h"
+
+#include "CImg_config.h"
+#include <CImg.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <stdexcept>
+#include <string>
+
+using namespace cimg_library;
+using namespace std;
+
+static const char *FILE_NAME = "pdv2test.pdv2";
+
+// Returns a vector field with one quality channel.
+static CImg< double > createField()
+{
+  CImg< double > V(75, 53, 1, 3);
+
+  cimg_forXY(V, x, y)
+  {
+    V(x, y, 0, 0) = 3.0 * sin(x * 0.1) + 0.01 * y;
+    V(x, y, 0, 1) = -2.0 * cos(y * 0.07) + 0.02 * x;
+    V(x, y, 0, 2) = (x + y) % 7 / 7.0;
+  }
+
+  return V;
+}
+
+// Returns the largest difference between the given field and the
+// region of V whose upper-left corner is at (x0, y0).
+static double getMaxError(const CImg< double > &V, int x0, int y0,
+                          const CImg< double > &R)
+{
+  double maxError = 0.0;
+
+  cimg_forXYV(R, x, y, c)
+    maxError = max(maxError, fabs(R(x, y, 0, c) - V(x0 + x, y0 + y, 0, c)));
+
+  return maxError;
+}
+
+// Writes a field with the given options, reads it back whole and
+// by region and checks that the differences are at most the given
+// tolerance.
+static bool checkRoundTrip(const string &name,
+                           const CompressedDenseVectorFieldIO::Options &options,
+                           double tolerance)
+{
+  const CImg< double > V = createField();
+  CImg< double > R;
+  CImg< float > Rf;
+  bool passed = true;
+
+  try
+  {
+    CompressedDenseVectorFieldIO::writeVectorField(V, FILE_NAME, options);
+
+    CompressedDenseVectorFieldIO::readVectorField(FILE_NAME, R, 2);
+    if(R.dimx() != V.dimx() || R.dimy() != V.dimy() || R.dimv() != V.dimv() ||
+       getMaxError(V, 0, 0, R) > tolerance)
+    {
+      std::cout<<"FAILED: "<<name<<": full read"<<std::endl;
+      passed = false;
+    }
+
+    // The region crosses tile borders and ends at the field border.
+    CompressedDenseVectorFieldIO::readVectorFieldRegion(FILE_NAME, 13, 9, 62, 44, R);
+    if(R.dimx() != 62 || R.dimy() != 44 || R.dimv() != V.dimv() ||
+       getMaxError(V, 13, 9, R) > tolerance)
+    {
+      std::cout<<"FAILED: "<<name<<": region read"<<std::endl;
+      passed = false;
+    }
+
+    CompressedDenseVectorFieldIO::readVectorFieldRegion(FILE_NAME, 20, 30, 5, 4, Rf);
+    if(Rf.dimx() != 5 || Rf.dimy() != 4 ||
+       getMaxError(V, 20, 30, CImg< double >(Rf)) > tolerance + 1e-5)
+    {
+      std::cout<<"FAILED: "<<name<<": single-precision region read"<<std::endl;
+      passed = false;
+    }
+  }
+  catch(exception &e)
+  {
+    std::cout<<"FAILED: "<<name<<": "<<e.what()<<std::endl;
+    passed = false;
+  }
+
+  remove(FILE_NAME);
+
+  if(passed)
+    std::cout<<"passed: "<<name<<std::endl;
+
+  return passed;
+}
+
+// Overwrites the header fields width, height, numchannels, tilewidth
+// and tileheight of a valid file and checks that reading it throws
+// runtime_error.
+static bool checkCorruptedHeader(const string &name, const unsigned int values[5])
+{
+  CompressedDenseVectorFieldIO::Options options;
+  unsigned char bytes[20];
+  CImg< double > R;
+  bool passed = false;
+
+  options.tileSize = 16;
+  CompressedDenseVectorFieldIO::writeVectorField(createField(), FILE_NAME, options);
+
+  for(int i = 0; i < 20; i++)
+    bytes[i] = (unsigned char)(values[i / 4] >> (8 * (i % 4)));
+
+  fstream stream(FILE_NAME, ios::binary | ios::in | ios::out);
+  stream.seekp(8);
+  stream.write((const char *)bytes, 20);
+  stream.close();
+
+  try
+  {
+    CompressedDenseVectorFieldIO::readVectorField(FILE_NAME, R);
+  }
+  catch(runtime_error &)
+  {
+    passed = true;
+  }
+
+  remove(FILE_NAME);
+
+  if(passed)
+    std::cout<<"passed: "<<name<<std::endl;
+  else
+    std::cout<<"FAILED: "<<name<<": the file was accepted"<<std::endl;
+
+  return passed;
+}
+
+int main()
+{
+  CompressedDenseVectorFieldIO::Options options;
+  bool passed = true;
+
+  options.tileSize = 16;
+  passed = checkRoundTrip("PDV2, default encoding", options, 1e-5) && passed;
+
+  options.deltaCoding = false;
+  passed = checkRoundTrip("PDV2, no delta coding", options, 1e-5) && passed;
+
+  options.compressionLevel = 0;
+  passed = checkRoundTrip("PDV2, uncompressed", options, 1e-5) && passed;
+
+  options.compressionLevel = 6;
+  options.deltaCoding = true;
+  options.quantizationStep = 0.01;
+  passed = checkRoundTrip("PDV2, quantized, delta coding", options, 0.005 + 1e-5) && passed;
+
+  options.tileSize = 128;
+  options.quantizationStep = 0.0;
+  passed = checkRoundTrip("PDV2, single tile", options, 1e-5) && passed;
+
+  // width = height = 2^30 with 1 x 1 tiles overflows the tile count
+  // and the index size in int
+  const unsigned int hugeSize[5] = { 1u << 30, 1u << 30, 3, 1, 1 };
+  const unsigned int hugeChannels[5] = { 75, 53, 1u << 30, 16, 16 };
+  const unsigned int smallTiles[5] = { 75, 53, 3, 1, 1 };
+  const unsigned int zeroTiles[5] = { 75, 53, 3, 0, 16 };
+  // a single 2^32-pixel tile overflows the pixel indices in int
+  const unsigned int hugeTiles[5] = { 65536, 65536, 3, 65536, 65536 };
+
+  passed = checkCorruptedHeader("PDV2, corrupted size", hugeSize) && passed;
+  passed = checkCorruptedHeader("PDV2, corrupted channel count", hugeChannels) && passed;
+  passed = checkCorruptedHeader("PDV2, corrupted tile size", smallTiles) && passed;
+  passed = checkCorruptedHeader("PDV2, zero tile size", zeroTiles) && passed;
+  passed = checkCorruptedHeader("PDV2, corrupted huge tile size", hugeTiles) && passed;
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}